@@ -153,6 +153,14 @@ audio_driver_t audio_detect_best_driver(void) {
     return AUDIO_DRIVER_ALSA;
 }
 
+/**
+ * Check whether a driver is rendered by midisynthd itself
+ */
+bool audio_driver_is_internal(audio_driver_t driver) {
+    return driver == AUDIO_DRIVER_NULL || driver == AUDIO_DRIVER_FREEWHEEL ||
+           driver == AUDIO_DRIVER_OFFLINE;
+}
+
 /**
  * Configure FluidSynth settings for the specified audio driver
  */
@@ -220,7 +228,8 @@ static int configure_audio_settings(fluid_settings_t *settings, audio_driver_t d
             break;
             
         case AUDIO_DRIVER_ALSA:
-            /* ALSA-specific settings - use default device */
+            /* ALSA-specific settings - use default device; the synth's
+             * own settings select config->audio_device */
             if (fluid_settings_setstr(settings, "audio.alsa.device", "default") != FLUID_OK) {
                 syslog(LOG_WARNING, "Failed to set ALSA device to default");
             }
@@ -265,6 +274,14 @@ audio_t *audio_init(const midisynthd_config_t *config) {
         goto error;
     }
     
+    /* Internal drivers are started by the synthesizer, no device to open */
+    if (audio_driver_is_internal(audio->driver_type)) {
+        audio->initialized = true;
+        syslog(LOG_INFO, "Audio subsystem using internal %s driver",
+               audio_driver_names[audio->driver_type]);
+        return audio;
+    }
+    
     /* Configure audio settings */
     if (configure_audio_settings(audio->settings, audio->driver_type, config) < 0) {
         syslog(LOG_ERR, "Failed to configure audio settings");
@@ -341,7 +358,8 @@ const char *audio_get_driver_name(audio_t *audio) {
  * Check if audio subsystem is properly initialized
  */
 bool audio_is_initialized(audio_t *audio) {
-    return audio && audio->initialized && audio->driver && audio->settings;
+    return audio && audio->initialized && audio->settings &&
+           (audio->driver || audio_driver_is_internal(audio->driver_type));
 }
 
 /**
@@ -76,6 +76,18 @@ void audio_cleanup(audio_t *audio);
 audio_driver_t audio_detect_best_driver(void);
 
 
+/**
+ * Check whether a driver is rendered by midisynthd itself
+ *
+ * The null, freewheel and offline drivers have no FluidSynth counterpart;
+ * the synthesizer drives them from its own render thread, or the host
+ * pulls audio with synth_render() in the offline case.
+ *
+ * @param driver Driver type
+ * @return true for device-less internal drivers
+ */
+bool audio_driver_is_internal(audio_driver_t driver);
+
 /**
  * Retrieve the FluidSynth settings instance used by the audio system
  *
@@ -99,6 +111,8 @@ const char *audio_get_driver_name(audio_t *audio);
 
 /**
  * Determine whether the audio subsystem has been initialized
+ *
+ * Internal drivers count as initialized without a FluidSynth driver.
  */
 bool audio_is_initialized(audio_t *audio);
 
@@ -0,0 +1,276 @@
+/*
+ * midisynthd - System-level MIDI Synthesizer Daemon for Linux
+ * Copyright (C) 2025 ArchLars
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include "audio_null.h"
+#include "memstat.h"
+#include "threads.h"
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <syslog.h>
+#include <sys/timerfd.h>
+
+#define NULL_AUDIO_CHANNELS      2
+#define NULL_AUDIO_RT_PRIORITY   60
+#define WAV_HEADER_SIZE          44
+
+struct audio_null_s {
+    pthread_t thread;
+    bool thread_started;
+    volatile int running;
+    bool freewheel;
+
+    fluid_audio_func_t render;
+    void *data;
+
+    int sample_rate;
+    int period;
+    float *left;
+    float *right;
+    float *interleaved;
+
+    int timer_fd;
+    FILE *file;
+    uint64_t data_bytes;
+
+    volatile uint64_t frames;
+    volatile uint64_t missed;
+};
+
+/**
+ * Bytes held by the period buffers
+ */
+static size_t null_buffer_bytes(const audio_null_t *audio) {
+    return (size_t)audio->period * (2 + NULL_AUDIO_CHANNELS) * sizeof(float);
+}
+
+/**
+ * Store little-endian integers into a header buffer
+ */
+static void put_le16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t)(v & 0xFF);
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void put_le32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)(v & 0xFF);
+    p[1] = (uint8_t)((v >> 8) & 0xFF);
+    p[2] = (uint8_t)((v >> 16) & 0xFF);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+/**
+ * Write a WAVE_FORMAT_IEEE_FLOAT header for the given data size
+ */
+static int write_wav_header(FILE *f, int sample_rate, uint64_t data_bytes) {
+    uint8_t h[WAV_HEADER_SIZE];
+    uint32_t size = data_bytes > 0xFFFFFFFFULL - 36 ? 0xFFFFFFFFU - 36 : (uint32_t)data_bytes;
+    uint16_t block_align = NULL_AUDIO_CHANNELS * sizeof(float);
+
+    memcpy(h, "RIFF", 4);
+    put_le32(h + 4, 36 + size);
+    memcpy(h + 8, "WAVEfmt ", 8);
+    put_le32(h + 16, 16);
+    put_le16(h + 20, 3); /* IEEE float */
+    put_le16(h + 22, NULL_AUDIO_CHANNELS);
+    put_le32(h + 24, (uint32_t)sample_rate);
+    put_le32(h + 28, (uint32_t)sample_rate * block_align);
+    put_le16(h + 32, block_align);
+    put_le16(h + 34, 32);
+    memcpy(h + 36, "data", 4);
+    put_le32(h + 40, size);
+
+    if (fseek(f, 0, SEEK_SET) != 0) return -1;
+    return fwrite(h, sizeof(h), 1, f) == 1 ? 0 : -1;
+}
+
+/**
+ * Render thread: one callback per period, paced by the timer or freewheeling
+ */
+static void *null_audio_thread(void *arg) {
+    audio_null_t *audio = (audio_null_t *)arg;
+    float *out[NULL_AUDIO_CHANNELS] = { audio->left, audio->right };
+    threads_register("msd-audio", true);
+
+    while (audio->running) {
+        if (!audio->freewheel) {
+            uint64_t expirations = 0;
+            ssize_t n = read(audio->timer_fd, &expirations, sizeof(expirations));
+            if (n != (ssize_t)sizeof(expirations)) {
+                if (n < 0 && errno == EINTR) continue;
+                syslog(LOG_ERR, "Null audio: timer read failed: %s", strerror(errno));
+                break;
+            }
+            if (expirations > 1) {
+                audio->missed += expirations - 1;
+            }
+        }
+
+        memset(audio->left, 0, (size_t)audio->period * sizeof(float));
+        memset(audio->right, 0, (size_t)audio->period * sizeof(float));
+        /* Effects go to the output too; with no effect buffers FluidSynth drops them */
+        audio->render(audio->data, audio->period, NULL_AUDIO_CHANNELS, out, NULL_AUDIO_CHANNELS, out);
+        audio->frames += (uint64_t)audio->period;
+
+        if (audio->file) {
+            uint64_t span = trace_begin();
+            for (int i = 0; i < audio->period; i++) {
+                audio->interleaved[2 * i] = audio->left[i];
+                audio->interleaved[2 * i + 1] = audio->right[i];
+            }
+            size_t bytes = (size_t)audio->period * NULL_AUDIO_CHANNELS * sizeof(float);
+            if (fwrite(audio->interleaved, bytes, 1, audio->file) == 1) {
+                audio->data_bytes += bytes;
+            }
+            trace_end(span, "file-write", (int64_t)bytes);
+        }
+    }
+
+    threads_unregister();
+    return NULL;
+}
+
+audio_null_t *audio_null_start(const midisynthd_config_t *config, bool freewheel,
+                               fluid_audio_func_t render, void *data) {
+    if (!config || !render || config->buffer_size <= 0 || config->sample_rate <= 0) {
+        syslog(LOG_ERR, "Invalid parameters for null audio backend");
+        return NULL;
+    }
+
+    audio_null_t *audio = calloc(1, sizeof(*audio));
+    if (!audio) {
+        syslog(LOG_ERR, "Failed to allocate null audio backend");
+        return NULL;
+    }
+
+    audio->freewheel = freewheel;
+    audio->render = render;
+    audio->data = data;
+    audio->sample_rate = config->sample_rate;
+    audio->period = config->buffer_size;
+    audio->timer_fd = -1;
+
+    audio->left = calloc((size_t)audio->period, sizeof(float));
+    audio->right = calloc((size_t)audio->period, sizeof(float));
+    audio->interleaved = calloc((size_t)audio->period * NULL_AUDIO_CHANNELS, sizeof(float));
+    memstat_add(MEMSTAT_BUFFERS, null_buffer_bytes(audio));
+    if (!audio->left || !audio->right || !audio->interleaved) {
+        syslog(LOG_ERR, "Failed to allocate null audio buffers");
+        goto error;
+    }
+
+    if (config->audio_file[0] != '\0') {
+        audio->file = fopen(config->audio_file, "wb");
+        if (!audio->file || write_wav_header(audio->file, audio->sample_rate, 0) < 0) {
+            syslog(LOG_ERR, "Cannot write audio file %s: %s", config->audio_file, strerror(errno));
+            goto error;
+        }
+    }
+
+    if (!freewheel) {
+        audio->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+        if (audio->timer_fd < 0) {
+            syslog(LOG_ERR, "Failed to create audio clock: %s", strerror(errno));
+            goto error;
+        }
+
+        uint64_t period_ns = (uint64_t)audio->period * 1000000000ULL / (uint64_t)audio->sample_rate;
+        struct itimerspec its;
+        its.it_interval.tv_sec = (time_t)(period_ns / 1000000000ULL);
+        its.it_interval.tv_nsec = (long)(period_ns % 1000000000ULL);
+        its.it_value = its.it_interval;
+        if (timerfd_settime(audio->timer_fd, 0, &its, NULL) < 0) {
+            syslog(LOG_ERR, "Failed to start audio clock: %s", strerror(errno));
+            goto error;
+        }
+    }
+
+    audio->running = 1;
+    if (pthread_create(&audio->thread, NULL, null_audio_thread, audio) != 0) {
+        syslog(LOG_ERR, "Failed to start null audio thread");
+        goto error;
+    }
+    audio->thread_started = true;
+
+    /* Writing the file blocks on the filesystem, which must not happen
+     * under SCHED_FIFO; without a file nothing blocks in the loop */
+    if (config->realtime_priority && !freewheel && !audio->file) {
+        struct sched_param param;
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = NULL_AUDIO_RT_PRIORITY;
+        if (pthread_setschedparam(audio->thread, SCHED_FIFO, &param) != 0) {
+            syslog(LOG_DEBUG, "Null audio: real-time priority unavailable");
+        }
+    }
+
+    syslog(LOG_INFO, "%s audio backend started: %d Hz, %d-frame periods, output %s",
+           freewheel ? "Freewheel" : "Null", audio->sample_rate, audio->period,
+           audio->file ? config->audio_file : "discarded");
+    return audio;
+
+error:
+    audio_null_stop(audio);
+    return NULL;
+}
+
+void audio_null_stop(audio_null_t *audio) {
+    if (!audio) {
+        return;
+    }
+
+    audio->running = 0;
+    if (audio->thread_started) {
+        pthread_join(audio->thread, NULL);
+        audio->thread_started = false;
+    }
+
+    if (audio->timer_fd >= 0) {
+        close(audio->timer_fd);
+        audio->timer_fd = -1;
+    }
+
+    if (audio->file) {
+        if (write_wav_header(audio->file, audio->sample_rate, audio->data_bytes) < 0) {
+            syslog(LOG_WARNING, "Failed to finalize audio file header");
+        }
+        fclose(audio->file);
+        audio->file = NULL;
+    }
+
+    free(audio->left);
+    free(audio->right);
+    free(audio->interleaved);
+    memstat_sub(MEMSTAT_BUFFERS, null_buffer_bytes(audio));
+    free(audio);
+}
+
+uint64_t audio_null_get_frames(audio_null_t *audio) {
+    return audio ? audio->frames : 0;
+}
+
+uint64_t audio_null_get_missed(audio_null_t *audio) {
+    return audio ? audio->missed : 0;
+}
@@ -0,0 +1,77 @@
+/*
+ * midisynthd - System-level MIDI Synthesizer Daemon for Linux
+ * Copyright (C) 2025 ArchLars
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef MIDISYNTHD_AUDIO_NULL_H
+#define MIDISYNTHD_AUDIO_NULL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <fluidsynth.h>
+#include "config.h"
+
+typedef struct audio_null_s audio_null_t;
+
+/**
+ * Start a device-less audio backend
+ *
+ * Spawns a render thread that calls @p render once per period of
+ * config->buffer_size frames. In clocked mode periods are paced by a
+ * timerfd at the configured sample rate; in freewheel mode they are
+ * rendered back to back as fast as the CPU allows. Output is discarded,
+ * or written as a 32-bit float stereo WAV file when config->audio_file
+ * is set.
+ *
+ * @param config Configuration with sample rate, period size and output file
+ * @param freewheel Render as fast as possible instead of in real time
+ * @param render Render callback (same contract as a FluidSynth driver callback)
+ * @param data User data passed to @p render
+ * @return Backend instance, or NULL on failure
+ */
+audio_null_t *audio_null_start(const midisynthd_config_t *config, bool freewheel,
+                               fluid_audio_func_t render, void *data);
+
+/**
+ * Stop the render thread, finalize the output file and free the backend
+ *
+ * Safe to call with NULL pointer.
+ *
+ * @param audio Backend instance
+ */
+void audio_null_stop(audio_null_t *audio);
+
+/**
+ * Get the number of frames rendered so far
+ *
+ * @param audio Backend instance
+ * @return Frames rendered since start
+ */
+uint64_t audio_null_get_frames(audio_null_t *audio);
+
+/**
+ * Get the number of clock ticks missed because rendering fell behind
+ *
+ * Always 0 in freewheel mode.
+ *
+ * @param audio Backend instance
+ * @return Missed periods since start
+ */
+uint64_t audio_null_get_missed(audio_null_t *audio);
+
+#endif /* MIDISYNTHD_AUDIO_NULL_H */
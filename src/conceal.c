@@ -0,0 +1,147 @@
+/*
+ * midisynthd - System-level MIDI Synthesizer Daemon for Linux
+ * Copyright (C) 2025 ArchLars
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include "conceal.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+
+struct conceal_s {
+    float history[CONCEAL_CHANNELS][CONCEAL_HISTORY];
+    uint64_t written;           /* Frames recorded; the ring position is modulo */
+    float last[CONCEAL_CHANNELS];   /* Last sample output on each channel */
+
+    /* Current run of concealed audio */
+    bool concealing;
+    bool fading;                /* The period before was concealed as well */
+    int span;                   /* Frames repeated */
+    int repeat;                 /* Position in the repeated frames */
+    float gain;
+    float decay;                /* Gain factor per frame, half per span */
+    float step[CONCEAL_CHANNELS];   /* Offset from the repeat to the last sample */
+    int step_left;
+};
+
+static float *channel(float *out[], int nout, int c) {
+    return c < nout ? out[c] : NULL;
+}
+
+conceal_t *conceal_create(void) {
+    conceal_t *conceal = calloc(1, sizeof(conceal_t));
+    if (conceal) {
+        conceal->gain = 1.0f;
+    }
+    return conceal;
+}
+
+void conceal_destroy(conceal_t *conceal) {
+    free(conceal);
+}
+
+bool conceal_resume(conceal_t *conceal, float *out[], int nout, int frames, bool after_gap) {
+    if (!conceal || frames <= 0) {
+        return false;
+    }
+
+    bool changed = after_gap || conceal->concealing;
+    int n = frames < CONCEAL_XFADE ? frames : CONCEAL_XFADE;
+    for (int c = 0; changed && c < CONCEAL_CHANNELS; c++) {
+        float *buf = channel(out, nout, c);
+        if (!buf) continue;
+        if (after_gap) {
+            /* The device played silence, so come back from zero */
+            for (int i = 0; i < n; i++) {
+                buf[i] *= (float)i / CONCEAL_XFADE;
+            }
+        } else {
+            float step = conceal->last[c] - buf[0];
+            for (int i = 0; i < n; i++) {
+                buf[i] += step * (1.0f - (float)i / CONCEAL_XFADE);
+            }
+        }
+    }
+
+    /* Gain carries over so back-to-back late periods keep fading */
+    conceal->fading = conceal->concealing;
+    conceal->concealing = false;
+    return changed;
+}
+
+void conceal_record(conceal_t *conceal, float *out[], int nout, int frames) {
+    if (!conceal || frames <= 0) {
+        return;
+    }
+
+    for (int c = 0; c < CONCEAL_CHANNELS; c++) {
+        float *buf = channel(out, nout, c);
+        float *hist = conceal->history[c];
+        for (int i = 0; i < frames; i++) {
+            hist[(conceal->written + (uint64_t)i) % CONCEAL_HISTORY] = buf ? buf[i] : 0.0f;
+        }
+        conceal->last[c] = buf ? buf[frames - 1] : 0.0f;
+    }
+    conceal->written += (uint64_t)frames;
+}
+
+void conceal_fill(conceal_t *conceal, float *out[], int nout, int start, int len) {
+    if (!conceal || start >= len) {
+        return;
+    }
+
+    if (!conceal->concealing) {
+        int span = len < CONCEAL_HISTORY ? len : CONCEAL_HISTORY;
+        if ((uint64_t)span > conceal->written) {
+            span = (int)conceal->written;
+        }
+        conceal->span = span;
+        conceal->repeat = 0;
+        if (!conceal->fading) {
+            conceal->gain = 1.0f;
+        }
+        conceal->decay = span > 0 ? powf(0.5f, 1.0f / (float)span) : 0.0f;
+        for (int c = 0; c < CONCEAL_CHANNELS; c++) {
+            float first = span > 0 ?
+                conceal->history[c][(conceal->written - (uint64_t)span) % CONCEAL_HISTORY] : 0.0f;
+            conceal->step[c] = conceal->last[c] - first;
+        }
+        conceal->step_left = CONCEAL_XFADE;
+        conceal->concealing = true;
+    }
+
+    uint64_t base = conceal->written - (uint64_t)conceal->span;
+    for (int i = start; i < len; i++) {
+        float ramp = conceal->step_left > 0 ? (float)conceal->step_left / CONCEAL_XFADE : 0.0f;
+        for (int c = 0; c < CONCEAL_CHANNELS; c++) {
+            float *buf = channel(out, nout, c);
+            if (!buf) continue;
+            float v = conceal->span > 0 ?
+                conceal->history[c][(base + (uint64_t)conceal->repeat) % CONCEAL_HISTORY] : 0.0f;
+            buf[i] = conceal->gain * v + conceal->step[c] * ramp;
+        }
+        if (conceal->step_left > 0) conceal->step_left--;
+        if (conceal->span > 0) conceal->repeat = (conceal->repeat + 1) % conceal->span;
+        conceal->gain *= conceal->decay;
+    }
+
+    for (int c = 0; c < CONCEAL_CHANNELS; c++) {
+        float *buf = channel(out, nout, c);
+        conceal->last[c] = buf ? buf[len - 1] : 0.0f;
+    }
+}
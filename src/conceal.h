@@ -0,0 +1,96 @@
+/*
+ * midisynthd - System-level MIDI Synthesizer Daemon for Linux
+ * Copyright (C) 2025 ArchLars
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef MIDISYNTHD_CONCEAL_H
+#define MIDISYNTHD_CONCEAL_H
+
+#include <stdbool.h>
+
+/* Output channels kept for concealment; any further channels stay silent */
+#define CONCEAL_CHANNELS        2
+/* Frames of past output kept to repeat from */
+#define CONCEAL_HISTORY         4096
+/* Frames a step between concealed and rendered audio is smoothed over */
+#define CONCEAL_XFADE           64
+
+typedef struct conceal_s conceal_t;
+
+/**
+ * Create a concealment stage
+ *
+ * The stage only works on the buffers handed to it and is meant to be
+ * used from the audio thread alone.
+ *
+ * @return Stage, or NULL when out of memory
+ */
+conceal_t *conceal_create(void);
+
+/**
+ * Free a concealment stage
+ *
+ * Safe to call with NULL pointer.
+ *
+ * @param conceal Stage
+ */
+void conceal_destroy(conceal_t *conceal);
+
+/**
+ * Blend freshly rendered audio in after concealment or a device xrun
+ *
+ * After concealed audio the step to the rendered audio is ramped out
+ * over CONCEAL_XFADE frames. After a gap in which the device played
+ * silence (@p after_gap) the rendered audio fades in from zero instead.
+ * Call on every period before conceal_record().
+ *
+ * @param conceal Stage
+ * @param out Output buffers
+ * @param nout Number of output buffers
+ * @param frames Frames rendered at the start of the period
+ * @param after_gap The device ran dry before this period
+ * @return true when the audio was changed
+ */
+bool conceal_resume(conceal_t *conceal, float *out[], int nout, int frames, bool after_gap);
+
+/**
+ * Keep rendered audio as the source of later concealment
+ *
+ * @param conceal Stage
+ * @param out Output buffers
+ * @param nout Number of output buffers
+ * @param frames Frames rendered at the start of the period
+ */
+void conceal_record(conceal_t *conceal, float *out[], int nout, int frames);
+
+/**
+ * Fill the part of a period that was not rendered in time
+ *
+ * Repeats the latest period of recorded audio, starting from the last
+ * sample played without a step and fading by half per repeated period,
+ * so a run of late periods dies away instead of looping.
+ *
+ * @param conceal Stage
+ * @param out Output buffers
+ * @param nout Number of output buffers
+ * @param start First frame to fill
+ * @param len Period length in frames
+ */
+void conceal_fill(conceal_t *conceal, float *out[], int nout, int start, int len);
+
+#endif /* MIDISYNTHD_CONCEAL_H */
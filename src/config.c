@@ -19,6 +19,7 @@
  */
 
 #include "config.h"
+#include "midi_router.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -39,14 +40,19 @@ const char *audio_driver_names[AUDIO_DRIVER_COUNT] = {
     "jack",
     "pipewire", 
     "pulseaudio",
-    "alsa"
+    "alsa",
+    "null",
+    "freewheel",
+    "offline"
 };
 
 /* MIDI driver names array */
 const char *midi_driver_names[MIDI_DRIVER_COUNT] = {
     "alsa_seq",
     "alsa_raw",
-    "jack"
+    "jack",
+    "pipe",
+    "pipewire"
 };
 
 /**
@@ -95,6 +101,9 @@ static audio_driver_t parse_audio_driver(const char *str) {
     if (strcasecmp(str, "pipewire") == 0) return AUDIO_DRIVER_PIPEWIRE;
     if (strcasecmp(str, "pulseaudio") == 0 || strcasecmp(str, "pulse") == 0) return AUDIO_DRIVER_PULSEAUDIO;
     if (strcasecmp(str, "alsa") == 0) return AUDIO_DRIVER_ALSA;
+    if (strcasecmp(str, "null") == 0) return AUDIO_DRIVER_NULL;
+    if (strcasecmp(str, "freewheel") == 0) return AUDIO_DRIVER_FREEWHEEL;
+    if (strcasecmp(str, "offline") == 0) return AUDIO_DRIVER_OFFLINE;
     
     return AUDIO_DRIVER_AUTO; /* Default */
 }
@@ -113,6 +122,18 @@ static bool parse_bool(const char *str) {
     return false;
 }
 
+/**
+ * Parse an input latency class
+ * @return true for playback, false for live
+ */
+static bool parse_latency_class(const char *key, const char *str) {
+    if (strcasecmp(str, "playback") == 0) return true;
+    if (strcasecmp(str, "live") != 0) {
+        syslog(LOG_WARNING, "Unknown latency class '%s' for %s, using live", str, key);
+    }
+    return false;
+}
+
 /**
  * Parse float value from string with bounds checking
  */
@@ -171,6 +192,18 @@ void config_init_defaults(midisynthd_config_t *config) {
     
     /* Synthesis settings */
     config->polyphony = CONFIG_DEFAULT_POLYPHONY;
+    config->shed_threshold = CONFIG_DEFAULT_SHED_THRESHOLD;
+    config->xrun_concealment = true;
+    config->sample_cache = 0;
+    config->sample_cache_floor = CONFIG_DEFAULT_SAMPLE_CACHE_FLOOR;
+    config->percussion_cache = 0;
+    config->level_meters = false;
+    config->lazy_start = false;
+    config->idle_timeout = CONFIG_DEFAULT_IDLE_TIMEOUT;
+    config->midi_playback = false;
+    config->osc_playback = false;
+    config->rtpmidi_playback = false;
+    config->playback_block = CONFIG_DEFAULT_PLAYBACK_BLOCK;
     config->chorus_enabled = true;
     config->chorus_level = CONFIG_DEFAULT_CHORUS_LEVEL;
     config->reverb_enabled = true;
@@ -202,6 +235,8 @@ void config_init_defaults(midisynthd_config_t *config) {
     config->realtime_priority = true;
     config->user[0] = '\0';
     config->group[0] = '\0';
+    config->daemonize = false;
+    config->trace_file[0] = '\0';
 }
 
 /**
@@ -244,6 +279,16 @@ static void parse_config_line(midisynthd_config_t *config, const char *line) {
     else if (strcasecmp(trimmed_key, "midi_driver") == 0) {
         config->midi_driver = config_parse_midi_driver(trimmed_value);
     }
+    else if (strcasecmp(trimmed_key, "midi_input") == 0) {
+        strncpy(config->midi_input, trimmed_value, CONFIG_MAX_PATH_LEN - 1);
+        config->midi_input[CONFIG_MAX_PATH_LEN - 1] = '\0';
+    }
+    else if (strcasecmp(trimmed_key, "osc_port") == 0) {
+        config->osc_port = parse_int(trimmed_value, 0, 65535, 0);
+    }
+    else if (strcasecmp(trimmed_key, "rtpmidi_port") == 0) {
+        config->rtpmidi_port = parse_int(trimmed_value, 0, 65534, 0);
+    }
     else if (strcasecmp(trimmed_key, "sample_rate") == 0) {
         config->sample_rate = parse_int(trimmed_value, 8000, 192000, CONFIG_DEFAULT_SAMPLE_RATE);
     }
@@ -253,6 +298,14 @@ static void parse_config_line(midisynthd_config_t *config, const char *line) {
     else if (strcasecmp(trimmed_key, "audio_periods") == 0) {
         config->audio_periods = parse_int(trimmed_value, 2, 8, CONFIG_DEFAULT_AUDIO_PERIODS);
     }
+    else if (strcasecmp(trimmed_key, "audio_file") == 0) {
+        strncpy(config->audio_file, trimmed_value, CONFIG_MAX_PATH_LEN - 1);
+        config->audio_file[CONFIG_MAX_PATH_LEN - 1] = '\0';
+    }
+    else if (strcasecmp(trimmed_key, "audio_device") == 0) {
+        strncpy(config->audio_device, trimmed_value, CONFIG_MAX_STRING_LEN - 1);
+        config->audio_device[CONFIG_MAX_STRING_LEN - 1] = '\0';
+    }
     else if (strcasecmp(trimmed_key, "gain") == 0) {
         config->gain = parse_float(trimmed_value, 0.0f, 2.0f, CONFIG_DEFAULT_GAIN);
     }
@@ -266,6 +319,42 @@ static void parse_config_line(midisynthd_config_t *config, const char *line) {
     else if (strcasecmp(trimmed_key, "polyphony") == 0) {
         config->polyphony = parse_int(trimmed_value, 16, 4096, CONFIG_DEFAULT_POLYPHONY);
     }
+    else if (strcasecmp(trimmed_key, "shed_threshold") == 0) {
+        config->shed_threshold = parse_int(trimmed_value, 0, 100, CONFIG_DEFAULT_SHED_THRESHOLD);
+    }
+    else if (strcasecmp(trimmed_key, "xrun_concealment") == 0) {
+        config->xrun_concealment = parse_bool(trimmed_value);
+    }
+    else if (strcasecmp(trimmed_key, "sample_cache") == 0) {
+        config->sample_cache = parse_int(trimmed_value, 0, 256, 0);
+    }
+    else if (strcasecmp(trimmed_key, "sample_cache_floor") == 0) {
+        config->sample_cache_floor = parse_int(trimmed_value, 0, 256, CONFIG_DEFAULT_SAMPLE_CACHE_FLOOR);
+    }
+    else if (strcasecmp(trimmed_key, "percussion_cache") == 0) {
+        config->percussion_cache = parse_int(trimmed_value, 0, 256, 0);
+    }
+    else if (strcasecmp(trimmed_key, "level_meters") == 0) {
+        config->level_meters = parse_bool(trimmed_value);
+    }
+    else if (strcasecmp(trimmed_key, "midi_latency") == 0) {
+        config->midi_playback = parse_latency_class(trimmed_key, trimmed_value);
+    }
+    else if (strcasecmp(trimmed_key, "osc_latency") == 0) {
+        config->osc_playback = parse_latency_class(trimmed_key, trimmed_value);
+    }
+    else if (strcasecmp(trimmed_key, "rtpmidi_latency") == 0) {
+        config->rtpmidi_playback = parse_latency_class(trimmed_key, trimmed_value);
+    }
+    else if (strcasecmp(trimmed_key, "playback_block") == 0) {
+        config->playback_block = parse_int(trimmed_value, 256, 8192, CONFIG_DEFAULT_PLAYBACK_BLOCK);
+    }
+    else if (strcasecmp(trimmed_key, "lazy_start") == 0) {
+        config->lazy_start = parse_bool(trimmed_value);
+    }
+    else if (strcasecmp(trimmed_key, "idle_timeout") == 0) {
+        config->idle_timeout = parse_int(trimmed_value, 0, 86400, CONFIG_DEFAULT_IDLE_TIMEOUT);
+    }
     else if (strcasecmp(trimmed_key, "chorus_enabled") == 0) {
         config->chorus_enabled = parse_bool(trimmed_value);
     }
@@ -284,9 +373,27 @@ static void parse_config_line(midisynthd_config_t *config, const char *line) {
                    trimmed_value, CONFIG_MAX_PATH_LEN - 1);
             config->soundfonts[config->soundfont_count].path[CONFIG_MAX_PATH_LEN - 1] = '\0';
             config->soundfonts[config->soundfont_count].enabled = true;
+            config->soundfonts[config->soundfont_count].drop_sm24 = false;
             config->soundfont_count++;
         }
     }
+    else if (strcasecmp(trimmed_key, "soundfont_24bit") == 0) {
+        /* Applies to the soundfont on the preceding soundfont= line */
+        if (config->soundfont_count > 0) {
+            config->soundfonts[config->soundfont_count - 1].drop_sm24 = !parse_bool(trimmed_value);
+        } else {
+            syslog(LOG_WARNING, "soundfont_24bit before any soundfont line, ignored");
+        }
+    }
+    else if (strcasecmp(trimmed_key, "route") == 0) {
+        if (config->route_count < CONFIG_MAX_ROUTES) {
+            strncpy(config->routes[config->route_count], trimmed_value, CONFIG_MAX_STRING_LEN - 1);
+            config->routes[config->route_count][CONFIG_MAX_STRING_LEN - 1] = '\0';
+            config->route_count++;
+        } else {
+            syslog(LOG_WARNING, "Too many route rules, ignoring: %s", trimmed_value);
+        }
+    }
     else if (strcasecmp(trimmed_key, "realtime_priority") == 0) {
         config->realtime_priority = parse_bool(trimmed_value);
     }
@@ -298,6 +405,10 @@ static void parse_config_line(midisynthd_config_t *config, const char *line) {
         strncpy(config->group, trimmed_value, CONFIG_MAX_STRING_LEN - 1);
         config->group[CONFIG_MAX_STRING_LEN - 1] = '\0';
     }
+    else if (strcasecmp(trimmed_key, "trace_file") == 0) {
+        strncpy(config->trace_file, trimmed_value, CONFIG_MAX_PATH_LEN - 1);
+        config->trace_file[CONFIG_MAX_PATH_LEN - 1] = '\0';
+    }
 }
 
 /**
@@ -443,6 +554,38 @@ int config_validate(midisynthd_config_t *config) {
         fixes++;
     }
     
+    /* The playback block is a whole number of FluidSynth's 64-frame blocks
+     * and at least one live period */
+    if (config->playback_block % 64 != 0 || config->playback_block < config->buffer_size) {
+        int block = (config->playback_block + 63) / 64 * 64;
+        if (block < config->buffer_size) block = (config->buffer_size + 63) / 64 * 64;
+        syslog(LOG_WARNING, "Invalid playback block %d, using %d", config->playback_block, block);
+        config->playback_block = block;
+        fixes++;
+    }
+    
+    /* The playback engine renders ahead of the live one, which lazy start
+     * does not bring up */
+    if (config->lazy_start && config_has_playback_inputs(config)) {
+        syslog(LOG_WARNING, "Playback latency class does not work with lazy start, inputs run live");
+        config->midi_playback = config->osc_playback = config->rtpmidi_playback = false;
+        fixes++;
+    }
+    
+    /* The sample cache holds presets on a loaded engine, which lazy start unloads */
+    if (config->lazy_start && config->sample_cache > 0) {
+        syslog(LOG_WARNING, "Sample cache does not work with lazy start, disabling it");
+        config->sample_cache = 0;
+        fixes++;
+    }
+    
+    /* Its render engine would load the soundfonts that lazy start holds back */
+    if (config->lazy_start && config->percussion_cache > 0) {
+        syslog(LOG_WARNING, "Percussion cache does not work with lazy start, disabling it");
+        config->percussion_cache = 0;
+        fixes++;
+    }
+    
     /* Validate chorus level */
     if (config->chorus_level < 0.0f || config->chorus_level > 10.0f) {
         syslog(LOG_WARNING, "Invalid chorus level %.2f, using default %.2f", 
@@ -459,6 +602,26 @@ int config_validate(midisynthd_config_t *config) {
         fixes++;
     }
     
+    /* Drop route rules the MIDI router would ignore */
+    for (int i = 0; i < config->route_count; ) {
+        if (midi_router_check_rule(config->routes[i]) == 0) {
+            i++;
+            continue;
+        }
+        syslog(LOG_WARNING, "Invalid route rule, ignoring: %s", config->routes[i]);
+        memmove(config->routes[i], config->routes[i + 1],
+                (size_t)(config->route_count - i - 1) * sizeof(config->routes[0]));
+        config->route_count--;
+        fixes++;
+    }
+    
+    /* A daemon has its stdin on /dev/null, so the pipe driver needs a FIFO */
+    if (config->daemonize && config->midi_driver == MIDI_DRIVER_PIPE &&
+        (config->midi_input[0] == '\0' || strcmp(config->midi_input, "-") == 0)) {
+        syslog(LOG_ERR, "Pipe MIDI from stdin does not work with --daemonize, set midi_input to a FIFO");
+        return -1;
+    }
+    
     /* Validate client name */
     if (strlen(config->client_name) == 0) {
         syslog(LOG_WARNING, "Empty client name, using default");
@@ -510,15 +673,56 @@ void config_print(const midisynthd_config_t *config) {
     printf("  Sample Rate:        %d Hz\n", config->sample_rate);
     printf("  Buffer Size:        %d samples\n", config->buffer_size);
     printf("  Audio Periods:      %d\n", config->audio_periods);
+    if (strlen(config->audio_device) > 0) {
+        printf("  Device:             %s\n", config->audio_device);
+    }
+    if (strlen(config->audio_file) > 0) {
+        printf("  Output File:        %s\n", config->audio_file);
+    }
     printf("  Gain:               %.2f\n", config->gain);
     
     printf("\nMIDI:\n");
     printf("  Driver:             %s\n", config_midi_driver_to_string(config->midi_driver));
+    if (config->midi_driver == MIDI_DRIVER_PIPE) {
+        printf("  Input:              %s\n", config->midi_input[0] ? config->midi_input : "stdin");
+    }
     printf("  Client Name:        %s\n", config->client_name);
     printf("  Auto-connect:       %s\n", config->midi_autoconnect ? "yes" : "no");
+    printf("  Latency:            %s\n", config->midi_playback ? "playback" : "live");
+    if (config->osc_port > 0) {
+        printf("  OSC Port:           %d (127.0.0.1, %s)\n", config->osc_port,
+               config->osc_playback ? "playback" : "live");
+    }
+    if (config->rtpmidi_port > 0) {
+        printf("  RTP-MIDI Ports:     %d-%d (%s)\n", config->rtpmidi_port, config->rtpmidi_port + 1,
+               config->rtpmidi_playback ? "playback" : "live");
+    }
+    if (config_has_playback_inputs(config)) {
+        printf("  Playback Block:     %d samples\n", config->playback_block);
+    }
     
     printf("\nSynthesis:\n");
     printf("  Polyphony:          %d voices\n", config->polyphony);
+    if (config->shed_threshold > 0) {
+        printf("  Voice Shedding:     above %d%% predicted load\n", config->shed_threshold);
+    } else {
+        printf("  Voice Shedding:     off\n");
+    }
+    printf("  Xrun Concealment:   %s\n", config->xrun_concealment ? "yes" : "no");
+    if (config->sample_cache > 0) {
+        printf("  Sample Cache:       %d presets (floor %d)\n", config->sample_cache, config->sample_cache_floor);
+    }
+    if (config->percussion_cache > 0) {
+        printf("  Percussion Cache:   %d MiB\n", config->percussion_cache);
+    }
+    printf("  Level Meters:       %s\n", config->level_meters ? "yes" : "no");
+    if (config->lazy_start) {
+        if (config->idle_timeout > 0) {
+            printf("  Lazy Start:         enabled (unload after %d s idle)\n", config->idle_timeout);
+        } else {
+            printf("  Lazy Start:         enabled (never unload)\n");
+        }
+    }
     printf("  Chorus:             %s", config->chorus_enabled ? "enabled" : "disabled");
     if (config->chorus_enabled) {
         printf(" (level %.2f)", config->chorus_level);
@@ -535,9 +739,17 @@ void config_print(const midisynthd_config_t *config) {
         printf("  (none configured)\n");
     } else {
         for (int i = 0; i < config->soundfont_count; i++) {
-            printf("  [%d] %s: %s\n", i + 1,
+            printf("  [%d] %s: %s%s\n", i + 1,
                    config->soundfonts[i].enabled ? "enabled" : "disabled",
-                   config->soundfonts[i].path);
+                   config->soundfonts[i].path,
+                   config->soundfonts[i].drop_sm24 ? " (16-bit only)" : "");
+        }
+    }
+    
+    if (config->route_count > 0) {
+        printf("\nMIDI Routing:\n");
+        for (int i = 0; i < config->route_count; i++) {
+            printf("  [%d] %s\n", i + 1, config->routes[i]);
         }
     }
     
@@ -549,6 +761,9 @@ void config_print(const midisynthd_config_t *config) {
     if (strlen(config->group) > 0) {
         printf("  Run as Group:       %s\n", config->group);
     }
+    if (strlen(config->trace_file) > 0) {
+        printf("  Span Trace:         %s\n", config->trace_file);
+    }
     
     printf("\n");
 }
@@ -571,25 +786,110 @@ int config_save(const midisynthd_config_t *config, const char *filename) {
     fprintf(f, "log_level=%s\n", config_log_level_to_string(config->log_level));
     fprintf(f, "audio_driver=%s\n", config_audio_driver_to_string(config->audio_driver));
     fprintf(f, "midi_driver=%s\n", config_midi_driver_to_string(config->midi_driver));
+    if (config->midi_input[0] != '\0')
+        fprintf(f, "midi_input=%s\n", config->midi_input);
+    if (config->osc_port > 0)
+        fprintf(f, "osc_port=%d\n", config->osc_port);
+    if (config->rtpmidi_port > 0)
+        fprintf(f, "rtpmidi_port=%d\n", config->rtpmidi_port);
+    fprintf(f, "midi_latency=%s\n", config->midi_playback ? "playback" : "live");
+    fprintf(f, "osc_latency=%s\n", config->osc_playback ? "playback" : "live");
+    fprintf(f, "rtpmidi_latency=%s\n", config->rtpmidi_playback ? "playback" : "live");
+    fprintf(f, "playback_block=%d\n", config->playback_block);
     fprintf(f, "sample_rate=%d\n", config->sample_rate);
     fprintf(f, "buffer_size=%d\n", config->buffer_size);
     fprintf(f, "audio_periods=%d\n", config->audio_periods);
+    if (config->audio_device[0] != '\0')
+        fprintf(f, "audio_device=%s\n", config->audio_device);
+    if (config->audio_file[0] != '\0')
+        fprintf(f, "audio_file=%s\n", config->audio_file);
+    if (config->trace_file[0] != '\0')
+        fprintf(f, "trace_file=%s\n", config->trace_file);
     fprintf(f, "gain=%.2f\n", config->gain);
     fprintf(f, "client_name=%s\n", config->client_name);
     fprintf(f, "midi_autoconnect=%s\n", config->midi_autoconnect ? "yes" : "no");
     fprintf(f, "polyphony=%d\n", config->polyphony);
+    fprintf(f, "shed_threshold=%d\n", config->shed_threshold);
+    fprintf(f, "xrun_concealment=%s\n", config->xrun_concealment ? "yes" : "no");
+    if (config->sample_cache > 0) {
+        fprintf(f, "sample_cache=%d\n", config->sample_cache);
+        fprintf(f, "sample_cache_floor=%d\n", config->sample_cache_floor);
+    }
+    if (config->percussion_cache > 0) {
+        fprintf(f, "percussion_cache=%d\n", config->percussion_cache);
+    }
+    fprintf(f, "level_meters=%s\n", config->level_meters ? "yes" : "no");
+    fprintf(f, "lazy_start=%s\n", config->lazy_start ? "yes" : "no");
+    fprintf(f, "idle_timeout=%d\n", config->idle_timeout);
     fprintf(f, "chorus_enabled=%s\n", config->chorus_enabled ? "yes" : "no");
     fprintf(f, "chorus_level=%.2f\n", config->chorus_level);
     fprintf(f, "reverb_enabled=%s\n", config->reverb_enabled ? "yes" : "no");
     fprintf(f, "reverb_level=%.2f\n", config->reverb_level);
     for (int i = 0; i < config->soundfont_count; i++) {
-        if (config->soundfonts[i].enabled)
+        if (config->soundfonts[i].enabled) {
             fprintf(f, "soundfont=%s\n", config->soundfonts[i].path);
+            if (config->soundfonts[i].drop_sm24)
+                fprintf(f, "soundfont_24bit=no\n");
+        }
+    }
+    for (int i = 0; i < config->route_count; i++) {
+        fprintf(f, "route=%s\n", config->routes[i]);
     }
     fclose(f);
     return 0;
 }
 
+int config_write_option(const char *filename, const char *key, const char *value) {
+    if (!filename || !key || !value) return -1;
+    
+    char tmp_path[CONFIG_MAX_PATH_LEN + 8];
+    if (snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", filename) >= (int)sizeof(tmp_path)) {
+        return -1;
+    }
+    
+    FILE *out = fopen(tmp_path, "w");
+    if (!out) {
+        syslog(LOG_ERR, "Failed to write %s: %s", tmp_path, strerror(errno));
+        return -1;
+    }
+    
+    bool replaced = false;
+    FILE *in = fopen(filename, "r");
+    if (in) {
+        char line[CONFIG_MAX_LINE_LEN];
+        while (fgets(line, sizeof(line), in)) {
+            if (!replaced) {
+                const char *p = line;
+                while (isspace((unsigned char)*p)) p++;
+                size_t key_len = strlen(key);
+                if (strncasecmp(p, key, key_len) == 0) {
+                    const char *q = p + key_len;
+                    while (*q == ' ' || *q == '\t') q++;
+                    if (*q == '=') {
+                        fprintf(out, "%s=%s\n", key, value);
+                        replaced = true;
+                        continue;
+                    }
+                }
+            }
+            fputs(line, out);
+        }
+        fclose(in);
+    }
+    
+    if (!replaced) {
+        fprintf(out, "%s=%s\n", key, value);
+    }
+    
+    if (fclose(out) != 0 || rename(tmp_path, filename) != 0) {
+        syslog(LOG_ERR, "Failed to update %s: %s", filename, strerror(errno));
+        unlink(tmp_path);
+        return -1;
+    }
+    
+    return 0;
+}
+
 void config_merge(midisynthd_config_t *system_config, const midisynthd_config_t *user_config) {
     if (!system_config || !user_config) return;
     *system_config = *user_config;
@@ -651,6 +951,8 @@ midi_driver_t config_parse_midi_driver(const char *driver_str) {
     if (!driver_str) return MIDI_DRIVER_ALSA_SEQ;
     if (strcasecmp(driver_str, "alsa_raw") == 0) return MIDI_DRIVER_ALSA_RAW;
     if (strcasecmp(driver_str, "jack") == 0) return MIDI_DRIVER_JACK;
+    if (strcasecmp(driver_str, "pipe") == 0) return MIDI_DRIVER_PIPE;
+    if (strcasecmp(driver_str, "pipewire") == 0) return MIDI_DRIVER_PIPEWIRE;
     return MIDI_DRIVER_ALSA_SEQ;
 }
 
@@ -672,3 +974,9 @@ const char* config_midi_driver_to_string(midi_driver_t driver) {
     if (driver < 0 || driver >= MIDI_DRIVER_COUNT) return "unknown";
     return midi_driver_names[driver];
 }
+
+bool config_has_playback_inputs(const midisynthd_config_t *config) {
+    return config && (config->midi_playback ||
+                      (config->osc_port > 0 && config->osc_playback) ||
+                      (config->rtpmidi_port > 0 && config->rtpmidi_playback));
+}
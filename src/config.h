@@ -43,12 +43,17 @@ extern "C" {
 #define CONFIG_DEFAULT_REVERB_LEVEL  0.9f
 #define CONFIG_DEFAULT_BUFFER_SIZE   512
 #define CONFIG_DEFAULT_AUDIO_PERIODS 4
+#define CONFIG_DEFAULT_SAMPLE_CACHE_FLOOR 4
+#define CONFIG_DEFAULT_IDLE_TIMEOUT  900
+#define CONFIG_DEFAULT_PLAYBACK_BLOCK 2048
+#define CONFIG_DEFAULT_SHED_THRESHOLD 90
 
 /* String and path length limits */
 #define CONFIG_MAX_PATH_LEN         512
 #define CONFIG_MAX_STRING_LEN       128
 #define CONFIG_MAX_SOUNDFONTS       8
 #define CONFIG_MAX_MIDI_CHANNELS    16
+#define CONFIG_MAX_ROUTES           32
 
 /* Logging levels */
 typedef enum {
@@ -65,6 +70,9 @@ typedef enum {
     AUDIO_DRIVER_PIPEWIRE,
     AUDIO_DRIVER_PULSEAUDIO,
     AUDIO_DRIVER_ALSA,
+    AUDIO_DRIVER_NULL,          /* No device, timer-paced rendering */
+    AUDIO_DRIVER_FREEWHEEL,     /* No device, render as fast as possible */
+    AUDIO_DRIVER_OFFLINE,       /* No device or clock, host pulls audio */
     AUDIO_DRIVER_COUNT
 } audio_driver_t;
 
@@ -73,6 +81,8 @@ typedef enum {
     MIDI_DRIVER_ALSA_SEQ = 0,
     MIDI_DRIVER_ALSA_RAW,
     MIDI_DRIVER_JACK,
+    MIDI_DRIVER_PIPE,           /* Raw MIDI bytes from stdin, a FIFO or a Unix socket */
+    MIDI_DRIVER_PIPEWIRE,
     MIDI_DRIVER_COUNT
 } midi_driver_t;
 
@@ -86,6 +96,7 @@ typedef struct {
     bool enabled;
     int bank_offset;
     float gain_offset;
+    bool drop_sm24;             /* Load 16-bit samples only, ignoring the sm24 chunk */
 } soundfont_config_t;
 
 
@@ -97,19 +108,40 @@ typedef struct midisynthd_config_t {
     int sample_rate;
     int buffer_size;
     int audio_periods;
+    char audio_file[CONFIG_MAX_PATH_LEN];
+    char audio_device[CONFIG_MAX_STRING_LEN];
     float gain;
     char client_name[CONFIG_MAX_STRING_LEN];
     bool midi_autoconnect;
+    char midi_input[CONFIG_MAX_PATH_LEN];     /* Source for the pipe MIDI driver */
+    int osc_port;                             /* Loopback UDP port for OSC input, 0 disables */
+    int rtpmidi_port;                         /* RTP-MIDI control port (data is +1), 0 disables */
+    bool midi_playback;                       /* Latency class of each input: false is live, */
+    bool osc_playback;                        /* true is playback, rendered ahead in */
+    bool rtpmidi_playback;                    /* playback_block frames by a second engine */
+    int playback_block;
     int polyphony;
+    int shed_threshold;                       /* Predicted period load (%) that sheds voices, 0 disables */
+    bool xrun_concealment;                    /* Cover late periods with a faded repeat */
+    int sample_cache;                         /* Presets kept loaded by the sample cache, 0 disables */
+    int sample_cache_floor;                   /* Presets never evicted under memory pressure */
+    int percussion_cache;                     /* MiB of pre-rendered channel 10 hits, 0 disables */
+    bool level_meters;                        /* Peak/RMS levels per channel and of the output */
+    bool lazy_start;                          /* Load soundfonts and audio on first MIDI input */
+    int idle_timeout;                         /* Seconds without input before unloading, 0 never */
     bool chorus_enabled;
     float chorus_level;
     bool reverb_enabled;
     float reverb_level;
     soundfont_config_t soundfonts[CONFIG_MAX_SOUNDFONTS];
     int soundfont_count;
+    char routes[CONFIG_MAX_ROUTES][CONFIG_MAX_STRING_LEN];  /* MIDI routing rules, in order */
+    int route_count;
     bool realtime_priority;
     char user[CONFIG_MAX_STRING_LEN];
     char group[CONFIG_MAX_STRING_LEN];
+    bool daemonize;                           /* Set by --daemonize, never read from files */
+    char trace_file[CONFIG_MAX_PATH_LEN];     /* Span trace written on SIGUSR1 and exit, empty disables */
 } midisynthd_config_t;
 
 /* Configuration validation result codes */
@@ -158,6 +190,17 @@ int config_validate(midisynthd_config_t *config);
  */
 int config_save(const midisynthd_config_t *config, const char *filename);
 
+/**
+ * Set a single key in a configuration file, preserving all other lines
+ * Replaces the first uncommented assignment of @p key or appends one if
+ * the key is not present. The file is created if it does not exist.
+ * @param filename Configuration file to update
+ * @param key Configuration key (e.g., "buffer_size")
+ * @param value New value as string
+ * @return 0 on success, -1 on error
+ */
+int config_write_option(const char *filename, const char *key, const char *value);
+
 /**
  * Print configuration to stdout (for testing and debugging)
  * @param config Configuration structure to print
@@ -257,6 +300,13 @@ bool config_validate_soundfont(const char *path);
  */
 bool config_find_default_soundfont(char *found_path, size_t path_len);
 
+/**
+ * Check whether any enabled input is in the playback latency class
+ * @param config Configuration structure to check
+ * @return true if a playback engine is needed
+ */
+bool config_has_playback_inputs(const midisynthd_config_t *config);
+
 /**
  * Set configuration option from string key-value pair
  * Used for command line overrides and dynamic configuration
@@ -0,0 +1,465 @@
+/*
+ * midisynthd - System-level MIDI Synthesizer Daemon for Linux
+ * Copyright (C) 2025 ArchLars
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include "event_loop.h"
+#include "memstat.h"
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <syslog.h>
+#include <sys/epoll.h>
+
+#if HAVE_LIBURING
+#include <liburing.h>
+
+#define URING_ENTRIES       64
+
+/* Write slots plus submission (64 B) and completion (2 x 16 B) entries */
+#define URING_MEMORY        ((size_t)EVENT_LOOP_WRITE_SLOTS * EVENT_LOOP_WRITE_SLOT_SIZE + \
+                             (size_t)URING_ENTRIES * (64 + 2 * 16))
+
+/* user_data tags: kind in the upper 32 bits, index in the lower */
+#define UD_WATCH            1ULL
+#define UD_WRITE            2ULL
+#define UD_CANCEL           3ULL
+#define UD_MAKE(kind, idx)  (((kind) << 32) | (uint64_t)(idx))
+#define UD_KIND(ud)         ((ud) >> 32)
+#define UD_INDEX(ud)        ((unsigned)((ud) & 0xFFFFFFFFu))
+#endif
+
+typedef enum {
+    WATCH_FREE = 0,
+    WATCH_ACTIVE,
+    WATCH_REMOVING          /* Cancel submitted, waiting for the poll to end */
+} watch_state_t;
+
+typedef struct {
+    int fd;
+    event_loop_cb_t cb;
+    void *data;
+    uint32_t events;        /* poll(2) bits being watched */
+    watch_state_t state;
+    bool armed;             /* io_uring poll request in flight */
+    uint32_t ready;         /* Events waiting to be dispatched */
+} watch_t;
+
+struct event_loop_s {
+    bool uring;
+    int epoll_fd;
+    watch_t watches[EVENT_LOOP_MAX_WATCHES];
+
+#if HAVE_LIBURING
+    struct io_uring ring;
+    bool fixed;             /* Slots registered with the kernel */
+    uint8_t *slot_mem;
+    struct iovec slots[EVENT_LOOP_WRITE_SLOTS];
+    bool slot_busy[EVENT_LOOP_WRITE_SLOTS];
+    int pending_writes;
+    int write_errors;
+#endif
+};
+
+static watch_t *find_watch(event_loop_t *loop, int fd) {
+    for (int i = 0; i < EVENT_LOOP_MAX_WATCHES; i++) {
+        if (loop->watches[i].state == WATCH_ACTIVE && loop->watches[i].fd == fd) {
+            return &loop->watches[i];
+        }
+    }
+    return NULL;
+}
+
+static watch_t *alloc_watch(event_loop_t *loop) {
+    for (int i = 0; i < EVENT_LOOP_MAX_WATCHES; i++) {
+        if (loop->watches[i].state == WATCH_FREE) {
+            return &loop->watches[i];
+        }
+    }
+    return NULL;
+}
+
+#if HAVE_LIBURING
+/**
+ * Get a submission entry, flushing the queue to the kernel when it is full
+ */
+static struct io_uring_sqe *get_sqe(event_loop_t *loop) {
+    struct io_uring_sqe *sqe = io_uring_get_sqe(&loop->ring);
+    if (!sqe) {
+        io_uring_submit(&loop->ring);
+        sqe = io_uring_get_sqe(&loop->ring);
+    }
+    return sqe;
+}
+
+static int arm_watch(event_loop_t *loop, watch_t *w) {
+    struct io_uring_sqe *sqe = get_sqe(loop);
+    if (!sqe) return -1;
+    io_uring_prep_poll_add(sqe, w->fd, w->events);
+    io_uring_sqe_set_data64(sqe, UD_MAKE(UD_WATCH, (unsigned)(w - loop->watches)));
+    w->armed = true;
+    return 0;
+}
+
+/**
+ * Consume all available completions without running callbacks
+ */
+static void reap_completions(event_loop_t *loop) {
+    struct io_uring_cqe *cqe;
+    unsigned head, seen = 0;
+
+    io_uring_for_each_cqe(&loop->ring, head, cqe) {
+        uint64_t ud = io_uring_cqe_get_data64(cqe);
+        unsigned idx = UD_INDEX(ud);
+        seen++;
+
+        switch (UD_KIND(ud)) {
+            case UD_WATCH: {
+                if (idx >= EVENT_LOOP_MAX_WATCHES) break;
+                watch_t *w = &loop->watches[idx];
+                w->armed = false;
+                if (w->state == WATCH_REMOVING) {
+                    w->state = WATCH_FREE;
+                } else if (cqe->res > 0) {
+                    w->ready |= (uint32_t)cqe->res;
+                } else if (cqe->res < 0 && cqe->res != -ECANCELED) {
+                    w->ready |= POLLERR;
+                }
+                break;
+            }
+            case UD_WRITE:
+                if (idx >= EVENT_LOOP_WRITE_SLOTS) break;
+                if (cqe->res < 0) {
+                    syslog(LOG_ERR, "Queued write failed: %s", strerror(-cqe->res));
+                    loop->write_errors++;
+                } else if ((size_t)cqe->res < loop->slots[idx].iov_len) {
+                    syslog(LOG_ERR, "Queued write truncated (%d of %zu bytes)",
+                           cqe->res, loop->slots[idx].iov_len);
+                    loop->write_errors++;
+                }
+                loop->slot_busy[idx] = false;
+                loop->pending_writes--;
+                break;
+            default:
+                break;
+        }
+    }
+    io_uring_cq_advance(&loop->ring, seen);
+}
+
+static int acquire_slot(event_loop_t *loop) {
+    for (;;) {
+        for (int i = 0; i < EVENT_LOOP_WRITE_SLOTS; i++) {
+            if (!loop->slot_busy[i]) return i;
+        }
+        /* All slots in flight: wait for one to come back */
+        int ret = io_uring_submit_and_wait(&loop->ring, 1);
+        if (ret < 0 && ret != -EINTR) return -1;
+        reap_completions(loop);
+    }
+}
+
+static int uring_setup(event_loop_t *loop) {
+    int ret = io_uring_queue_init(URING_ENTRIES, &loop->ring, 0);
+    if (ret < 0) {
+        syslog(LOG_INFO, "io_uring unavailable (%s), using epoll", strerror(-ret));
+        return -1;
+    }
+
+    if (posix_memalign((void **)&loop->slot_mem, 4096,
+                       (size_t)EVENT_LOOP_WRITE_SLOTS * EVENT_LOOP_WRITE_SLOT_SIZE) != 0) {
+        io_uring_queue_exit(&loop->ring);
+        return -1;
+    }
+    memstat_add(MEMSTAT_QUEUES, URING_MEMORY);
+    for (int i = 0; i < EVENT_LOOP_WRITE_SLOTS; i++) {
+        loop->slots[i].iov_base = loop->slot_mem + (size_t)i * EVENT_LOOP_WRITE_SLOT_SIZE;
+        loop->slots[i].iov_len = EVENT_LOOP_WRITE_SLOT_SIZE;
+    }
+
+    /* Registration pins the slots; without it writes still go through the
+     * ring, just with a per-request page lookup */
+    ret = io_uring_register_buffers(&loop->ring, loop->slots, EVENT_LOOP_WRITE_SLOTS);
+    loop->fixed = ret == 0;
+    if (!loop->fixed) {
+        syslog(LOG_INFO, "io_uring buffer registration failed (%s), using plain writes",
+               strerror(-ret));
+    }
+    return 0;
+}
+#endif /* HAVE_LIBURING */
+
+event_loop_t *event_loop_create(void) {
+    event_loop_t *loop = calloc(1, sizeof(*loop));
+    if (!loop) {
+        syslog(LOG_ERR, "Failed to allocate event loop");
+        return NULL;
+    }
+    loop->epoll_fd = -1;
+
+#if HAVE_LIBURING
+    if (uring_setup(loop) == 0) {
+        loop->uring = true;
+        syslog(LOG_DEBUG, "I/O loop using io_uring");
+        return loop;
+    }
+#endif
+
+    loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->epoll_fd < 0) {
+        syslog(LOG_ERR, "Failed to create epoll instance: %s", strerror(errno));
+        free(loop);
+        return NULL;
+    }
+    syslog(LOG_DEBUG, "I/O loop using epoll");
+    return loop;
+}
+
+void event_loop_destroy(event_loop_t *loop) {
+    if (!loop) return;
+
+#if HAVE_LIBURING
+    if (loop->uring) {
+        event_loop_flush(loop);
+        /* Exiting the ring cancels outstanding poll requests */
+        io_uring_queue_exit(&loop->ring);
+        free(loop->slot_mem);
+        memstat_sub(MEMSTAT_QUEUES, URING_MEMORY);
+    }
+#endif
+    if (loop->epoll_fd >= 0) {
+        close(loop->epoll_fd);
+    }
+    free(loop);
+}
+
+const char *event_loop_backend(const event_loop_t *loop) {
+    return loop && loop->uring ? "io_uring" : "epoll";
+}
+
+int event_loop_add_fd(event_loop_t *loop, int fd, event_loop_cb_t cb, void *data) {
+    return event_loop_add_fd_events(loop, fd, POLLIN, cb, data);
+}
+
+int event_loop_add_fd_events(event_loop_t *loop, int fd, uint32_t events,
+                             event_loop_cb_t cb, void *data) {
+    if (!loop || fd < 0 || !events || !cb || find_watch(loop, fd)) return -1;
+
+    watch_t *w = alloc_watch(loop);
+    if (!w) {
+        syslog(LOG_ERR, "Event loop watch table full, cannot add fd %d", fd);
+        return -1;
+    }
+    w->fd = fd;
+    w->cb = cb;
+    w->data = data;
+    w->events = events;
+    w->ready = 0;
+    w->armed = false;
+
+#if HAVE_LIBURING
+    if (loop->uring) {
+        if (arm_watch(loop, w) < 0) return -1;
+        w->state = WATCH_ACTIVE;
+        return 0;
+    }
+#endif
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;     /* POLLIN/POLLPRI match their EPOLL counterparts */
+    ev.data.u32 = (uint32_t)(w - loop->watches);
+    if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        syslog(LOG_ERR, "Failed to watch fd %d: %s", fd, strerror(errno));
+        return -1;
+    }
+    w->state = WATCH_ACTIVE;
+    return 0;
+}
+
+int event_loop_remove_fd(event_loop_t *loop, int fd) {
+    if (!loop) return -1;
+    watch_t *w = find_watch(loop, fd);
+    if (!w) return -1;
+    w->ready = 0;
+
+#if HAVE_LIBURING
+    if (loop->uring) {
+        if (!w->armed) {
+            w->state = WATCH_FREE;
+            return 0;
+        }
+        struct io_uring_sqe *sqe = get_sqe(loop);
+        if (!sqe) return -1;
+        io_uring_prep_poll_remove(sqe, UD_MAKE(UD_WATCH, (unsigned)(w - loop->watches)));
+        io_uring_sqe_set_data64(sqe, UD_MAKE(UD_CANCEL, 0));
+        w->state = WATCH_REMOVING;
+        return 0;
+    }
+#endif
+
+    epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+    w->state = WATCH_FREE;
+    return 0;
+}
+
+int event_loop_write(event_loop_t *loop, int fd, const void *buf, size_t len, off_t offset) {
+    if (!loop || fd < 0 || (!buf && len > 0) || offset < 0) return -1;
+    const uint8_t *p = buf;
+
+#if HAVE_LIBURING
+    if (loop->uring) {
+        while (len > 0) {
+            int slot = acquire_slot(loop);
+            if (slot < 0) return -1;
+            size_t chunk = len < EVENT_LOOP_WRITE_SLOT_SIZE ? len : EVENT_LOOP_WRITE_SLOT_SIZE;
+
+            struct io_uring_sqe *sqe = get_sqe(loop);
+            if (!sqe) return -1;
+            memcpy(loop->slots[slot].iov_base, p, chunk);
+            loop->slots[slot].iov_len = chunk;
+            if (loop->fixed) {
+                io_uring_prep_write_fixed(sqe, fd, loop->slots[slot].iov_base,
+                                          (unsigned)chunk, (uint64_t)offset, slot);
+            } else {
+                io_uring_prep_write(sqe, fd, loop->slots[slot].iov_base,
+                                    (unsigned)chunk, (uint64_t)offset);
+            }
+            io_uring_sqe_set_data64(sqe, UD_MAKE(UD_WRITE, (unsigned)slot));
+            loop->slot_busy[slot] = true;
+            loop->pending_writes++;
+
+            p += chunk;
+            len -= chunk;
+            offset += (off_t)chunk;
+        }
+        return 0;
+    }
+#endif
+
+    while (len > 0) {
+        ssize_t n = pwrite(fd, p, len, offset);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            syslog(LOG_ERR, "Write failed: %s", strerror(errno));
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+        offset += n;
+    }
+    return 0;
+}
+
+/**
+ * Run callbacks for every watch with pending events
+ */
+static int dispatch_ready(event_loop_t *loop) {
+    int dispatched = 0;
+    for (int i = 0; i < EVENT_LOOP_MAX_WATCHES; i++) {
+        watch_t *w = &loop->watches[i];
+        if (w->state != WATCH_ACTIVE || !w->ready) continue;
+
+        uint32_t events = w->ready;
+        w->ready = 0;
+        w->cb(w->data, w->fd, events);
+        dispatched++;
+
+#if HAVE_LIBURING
+        /* Poll requests are one-shot; re-arm unless the callback removed it */
+        if (loop->uring && w->state == WATCH_ACTIVE && !w->armed) {
+            arm_watch(loop, w);
+        }
+#endif
+    }
+    return dispatched;
+}
+
+int event_loop_run_once(event_loop_t *loop, int timeout_ms) {
+    if (!loop) return -1;
+
+#if HAVE_LIBURING
+    if (loop->uring) {
+        /* Re-arms and writes queued since the last call go in one submit */
+        struct io_uring_cqe *cqe = NULL;
+        int ret = io_uring_submit(&loop->ring);
+        if (ret < 0 && ret != -EINTR && ret != -EBUSY) {
+            syslog(LOG_ERR, "io_uring submit failed: %s", strerror(-ret));
+            return -1;
+        }
+
+        if (timeout_ms > 0) {
+            struct __kernel_timespec ts = {
+                .tv_sec = timeout_ms / 1000,
+                .tv_nsec = (long long)(timeout_ms % 1000) * 1000000LL
+            };
+            ret = io_uring_wait_cqe_timeout(&loop->ring, &cqe, &ts);
+        } else {
+            ret = io_uring_peek_cqe(&loop->ring, &cqe);
+        }
+        if (ret < 0 && ret != -ETIME && ret != -EINTR && ret != -EAGAIN) {
+            syslog(LOG_ERR, "io_uring wait failed: %s", strerror(-ret));
+            return -1;
+        }
+
+        reap_completions(loop);
+        return dispatch_ready(loop);
+    }
+#endif
+
+    struct epoll_event events[EVENT_LOOP_MAX_WATCHES];
+    int n = epoll_wait(loop->epoll_fd, events, EVENT_LOOP_MAX_WATCHES, timeout_ms);
+    if (n < 0) {
+        if (errno == EINTR) return 0;
+        syslog(LOG_ERR, "epoll_wait failed: %s", strerror(errno));
+        return -1;
+    }
+    for (int i = 0; i < n; i++) {
+        uint32_t idx = events[i].data.u32;
+        if (idx < EVENT_LOOP_MAX_WATCHES && loop->watches[idx].state == WATCH_ACTIVE) {
+            loop->watches[idx].ready |= events[i].events;
+        }
+    }
+    return dispatch_ready(loop);
+}
+
+int event_loop_flush(event_loop_t *loop) {
+    if (!loop) return -1;
+
+#if HAVE_LIBURING
+    if (loop->uring) {
+        while (loop->pending_writes > 0) {
+            int ret = io_uring_submit_and_wait(&loop->ring, 1);
+            if (ret < 0 && ret != -EINTR) {
+                syslog(LOG_ERR, "io_uring flush failed: %s", strerror(-ret));
+                return -1;
+            }
+            reap_completions(loop);
+        }
+        int errors = loop->write_errors;
+        loop->write_errors = 0;
+        return errors ? -1 : 0;
+    }
+#endif
+
+    return 0;
+}
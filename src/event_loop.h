@@ -0,0 +1,152 @@
+/*
+ * midisynthd - System-level MIDI Synthesizer Daemon for Linux
+ * Copyright (C) 2025 ArchLars
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef MIDISYNTHD_EVENT_LOOP_H
+#define MIDISYNTHD_EVENT_LOOP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/* Descriptors that can be watched at the same time */
+#define EVENT_LOOP_MAX_WATCHES      32
+
+/* Registered write buffers (io_uring backend) */
+#define EVENT_LOOP_WRITE_SLOTS      16
+#define EVENT_LOOP_WRITE_SLOT_SIZE  65536
+
+typedef struct event_loop_s event_loop_t;
+
+/**
+ * Callback for a readable descriptor
+ *
+ * Runs on the thread calling event_loop_run_once(). The callback should
+ * drain the descriptor; it is re-armed afterwards.
+ *
+ * @param data User data given to event_loop_add_fd()
+ * @param fd Descriptor that became ready
+ * @param events poll(2) event bits (POLLIN, POLLPRI, POLLHUP, POLLERR)
+ */
+typedef void (*event_loop_cb_t)(void *data, int fd, uint32_t events);
+
+/**
+ * Create the non-real-time I/O loop
+ *
+ * Uses io_uring when built with liburing and the kernel allows it,
+ * otherwise epoll.
+ *
+ * @return Loop instance, or NULL on failure
+ */
+event_loop_t *event_loop_create(void);
+
+/**
+ * Destroy a loop, completing queued writes first
+ *
+ * Safe to call with NULL pointer. Watched descriptors are not closed.
+ *
+ * @param loop Loop instance
+ */
+void event_loop_destroy(event_loop_t *loop);
+
+/**
+ * Name of the backend in use
+ *
+ * @param loop Loop instance
+ * @return "io_uring" or "epoll"
+ */
+const char *event_loop_backend(const event_loop_t *loop);
+
+/**
+ * Watch a descriptor for input
+ *
+ * @param loop Loop instance
+ * @param fd Descriptor to watch
+ * @param cb Callback run when @p fd is readable or hung up
+ * @param data User data passed to @p cb
+ * @return 0 on success, -1 on error or if the watch table is full
+ */
+int event_loop_add_fd(event_loop_t *loop, int fd, event_loop_cb_t cb, void *data);
+
+/**
+ * Watch a descriptor for specific poll(2) events
+ *
+ * Like event_loop_add_fd() but with the event mask given, e.g. POLLPRI
+ * for PSI triggers and cgroup event files.
+ *
+ * @param loop Loop instance
+ * @param fd Descriptor to watch
+ * @param events POLLIN and/or POLLPRI
+ * @param cb Callback run when one of @p events is pending or on hang-up
+ * @param data User data passed to @p cb
+ * @return 0 on success, -1 on error or if the watch table is full
+ */
+int event_loop_add_fd_events(event_loop_t *loop, int fd, uint32_t events,
+                             event_loop_cb_t cb, void *data);
+
+/**
+ * Stop watching a descriptor
+ *
+ * May be called from within a callback, including for its own descriptor.
+ *
+ * @param loop Loop instance
+ * @param fd Descriptor to remove
+ * @return 0 on success, -1 if @p fd is not watched
+ */
+int event_loop_remove_fd(event_loop_t *loop, int fd);
+
+/**
+ * Queue a positioned write
+ *
+ * The data is copied, so @p buf may be reused as soon as this returns.
+ * With io_uring the copy goes into a registered buffer and is submitted
+ * together with everything else queued in the same loop iteration; with
+ * epoll the write happens immediately. Writes may complete out of order,
+ * so each needs its own offset.
+ *
+ * @param loop Loop instance
+ * @param fd Destination file
+ * @param buf Data to write
+ * @param len Number of bytes
+ * @param offset File offset of the first byte
+ * @return 0 if queued or written, -1 on error
+ */
+int event_loop_write(event_loop_t *loop, int fd, const void *buf, size_t len, off_t offset);
+
+/**
+ * Wait for and dispatch events
+ *
+ * Submits queued work, waits up to @p timeout_ms for activity and runs the
+ * callbacks of ready descriptors. Returns early when a signal arrives.
+ *
+ * @param loop Loop instance
+ * @param timeout_ms Maximum wait in milliseconds, 0 to only poll
+ * @return Number of callbacks run, or -1 on error
+ */
+int event_loop_run_once(event_loop_t *loop, int timeout_ms);
+
+/**
+ * Wait until all queued writes have completed
+ *
+ * @param loop Loop instance
+ * @return 0 if every write succeeded, -1 otherwise
+ */
+int event_loop_flush(event_loop_t *loop);
+
+#endif /* MIDISYNTHD_EVENT_LOOP_H */
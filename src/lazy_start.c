@@ -0,0 +1,184 @@
+/*
+ * midisynthd - System-level MIDI Synthesizer Daemon for Linux
+ * Copyright (C) 2025 ArchLars
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include "lazy_start.h"
+#include "monotonic.h"
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <syslog.h>
+#include <time.h>
+#include <sys/timerfd.h>
+
+struct lazy_start_s {
+    synth_t *synth;
+    event_loop_t *loop;
+    int wakeup_fd;              /* Owned by the synth */
+    int timer_fd;
+    uint64_t idle_ns;           /* 0 keeps the engine running */
+    bool watching;
+    lazy_start_stats_t stats;
+};
+
+int lazy_start_activate(lazy_start_t *lazy) {
+    if (!lazy) return -1;
+    if (synth_is_active(lazy->synth)) return 0;
+
+    uint64_t start = monotonic_ns();
+    if (synth_activate(lazy->synth) < 0) {
+        lazy->stats.failures++;
+        syslog(LOG_ERR, "Failed to start synthesizer engine, next input retries");
+        return -1;
+    }
+    uint64_t elapsed = monotonic_ns() - start;
+    lazy->stats.activations++;
+    lazy->stats.activation_ns_last = elapsed;
+    if (elapsed > lazy->stats.activation_ns_max) {
+        lazy->stats.activation_ns_max = elapsed;
+    }
+    syslog(LOG_INFO, "Engine started on first input in %.1f ms", elapsed / 1e6);
+    return 0;
+}
+
+int lazy_start_check(lazy_start_t *lazy) {
+    if (!lazy || lazy->idle_ns == 0 || !synth_is_active(lazy->synth)) return 0;
+
+    uint64_t last = synth_get_last_input_ns(lazy->synth);
+    uint64_t now = monotonic_ns();
+    if (last > now || now - last < lazy->idle_ns) return 0;
+
+    /* Release tails and sustained notes play out before unloading */
+    synth_status_t status;
+    if (synth_get_status(lazy->synth, &status) == 0 && status.active_voices > 0) return 0;
+
+    if (synth_deactivate(lazy->synth) < 0) return 0;
+    lazy->stats.deactivations++;
+    syslog(LOG_INFO, "Engine stopped after %llu s without input",
+           (unsigned long long)(lazy->idle_ns / 1000000000ULL));
+    return 1;
+}
+
+static void on_wakeup(void *data, int fd, uint32_t events) {
+    lazy_start_t *lazy = data;
+    uint64_t count;
+    (void)events;
+    if (read(fd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+        return;
+    }
+    lazy_start_activate(lazy);
+}
+
+static void on_timer(void *data, int fd, uint32_t events) {
+    lazy_start_t *lazy = data;
+    uint64_t expirations;
+    (void)events;
+    if (read(fd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN) {
+        return;
+    }
+    lazy_start_check(lazy);
+}
+
+lazy_start_t *lazy_start_create(const midisynthd_config_t *config, synth_t *synth, event_loop_t *loop) {
+    if (!config || !synth || !loop || !config->lazy_start) {
+        syslog(LOG_ERR, "Invalid parameters for lazy start");
+        return NULL;
+    }
+
+    int wakeup_fd = synth_get_wakeup_fd(synth);
+    if (wakeup_fd < 0) {
+        syslog(LOG_ERR, "Synthesizer was not created for lazy start");
+        return NULL;
+    }
+
+    lazy_start_t *lazy = calloc(1, sizeof(*lazy));
+    if (!lazy) return NULL;
+    lazy->synth = synth;
+    lazy->loop = loop;
+    lazy->wakeup_fd = -1;
+    lazy->timer_fd = -1;
+    lazy->idle_ns = (uint64_t)(config->idle_timeout > 0 ? config->idle_timeout : 0) * 1000000000ULL;
+
+    if (event_loop_add_fd(loop, wakeup_fd, on_wakeup, lazy) < 0) {
+        syslog(LOG_ERR, "Failed to watch engine wakeup");
+        free(lazy);
+        return NULL;
+    }
+    lazy->wakeup_fd = wakeup_fd;
+
+    if (lazy->idle_ns > 0) {
+        lazy->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        struct itimerspec its = {
+            .it_interval = { LAZY_START_CHECK_MS / 1000, (LAZY_START_CHECK_MS % 1000) * 1000000L },
+            .it_value = { LAZY_START_CHECK_MS / 1000, (LAZY_START_CHECK_MS % 1000) * 1000000L },
+        };
+        if (lazy->timer_fd < 0 || timerfd_settime(lazy->timer_fd, 0, &its, NULL) < 0 ||
+            event_loop_add_fd(loop, lazy->timer_fd, on_timer, lazy) < 0) {
+            syslog(LOG_ERR, "Failed to start idle timer: %s", strerror(errno));
+            lazy_start_cleanup(lazy);
+            return NULL;
+        }
+    }
+
+    lazy->watching = true;
+    if (lazy->idle_ns > 0) {
+        syslog(LOG_INFO, "Lazy start: engine loads on first input, unloads after %d s idle",
+               config->idle_timeout);
+    } else {
+        syslog(LOG_INFO, "Lazy start: engine loads on first input");
+    }
+    return lazy;
+}
+
+void lazy_start_cleanup(lazy_start_t *lazy) {
+    if (!lazy) return;
+
+    if (lazy->wakeup_fd >= 0) {
+        event_loop_remove_fd(lazy->loop, lazy->wakeup_fd);
+    }
+    if (lazy->timer_fd >= 0) {
+        event_loop_remove_fd(lazy->loop, lazy->timer_fd);
+        close(lazy->timer_fd);
+    }
+    if (lazy->watching) {
+        lazy_start_log(lazy);
+    }
+    free(lazy);
+}
+
+int lazy_start_get_stats(lazy_start_t *lazy, lazy_start_stats_t *stats) {
+    if (!lazy || !stats) return -1;
+    *stats = lazy->stats;
+    return 0;
+}
+
+void lazy_start_log(lazy_start_t *lazy) {
+    if (!lazy) return;
+    const lazy_start_stats_t *s = &lazy->stats;
+    syslog(LOG_INFO, "Lazy start: engine %s, %llu starts (last %.1f ms, max %.1f ms), "
+           "%llu idle stops, %llu failed starts",
+           synth_is_active(lazy->synth) ? "running" : "unloaded",
+           (unsigned long long)s->activations,
+           s->activation_ns_last / 1e6, s->activation_ns_max / 1e6,
+           (unsigned long long)s->deactivations,
+           (unsigned long long)s->failures);
+}
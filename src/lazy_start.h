@@ -0,0 +1,107 @@
+/*
+ * midisynthd - System-level MIDI Synthesizer Daemon for Linux
+ * Copyright (C) 2025 ArchLars
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef MIDISYNTHD_LAZY_START_H
+#define MIDISYNTHD_LAZY_START_H
+
+#include <stdint.h>
+#include "config.h"
+#include "synth.h"
+#include "event_loop.h"
+
+/* How often the engine is checked for idleness */
+#define LAZY_START_CHECK_MS     1000
+
+typedef struct lazy_start_s lazy_start_t;
+
+/**
+ * Lazy start counters
+ */
+typedef struct {
+    uint64_t activations;       /* Engine starts */
+    uint64_t deactivations;     /* Engine stops after the idle timeout */
+    uint64_t failures;          /* Starts that failed */
+    uint64_t activation_ns_last; /* Time to load soundfonts and start audio */
+    uint64_t activation_ns_max;
+} lazy_start_stats_t;
+
+/**
+ * Start and stop the synthesizer engine on demand
+ *
+ * Requires a synth created with config->lazy_start: its MIDI inputs are
+ * open but no soundfont is loaded and no audio driver runs. The first
+ * MIDI message makes the synth request activation, which is carried out
+ * here on the event loop, so loading never blocks an input thread. Once
+ * no input arrived for config->idle_timeout seconds and no voice is
+ * playing, the engine is stopped again.
+ *
+ * @param config Configuration holding the idle timeout
+ * @param synth Synthesizer, created with the same configuration
+ * @param loop Event loop the wakeup and idle timer are watched on
+ * @return Controller, or NULL on error
+ */
+lazy_start_t *lazy_start_create(const midisynthd_config_t *config, synth_t *synth, event_loop_t *loop);
+
+/**
+ * Stop watching; the engine is left as it is
+ *
+ * Safe to call with NULL pointer.
+ *
+ * @param lazy Controller
+ */
+void lazy_start_cleanup(lazy_start_t *lazy);
+
+/**
+ * Start the engine and time it
+ *
+ * Runs from the event loop when the synth requests activation.
+ *
+ * @param lazy Controller
+ * @return 0 on success or if already running, -1 on error
+ */
+int lazy_start_activate(lazy_start_t *lazy);
+
+/**
+ * Stop the engine if it has been idle for the timeout
+ *
+ * Runs every LAZY_START_CHECK_MS from the event loop.
+ *
+ * @param lazy Controller
+ * @return 1 if the engine was stopped, 0 otherwise
+ */
+int lazy_start_check(lazy_start_t *lazy);
+
+/**
+ * Get lazy start counters
+ *
+ * @param lazy Controller
+ * @param stats Receives the counters
+ * @return 0 on success, -1 on error
+ */
+int lazy_start_get_stats(lazy_start_t *lazy, lazy_start_stats_t *stats);
+
+/**
+ * Log engine state and lazy start counters to syslog
+ *
+ * @param lazy Controller, NULL logs nothing
+ */
+void lazy_start_log(lazy_start_t *lazy);
+
+#endif /* MIDISYNTHD_LAZY_START_H */
@@ -38,8 +38,20 @@
 #include "synth.h"
 #include "midi_alsa.h"
 #include "midi_jack.h"
+#include "midi_pipe.h"
+#include "midi_pipewire.h"
+#include "osc.h"
+#include "rtp_midi.h"
+#include "sample_cache.h"
+#include "lazy_start.h"
 #include "audio.h"
+#include "event_loop.h"
+#include "memstat.h"
+#include "threads.h"
+#include "rt_sentinel.h"
+#include "trace.h"
 #include "daemonize.h"
+#include "tune.h"
 
 #ifndef PACKAGE_NAME
 #define PACKAGE_NAME "midisynthd"
@@ -52,10 +64,17 @@
 /* Global state */
 static volatile sig_atomic_t g_running = 1;
 static volatile sig_atomic_t g_reload_config = 0;
+static volatile sig_atomic_t g_print_status = 0;
+static volatile sig_atomic_t g_all_notes_off = 0;
 static midisynthd_config_t g_config;
 static synth_t *g_synth = NULL;
 static void *g_midi = NULL;
 static audio_t *g_audio = NULL;
+static event_loop_t *g_loop = NULL;
+static osc_t *g_osc = NULL;
+static rtp_midi_t *g_rtp = NULL;
+static sample_cache_t *g_cache = NULL;
+static lazy_start_t *g_lazy = NULL;
 
 /* Command line options */
 static struct option long_options[] = {
@@ -70,6 +89,7 @@ static struct option long_options[] = {
     {"no-realtime", no_argument,       0, 'n'},
     {"user",        required_argument, 0, 'u'},
     {"group",       required_argument, 0, 'g'},
+    {"tune",        no_argument,       0, 'T'},
     {0, 0, 0, 0}
 };
 
@@ -94,6 +114,8 @@ static void print_usage(const char *program_name) {
     printf("  -n, --no-realtime   Disable real-time priority scheduling\n");
     printf("  -u, --user USER     Run as specified user (if started as root)\n");
     printf("  -g, --group GROUP   Run as specified group (if started as root)\n");
+    printf("  -T, --tune          Measure the audio backend under load and write the\n");
+    printf("                      lowest stable buffer_size/audio_periods to the config\n");
     printf("\n");
     printf("Configuration files (in order of precedence):\n");
     printf("  User config:        ~/.config/midisynthd.conf\n");
@@ -114,6 +136,7 @@ static void print_usage(const char *program_name) {
     printf("  %s                           # Run in foreground\n", program_name);
     printf("  %s --daemonize               # Run as daemon\n", program_name);
     printf("  %s --test-config             # Test configuration\n", program_name);
+    printf("  %s --tune                    # Find the lowest stable latency\n", program_name);
     printf("  %s --verbose --config custom.conf  # Debug with custom config\n", program_name);
     printf("\n");
     printf("Report bugs to: https://github.com/ArchLars/midisynthd/issues\n");
@@ -137,7 +160,162 @@ static void print_version(void) {
 #endif
     printf("\n");
     printf("Audio drivers supported: JACK, PipeWire, PulseAudio, ALSA\n");
-    printf("MIDI drivers supported:  ALSA Sequencer, Raw ALSA MIDI\n");
+    printf("MIDI drivers supported:  ALSA Sequencer, Raw ALSA MIDI, JACK, PipeWire, pipe\n");
+}
+
+/**
+ * Print the memory the configuration will need, for sizing memory limits
+ */
+static void print_memory_estimate(const midisynthd_config_t *config) {
+    printf("\nMemory Estimate:\n");
+    for (int i = 0; i < config->soundfont_count && i < CONFIG_MAX_SOUNDFONTS; i++) {
+        memstat_sf2_t sf;
+        if (!config->soundfonts[i].enabled || memstat_sf2_estimate(config->soundfonts[i].path, &sf) < 0) {
+            continue;
+        }
+        size_t saved = config->soundfonts[i].drop_sm24 ? sf.sm24_bytes : 0;
+        printf("  %s: %zu KiB samples, %zu KiB metadata (%d presets, %d zones)\n",
+               config->soundfonts[i].path, (sf.sample_bytes - saved) / 1024, sf.metadata_bytes / 1024,
+               sf.presets, sf.zones);
+        if (saved > 0) {
+            printf("    24-bit extension ignored: %zu KiB saved\n", saved / 1024);
+        }
+    }
+    memstat_t est;
+    synth_estimate_memory(config, &est);
+    memstat_print(stdout, &est);
+}
+
+/**
+ * Log output levels in dBFS, and the channels that are sounding
+ */
+static void log_levels(const meter_snapshot_t *levels) {
+    syslog(LOG_INFO, "Output level: L %.1f dBFS peak %.1f RMS, R %.1f dBFS peak %.1f RMS, "
+           "%llu of %llu windows clipped",
+           meter_to_db(levels->master[0].peak), meter_to_db(levels->master[0].rms),
+           meter_to_db(levels->master[1].peak), meter_to_db(levels->master[1].rms),
+           (unsigned long long)levels->clipped, (unsigned long long)levels->windows);
+    if (!levels->channel_levels) {
+        return;
+    }
+
+    char line[512];
+    size_t len = 0;
+    line[0] = '\0';
+    for (int ch = 0; ch < METER_CHANNELS && len < sizeof(line); ch++) {
+        if (levels->channels[ch].peak > 0.0f) {
+            len += (size_t)snprintf(line + len, sizeof(line) - len, " %d: %.1f/%.1f", ch + 1,
+                                    meter_to_db(levels->channels[ch].peak),
+                                    meter_to_db(levels->channels[ch].rms));
+        }
+    }
+    syslog(LOG_INFO, "Channel levels (dBFS peak/RMS):%s", len > 0 ? line : " all silent");
+}
+
+/**
+ * Disconnect MIDI inputs and release their notes, for SIGUSR2
+ *
+ * Runs from the main loop: the drivers take locks and free memory.
+ */
+static void all_notes_off(void) {
+    if (g_config.log_level >= LOG_LEVEL_INFO) {
+        syslog(LOG_INFO, "Received SIGUSR2, sending All Notes Off");
+    }
+    if (g_midi) {
+        if (g_config.midi_driver == MIDI_DRIVER_JACK)
+            midi_jack_disconnect_all(g_midi);
+        else if (g_config.midi_driver == MIDI_DRIVER_PIPE)
+            midi_pipe_disconnect_all(g_midi);
+        else if (g_config.midi_driver == MIDI_DRIVER_PIPEWIRE)
+            midi_pipewire_disconnect_all(g_midi);
+        else
+            midi_alsa_disconnect_all(g_midi);
+    } else if (g_synth) {
+        synth_all_notes_off(g_synth);
+    }
+}
+
+/**
+ * Log status, statistics and levels, and write the trace, for SIGUSR1
+ *
+ * Runs from the main loop: none of it is safe in a signal handler.
+ */
+static void log_status(void) {
+    if (g_config.log_level >= LOG_LEVEL_INFO) {
+        syslog(LOG_INFO, "Received SIGUSR1, printing status information");
+    }
+    if (!g_synth) {
+        syslog(LOG_WARNING, "Synthesizer not initialized; no status available");
+        return;
+    }
+    synth_status_t status;
+    if (synth_get_status(g_synth, &status) == 0) {
+        syslog(LOG_INFO,
+               "Synth status: voices %d/%d, CPU %.2f%%, %0.f Hz, %d-frame buffer",
+               status.active_voices,
+               status.max_polyphony,
+               status.cpu_load,
+               status.sample_rate,
+               status.buffer_size);
+        if (status.levels.windows > 0) {
+            log_levels(&status.levels);
+        }
+    } else {
+        syslog(LOG_WARNING, "Unable to retrieve synthesizer status");
+    }
+    synth_render_stats_t render;
+    if (synth_get_playback(g_synth) && synth_get_render_stats(g_synth, &render) == 0) {
+        syslog(LOG_INFO, "Playback engine: %llu blocks rendered, %llu underruns",
+               (unsigned long long)render.playback_blocks,
+               (unsigned long long)render.playback_underruns);
+    }
+    if (g_config.shed_threshold > 0 && synth_get_render_stats(g_synth, &render) == 0) {
+        syslog(LOG_INFO, "Voice shedding: %llu voices shed in %llu periods, %.1f ns per voice-frame",
+               (unsigned long long)render.shed_voices,
+               (unsigned long long)render.shed_periods, render.voice_cost_ns);
+    }
+    if (g_config.xrun_concealment && synth_get_render_stats(g_synth, &render) == 0) {
+        syslog(LOG_INFO, "Xrun concealment: %llu of %llu periods concealed (%llu frames), "
+               "%llu resyncs; load avg %.1f%% peak %.1f%%, %llu late periods",
+               (unsigned long long)render.concealed_periods, (unsigned long long)render.periods,
+               (unsigned long long)render.concealed_frames, (unsigned long long)render.resyncs,
+               render.avg_load, render.peak_load, (unsigned long long)render.late_periods);
+    }
+    if (synth_get_render_stats(g_synth, &render) == 0 && render.failed_events > 0) {
+        syslog(LOG_INFO, "Timed MIDI: %llu events rejected by the engine",
+               (unsigned long long)render.failed_events);
+    }
+    perc_cache_stats_t perc;
+    if (synth_get_percussion_stats(g_synth, &perc) == 0) {
+        syslog(LOG_INFO, "Percussion cache: %llu hits, %llu misses, %d entries in %zu/%zu KiB, "
+               "%llu invalidations",
+               (unsigned long long)perc.hits, (unsigned long long)perc.misses, perc.entries,
+               perc.bytes / 1024, perc.budget / 1024, (unsigned long long)perc.invalidations);
+    }
+    synth_soundfont_memory_t sf;
+    for (int i = 0; synth_get_soundfont_memory(g_synth, i, &sf) == 0; i++) {
+        syslog(LOG_INFO, "Soundfont %d memory: %zu KiB samples, %zu KiB metadata, %zu KiB saved (%s)",
+               sf.id, sf.sample_bytes / 1024, sf.metadata_bytes / 1024,
+               sf.saved_bytes / 1024, sf.path);
+    }
+    memstat_t mem;
+    memstat_get(&mem);
+    memstat_log(&mem);
+    sample_cache_log(g_cache);
+    lazy_start_log(g_lazy);
+    midi_parser_stats_t parser;
+    if (g_midi && g_config.midi_driver == MIDI_DRIVER_JACK &&
+        midi_jack_get_stats(g_midi, &parser) == 0) {
+        midi_parser_log_stats(&parser, "JACK MIDI");
+    } else if (g_midi && g_config.midi_driver == MIDI_DRIVER_PIPEWIRE &&
+               midi_pipewire_get_stats(g_midi, &parser) == 0) {
+        midi_parser_log_stats(&parser, "PipeWire MIDI");
+    }
+    threads_log();
+    RT_SENTINEL_REPORT();
+    if (trace_enabled()) {
+        trace_write(g_config.trace_file);
+    }
 }
 
 /**
@@ -160,38 +338,10 @@ static void signal_handler(int sig) {
             g_reload_config = 1;
             break;
         case SIGUSR1:
-            if (g_config.log_level >= LOG_LEVEL_INFO) {
-                syslog(LOG_INFO, "Received SIGUSR1, printing status information");
-            }
-            if (g_synth) {
-                synth_status_t status;
-                if (synth_get_status(g_synth, &status) == 0) {
-                    syslog(LOG_INFO,
-                           "Synth status: voices %d/%d, CPU %.2f%%, %0.f Hz, %d-frame buffer",
-                           status.active_voices,
-                           status.max_polyphony,
-                           status.cpu_load,
-                           status.sample_rate,
-                           status.buffer_size);
-                } else {
-                    syslog(LOG_WARNING, "Unable to retrieve synthesizer status");
-                }
-            } else {
-                syslog(LOG_WARNING, "Synthesizer not initialized; no status available");
-            }
+            g_print_status = 1;
             break;
         case SIGUSR2:
-            if (g_config.log_level >= LOG_LEVEL_INFO) {
-                syslog(LOG_INFO, "Received SIGUSR2, sending All Notes Off");
-            }
-            if (g_midi) {
-                if (g_config.midi_driver == MIDI_DRIVER_JACK)
-                    midi_jack_disconnect_all(g_midi);
-                else
-                    midi_alsa_disconnect_all(g_midi);
-            } else if (g_synth) {
-                synth_all_notes_off(g_synth);
-            }
+            g_all_notes_off = 1;
             break;
         default:
             syslog(LOG_WARNING, "Received unexpected signal %d", sig);
@@ -233,7 +383,7 @@ static int setup_signals(void) {
  */
 static int load_configuration(const char *config_file, const char *soundfont_override,
                              const char *user_override, const char *group_override,
-                             int verbose, int quiet, int no_realtime) {
+                             int verbose, int quiet, int no_realtime, int daemonize) {
     int ret = 0;
     
     /* Initialize with default values */
@@ -286,6 +436,8 @@ static int load_configuration(const char *config_file, const char *soundfont_ove
         g_config.realtime_priority = false;
     }
     
+    g_config.daemonize = daemonize != 0;
+    
     /* Validate configuration */
     int validation_result = config_validate(&g_config);
     if (validation_result < 0) {
@@ -346,10 +498,30 @@ static int drop_privileges(void) {
     return 0;
 }
 
+/**
+ * Engine an input feeds, by its latency class
+ */
+static synth_t *input_synth(bool playback) {
+    synth_t *engine = playback ? synth_get_playback(g_synth) : NULL;
+    return engine ? engine : g_synth;
+}
+
 /**
  * Initialize all subsystem modules
  */
 static int initialize_modules(void) {
+    if (g_config.trace_file[0] != '\0' && trace_start() < 0) {
+        syslog(LOG_WARNING, "Span tracer unavailable");
+    }
+    
+    /* Non-real-time I/O (control, rawmidi, recording) runs on this loop */
+    g_loop = event_loop_create();
+    if (!g_loop) {
+        syslog(LOG_ERR, "Failed to create I/O event loop");
+        return -1;
+    }
+    syslog(LOG_INFO, "I/O event loop: %s", event_loop_backend(g_loop));
+    
     syslog(LOG_INFO, "Initializing audio subsystem");
     g_audio = audio_init(&g_config);
     if (!g_audio) {
@@ -364,17 +536,39 @@ static int initialize_modules(void) {
         return -1;
     }
     
+    if (g_config.sample_cache > 0) {
+        g_cache = sample_cache_create(&g_config, g_synth, g_loop);
+        if (!g_cache) {
+            syslog(LOG_ERR, "Failed to start sample cache");
+            return -1;
+        }
+    }
+    
+    if (g_config.lazy_start) {
+        g_lazy = lazy_start_create(&g_config, g_synth, g_loop);
+        if (!g_lazy) {
+            syslog(LOG_ERR, "Failed to set up lazy start");
+            return -1;
+        }
+    }
+    
     syslog(LOG_INFO, "Initializing %s MIDI input system",
            config_midi_driver_to_string(g_config.midi_driver));
     switch (g_config.midi_driver) {
         case MIDI_DRIVER_ALSA_SEQ:
-            g_midi = midi_alsa_init(&g_config, g_synth);
+            g_midi = midi_alsa_init(&g_config, input_synth(g_config.midi_playback));
             break;
         case MIDI_DRIVER_ALSA_RAW:
             syslog(LOG_ERR, "MIDI driver 'alsa_raw' not implemented");
             return -1;
         case MIDI_DRIVER_JACK:
-            g_midi = midi_jack_init(&g_config, g_synth);
+            g_midi = midi_jack_init(&g_config, input_synth(g_config.midi_playback));
+            break;
+        case MIDI_DRIVER_PIPE:
+            g_midi = midi_pipe_init(&g_config, input_synth(g_config.midi_playback), g_loop);
+            break;
+        case MIDI_DRIVER_PIPEWIRE:
+            g_midi = midi_pipewire_init(&g_config, input_synth(g_config.midi_playback));
             break;
         default:
             syslog(LOG_ERR, "Unknown MIDI driver %d", g_config.midi_driver);
@@ -385,6 +579,22 @@ static int initialize_modules(void) {
         return -1;
     }
     
+    if (g_config.osc_port > 0) {
+        g_osc = osc_init(&g_config, input_synth(g_config.osc_playback), g_loop);
+        if (!g_osc) {
+            syslog(LOG_ERR, "Failed to initialize OSC input");
+            return -1;
+        }
+    }
+    
+    if (g_config.rtpmidi_port > 0) {
+        g_rtp = rtp_midi_init(&g_config, input_synth(g_config.rtpmidi_playback), g_loop);
+        if (!g_rtp) {
+            syslog(LOG_ERR, "Failed to initialize RTP-MIDI session");
+            return -1;
+        }
+    }
+    
     syslog(LOG_INFO, "All modules initialized successfully");
     return 0;
 }
@@ -397,24 +607,67 @@ static void cleanup_modules(void) {
         syslog(LOG_INFO, "Cleaning up modules and shutting down");
     }
     
+    /* Peaks are what memory limits should be sized by */
+    if (g_synth) {
+        memstat_t mem;
+        memstat_get(&mem);
+        memstat_log(&mem);
+        threads_log();
+        RT_SENTINEL_REPORT();
+    }
+    /* While the threads still run and have their names */
+    if (trace_enabled()) {
+        trace_write(g_config.trace_file);
+    }
+    
     if (g_midi) {
         if (g_config.midi_driver == MIDI_DRIVER_JACK)
             midi_jack_cleanup(g_midi);
+        else if (g_config.midi_driver == MIDI_DRIVER_PIPE)
+            midi_pipe_cleanup(g_midi);
+        else if (g_config.midi_driver == MIDI_DRIVER_PIPEWIRE)
+            midi_pipewire_cleanup(g_midi);
         else
             midi_alsa_cleanup(g_midi);
         g_midi = NULL;
     }
     
+    if (g_osc) {
+        osc_cleanup(g_osc);
+        g_osc = NULL;
+    }
+    
+    if (g_rtp) {
+        rtp_midi_cleanup(g_rtp);
+        g_rtp = NULL;
+    }
+    
+    if (g_lazy) {
+        lazy_start_cleanup(g_lazy);
+        g_lazy = NULL;
+    }
+    
+    if (g_cache) {
+        sample_cache_cleanup(g_cache);
+        g_cache = NULL;
+    }
+    
     if (g_synth) {
         synth_cleanup(g_synth);
         g_synth = NULL;
     }
     
+    if (g_loop) {
+        event_loop_destroy(g_loop);
+        g_loop = NULL;
+    }
+    
     if (g_audio) {
         audio_cleanup(g_audio);
         g_audio = NULL;
     }
     
+    trace_stop();
     config_cleanup(&g_config);
 }
 
@@ -498,19 +751,38 @@ static int main_loop(void) {
             reload_configuration();
         }
         
-        /* Process MIDI events */
+        /* Handle status request */
+        if (g_print_status) {
+            g_print_status = 0;
+            log_status();
+        }
+        
+        /* Handle All Notes Off request */
+        if (g_all_notes_off) {
+            g_all_notes_off = 0;
+            all_notes_off();
+        }
+        
+        /* Wait for non-real-time I/O; signals interrupt the wait */
+        if (event_loop_run_once(g_loop, 100) < 0) {
+            syslog(LOG_ERR, "Critical error in I/O event loop");
+            break;
+        }
+        
+        /* MIDI input runs on driver threads; this only checks their state */
         int ret = 0;
         if (g_config.midi_driver == MIDI_DRIVER_JACK)
-            ret = midi_jack_process_events(g_midi, 100);
+            ret = midi_jack_process_events(g_midi, 0);
+        else if (g_config.midi_driver == MIDI_DRIVER_PIPE)
+            ret = midi_pipe_process_events(g_midi, 0);
+        else if (g_config.midi_driver == MIDI_DRIVER_PIPEWIRE)
+            ret = midi_pipewire_process_events(g_midi, 0);
         else
-            ret = midi_alsa_process_events(g_midi, 100);
+            ret = midi_alsa_process_events(g_midi, 0);
         if (ret < 0) {
             syslog(LOG_ERR, "Critical error processing MIDI events");
             break;
         }
-        
-        /* Brief sleep to prevent busy waiting */
-        usleep(1000); /* 1ms */
     }
     
 #ifdef HAVE_SYSTEMD
@@ -533,6 +805,7 @@ int main(int argc, char *argv[]) {
     int quiet = 0;
     int test_config = 0;
     int no_realtime = 0;
+    int tune = 0;
     char *config_file = NULL;
     char *soundfont_override = NULL;
     char *user_override = NULL;
@@ -540,7 +813,7 @@ int main(int argc, char *argv[]) {
     int ret = EXIT_SUCCESS;
     
     /* Parse command line arguments */
-    while ((opt = getopt_long(argc, argv, "hvc:dVqts:nu:g:", long_options, &option_index)) != -1) {
+    while ((opt = getopt_long(argc, argv, "hvc:dVqts:nu:g:T", long_options, &option_index)) != -1) {
         switch (opt) {
             case 'h':
                 print_usage(argv[0]);
@@ -577,6 +850,9 @@ int main(int argc, char *argv[]) {
             case 'g':
                 group_override = optarg;
                 break;
+            case 'T':
+                tune = 1;
+                break;
             default:
                 fprintf(stderr, "Try '%s --help' for more information.\n", argv[0]);
                 exit(EXIT_FAILURE);
@@ -604,7 +880,7 @@ int main(int argc, char *argv[]) {
     
     /* Load and validate configuration */
     if (load_configuration(config_file, soundfont_override, user_override, 
-                          group_override, verbose, quiet, no_realtime) < 0) {
+                          group_override, verbose, quiet, no_realtime, daemonize) < 0) {
         ret = EXIT_FAILURE;
         goto cleanup;
     }
@@ -613,6 +889,7 @@ int main(int argc, char *argv[]) {
     if (test_config) {
         printf("Configuration test successful\n\n");
         config_print(&g_config);
+        print_memory_estimate(&g_config);
         goto cleanup;
     }
     
@@ -630,6 +907,16 @@ int main(int argc, char *argv[]) {
         goto cleanup;
     }
     
+    /* Run the latency tuner and exit if requested */
+    if (tune) {
+        char *user_path = config_file ? NULL : config_get_user_path();
+        if (tune_run(&g_config, config_file ? config_file : user_path) < 0) {
+            ret = EXIT_FAILURE;
+        }
+        free(user_path);
+        goto cleanup;
+    }
+    
     /* Daemonize if requested (before dropping privileges) */
     if (daemonize) {
         if (daemon_init() < 0) {
@@ -651,6 +938,10 @@ int main(int argc, char *argv[]) {
         goto cleanup;
     }
     
+    /* Registered after daemonizing, which changes the TID; the main thread
+     * keeps the process name so killall and systemd still match it */
+    threads_register("main", false);
+    
     /* Initialize all subsystem modules */
     if (initialize_modules() < 0) {
         ret = EXIT_FAILURE;
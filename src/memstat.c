@@ -0,0 +1,271 @@
+/*
+ * midisynthd - System-level MIDI Synthesizer Daemon for Linux
+ * Copyright (C) 2025 ArchLars
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include "memstat.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <syslog.h>
+
+/* In-memory size of FluidSynth's soundfont tables. Every preset and
+ * instrument zone carries a full generator table (63 entries of 32 bytes),
+ * which is what dominates metadata for large fonts. */
+#define MEMSTAT_PRESET_BYTES        256
+#define MEMSTAT_INST_BYTES          128
+#define MEMSTAT_ZONE_BYTES          2176
+#define MEMSTAT_MOD_BYTES           64
+#define MEMSTAT_SAMPLE_HDR_BYTES    160
+
+/* fluid_voice_t plus the two rvoices it renders through */
+#define MEMSTAT_VOICE_BYTES         4096
+
+/* Mixer: dry left/right plus reverb and chorus pairs, 8192 doubles each */
+#define MEMSTAT_MIX_BUFFERS         6
+#define MEMSTAT_MIX_FRAMES          8192
+
+/* SoundFont 2 record sizes in the pdta chunk */
+#define SF2_PHDR_SIZE   38
+#define SF2_BAG_SIZE    4
+#define SF2_MOD_SIZE    10
+#define SF2_INST_SIZE   22
+#define SF2_SHDR_SIZE   46
+
+static size_t mem_current[MEMSTAT_COUNT];
+static size_t mem_peak[MEMSTAT_COUNT];
+static size_t mem_total;
+static size_t mem_total_peak;
+
+static const char *category_names[MEMSTAT_COUNT] = {
+    [MEMSTAT_SAMPLES] = "samples",
+    [MEMSTAT_PRESETS] = "presets",
+    [MEMSTAT_VOICES]  = "voices",
+    [MEMSTAT_BUFFERS] = "buffers",
+    [MEMSTAT_QUEUES]  = "queues",
+};
+
+/**
+ * Raise a peak counter to at least value
+ */
+static void raise_peak(size_t *peak, size_t value) {
+    size_t old = __atomic_load_n(peak, __ATOMIC_RELAXED);
+    while (value > old &&
+           !__atomic_compare_exchange_n(peak, &old, value, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+void memstat_add(memstat_category_t category, size_t bytes) {
+    if (category < 0 || category >= MEMSTAT_COUNT || bytes == 0) return;
+    raise_peak(&mem_peak[category], __atomic_add_fetch(&mem_current[category], bytes, __ATOMIC_RELAXED));
+    raise_peak(&mem_total_peak, __atomic_add_fetch(&mem_total, bytes, __ATOMIC_RELAXED));
+}
+
+void memstat_sub(memstat_category_t category, size_t bytes) {
+    if (category < 0 || category >= MEMSTAT_COUNT || bytes == 0) return;
+    __atomic_sub_fetch(&mem_current[category], bytes, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&mem_total, bytes, __ATOMIC_RELAXED);
+}
+
+/**
+ * Read a "Key:   123 kB" line from /proc/self/status
+ */
+static size_t proc_status_kb(const char *buf, const char *key) {
+    const char *p = strstr(buf, key);
+    if (!p) return 0;
+    unsigned long long kb = 0;
+    if (sscanf(p + strlen(key), " %llu", &kb) != 1) return 0;
+    return (size_t)kb * 1024;
+}
+
+void memstat_get(memstat_t *stats) {
+    if (!stats) return;
+    memset(stats, 0, sizeof(*stats));
+    for (int i = 0; i < MEMSTAT_COUNT; i++) {
+        stats->current[i] = __atomic_load_n(&mem_current[i], __ATOMIC_RELAXED);
+        stats->peak[i] = __atomic_load_n(&mem_peak[i], __ATOMIC_RELAXED);
+    }
+    stats->total = __atomic_load_n(&mem_total, __ATOMIC_RELAXED);
+    stats->total_peak = __atomic_load_n(&mem_total_peak, __ATOMIC_RELAXED);
+
+    FILE *f = fopen("/proc/self/status", "r");
+    if (f) {
+        char buf[4096];
+        size_t n = fread(buf, 1, sizeof(buf) - 1, f);
+        buf[n] = '\0';
+        stats->rss = proc_status_kb(buf, "VmRSS:");
+        stats->rss_peak = proc_status_kb(buf, "VmHWM:");
+        fclose(f);
+    }
+}
+
+const char *memstat_category_name(memstat_category_t category) {
+    if (category < 0 || category >= MEMSTAT_COUNT) return "unknown";
+    return category_names[category];
+}
+
+static uint32_t read_le32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/**
+ * Walk the sub-chunks of a LIST chunk, adding up what they describe
+ */
+static int scan_list(FILE *f, const char *type, uint32_t end, memstat_sf2_t *est) {
+    uint8_t hdr[8];
+    while ((uint32_t)ftell(f) + 8 <= end && fread(hdr, 1, 8, f) == 8) {
+        uint32_t size = read_le32(hdr + 4);
+        long next = ftell(f) + (long)size + (size & 1);
+        if ((uint32_t)next > end) return -1;
+
+        if (strcmp(type, "sdta") == 0) {
+            if (memcmp(hdr, "smpl", 4) == 0) {
+                est->sample_bytes += size;
+            } else if (memcmp(hdr, "sm24", 4) == 0) {
+                est->sample_bytes += size;
+                est->sm24_bytes = size;
+                est->sm24_offset = ftell(f) - 8;
+            }
+        } else if (strcmp(type, "pdta") == 0) {
+            /* Each table ends with a terminal record that is not loaded */
+            int records;
+            if (memcmp(hdr, "phdr", 4) == 0) {
+                records = (int)(size / SF2_PHDR_SIZE) - 1;
+                est->presets += records > 0 ? records : 0;
+                est->metadata_bytes += (size_t)(records > 0 ? records : 0) * MEMSTAT_PRESET_BYTES;
+            } else if (memcmp(hdr, "inst", 4) == 0) {
+                records = (int)(size / SF2_INST_SIZE) - 1;
+                est->instruments += records > 0 ? records : 0;
+                est->metadata_bytes += (size_t)(records > 0 ? records : 0) * MEMSTAT_INST_BYTES;
+            } else if (memcmp(hdr, "pbag", 4) == 0 || memcmp(hdr, "ibag", 4) == 0) {
+                records = (int)(size / SF2_BAG_SIZE) - 1;
+                est->zones += records > 0 ? records : 0;
+                est->metadata_bytes += (size_t)(records > 0 ? records : 0) * MEMSTAT_ZONE_BYTES;
+            } else if (memcmp(hdr, "pmod", 4) == 0 || memcmp(hdr, "imod", 4) == 0) {
+                records = (int)(size / SF2_MOD_SIZE) - 1;
+                est->metadata_bytes += (size_t)(records > 0 ? records : 0) * MEMSTAT_MOD_BYTES;
+            } else if (memcmp(hdr, "shdr", 4) == 0) {
+                records = (int)(size / SF2_SHDR_SIZE) - 1;
+                est->samples += records > 0 ? records : 0;
+                est->metadata_bytes += (size_t)(records > 0 ? records : 0) * MEMSTAT_SAMPLE_HDR_BYTES;
+            }
+        }
+        if (fseek(f, next, SEEK_SET) != 0) return -1;
+    }
+    return 0;
+}
+
+int memstat_sf2_estimate(const char *path, memstat_sf2_t *est) {
+    if (!path || !est) return -1;
+    memset(est, 0, sizeof(*est));
+
+    FILE *f = fopen(path, "rb");
+    if (!f) return -1;
+
+    uint8_t hdr[12];
+    if (fread(hdr, 1, 12, f) != 12 || memcmp(hdr, "RIFF", 4) != 0 || memcmp(hdr + 8, "sfbk", 4) != 0) {
+        fclose(f);
+        return -1;
+    }
+    uint32_t riff_end = 8 + read_le32(hdr + 4);
+
+    int ret = 0;
+    while (ret == 0 && (uint32_t)ftell(f) + 12 <= riff_end && fread(hdr, 1, 12, f) == 12) {
+        uint32_t size = read_le32(hdr + 4);
+        uint32_t end = (uint32_t)ftell(f) - 4 + size;
+        if (memcmp(hdr, "LIST", 4) != 0 || end > riff_end) {
+            ret = -1;
+            break;
+        }
+        char type[5] = { 0 };
+        memcpy(type, hdr + 8, 4);
+        ret = scan_list(f, type, end, est);
+        if (ret == 0 && fseek(f, (long)end + (size & 1), SEEK_SET) != 0) ret = -1;
+    }
+
+    fclose(f);
+    return ret;
+}
+
+size_t memstat_voice_bytes(int polyphony) {
+    return polyphony > 0 ? (size_t)polyphony * MEMSTAT_VOICE_BYTES : 0;
+}
+
+size_t memstat_effect_bytes(int sample_rate) {
+    size_t mix = (size_t)MEMSTAT_MIX_BUFFERS * MEMSTAT_MIX_FRAMES * sizeof(double);
+    /* Reverb and chorus delay lines hold roughly half a second of audio */
+    size_t delay = sample_rate > 0 ? (size_t)sample_rate / 2 * sizeof(double) : 0;
+    return mix + delay;
+}
+
+/**
+ * Format a byte count with a binary unit
+ */
+static const char *format_bytes(char *buf, size_t size, size_t bytes) {
+    if (bytes >= 1024 * 1024) {
+        snprintf(buf, size, "%.1f MiB", (double)bytes / (1024.0 * 1024.0));
+    } else if (bytes >= 1024) {
+        snprintf(buf, size, "%.1f KiB", (double)bytes / 1024.0);
+    } else {
+        snprintf(buf, size, "%zu B", bytes);
+    }
+    return buf;
+}
+
+void memstat_log(const memstat_t *stats) {
+    if (!stats) return;
+
+    char line[512];
+    size_t len = 0;
+    char a[32], b[32], c[32], d[32];
+    for (int i = 0; i < MEMSTAT_COUNT; i++) {
+        len += (size_t)snprintf(line + len, sizeof(line) - len, "%s %s (peak %s), ",
+                                category_names[i],
+                                format_bytes(a, sizeof(a), stats->current[i]),
+                                format_bytes(b, sizeof(b), stats->peak[i]));
+        if (len >= sizeof(line)) return;
+    }
+    syslog(LOG_INFO, "Memory: %saccounted %s (peak %s), RSS %s (peak %s)", line,
+           format_bytes(a, sizeof(a), stats->total), format_bytes(b, sizeof(b), stats->total_peak),
+           format_bytes(c, sizeof(c), stats->rss), format_bytes(d, sizeof(d), stats->rss_peak));
+}
+
+void memstat_print(FILE *out, const memstat_t *stats) {
+    if (!out || !stats) return;
+
+    static const char *labels[MEMSTAT_COUNT] = {
+        [MEMSTAT_SAMPLES] = "Sample data",
+        [MEMSTAT_PRESETS] = "Preset metadata",
+        [MEMSTAT_VOICES]  = "Voice pool",
+        [MEMSTAT_BUFFERS] = "Effect buffers",
+        [MEMSTAT_QUEUES]  = "Queues and rings",
+    };
+    char a[32], b[32];
+    for (int i = 0; i < MEMSTAT_COUNT; i++) {
+        fprintf(out, "  %-19s %10s (peak %s)\n", labels[i],
+                format_bytes(a, sizeof(a), stats->current[i]),
+                format_bytes(b, sizeof(b), stats->peak[i]));
+    }
+    fprintf(out, "  %-19s %10s (peak %s)\n", "Total accounted",
+            format_bytes(a, sizeof(a), stats->total), format_bytes(b, sizeof(b), stats->total_peak));
+    if (stats->rss) {
+        fprintf(out, "  %-19s %10s (peak %s)\n", "Resident (RSS)",
+                format_bytes(a, sizeof(a), stats->rss), format_bytes(b, sizeof(b), stats->rss_peak));
+    }
+}
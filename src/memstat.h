@@ -0,0 +1,134 @@
+/*
+ * midisynthd - System-level MIDI Synthesizer Daemon for Linux
+ * Copyright (C) 2025 ArchLars
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef MIDISYNTHD_MEMSTAT_H
+#define MIDISYNTHD_MEMSTAT_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+/**
+ * Where accounted memory goes
+ */
+typedef enum {
+    MEMSTAT_SAMPLES = 0,        /* Sample data of loaded soundfonts */
+    MEMSTAT_PRESETS,            /* Preset, instrument and zone metadata */
+    MEMSTAT_VOICES,             /* Synthesis voice pool */
+    MEMSTAT_BUFFERS,            /* Mix, effect and period buffers */
+    MEMSTAT_QUEUES,             /* Event queues, packet buffers and I/O rings */
+    MEMSTAT_COUNT
+} memstat_category_t;
+
+/**
+ * Snapshot of accounted memory, in bytes
+ *
+ * FluidSynth does not report its allocations, so its categories (samples,
+ * metadata, voices, mix and effect buffers) are estimates from the
+ * soundfont files and settings; the daemon's own buffers are exact. The
+ * resident set size shows how much the accounting leaves out.
+ */
+typedef struct {
+    size_t current[MEMSTAT_COUNT];
+    size_t peak[MEMSTAT_COUNT];
+    size_t total;
+    size_t total_peak;
+    size_t rss;                 /* Resident set size (VmRSS), 0 if unknown */
+    size_t rss_peak;            /* Peak resident set size (VmHWM), 0 if unknown */
+} memstat_t;
+
+/**
+ * Memory a SoundFont 2 file occupies once loaded
+ */
+typedef struct {
+    size_t sample_bytes;        /* 16-bit sample data plus 24-bit extension */
+    size_t sm24_bytes;          /* 24-bit extension alone */
+    long sm24_offset;           /* File offset of the sm24 chunk header, 0 if none */
+    size_t metadata_bytes;      /* Estimated preset, instrument and zone tables */
+    int presets;
+    int instruments;
+    int zones;
+    int samples;
+} memstat_sf2_t;
+
+/**
+ * Account bytes to a category
+ *
+ * Safe to call from any thread.
+ *
+ * @param category Category the memory belongs to
+ * @param bytes Bytes allocated
+ */
+void memstat_add(memstat_category_t category, size_t bytes);
+
+/**
+ * Release bytes previously accounted with memstat_add()
+ *
+ * @param category Category the memory belonged to
+ * @param bytes Bytes freed
+ */
+void memstat_sub(memstat_category_t category, size_t bytes);
+
+/**
+ * Read current and peak usage, plus the process resident set size
+ *
+ * @param stats Receives the snapshot
+ */
+void memstat_get(memstat_t *stats);
+
+/**
+ * Human-readable category name
+ */
+const char *memstat_category_name(memstat_category_t category);
+
+/**
+ * Size up a SoundFont 2 file from its chunk headers without loading it
+ *
+ * @param path Soundfont file
+ * @param est Receives the sizes
+ * @return 0 on success, -1 if the file is not a readable SoundFont 2 file
+ */
+int memstat_sf2_estimate(const char *path, memstat_sf2_t *est);
+
+/**
+ * Estimated FluidSynth voice pool size for a polyphony
+ */
+size_t memstat_voice_bytes(int polyphony);
+
+/**
+ * Estimated FluidSynth mix buffer and reverb/chorus memory
+ */
+size_t memstat_effect_bytes(int sample_rate);
+
+/**
+ * Log usage and peaks as a single syslog line
+ *
+ * @param stats Snapshot from memstat_get()
+ */
+void memstat_log(const memstat_t *stats);
+
+/**
+ * Print usage as a table
+ *
+ * @param out Stream to print to
+ * @param stats Snapshot from memstat_get()
+ */
+void memstat_print(FILE *out, const memstat_t *stats);
+
+#endif /* MIDISYNTHD_MEMSTAT_H */
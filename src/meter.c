@@ -0,0 +1,221 @@
+/*
+ * midisynthd - System-level MIDI Synthesizer Daemon for Linux
+ * Copyright (C) 2025 ArchLars
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include "meter.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Four lanes: the width SSE2 and NEON compare natively, so the loop
+ * stays vectorized on baseline x86-64 and ARM builds */
+typedef float meter_vec_t __attribute__((vector_size(16)));
+typedef int32_t meter_mask_t __attribute__((vector_size(16)));
+#define METER_LANES ((int)(sizeof(meter_vec_t) / sizeof(float)))
+/* Reads of a snapshot tried while it is being written */
+#define METER_READ_TRIES 64
+
+/**
+ * Running sums of one window, rendering thread only
+ */
+typedef struct {
+    float peak;
+    double sumsq;
+} meter_acc_t;
+
+struct meter_s {
+    int window;                 /* Frames per snapshot */
+    int frames;                 /* Frames in the current window */
+    bool channel_levels;
+    meter_acc_t channels[METER_CHANNELS];
+    meter_acc_t master[2];
+    uint64_t windows;
+    uint64_t clipped;
+
+    /* Published snapshot; seq is odd while it is being written */
+    unsigned seq;
+    meter_snapshot_t snapshot;
+};
+
+/**
+ * Absolute value of each lane, by clearing the sign bits
+ */
+static inline meter_vec_t vec_abs(meter_vec_t v) {
+    return (meter_vec_t)((meter_mask_t)v & 0x7fffffff);
+}
+
+/**
+ * Larger of each pair of lanes
+ */
+static inline meter_vec_t vec_max(meter_vec_t a, meter_vec_t b) {
+    meter_mask_t larger = a > b;
+    return (meter_vec_t)(((meter_mask_t)a & larger) | ((meter_mask_t)b & ~larger));
+}
+
+void meter_block(const float *buf, int frames, float *peak, double *sumsq) {
+    /* Two sets of accumulators so consecutive vectors do not wait on each other */
+    meter_vec_t peak0 = { 0 }, peak1 = { 0 };
+    meter_vec_t sum0 = { 0 }, sum1 = { 0 };
+    int i = 0;
+    for (; i + 2 * METER_LANES <= frames; i += 2 * METER_LANES) {
+        meter_vec_t v0, v1;
+        memcpy(&v0, buf + i, sizeof(v0));
+        memcpy(&v1, buf + i + METER_LANES, sizeof(v1));
+        sum0 += v0 * v0;
+        sum1 += v1 * v1;
+        peak0 = vec_max(vec_abs(v0), peak0);
+        peak1 = vec_max(vec_abs(v1), peak1);
+    }
+    peak0 = vec_max(peak0, peak1);
+    sum0 += sum1;
+
+    float p = *peak;
+    float s = 0.0f;
+    for (int lane = 0; lane < METER_LANES; lane++) {
+        if (peak0[lane] > p) p = peak0[lane];
+        s += sum0[lane];
+    }
+    for (; i < frames; i++) {
+        float a = fabsf(buf[i]);
+        if (a > p) p = a;
+        s += buf[i] * buf[i];
+    }
+    *peak = p;
+    *sumsq += s;
+}
+
+meter_t *meter_create(int sample_rate, bool channel_levels) {
+    if (sample_rate <= 0) {
+        return NULL;
+    }
+    meter_t *meter = calloc(1, sizeof(meter_t));
+    if (!meter) {
+        return NULL;
+    }
+    meter->window = sample_rate / METER_RATE_HZ > 0 ? sample_rate / METER_RATE_HZ : 1;
+    meter->channel_levels = channel_levels;
+    meter->snapshot.channel_levels = channel_levels;
+    return meter;
+}
+
+void meter_destroy(meter_t *meter) {
+    free(meter);
+}
+
+void meter_add_channel(meter_t *meter, int channel, const float *left, const float *right, int frames) {
+    if (!meter || channel < 0 || channel >= METER_CHANNELS || frames <= 0) {
+        return;
+    }
+    meter_acc_t *acc = &meter->channels[channel];
+    if (left) meter_block(left, frames, &acc->peak, &acc->sumsq);
+    if (right) meter_block(right, frames, &acc->peak, &acc->sumsq);
+}
+
+void meter_add_master(meter_t *meter, const float *left, const float *right, int frames) {
+    if (!meter || frames <= 0) {
+        return;
+    }
+    if (left) meter_block(left, frames, &meter->master[0].peak, &meter->master[0].sumsq);
+    if (right) meter_block(right, frames, &meter->master[1].peak, &meter->master[1].sumsq);
+}
+
+static meter_level_t level_of(const meter_acc_t *acc, double samples) {
+    meter_level_t level = { acc->peak, (float)sqrt(acc->sumsq / samples) };
+    return level;
+}
+
+/**
+ * Publish the finished window and start the next one
+ */
+static void publish(meter_t *meter) {
+    meter->windows++;
+    if (meter->master[0].peak >= 1.0f || meter->master[1].peak >= 1.0f) {
+        meter->clipped++;
+    }
+
+    unsigned seq = meter->seq;
+    __atomic_store_n(&meter->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    meter_snapshot_t *snap = &meter->snapshot;
+    for (int ch = 0; ch < METER_CHANNELS; ch++) {
+        snap->channels[ch] = level_of(&meter->channels[ch], 2.0 * meter->frames);
+    }
+    snap->master[0] = level_of(&meter->master[0], meter->frames);
+    snap->master[1] = level_of(&meter->master[1], meter->frames);
+    snap->windows = meter->windows;
+    snap->clipped = meter->clipped;
+    __atomic_store_n(&meter->seq, seq + 2, __ATOMIC_RELEASE);
+
+    memset(meter->channels, 0, sizeof(meter->channels));
+    memset(meter->master, 0, sizeof(meter->master));
+    meter->frames = 0;
+}
+
+void meter_advance(meter_t *meter, int frames) {
+    if (!meter || frames <= 0) {
+        return;
+    }
+    meter->frames += frames;
+    if (meter->frames >= meter->window) {
+        publish(meter);
+    }
+}
+
+int meter_get(meter_t *meter, meter_snapshot_t *snapshot) {
+    if (!meter || !snapshot) {
+        return -1;
+    }
+    /* A write takes well under a microsecond; a writer preempted halfway
+     * must not hold the reader up */
+    for (int tries = 0; tries < METER_READ_TRIES; tries++) {
+        unsigned seq = __atomic_load_n(&meter->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1) {
+            continue;
+        }
+        memcpy(snapshot, &meter->snapshot, sizeof(*snapshot));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&meter->seq, __ATOMIC_RELAXED) == seq) {
+            return 0;
+        }
+    }
+    memset(snapshot, 0, sizeof(*snapshot));
+    return -1;
+}
+
+void meter_merge(meter_snapshot_t *into, const meter_snapshot_t *from) {
+    if (!into || !from || !from->channel_levels) {
+        return;
+    }
+    for (int ch = 0; ch < METER_CHANNELS; ch++) {
+        meter_level_t *a = &into->channels[ch];
+        const meter_level_t *b = &from->channels[ch];
+        if (b->peak > a->peak) a->peak = b->peak;
+        a->rms = sqrtf(a->rms * a->rms + b->rms * b->rms);
+    }
+    into->channel_levels = true;
+}
+
+float meter_to_db(float level) {
+    if (level <= 0.0f) {
+        return METER_FLOOR_DB;
+    }
+    float db = 20.0f * log10f(level);
+    return db < METER_FLOOR_DB ? METER_FLOOR_DB : db;
+}
@@ -0,0 +1,143 @@
+/*
+ * midisynthd - System-level MIDI Synthesizer Daemon for Linux
+ * Copyright (C) 2025 ArchLars
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef MIDISYNTHD_METER_H
+#define MIDISYNTHD_METER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* MIDI channels metered */
+#define METER_CHANNELS          16
+/* Snapshots published per second of audio */
+#define METER_RATE_HZ           20
+/* Level reported for silence, in dBFS */
+#define METER_FLOOR_DB          -120.0f
+
+typedef struct meter_s meter_t;
+
+/**
+ * Peak and RMS level over one window, 1.0 is full scale
+ */
+typedef struct {
+    float peak;
+    float rms;
+} meter_level_t;
+
+/**
+ * Levels of the latest complete window
+ */
+typedef struct {
+    meter_level_t channels[METER_CHANNELS];  /* Left and right together */
+    meter_level_t master[2];                 /* Left and right output */
+    bool channel_levels;                     /* channels[] are measured */
+    uint64_t windows;                        /* Windows published, 0 before the first */
+    uint64_t clipped;                        /* Windows in which the master reached full scale */
+} meter_snapshot_t;
+
+/**
+ * Accumulate the peak and energy of a buffer
+ *
+ * Vectorized with the compiler's generic vector types, so it needs no
+ * particular instruction set.
+ *
+ * @param buf Samples
+ * @param frames Number of samples
+ * @param peak Raised to the largest absolute sample
+ * @param sumsq Increased by the sum of the squared samples
+ */
+void meter_block(const float *buf, int frames, float *peak, double *sumsq);
+
+/**
+ * Create meters publishing a snapshot every 1/METER_RATE_HZ s of audio
+ *
+ * @param sample_rate Sample rate in Hz
+ * @param channel_levels Channel levels will be fed with meter_add_channel()
+ * @return Meters, or NULL on allocation failure
+ */
+meter_t *meter_create(int sample_rate, bool channel_levels);
+
+/**
+ * Free meters; safe with NULL
+ */
+void meter_destroy(meter_t *meter);
+
+/**
+ * Add a MIDI channel's audio to the current window
+ *
+ * Called by the rendering thread; a channel may be fed several times per
+ * window, e.g. once per render chunk or from several sources.
+ *
+ * @param meter Meters
+ * @param channel MIDI channel 0-15
+ * @param left Left samples
+ * @param right Right samples
+ * @param frames Frames in each buffer
+ */
+void meter_add_channel(meter_t *meter, int channel, const float *left, const float *right, int frames);
+
+/**
+ * Add the mixed output to the current window
+ *
+ * @param meter Meters
+ * @param left Left samples
+ * @param right Right samples
+ * @param frames Frames in each buffer
+ */
+void meter_add_master(meter_t *meter, const float *left, const float *right, int frames);
+
+/**
+ * Advance the window by the frames just rendered
+ *
+ * Publishes a snapshot and starts a new window once a window's worth
+ * of frames has passed. Never blocks.
+ *
+ * @param meter Meters
+ * @param frames Frames rendered since the last call
+ */
+void meter_advance(meter_t *meter, int frames);
+
+/**
+ * Get the latest snapshot; safe from any thread
+ *
+ * Gives up rather than wait when every read overlaps a write.
+ *
+ * @param meter Meters
+ * @param snapshot Receives the levels, zeroed on failure
+ * @return 0 on success, -1 on error or when no consistent snapshot was read
+ */
+int meter_get(meter_t *meter, meter_snapshot_t *snapshot);
+
+/**
+ * Add another engine's channel levels into a snapshot
+ *
+ * Peaks take the larger value and RMS levels add as uncorrelated signals.
+ *
+ * @param into Snapshot updated
+ * @param from Snapshot whose channel levels are added
+ */
+void meter_merge(meter_snapshot_t *into, const meter_snapshot_t *from);
+
+/**
+ * Convert a level to dBFS, METER_FLOOR_DB for silence
+ */
+float meter_to_db(float level);
+
+#endif /* MIDISYNTHD_METER_H */
@@ -26,30 +26,140 @@
 #include <fluidsynth/midi.h>
 #include "midi_alsa.h"
 #include "synth.h"
+#include "midi_router.h"
+#include "threads.h"
+#include "rt_sentinel.h"
+#include "trace.h"
 
 struct midi_alsa_s {
     fluid_midi_driver_t *driver;
     fluid_settings_t *settings;
     synth_t *synth;
     fluid_synth_t *fluid_synth;
+    midi_router_t *router;
     bool initialized;
 };
 
+/**
+ * Run an event through the routing tables, rewriting it in place
+ * @return true if the event should be delivered
+ */
+static bool route_event(const midi_router_t *router, fluid_midi_event_t *event) {
+    int type = fluid_midi_event_get_type(event);
+    uint8_t msg[3] = { (uint8_t)type, 0, 0 };
+
+    if (type < 0xF0) {
+        msg[0] |= (uint8_t)(fluid_midi_event_get_channel(event) & 0x0F);
+        switch (type) {
+            case 0x80:
+            case 0x90:
+            case 0xA0:
+                msg[1] = (uint8_t)fluid_midi_event_get_key(event);
+                msg[2] = (uint8_t)fluid_midi_event_get_velocity(event);
+                break;
+            case 0xB0:
+                msg[1] = (uint8_t)fluid_midi_event_get_control(event);
+                break;
+            default:
+                break;
+        }
+    }
+
+    if (!midi_router_apply(router, msg, sizeof(msg))) {
+        return false;
+    }
+
+    if (type < 0xF0) {
+        fluid_midi_event_set_channel(event, msg[0] & 0x0F);
+        if (type == 0x80 || type == 0x90 || type == 0xA0) {
+            fluid_midi_event_set_key(event, msg[1]);
+        }
+        if (type == 0x90) {
+            fluid_midi_event_set_velocity(event, msg[2]);
+        }
+    }
+    return true;
+}
+
+/**
+ * Rebuild the MIDI bytes of a channel event
+ * @return Message length, or 1 for system messages, which carry no data here
+ */
+static size_t event_to_bytes(fluid_midi_event_t *event, uint8_t msg[3]) {
+    int type = fluid_midi_event_get_type(event);
+    msg[0] = (uint8_t)type;
+    msg[1] = msg[2] = 0;
+
+    if (type >= 0xF0) {
+        return 1;
+    }
+    msg[0] |= (uint8_t)(fluid_midi_event_get_channel(event) & 0x0F);
+    switch (type) {
+        case 0x80:
+        case 0x90:
+        case 0xA0:
+            msg[1] = (uint8_t)fluid_midi_event_get_key(event);
+            msg[2] = (uint8_t)fluid_midi_event_get_velocity(event);
+            return 3;
+        case 0xB0:
+            msg[1] = (uint8_t)fluid_midi_event_get_control(event);
+            msg[2] = (uint8_t)fluid_midi_event_get_value(event);
+            return 3;
+        case 0xC0:
+        case 0xD0:
+            msg[1] = (uint8_t)fluid_midi_event_get_program(event);
+            return 2;
+        case 0xE0: {
+            int bend = fluid_midi_event_get_pitch(event);
+            msg[1] = (uint8_t)(bend & 0x7F);
+            msg[2] = (uint8_t)((bend >> 7) & 0x7F);
+            return 3;
+        }
+        default:
+            return 1;
+    }
+}
+
 /**
  * MIDI event handler callback
  * This function is called by FluidSynth's MIDI driver when MIDI events are received
  */
-static int midi_event_handler(void *data, fluid_midi_event_t *event) {
-    midi_alsa_t *midi = (midi_alsa_t *)data;
-    
+static int handle_event(midi_alsa_t *midi, fluid_midi_event_t *event) {
     if (!midi || !midi->fluid_synth || !event) {
         return FLUID_FAILED;
     }
     
+    if (midi->router && !route_event(midi->router, event)) {
+        return FLUID_OK;
+    }
+
+    /* Held back by lazy start, or timed by the playback engine's queue */
+    uint8_t msg[3];
+    size_t len = event_to_bytes(event, msg);
+    if (synth_defer_midi(midi->synth, msg, len)) {
+        return FLUID_OK;
+    }
+    /* Channel messages go through the synth, which tracks the notes each
+     * channel plays for shedding, times preset loads for the sample cache
+     * and mixes channel 10 from the percussion cache */
+    if (len > 1) {
+        return synth_process_midi_data(midi->synth, msg, len) == 0 ? FLUID_OK : FLUID_FAILED;
+    }
+
     /* Let FluidSynth handle the MIDI event directly */
     return fluid_synth_handle_midi_event(midi->fluid_synth, event);
 }
 
+static int midi_event_handler(void *data, fluid_midi_event_t *event) {
+    threads_register("msd-alsa-midi", true);
+    RT_SENTINEL_ENTER();
+    uint64_t span = trace_begin();
+    int ret = handle_event((midi_alsa_t *)data, event);
+    trace_end(span, "alsa-midi", 1);
+    RT_SENTINEL_LEAVE();
+    return ret;
+}
+
 /**
  * Initialize ALSA MIDI input system
  */
@@ -106,12 +216,21 @@ midi_alsa_t *midi_alsa_init(const midisynthd_config_t *config, synth_t *synth) {
         }
     }
 
+    /* Routing tables are only consulted when rules are configured */
+    midi_router_t *router = midi_router_create(config);
+    if (midi_router_is_active(router)) {
+        midi->router = router;
+    } else {
+        midi_router_destroy(router);
+    }
+
     /* Create the MIDI driver with our event handler */
     midi->driver = new_fluid_midi_driver(midi->settings,
                                          midi_event_handler,
                                          midi);
     if (!midi->driver) {
         syslog(LOG_ERR, "Failed to create FluidSynth MIDI driver");
+        midi_router_destroy(midi->router);
         free(midi);
         return NULL;
     }
@@ -215,6 +334,10 @@ void midi_alsa_cleanup(midi_alsa_t *midi) {
         delete_fluid_midi_driver(midi->driver);
         midi->driver = NULL;
     }
+
+    /* Freed after the driver so its thread can no longer use it */
+    midi_router_destroy(midi->router);
+    midi->router = NULL;
     
     midi->initialized = false;
     midi->settings = NULL; /* Don't delete - owned by synth module */
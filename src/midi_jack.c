@@ -7,85 +7,82 @@
 #include <string.h>
 #include <syslog.h>
 #include <unistd.h>
-#include <alsa/asoundlib.h>
+#include <poll.h>
+#include "midi_parser.h"
+#include "midi_router.h"
+#include "threads.h"
+#include "rt_sentinel.h"
+#include "trace.h"
 
 struct midi_jack_s {
     jack_client_t *client;
     jack_port_t *in_port;
     synth_t *synth;
+    midi_parser_t parser;       /* Only touched by the process callback */
+    midi_router_t *router;
     bool initialized;
+
+    /* Freewheel state, written by the JACK freewheel callback */
+    bool freewheel;
+    bool freewheel_synced;      /* The synth renders through JACK and follows */
+    bool freewheel_logged;      /* State last reported by the main loop */
+    bool cycle_scheduled;       /* This cycle's events are queued by frame */
+    uint64_t event_frame;       /* Target frame of the event being parsed */
+    uint64_t freewheel_cycles;
 };
 
-static void handle_event(midi_jack_t *midi, const jack_midi_event_t *ev) {
-    if (!midi || !midi->synth || !ev || ev->size == 0) return;
-    const uint8_t *d = ev->buffer;
-    uint8_t status = d[0];
-    int ch = status & 0x0F;
-    snd_seq_event_t sev; 
-    snd_seq_ev_clear(&sev);
-
-    switch (status & 0xF0) {
-        case 0x90: /* Note on */
-            if (ev->size >= 3) {
-                sev.type = SND_SEQ_EVENT_NOTEON;
-                sev.data.note.channel = ch;
-                sev.data.note.note = d[1];
-                sev.data.note.velocity = d[2];
-                synth_handle_midi_event(midi->synth, &sev);
-            }
-            break;
-        case 0x80: /* Note off */
-            if (ev->size >= 3) {
-                sev.type = SND_SEQ_EVENT_NOTEOFF;
-                sev.data.note.channel = ch;
-                sev.data.note.note = d[1];
-                sev.data.note.velocity = d[2];
-                synth_handle_midi_event(midi->synth, &sev);
-            }
-            break;
-        case 0xB0: /* Control change */
-            if (ev->size >= 3) {
-                sev.type = SND_SEQ_EVENT_CONTROLLER;
-                sev.data.control.channel = ch;
-                sev.data.control.param = d[1];
-                sev.data.control.value = d[2];
-                synth_handle_midi_event(midi->synth, &sev);
-            }
-            break;
-        case 0xC0: /* Program change */
-            if (ev->size >= 2) {
-                sev.type = SND_SEQ_EVENT_PGMCHANGE;
-                sev.data.control.channel = ch;
-                sev.data.control.value = d[1];
-                synth_handle_midi_event(midi->synth, &sev);
-            }
-            break;
-        case 0xE0: /* Pitch bend */
-            if (ev->size >= 3) {
-                sev.type = SND_SEQ_EVENT_PITCHBEND;
-                sev.data.control.channel = ch;
-                sev.data.control.value = ((d[2] << 7) | d[1]) - 8192;
-                synth_handle_midi_event(midi->synth, &sev);
-            }
-            break;
-        default:
-            break;
-    }
+/**
+ * Parser callback applying the routing tables before dispatch
+ *
+ * While freewheeling, channel messages are queued at their frame in the
+ * cycle so the export matches the timeline rather than JACK's pace.
+ */
+static void dispatch_event(void *data, const uint8_t *msg, size_t len) {
+    midi_jack_t *midi = data;
+    midi_parser_route_synth(midi->router, midi->synth, msg, len, midi->cycle_scheduled, midi->event_frame);
 }
 
 static int process_callback(jack_nframes_t nframes, void *arg) {
     midi_jack_t *midi = arg;
+    threads_register("msd-jack-midi", true);
+    RT_SENTINEL_ENTER();
+    uint64_t span = trace_begin();
     void *buf = jack_port_get_buffer(midi->in_port, nframes);
     uint32_t count = jack_midi_get_event_count(buf);
+
+    /* Freewheeling the render clock stands still between periods. Whether
+     * the synth's JACK client runs before or after this one in the cycle,
+     * every event lands at the same offset and the spacing is exact. */
+    uint64_t base = 0;
+    midi->cycle_scheduled = __atomic_load_n(&midi->freewheel_synced, __ATOMIC_ACQUIRE);
+    if (midi->cycle_scheduled) {
+        base = synth_get_frame_time(midi->synth);
+        midi->freewheel_cycles++;
+    }
+
     for (uint32_t i = 0; i < count; i++) {
         jack_midi_event_t ev;
-        if (jack_midi_event_get(&ev, buf, i) == 0) {
-            handle_event(midi, &ev);
+        /* Raw bytes go straight to the synth; one JACK event may carry
+         * several messages or running-status continuations */
+        if (jack_midi_event_get(&ev, buf, i) == 0 && ev.size > 0) {
+            midi->event_frame = base + ev.time;
+            midi_parser_feed(&midi->parser, ev.buffer, ev.size);
         }
     }
+    if (count > 0) {
+        trace_end(span, "jack-midi", count);
+    }
+    RT_SENTINEL_LEAVE();
     return 0;
 }
 
+static void freewheel_callback(int starting, void *arg) {
+    midi_jack_t *midi = arg;
+    bool synced = synth_set_freewheel(midi->synth, starting != 0) == 0 && starting;
+    __atomic_store_n(&midi->freewheel_synced, synced, __ATOMIC_RELEASE);
+    __atomic_store_n(&midi->freewheel, starting != 0, __ATOMIC_RELEASE);
+}
+
 midi_jack_t *midi_jack_init(const midisynthd_config_t *config, synth_t *synth) {
     if (!config || !synth) {
         syslog(LOG_ERR, "Invalid parameters for JACK MIDI init");
@@ -96,10 +93,19 @@ midi_jack_t *midi_jack_init(const midisynthd_config_t *config, synth_t *synth) {
     if (!midi) return NULL;
     midi->synth = synth;
 
+    midi_router_t *router = midi_router_create(config);
+    if (midi_router_is_active(router)) {
+        midi->router = router;
+    } else {
+        midi_router_destroy(router);
+    }
+    midi_parser_init(&midi->parser, dispatch_event, midi);
+
     jack_status_t status = 0;
     midi->client = jack_client_open(config->client_name, JackNoStartServer, &status);
     if (!midi->client) {
         syslog(LOG_ERR, "Failed to open JACK client");
+        midi_router_destroy(midi->router);
         free(midi);
         return NULL;
     }
@@ -109,14 +115,17 @@ midi_jack_t *midi_jack_init(const midisynthd_config_t *config, synth_t *synth) {
     if (!midi->in_port) {
         syslog(LOG_ERR, "Failed to register JACK MIDI port");
         jack_client_close(midi->client);
+        midi_router_destroy(midi->router);
         free(midi);
         return NULL;
     }
 
     jack_set_process_callback(midi->client, process_callback, midi);
+    jack_set_freewheel_callback(midi->client, freewheel_callback, midi);
     if (jack_activate(midi->client) != 0) {
         syslog(LOG_ERR, "Failed to activate JACK client");
         jack_client_close(midi->client);
+        midi_router_destroy(midi->router);
         free(midi);
         return NULL;
     }
@@ -138,6 +147,20 @@ midi_jack_t *midi_jack_init(const midisynthd_config_t *config, synth_t *synth) {
 
 int midi_jack_process_events(midi_jack_t *midi, int timeout_ms) {
     if (!midi || !midi->initialized) return -1;
+
+    bool freewheel = __atomic_load_n(&midi->freewheel, __ATOMIC_ACQUIRE);
+    if (freewheel != midi->freewheel_logged) {
+        midi->freewheel_logged = freewheel;
+        if (!freewheel) {
+            syslog(LOG_INFO, "JACK freewheel ended");
+        } else if (__atomic_load_n(&midi->freewheel_synced, __ATOMIC_ACQUIRE)) {
+            syslog(LOG_INFO, "JACK freewheel started, rendering cycle by cycle");
+        } else {
+            syslog(LOG_WARNING, "JACK freewheel started, but audio is not rendered through JACK; "
+                   "use audio_driver=jack for offline export");
+        }
+    }
+
     if (timeout_ms > 0) poll(NULL, 0, timeout_ms);
     return 0;
 }
@@ -148,12 +171,24 @@ int midi_jack_disconnect_all(midi_jack_t *midi) {
     return 0;
 }
 
+int midi_jack_get_stats(midi_jack_t *midi, midi_parser_stats_t *stats) {
+    if (!midi || !stats) return -1;
+    *stats = midi->parser.stats;
+    return 0;
+}
+
 void midi_jack_cleanup(midi_jack_t *midi) {
     if (!midi) return;
     if (midi->client) {
         jack_client_close(midi->client);
         midi->client = NULL;
+        midi_parser_log_stats(&midi->parser.stats, "JACK MIDI");
+        if (midi->freewheel_cycles > 0) {
+            syslog(LOG_INFO, "JACK MIDI: %llu freewheel cycles",
+                   (unsigned long long)midi->freewheel_cycles);
+        }
     }
+    midi_router_destroy(midi->router);
     free(midi);
 }
 
@@ -3,6 +3,7 @@
 
 #include "config.h"
 #include "synth.h"
+#include "midi_parser.h"
 
 #ifdef HAVE_JACK
 #include <jack/jack.h>
@@ -15,5 +16,6 @@ midi_jack_t *midi_jack_init(const midisynthd_config_t *config, synth_t *synth);
 void midi_jack_cleanup(midi_jack_t *midi);
 int midi_jack_process_events(midi_jack_t *midi, int timeout_ms);
 int midi_jack_disconnect_all(midi_jack_t *midi);
+int midi_jack_get_stats(midi_jack_t *midi, midi_parser_stats_t *stats);
 
 #endif /* MIDI_JACK_H */
@@ -0,0 +1,222 @@
+/*
+ * midisynthd - System-level MIDI Synthesizer Daemon for Linux
+ * Copyright (C) 2025 ArchLars
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include "midi_parser.h"
+#include "synth.h"
+
+#include <string.h>
+#include <syslog.h>
+
+/**
+ * Data bytes following a status byte (0x80-0xF6)
+ */
+static uint8_t data_length(uint8_t status) {
+    switch (status & 0xF0) {
+        case 0xC0:
+        case 0xD0:
+            return 1;
+        case 0xF0:
+            switch (status) {
+                case 0xF1: return 1;    /* MTC quarter frame */
+                case 0xF2: return 2;    /* Song position */
+                case 0xF3: return 1;    /* Song select */
+                default:   return 0;    /* Tune request, undefined */
+            }
+        default:
+            return 2;
+    }
+}
+
+/**
+ * Count a completed message by type
+ */
+static void count_message(midi_parser_t *p, const uint8_t *msg) {
+    switch (msg[0] & 0xF0) {
+        case 0x80: p->stats.note_off++; break;
+        case 0x90:
+            if (msg[2] == 0) p->stats.note_off++;
+            else p->stats.note_on++;
+            break;
+        case 0xA0: p->stats.key_pressure++; break;
+        case 0xB0: p->stats.control_change++; break;
+        case 0xC0: p->stats.program_change++; break;
+        case 0xD0: p->stats.channel_pressure++; break;
+        case 0xE0: p->stats.pitch_bend++; break;
+        default:   p->stats.system_common++; break;
+    }
+}
+
+/**
+ * Abandon an unterminated SysEx
+ */
+static void abort_sysex(midi_parser_t *p) {
+    if (p->in_sysex) {
+        p->stats.errors++;
+        p->in_sysex = false;
+    }
+}
+
+void midi_parser_init(midi_parser_t *parser, midi_parser_emit_t emit, void *data) {
+    if (!parser) return;
+    memset(parser, 0, sizeof(*parser));
+    parser->emit = emit;
+    parser->data = data;
+}
+
+void midi_parser_reset(midi_parser_t *parser) {
+    if (!parser) return;
+    parser->status = 0;
+    parser->count = 0;
+    parser->in_sysex = false;
+}
+
+int midi_parser_feed(midi_parser_t *p, const uint8_t *bytes, size_t len) {
+    if (!p || !bytes) return 0;
+
+    int emitted = 0;
+    for (size_t i = 0; i < len; i++) {
+        uint8_t b = bytes[i];
+
+        /* Real-time bytes may appear anywhere, even inside other messages */
+        if (b >= 0xF8) {
+            p->stats.realtime++;
+            continue;
+        }
+
+        if (b == 0xF0) {
+            abort_sysex(p);
+            p->in_sysex = true;
+            p->sysex_overflow = false;
+            p->sysex[0] = b;
+            p->sysex_len = 1;
+            p->status = 0;
+            continue;
+        }
+
+        if (b == 0xF7) {
+            if (!p->in_sysex) {
+                p->stats.errors++;
+                continue;
+            }
+            p->in_sysex = false;
+            if (p->sysex_overflow) {
+                p->stats.errors++;
+                continue;
+            }
+            p->sysex[p->sysex_len++] = b;
+            p->stats.sysex++;
+            if (p->emit) p->emit(p->data, p->sysex, p->sysex_len);
+            emitted++;
+            continue;
+        }
+
+        if (b & 0x80) {
+            /* Any other status byte ends a SysEx and starts a message */
+            abort_sysex(p);
+            p->status = b;
+            p->msg[0] = b;
+            p->expected = data_length(b);
+            p->count = 0;
+            p->reused = false;
+
+            if (p->expected == 0) {
+                if (b == 0xF6) p->stats.system_common++;
+                else p->stats.errors++;     /* F4/F5 are undefined */
+                p->status = 0;
+            }
+            continue;
+        }
+
+        /* Data byte */
+        if (p->in_sysex) {
+            if (p->sysex_len < MIDI_PARSER_SYSEX_MAX - 1) {
+                p->sysex[p->sysex_len++] = b;
+            } else {
+                p->sysex_overflow = true;
+            }
+            continue;
+        }
+
+        if (p->status == 0) {
+            p->stats.errors++;
+            continue;
+        }
+
+        p->msg[1 + p->count++] = b;
+        if (p->count < p->expected) {
+            continue;
+        }
+
+        count_message(p, p->msg);
+        if (p->reused) p->stats.running_status++;
+        if (p->status < 0xF0) {
+            if (p->emit) p->emit(p->data, p->msg, 1 + (size_t)p->expected);
+            emitted++;
+            p->reused = true;       /* Further data bytes reuse this status */
+        } else {
+            p->status = 0;          /* System common cancels running status */
+        }
+        p->count = 0;
+    }
+
+    return emitted;
+}
+
+void midi_parser_log_stats(const midi_parser_stats_t *stats, const char *source) {
+    if (!stats) return;
+    syslog(LOG_INFO, "%s: %llu note on, %llu note off, %llu poly pressure, %llu CC, "
+           "%llu program, %llu channel pressure, %llu pitch bend, %llu SysEx, "
+           "%llu system, %llu realtime, %llu running status, %llu errors",
+           source ? source : "MIDI",
+           (unsigned long long)stats->note_on, (unsigned long long)stats->note_off,
+           (unsigned long long)stats->key_pressure, (unsigned long long)stats->control_change,
+           (unsigned long long)stats->program_change, (unsigned long long)stats->channel_pressure,
+           (unsigned long long)stats->pitch_bend, (unsigned long long)stats->sysex,
+           (unsigned long long)stats->system_common, (unsigned long long)stats->realtime,
+           (unsigned long long)stats->running_status, (unsigned long long)stats->errors);
+}
+
+void midi_parser_dispatch_synth(void *synth, const uint8_t *msg, size_t len) {
+    if (msg[0] == MIDI_SYSTEM_EXCLUSIVE) {
+        synth_sysex((synth_t *)synth, msg, len);
+    } else {
+        synth_process_midi_data((synth_t *)synth, msg, len);
+    }
+}
+
+int midi_parser_route_synth(const midi_router_t *router, void *synth, const uint8_t *msg,
+                            size_t len, bool schedule, uint64_t frame) {
+    uint8_t buf[3];
+
+    if (len > sizeof(buf)) {
+        uint8_t status = msg[0];
+        if (!midi_router_apply(router, &status, 1)) return -1;
+        midi_parser_dispatch_synth(synth, msg, len);
+        return 0;
+    }
+
+    memcpy(buf, msg, len);
+    if (!midi_router_apply(router, buf, len)) return -1;
+    if (schedule && buf[0] < 0xF0 && synth_schedule_midi((synth_t *)synth, frame, buf, len) == 0) {
+        return 1;
+    }
+    midi_parser_dispatch_synth(synth, buf, len);
+    return 0;
+}
@@ -0,0 +1,149 @@
+/*
+ * midisynthd - System-level MIDI Synthesizer Daemon for Linux
+ * Copyright (C) 2025 ArchLars
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef MIDISYNTHD_MIDI_PARSER_H
+#define MIDISYNTHD_MIDI_PARSER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "midi_router.h"
+
+/* Longest SysEx message kept, including F0 and F7; longer ones are dropped */
+#define MIDI_PARSER_SYSEX_MAX   256
+
+/**
+ * Callback receiving each complete message
+ *
+ * Channel messages arrive with their status byte even when they were sent
+ * with running status. SysEx messages include the leading F0 and trailing
+ * F7 bytes.
+ *
+ * @param data User data given to midi_parser_init()
+ * @param msg Message bytes
+ * @param len Message length
+ */
+typedef void (*midi_parser_emit_t)(void *data, const uint8_t *msg, size_t len);
+
+/**
+ * Per-type message counters
+ */
+typedef struct {
+    uint64_t note_on;
+    uint64_t note_off;          /* Includes note on with velocity 0 */
+    uint64_t key_pressure;
+    uint64_t control_change;
+    uint64_t program_change;
+    uint64_t channel_pressure;
+    uint64_t pitch_bend;
+    uint64_t sysex;
+    uint64_t system_common;     /* MTC quarter frame, song position/select, tune request */
+    uint64_t realtime;          /* Clock, start/stop, active sensing, reset */
+    uint64_t running_status;    /* Messages that reused the previous status */
+    uint64_t errors;            /* Stray data bytes, truncated or oversized SysEx */
+} midi_parser_stats_t;
+
+/**
+ * Stateful raw MIDI byte stream decoder
+ *
+ * Allocation-free and safe to use from a real-time thread. Declared in
+ * the header so drivers can embed it in their own state.
+ */
+typedef struct {
+    midi_parser_emit_t emit;
+    void *data;
+
+    uint8_t status;             /* Current (running) status, 0 if none */
+    uint8_t msg[3];
+    uint8_t expected;           /* Data bytes the current status takes */
+    uint8_t count;              /* Data bytes received so far */
+    bool reused;                /* Current message uses running status */
+
+    bool in_sysex;
+    bool sysex_overflow;
+    size_t sysex_len;
+    uint8_t sysex[MIDI_PARSER_SYSEX_MAX];
+
+    midi_parser_stats_t stats;
+} midi_parser_t;
+
+/**
+ * Initialize a parser
+ *
+ * @param parser Parser to initialize
+ * @param emit Callback for complete messages
+ * @param data User data passed to @p emit
+ */
+void midi_parser_init(midi_parser_t *parser, midi_parser_emit_t emit, void *data);
+
+/**
+ * Forget running status and any partial message, keeping the counters
+ *
+ * @param parser Parser instance
+ */
+void midi_parser_reset(midi_parser_t *parser);
+
+/**
+ * Decode a chunk of the byte stream
+ *
+ * Messages may span chunks, and one chunk may hold several messages.
+ *
+ * @param parser Parser instance
+ * @param bytes Raw MIDI bytes
+ * @param len Number of bytes
+ * @return Number of messages emitted
+ */
+int midi_parser_feed(midi_parser_t *parser, const uint8_t *bytes, size_t len);
+
+/**
+ * Log the counters of a parser at info level
+ *
+ * @param stats Counters to log
+ * @param source Name of the input, e.g. "JACK MIDI"
+ */
+void midi_parser_log_stats(const midi_parser_stats_t *stats, const char *source);
+
+/**
+ * Emit callback that dispatches messages to a synth_t
+ *
+ * Pass the synthesizer as user data to midi_parser_init().
+ */
+void midi_parser_dispatch_synth(void *synth, const uint8_t *msg, size_t len);
+
+/**
+ * Route a message, then queue or dispatch it to a synth_t
+ *
+ * Messages of up to three bytes are rewritten by the routing tables in a
+ * copy. SysEx is passed or dropped as a whole, never rewritten, and always
+ * applied at once. With @p schedule set, routed channel messages are
+ * queued at @p frame and dispatched at once only if the queue is full.
+ *
+ * @param router Routing tables, or NULL to pass messages unchanged
+ * @param synth Synthesizer instance
+ * @param msg Complete message
+ * @param len Message length
+ * @param schedule Queue channel messages rather than dispatch them
+ * @param frame Render frame for queued messages
+ * @return 1 if queued, 0 if dispatched, -1 if the router dropped it
+ */
+int midi_parser_route_synth(const midi_router_t *router, void *synth, const uint8_t *msg,
+                            size_t len, bool schedule, uint64_t frame);
+
+#endif /* MIDISYNTHD_MIDI_PARSER_H */
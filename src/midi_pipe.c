@@ -0,0 +1,394 @@
+/*
+ * midisynthd - System-level MIDI Synthesizer Daemon for Linux
+ * Copyright (C) 2025 ArchLars
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include "midi_pipe.h"
+#include "midi_router.h"
+#include "memstat.h"
+#include "monotonic.h"
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <syslog.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+/* Chunks read per wakeup before yielding to other descriptors */
+#define MIDI_PIPE_READS_PER_WAKEUP  16
+
+typedef enum {
+    PIPE_MODE_STDIN = 0,
+    PIPE_MODE_FIFO,
+    PIPE_MODE_SOCKET
+} pipe_mode_t;
+
+struct midi_pipe_s;
+
+typedef struct {
+    int fd;                     /* -1 when the slot is free */
+    midi_parser_t parser;
+    struct midi_pipe_s *owner;
+} pipe_source_t;
+
+struct midi_pipe_s {
+    synth_t *synth;
+    event_loop_t *loop;
+    midi_router_t *router;
+
+    pipe_mode_t mode;
+    char path[CONFIG_MAX_PATH_LEN];
+    int listen_fd;
+    int keepalive_fd;           /* Write end held open so the FIFO never reports EOF */
+    int stdin_flags;
+    bool created_path;
+
+    pipe_source_t sources[MIDI_PIPE_MAX_CLIENTS];
+    midi_parser_stats_t closed_stats;
+    uint8_t buf[MIDI_PIPE_CHUNK];
+
+    uint64_t events;
+    uint64_t bytes;
+    uint64_t reads;
+    uint64_t busy_ns;
+    uint64_t start_ns;
+    bool initialized;
+};
+
+static void add_parser_stats(midi_parser_stats_t *sum, const midi_parser_stats_t *s) {
+    sum->note_on += s->note_on;
+    sum->note_off += s->note_off;
+    sum->key_pressure += s->key_pressure;
+    sum->control_change += s->control_change;
+    sum->program_change += s->program_change;
+    sum->channel_pressure += s->channel_pressure;
+    sum->pitch_bend += s->pitch_bend;
+    sum->sysex += s->sysex;
+    sum->system_common += s->system_common;
+    sum->realtime += s->realtime;
+    sum->running_status += s->running_status;
+    sum->errors += s->errors;
+}
+
+/**
+ * Parser callback: route, then dispatch to the synth
+ */
+static void dispatch_message(void *data, const uint8_t *msg, size_t len) {
+    pipe_source_t *src = data;
+    midi_pipe_t *midi = src->owner;
+    midi_parser_route_synth(midi->router, midi->synth, msg, len, false, 0);
+}
+
+static pipe_source_t *add_source(midi_pipe_t *midi, int fd);
+
+static void close_source(midi_pipe_t *midi, pipe_source_t *src) {
+    event_loop_remove_fd(midi->loop, src->fd);
+    if (src->fd != STDIN_FILENO) {
+        close(src->fd);
+    }
+    add_parser_stats(&midi->closed_stats, &src->parser.stats);
+    src->fd = -1;
+}
+
+/**
+ * Drain a readable source in large chunks
+ */
+static void on_source_readable(void *data, int fd, uint32_t events) {
+    pipe_source_t *src = data;
+    midi_pipe_t *midi = src->owner;
+    (void)events;
+
+    for (int i = 0; i < MIDI_PIPE_READS_PER_WAKEUP; i++) {
+        ssize_t n = read(fd, midi->buf, sizeof(midi->buf));
+        if (n > 0) {
+            uint64_t t0 = monotonic_ns();
+            uint64_t span = trace_begin();
+            int emitted = midi_parser_feed(&src->parser, midi->buf, (size_t)n);
+            trace_end(span, "pipe-midi", emitted);
+            midi->busy_ns += monotonic_ns() - t0;
+            midi->events += (uint64_t)emitted;
+            midi->bytes += (uint64_t)n;
+            midi->reads++;
+            if ((size_t)n < sizeof(midi->buf)) break;
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        if (n < 0 && errno == EINTR) continue;
+
+        if (n == 0) {
+            syslog(LOG_INFO, "Pipe MIDI: %s closed",
+                   midi->mode == PIPE_MODE_SOCKET ? "client" : "input");
+        } else {
+            syslog(LOG_WARNING, "Pipe MIDI: read failed: %s", strerror(errno));
+        }
+        close_source(midi, src);
+        break;
+    }
+}
+
+static void on_accept(void *data, int fd, uint32_t events) {
+    midi_pipe_t *midi = data;
+    (void)events;
+
+    for (;;) {
+        int client = accept(fd, NULL, NULL);
+        if (client < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                syslog(LOG_WARNING, "Pipe MIDI: accept failed: %s", strerror(errno));
+            }
+            return;
+        }
+        fcntl(client, F_SETFL, fcntl(client, F_GETFL) | O_NONBLOCK);
+        fcntl(client, F_SETFD, FD_CLOEXEC);
+        if (!add_source(midi, client)) {
+            syslog(LOG_WARNING, "Pipe MIDI: too many clients, rejecting connection");
+            close(client);
+        } else {
+            syslog(LOG_INFO, "Pipe MIDI: client connected");
+        }
+    }
+}
+
+static pipe_source_t *add_source(midi_pipe_t *midi, int fd) {
+    for (int i = 0; i < MIDI_PIPE_MAX_CLIENTS; i++) {
+        pipe_source_t *src = &midi->sources[i];
+        if (src->fd >= 0) continue;
+
+        src->fd = fd;
+        src->owner = midi;
+        midi_parser_init(&src->parser, dispatch_message, src);
+        if (event_loop_add_fd(midi->loop, fd, on_source_readable, src) < 0) {
+            src->fd = -1;
+            return NULL;
+        }
+        return src;
+    }
+    return NULL;
+}
+
+static int open_stdin(midi_pipe_t *midi) {
+    midi->stdin_flags = fcntl(STDIN_FILENO, F_GETFL);
+    if (midi->stdin_flags < 0 ||
+        fcntl(STDIN_FILENO, F_SETFL, midi->stdin_flags | O_NONBLOCK) < 0) {
+        syslog(LOG_ERR, "Pipe MIDI: cannot use stdin: %s", strerror(errno));
+        return -1;
+    }
+    if (!add_source(midi, STDIN_FILENO)) {
+        fcntl(STDIN_FILENO, F_SETFL, midi->stdin_flags);
+        return -1;
+    }
+    return 0;
+}
+
+static int open_fifo(midi_pipe_t *midi) {
+    struct stat st;
+    if (stat(midi->path, &st) < 0) {
+        if (mkfifo(midi->path, 0660) < 0) {
+            syslog(LOG_ERR, "Pipe MIDI: cannot create FIFO %s: %s", midi->path, strerror(errno));
+            return -1;
+        }
+        midi->created_path = true;
+    } else if (!S_ISFIFO(st.st_mode)) {
+        syslog(LOG_ERR, "Pipe MIDI: %s exists and is not a FIFO", midi->path);
+        return -1;
+    }
+
+    int fd = open(midi->path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+        syslog(LOG_ERR, "Pipe MIDI: cannot open %s: %s", midi->path, strerror(errno));
+        return -1;
+    }
+    /* With a writer always present, writers may come and go without EOF */
+    midi->keepalive_fd = open(midi->path, O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+    if (midi->keepalive_fd < 0) {
+        syslog(LOG_WARNING, "Pipe MIDI: cannot hold %s open: %s", midi->path, strerror(errno));
+    }
+
+    if (!add_source(midi, fd)) {
+        close(fd);
+        return -1;
+    }
+    return 0;
+}
+
+static int open_socket(midi_pipe_t *midi) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(midi->path) >= sizeof(addr.sun_path)) {
+        syslog(LOG_ERR, "Pipe MIDI: socket path too long: %s", midi->path);
+        return -1;
+    }
+    strcpy(addr.sun_path, midi->path);
+
+    midi->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (midi->listen_fd < 0) {
+        syslog(LOG_ERR, "Pipe MIDI: socket failed: %s", strerror(errno));
+        return -1;
+    }
+
+    /* Remove a stale socket left by a previous run */
+    struct stat st;
+    if (stat(midi->path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        unlink(midi->path);
+    }
+
+    if (bind(midi->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(midi->listen_fd, MIDI_PIPE_MAX_CLIENTS) < 0) {
+        syslog(LOG_ERR, "Pipe MIDI: cannot listen on %s: %s", midi->path, strerror(errno));
+        return -1;
+    }
+    midi->created_path = true;
+
+    return event_loop_add_fd(midi->loop, midi->listen_fd, on_accept, midi);
+}
+
+midi_pipe_t *midi_pipe_init(const midisynthd_config_t *config, synth_t *synth, event_loop_t *loop) {
+    if (!config || !synth || !loop) {
+        syslog(LOG_ERR, "Invalid parameters for pipe MIDI init");
+        return NULL;
+    }
+
+    midi_pipe_t *midi = calloc(1, sizeof(*midi));
+    if (!midi) {
+        syslog(LOG_ERR, "Failed to allocate pipe MIDI object");
+        return NULL;
+    }
+    memstat_add(MEMSTAT_QUEUES, sizeof(*midi));
+    midi->synth = synth;
+    midi->loop = loop;
+    midi->listen_fd = -1;
+    midi->keepalive_fd = -1;
+    midi->stdin_flags = -1;
+    for (int i = 0; i < MIDI_PIPE_MAX_CLIENTS; i++) {
+        midi->sources[i].fd = -1;
+    }
+
+    midi_router_t *router = midi_router_create(config);
+    if (midi_router_is_active(router)) {
+        midi->router = router;
+    } else {
+        midi_router_destroy(router);
+    }
+
+    const char *input = config->midi_input;
+    int ret;
+    if (input[0] == '\0' || strcmp(input, "-") == 0) {
+        midi->mode = PIPE_MODE_STDIN;
+        strcpy(midi->path, "stdin");
+        ret = open_stdin(midi);
+    } else if (strncmp(input, "unix:", 5) == 0) {
+        midi->mode = PIPE_MODE_SOCKET;
+        snprintf(midi->path, sizeof(midi->path), "%s", input + 5);
+        ret = open_socket(midi);
+    } else {
+        midi->mode = PIPE_MODE_FIFO;
+        snprintf(midi->path, sizeof(midi->path), "%s", input);
+        ret = open_fifo(midi);
+    }
+    if (ret < 0) {
+        midi_pipe_cleanup(midi);
+        return NULL;
+    }
+
+    midi->start_ns = monotonic_ns();
+    midi->initialized = true;
+    syslog(LOG_INFO, "Pipe MIDI driver reading raw MIDI from %s%s",
+           midi->mode == PIPE_MODE_SOCKET ? "socket " : "", midi->path);
+    return midi;
+}
+
+int midi_pipe_process_events(midi_pipe_t *midi, int timeout_ms) {
+    if (!midi || !midi->initialized) return -1;
+    /* Input is read by the event loop; nothing to do here */
+    if (timeout_ms > 0) poll(NULL, 0, timeout_ms);
+    return 0;
+}
+
+int midi_pipe_disconnect_all(midi_pipe_t *midi) {
+    if (!midi || !midi->initialized) return -1;
+    for (int i = 0; i < MIDI_PIPE_MAX_CLIENTS; i++) {
+        if (midi->sources[i].fd >= 0) midi_parser_reset(&midi->sources[i].parser);
+    }
+    synth_all_notes_off(midi->synth);
+    return 0;
+}
+
+int midi_pipe_get_stats(midi_pipe_t *midi, midi_pipe_stats_t *stats) {
+    if (!midi || !stats) return -1;
+    memset(stats, 0, sizeof(*stats));
+    stats->events = midi->events;
+    stats->bytes = midi->bytes;
+    stats->reads = midi->reads;
+    stats->busy_ns = midi->busy_ns;
+    stats->elapsed_ns = midi->start_ns ? monotonic_ns() - midi->start_ns : 0;
+    if (stats->elapsed_ns > 0) {
+        stats->events_per_sec = (double)stats->events * 1e9 / (double)stats->elapsed_ns;
+    }
+    if (stats->busy_ns > 0) {
+        stats->capacity_per_sec = (double)stats->events * 1e9 / (double)stats->busy_ns;
+    }
+    stats->parser = midi->closed_stats;
+    for (int i = 0; i < MIDI_PIPE_MAX_CLIENTS; i++) {
+        if (midi->sources[i].fd >= 0) add_parser_stats(&stats->parser, &midi->sources[i].parser.stats);
+    }
+    return 0;
+}
+
+void midi_pipe_cleanup(midi_pipe_t *midi) {
+    if (!midi) return;
+
+    if (midi->initialized) {
+        midi_pipe_stats_t stats;
+        midi_pipe_get_stats(midi, &stats);
+        syslog(LOG_INFO, "Pipe MIDI: %llu events, %llu bytes in %llu reads over %.1f s "
+               "(%.0f events/s, decoder capacity %.0f events/s)",
+               (unsigned long long)stats.events, (unsigned long long)stats.bytes,
+               (unsigned long long)stats.reads, stats.elapsed_ns / 1e9,
+               stats.events_per_sec, stats.capacity_per_sec);
+        midi_parser_log_stats(&stats.parser, "Pipe MIDI");
+    }
+
+    for (int i = 0; i < MIDI_PIPE_MAX_CLIENTS; i++) {
+        if (midi->sources[i].fd >= 0) close_source(midi, &midi->sources[i]);
+    }
+    if (midi->stdin_flags >= 0) {
+        fcntl(STDIN_FILENO, F_SETFL, midi->stdin_flags);
+    }
+    if (midi->listen_fd >= 0) {
+        event_loop_remove_fd(midi->loop, midi->listen_fd);
+        close(midi->listen_fd);
+    }
+    if (midi->keepalive_fd >= 0) {
+        close(midi->keepalive_fd);
+    }
+    if (midi->created_path) {
+        unlink(midi->path);
+    }
+    midi_router_destroy(midi->router);
+    memstat_sub(MEMSTAT_QUEUES, sizeof(*midi));
+    free(midi);
+}
@@ -0,0 +1,44 @@
+#ifndef MIDI_PIPE_H
+#define MIDI_PIPE_H
+
+#include <stdint.h>
+#include "config.h"
+#include "synth.h"
+#include "event_loop.h"
+#include "midi_parser.h"
+
+/* Bytes read per read() call */
+#define MIDI_PIPE_CHUNK         65536
+/* Simultaneous Unix socket clients */
+#define MIDI_PIPE_MAX_CLIENTS   8
+
+typedef struct midi_pipe_s midi_pipe_t;
+
+/**
+ * Throughput counters for the raw MIDI input
+ */
+typedef struct {
+    uint64_t events;            /* Messages dispatched to the synth */
+    uint64_t bytes;
+    uint64_t reads;             /* read() calls that returned data */
+    uint64_t busy_ns;           /* Time spent decoding and dispatching */
+    uint64_t elapsed_ns;        /* Time since the input was opened */
+    double events_per_sec;      /* Observed rate over elapsed time */
+    double capacity_per_sec;    /* Rate the decoder sustains, events / busy time */
+    midi_parser_stats_t parser; /* Summed over all sources */
+} midi_pipe_stats_t;
+
+/**
+ * Open the raw MIDI input named by config->midi_input
+ *
+ * An empty value or "-" reads stdin, "unix:/path" listens on a Unix stream
+ * socket and anything else is a FIFO, created if it does not exist. Input
+ * is read from @p loop.
+ */
+midi_pipe_t *midi_pipe_init(const midisynthd_config_t *config, synth_t *synth, event_loop_t *loop);
+void midi_pipe_cleanup(midi_pipe_t *midi);
+int midi_pipe_process_events(midi_pipe_t *midi, int timeout_ms);
+int midi_pipe_disconnect_all(midi_pipe_t *midi);
+int midi_pipe_get_stats(midi_pipe_t *midi, midi_pipe_stats_t *stats);
+
+#endif /* MIDI_PIPE_H */
@@ -0,0 +1,263 @@
+/*
+ * MIDI input via a PipeWire filter node for midisynthd
+ */
+#include "midi_pipewire.h"
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <poll.h>
+
+#if HAVE_PIPEWIRE
+#include <stdio.h>
+#include <pipewire/pipewire.h>
+#include <pipewire/filter.h>
+#include <spa/control/control.h>
+#include <spa/pod/iter.h>
+#include "midi_router.h"
+#include "threads.h"
+#include "rt_sentinel.h"
+#include "trace.h"
+
+/* Cycles a target frame may run ahead of the render clock before the
+ * graph-to-render mapping is taken again */
+#define MIDI_PIPEWIRE_MAX_LEAD_CYCLES   4
+
+/* Port user data handed back by pw_filter_add_port() */
+struct midi_pipewire_port {
+    struct midi_pipewire_s *owner;
+};
+
+struct midi_pipewire_s {
+    struct pw_thread_loop *loop;
+    struct pw_filter *filter;
+    struct midi_pipewire_port *port;
+    synth_t *synth;
+    midi_router_t *router;
+    midi_parser_t parser;       /* Only touched by the process callback */
+    uint32_t default_quantum;
+    bool pw_ready;              /* pw_init() was called */
+
+    /* Render frame = graph position + anchor, taken on the first cycle and
+     * again whenever the two clocks drift apart */
+    bool anchored;
+    uint64_t anchor;
+    uint64_t event_frame;       /* Target frame of the event being parsed */
+    uint64_t scheduled;
+    uint64_t resyncs;
+
+    bool initialized;
+};
+
+/**
+ * Parser callback: route, then queue at the current event's frame
+ */
+static void dispatch_timed(void *data, const uint8_t *msg, size_t len) {
+    midi_pipewire_t *midi = data;
+    if (midi_parser_route_synth(midi->router, midi->synth, msg, len, true, midi->event_frame) > 0) {
+        midi->scheduled++;
+    }
+}
+
+/**
+ * Map the start of this graph cycle onto the render clock
+ *
+ * When the audio backend runs in the same PipeWire graph both clocks
+ * advance by the same quantum each cycle and the anchor never moves.
+ */
+static uint64_t cycle_start_frame(midi_pipewire_t *midi, uint64_t position, uint32_t quantum) {
+    uint64_t now = synth_get_frame_time(midi->synth);
+    uint64_t target = position + midi->anchor;
+    if (!midi->anchored || target < now ||
+        target > now + (uint64_t)quantum * MIDI_PIPEWIRE_MAX_LEAD_CYCLES) {
+        if (midi->anchored) midi->resyncs++;
+        midi->anchor = now + quantum - position;
+        midi->anchored = true;
+        target = now + quantum;
+    }
+    return target;
+}
+
+static void on_process(void *data, struct spa_io_position *position) {
+    midi_pipewire_t *midi = data;
+    threads_register("msd-pw-midi", true);
+    struct pw_buffer *b = pw_filter_dequeue_buffer(midi->port);
+    if (!b) return;
+    RT_SENTINEL_ENTER();
+    uint64_t span = trace_begin();
+    int events = 0;
+
+    struct spa_data *d = &b->buffer->datas[0];
+    struct spa_pod *pod = spa_pod_from_data(d->data, d->maxsize, d->chunk->offset, d->chunk->size);
+    if (pod && spa_pod_is_sequence(pod)) {
+        uint32_t quantum = position ? (uint32_t)position->clock.duration : midi->default_quantum;
+        uint64_t start = position ? cycle_start_frame(midi, position->clock.position, quantum)
+                                  : synth_get_frame_time(midi->synth);
+        struct spa_pod_control *c;
+        SPA_POD_SEQUENCE_FOREACH((struct spa_pod_sequence *)pod, c) {
+            if (c->type != SPA_CONTROL_Midi) continue;
+            midi->event_frame = start + c->offset;
+            events += midi_parser_feed(&midi->parser, SPA_POD_BODY(&c->value), SPA_POD_BODY_SIZE(&c->value));
+        }
+    }
+    if (events > 0) {
+        trace_end(span, "pw-midi", events);
+    }
+    RT_SENTINEL_LEAVE();
+    pw_filter_queue_buffer(midi->port, b);
+}
+
+static void on_state_changed(void *data, enum pw_filter_state old,
+                             enum pw_filter_state state, const char *error) {
+    (void)data;
+    (void)old;
+    if (state == PW_FILTER_STATE_ERROR) {
+        syslog(LOG_ERR, "PipeWire MIDI filter error: %s", error ? error : "unknown");
+    } else {
+        syslog(LOG_DEBUG, "PipeWire MIDI filter %s", pw_filter_state_as_string(state));
+    }
+}
+
+static const struct pw_filter_events filter_events = {
+    PW_VERSION_FILTER_EVENTS,
+    .state_changed = on_state_changed,
+    .process = on_process,
+};
+
+midi_pipewire_t *midi_pipewire_init(const midisynthd_config_t *config, synth_t *synth) {
+    if (!config || !synth) {
+        syslog(LOG_ERR, "Invalid parameters for PipeWire MIDI init");
+        return NULL;
+    }
+
+    midi_pipewire_t *midi = calloc(1, sizeof(*midi));
+    if (!midi) return NULL;
+    midi->synth = synth;
+    midi->default_quantum = config->buffer_size > 0 ? (uint32_t)config->buffer_size : CONFIG_DEFAULT_BUFFER_SIZE;
+
+    midi_router_t *router = midi_router_create(config);
+    if (midi_router_is_active(router)) {
+        midi->router = router;
+    } else {
+        midi_router_destroy(router);
+    }
+    midi_parser_init(&midi->parser, dispatch_timed, midi);
+
+    pw_init(NULL, NULL);
+    midi->pw_ready = true;
+    midi->loop = pw_thread_loop_new("midisynthd-midi", NULL);
+    if (!midi->loop || pw_thread_loop_start(midi->loop) < 0) {
+        syslog(LOG_ERR, "Failed to start PipeWire thread loop");
+        midi_pipewire_cleanup(midi);
+        return NULL;
+    }
+
+    /* Ask for the audio period as quantum so both share the graph cycle */
+    char latency[32];
+    snprintf(latency, sizeof(latency), "%u/%d", midi->default_quantum,
+             config->sample_rate > 0 ? config->sample_rate : CONFIG_DEFAULT_SAMPLE_RATE);
+
+    pw_thread_loop_lock(midi->loop);
+    midi->filter = pw_filter_new_simple(pw_thread_loop_get_loop(midi->loop), config->client_name,
+        pw_properties_new(PW_KEY_MEDIA_TYPE, "Midi",
+                          PW_KEY_MEDIA_CATEGORY, "Playback",
+                          PW_KEY_MEDIA_ROLE, "DSP",
+                          PW_KEY_NODE_LATENCY, latency,
+                          PW_KEY_NODE_AUTOCONNECT, config->midi_autoconnect ? "true" : "false",
+                          NULL),
+        &filter_events, midi);
+    if (midi->filter) {
+        midi->port = pw_filter_add_port(midi->filter, PW_DIRECTION_INPUT, PW_FILTER_PORT_FLAG_MAP_BUFFERS,
+            sizeof(struct midi_pipewire_port),
+            pw_properties_new(PW_KEY_FORMAT_DSP, "8 bit raw midi",
+                              PW_KEY_PORT_NAME, "midi_in",
+                              NULL),
+            NULL, 0);
+        if (midi->port) midi->port->owner = midi;
+    }
+    int ret = midi->port ? pw_filter_connect(midi->filter, PW_FILTER_FLAG_RT_PROCESS, NULL, 0) : -1;
+    pw_thread_loop_unlock(midi->loop);
+
+    if (ret < 0) {
+        syslog(LOG_ERR, "Failed to register PipeWire MIDI filter");
+        midi_pipewire_cleanup(midi);
+        return NULL;
+    }
+
+    midi->initialized = true;
+    syslog(LOG_INFO, "PipeWire MIDI driver initialized (quantum %s)", latency);
+    return midi;
+}
+
+int midi_pipewire_process_events(midi_pipewire_t *midi, int timeout_ms) {
+    if (!midi || !midi->initialized) return -1;
+    /* Events arrive on the PipeWire data thread; nothing to do here */
+    if (timeout_ms > 0) poll(NULL, 0, timeout_ms);
+    return 0;
+}
+
+int midi_pipewire_disconnect_all(midi_pipewire_t *midi) {
+    if (!midi || !midi->initialized) return -1;
+    synth_all_notes_off(midi->synth);
+    return 0;
+}
+
+int midi_pipewire_get_stats(midi_pipewire_t *midi, midi_parser_stats_t *stats) {
+    if (!midi || !stats) return -1;
+    *stats = midi->parser.stats;
+    return 0;
+}
+
+void midi_pipewire_cleanup(midi_pipewire_t *midi) {
+    if (!midi) return;
+    if (midi->loop) {
+        pw_thread_loop_stop(midi->loop);
+    }
+    if (midi->filter) {
+        pw_filter_destroy(midi->filter);
+    }
+    if (midi->loop) {
+        pw_thread_loop_destroy(midi->loop);
+    }
+    if (midi->pw_ready) {
+        pw_deinit();
+    }
+    if (midi->initialized) {
+        midi_parser_log_stats(&midi->parser.stats, "PipeWire MIDI");
+        syslog(LOG_INFO, "PipeWire MIDI: %llu events scheduled, %llu clock resyncs",
+               (unsigned long long)midi->scheduled, (unsigned long long)midi->resyncs);
+    }
+    midi_router_destroy(midi->router);
+    free(midi);
+}
+
+#else /* !HAVE_PIPEWIRE */
+
+midi_pipewire_t *midi_pipewire_init(const midisynthd_config_t *config, synth_t *synth) {
+    (void)config;
+    (void)synth;
+    syslog(LOG_ERR, "midisynthd was built without PipeWire support");
+    return NULL;
+}
+
+void midi_pipewire_cleanup(midi_pipewire_t *midi) {
+    (void)midi;
+}
+
+int midi_pipewire_process_events(midi_pipewire_t *midi, int timeout_ms) {
+    (void)midi;
+    if (timeout_ms > 0) poll(NULL, 0, timeout_ms);
+    return -1;
+}
+
+int midi_pipewire_disconnect_all(midi_pipewire_t *midi) {
+    (void)midi;
+    return -1;
+}
+
+int midi_pipewire_get_stats(midi_pipewire_t *midi, midi_parser_stats_t *stats) {
+    (void)midi;
+    (void)stats;
+    return -1;
+}
+
+#endif /* HAVE_PIPEWIRE */
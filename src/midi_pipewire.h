@@ -0,0 +1,24 @@
+#ifndef MIDI_PIPEWIRE_H
+#define MIDI_PIPEWIRE_H
+
+#include "config.h"
+#include "synth.h"
+#include "midi_parser.h"
+
+typedef struct midi_pipewire_s midi_pipewire_t;
+
+/**
+ * Register a PipeWire filter node with one MIDI input port
+ *
+ * Events are queued on the synth's render clock at their frame offset in
+ * the graph cycle, one quantum ahead, so their spacing inside a cycle is
+ * kept. Without PipeWire support compiled in this logs an error and
+ * returns NULL.
+ */
+midi_pipewire_t *midi_pipewire_init(const midisynthd_config_t *config, synth_t *synth);
+void midi_pipewire_cleanup(midi_pipewire_t *midi);
+int midi_pipewire_process_events(midi_pipewire_t *midi, int timeout_ms);
+int midi_pipewire_disconnect_all(midi_pipewire_t *midi);
+int midi_pipewire_get_stats(midi_pipewire_t *midi, midi_parser_stats_t *stats);
+
+#endif /* MIDI_PIPEWIRE_H */
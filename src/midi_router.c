@@ -0,0 +1,297 @@
+/*
+ * midisynthd - System-level MIDI Synthesizer Daemon for Linux
+ * Copyright (C) 2025 ArchLars
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include "midi_router.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+#include <syslog.h>
+
+#define ROUTER_CHANNELS     16
+#define ROUTER_KEY_DROP     0xFF
+
+/* Bits in type_mask, indexed by (status >> 4) & 7 */
+#define TYPE_BIT(status)    (1u << (((status) >> 4) & 7))
+#define TYPE_NOTES          (TYPE_BIT(0x80) | TYPE_BIT(0x90))
+#define TYPE_ALL            0xFFu
+
+struct midi_router_s {
+    bool active;
+    bool pass_sysex;
+    uint8_t type_mask[ROUTER_CHANNELS];
+    uint8_t chan_map[ROUTER_CHANNELS];
+    uint8_t key_lut[ROUTER_CHANNELS][128];
+    uint8_t vel_lut[ROUTER_CHANNELS][128];
+    uint32_t cc_allow[ROUTER_CHANNELS][4];
+};
+
+/**
+ * Parse "n" or "lo-hi" strictly
+ */
+static int parse_range(const char *tok, int *lo, int *hi) {
+    char *end;
+    long a = strtol(tok, &end, 10);
+    if (end == tok) return -1;
+    long b = a;
+    if (*end == '-') {
+        const char *second = end + 1;
+        b = strtol(second, &end, 10);
+        if (end == second) return -1;
+    }
+    if (*end != '\0') return -1;
+    *lo = (int)a;
+    *hi = (int)b;
+    return 0;
+}
+
+/**
+ * Parse a channel list ("all", "10", "1-9,11-16") into a 16-bit mask
+ */
+static int parse_channels(const char *spec, uint16_t *mask) {
+    *mask = 0;
+    if (strcasecmp(spec, "all") == 0) {
+        *mask = 0xFFFF;
+        return 0;
+    }
+
+    char buf[64];
+    strncpy(buf, spec, sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = '\0';
+
+    char *save = NULL;
+    for (char *tok = strtok_r(buf, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        int lo, hi;
+        if (parse_range(tok, &lo, &hi) < 0) return -1;
+        if (lo < 1 || hi > ROUTER_CHANNELS || lo > hi) return -1;
+        for (int c = lo; c <= hi; c++) *mask |= (uint16_t)(1u << (c - 1));
+    }
+    return *mask ? 0 : -1;
+}
+
+/**
+ * Parse a controller list ("1,7,10-11") into a 128-bit mask
+ */
+static int parse_cc_list(const char *spec, uint32_t bits[4]) {
+    memset(bits, 0, 4 * sizeof(uint32_t));
+
+    char buf[CONFIG_MAX_STRING_LEN];
+    strncpy(buf, spec, sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = '\0';
+
+    char *save = NULL;
+    for (char *tok = strtok_r(buf, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        int lo, hi;
+        if (parse_range(tok, &lo, &hi) < 0) return -1;
+        if (lo < 0 || hi > 127 || lo > hi) return -1;
+        for (int cc = lo; cc <= hi; cc++) bits[cc >> 5] |= 1u << (cc & 31);
+    }
+    return 0;
+}
+
+static int parse_type(const char *name, uint8_t *bits, bool *sysex) {
+    if (strcasecmp(name, "note") == 0) *bits |= TYPE_NOTES;
+    else if (strcasecmp(name, "aftertouch") == 0) *bits |= TYPE_BIT(0xA0);
+    else if (strcasecmp(name, "cc") == 0) *bits |= TYPE_BIT(0xB0);
+    else if (strcasecmp(name, "program") == 0) *bits |= TYPE_BIT(0xC0);
+    else if (strcasecmp(name, "pressure") == 0) *bits |= TYPE_BIT(0xD0);
+    else if (strcasecmp(name, "pitchbend") == 0) *bits |= TYPE_BIT(0xE0);
+    else if (strcasecmp(name, "sysex") == 0) *sysex = true;
+    else return -1;
+    return 0;
+}
+
+static void reset_tables(midi_router_t *r) {
+    memset(r, 0, sizeof(*r));
+    r->pass_sysex = true;
+    for (int ch = 0; ch < ROUTER_CHANNELS; ch++) {
+        r->type_mask[ch] = TYPE_ALL;
+        r->chan_map[ch] = (uint8_t)ch;
+        memset(r->cc_allow[ch], 0xFF, sizeof(r->cc_allow[ch]));
+        for (int i = 0; i < 128; i++) {
+            r->key_lut[ch][i] = (uint8_t)i;
+            r->vel_lut[ch][i] = (uint8_t)i;
+        }
+    }
+}
+
+/**
+ * Apply one rule to the tables; with r == NULL only validate it
+ */
+static int compile_rule(midi_router_t *r, const char *rule) {
+    char op[16], chans[64], a[CONFIG_MAX_STRING_LEN], b[32], c[32];
+    int n = sscanf(rule, "%15s %63s %127s %31s %31s", op, chans, a, b, c);
+    uint16_t mask;
+    if (n < 3 || parse_channels(chans, &mask) < 0) return -1;
+
+    midi_router_t scratch;
+    if (!r) {
+        reset_tables(&scratch);
+        r = &scratch;
+    }
+
+    for (int ch = 0; ch < ROUTER_CHANNELS; ch++) {
+        if (!(mask & (1u << ch))) continue;
+
+        if (strcasecmp(op, "channel") == 0) {
+            int dest = atoi(a);
+            if (n != 3 || dest < 1 || dest > ROUTER_CHANNELS) return -1;
+            r->chan_map[ch] = (uint8_t)(dest - 1);
+        }
+        else if (strcasecmp(op, "transpose") == 0) {
+            int shift = atoi(a);
+            if (n != 3 || shift < -127 || shift > 127) return -1;
+            for (int k = 0; k < 128; k++) {
+                if (r->key_lut[ch][k] == ROUTER_KEY_DROP) continue;
+                int key = r->key_lut[ch][k] + shift;
+                r->key_lut[ch][k] = (key < 0 || key > 127) ? ROUTER_KEY_DROP : (uint8_t)key;
+            }
+        }
+        else if (strcasecmp(op, "keyrange") == 0) {
+            int lo = atoi(a), hi = n >= 4 ? atoi(b) : -1;
+            if (n != 4 || lo < 0 || hi > 127 || lo > hi) return -1;
+            for (int k = 0; k < 128; k++) {
+                if (k < lo || k > hi) r->key_lut[ch][k] = ROUTER_KEY_DROP;
+            }
+        }
+        else if (strcasecmp(op, "velocity") == 0) {
+            uint8_t lut[128];
+            lut[0] = 0;
+            if (strcasecmp(a, "fixed") == 0 && n == 4) {
+                int v = atoi(b);
+                if (v < 1 || v > 127) return -1;
+                for (int i = 1; i < 128; i++) lut[i] = (uint8_t)v;
+            } else if (strcasecmp(a, "scale") == 0 && n == 5) {
+                int lo = atoi(b), hi = atoi(c);
+                if (lo < 1 || hi > 127 || lo > hi) return -1;
+                for (int i = 1; i < 128; i++) {
+                    lut[i] = (uint8_t)(lo + ((hi - lo) * (i - 1) + 63) / 126);
+                }
+            } else if (strcasecmp(a, "curve") == 0 && n == 4) {
+                double gamma = atof(b);
+                if (gamma <= 0.0 || gamma > 10.0) return -1;
+                for (int i = 1; i < 128; i++) {
+                    int v = (int)lround(127.0 * pow(i / 127.0, gamma));
+                    lut[i] = (uint8_t)(v < 1 ? 1 : v);
+                }
+            } else {
+                return -1;
+            }
+            /* Compose with earlier velocity rules */
+            for (int i = 1; i < 128; i++) r->vel_lut[ch][i] = lut[r->vel_lut[ch][i]];
+        }
+        else if (strcasecmp(op, "cc") == 0) {
+            uint32_t bits[4];
+            if (n != 4 || parse_cc_list(b, bits) < 0) return -1;
+            if (strcasecmp(a, "allow") == 0) {
+                for (int w = 0; w < 4; w++) r->cc_allow[ch][w] &= bits[w];
+            } else if (strcasecmp(a, "block") == 0) {
+                for (int w = 0; w < 4; w++) r->cc_allow[ch][w] &= ~bits[w];
+            } else {
+                return -1;
+            }
+        }
+        else if (strcasecmp(op, "drop") == 0) {
+            /* Up to three types per rule */
+            uint8_t bits = 0;
+            bool sysex = false;
+            if (parse_type(a, &bits, &sysex) < 0) return -1;
+            if (n >= 4 && parse_type(b, &bits, &sysex) < 0) return -1;
+            if (n >= 5 && parse_type(c, &bits, &sysex) < 0) return -1;
+            r->type_mask[ch] &= (uint8_t)~bits;
+            if (sysex) r->pass_sysex = false;
+        }
+        else {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+midi_router_t *midi_router_create(const midisynthd_config_t *config) {
+    midi_router_t *r = malloc(sizeof(*r));
+    if (!r) {
+        syslog(LOG_ERR, "Failed to allocate MIDI router");
+        return NULL;
+    }
+    reset_tables(r);
+
+    int compiled = 0;
+    for (int i = 0; config && i < config->route_count && i < CONFIG_MAX_ROUTES; i++) {
+        if (compile_rule(r, config->routes[i]) < 0) {
+            syslog(LOG_WARNING, "Ignoring invalid route rule: %s", config->routes[i]);
+            continue;
+        }
+        compiled++;
+    }
+
+    r->active = compiled > 0;
+    if (r->active) {
+        syslog(LOG_INFO, "MIDI routing: %d rule(s) compiled", compiled);
+    }
+    return r;
+}
+
+void midi_router_destroy(midi_router_t *router) {
+    free(router);
+}
+
+bool midi_router_is_active(const midi_router_t *router) {
+    return router && router->active;
+}
+
+int midi_router_check_rule(const char *rule) {
+    return rule ? compile_rule(NULL, rule) : -1;
+}
+
+bool midi_router_apply(const midi_router_t *r, uint8_t *msg, size_t len) {
+    if (!r || !r->active || len == 0) return true;
+
+    uint8_t status = msg[0];
+    if (status >= 0xF0) return status != 0xF0 || r->pass_sysex;
+
+    unsigned ch = status & 0x0F;
+    if (!(r->type_mask[ch] & TYPE_BIT(status))) return false;
+    if (len < 2) return true;
+
+    switch (status & 0xF0) {
+        case 0x90:
+            if (len >= 3) msg[2] = r->vel_lut[ch][msg[2] & 0x7F];
+            /* fall through */
+        case 0x80:
+        case 0xA0: {
+            uint8_t key = r->key_lut[ch][msg[1] & 0x7F];
+            if (key == ROUTER_KEY_DROP) return false;
+            msg[1] = key;
+            break;
+        }
+        case 0xB0:
+            if (!(r->cc_allow[ch][(msg[1] >> 5) & 3] & (1u << (msg[1] & 31)))) return false;
+            break;
+        default:
+            break;
+    }
+
+    msg[0] = (uint8_t)((status & 0xF0) | r->chan_map[ch]);
+    return true;
+}
@@ -0,0 +1,93 @@
+/*
+ * midisynthd - System-level MIDI Synthesizer Daemon for Linux
+ * Copyright (C) 2025 ArchLars
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef MIDISYNTHD_MIDI_ROUTER_H
+#define MIDISYNTHD_MIDI_ROUTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "config.h"
+
+typedef struct midi_router_s midi_router_t;
+
+/**
+ * Compile the route rules of a configuration into lookup tables
+ *
+ * Each `route` line holds one rule; channels are 1-16 and may be given
+ * as `all`, a single channel or a list of channels and ranges
+ * (`1-9,11-16`). Rules apply to the channel a message arrives on:
+ *
+ *   channel <channels> <dest>          Move messages to another channel
+ *   transpose <channels> <semitones>   Shift note numbers
+ *   keyrange <channels> <low> <high>   Drop notes outside the range
+ *   velocity <channels> fixed <v>      Constant note-on velocity
+ *   velocity <channels> scale <lo> <hi> Map 1-127 linearly onto lo-hi
+ *   velocity <channels> curve <gamma>  Power curve (<1 louder, >1 softer)
+ *   cc <channels> allow <list>         Pass only the listed controllers
+ *   cc <channels> block <list>         Drop the listed controllers
+ *   drop <channels> <type>...          Drop note, aftertouch, pressure,
+ *                                      program, pitchbend, cc or sysex
+ *
+ * Invalid rules are logged and ignored.
+ *
+ * @param config Configuration holding the rules
+ * @return Router instance, or NULL on allocation failure
+ */
+midi_router_t *midi_router_create(const midisynthd_config_t *config);
+
+/**
+ * Free a router
+ *
+ * Safe to call with NULL pointer.
+ *
+ * @param router Router instance
+ */
+void midi_router_destroy(midi_router_t *router);
+
+/**
+ * Check whether any rule is in effect
+ *
+ * @param router Router instance
+ * @return true if messages can be changed or dropped
+ */
+bool midi_router_is_active(const midi_router_t *router);
+
+/**
+ * Route one message in place
+ *
+ * Table lookups only, no allocation; safe in real-time callbacks.
+ *
+ * @param router Router instance (NULL passes everything)
+ * @param msg Complete message; channel, key and velocity may be rewritten
+ * @param len Message length
+ * @return true to deliver the message, false to drop it
+ */
+bool midi_router_apply(const midi_router_t *router, uint8_t *msg, size_t len);
+
+/**
+ * Parse one rule without building a router
+ *
+ * @param rule Rule text as written after `route =`
+ * @return 0 if the rule is valid, -1 otherwise
+ */
+int midi_router_check_rule(const char *rule);
+
+#endif /* MIDISYNTHD_MIDI_ROUTER_H */
@@ -0,0 +1,462 @@
+/*
+ * midisynthd - System-level MIDI Synthesizer Daemon for Linux
+ * Copyright (C) 2025 ArchLars
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+/* recvmmsg() */
+#define _GNU_SOURCE
+
+#include "osc.h"
+#include "midi_router.h"
+#include "memstat.h"
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <math.h>
+#include <syslog.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+/* recvmmsg() calls per wakeup before yielding to other descriptors */
+#define OSC_BATCHES_PER_WAKEUP  8
+/* Receive buffer requested from the kernel; best effort */
+#define OSC_RCVBUF_SIZE         (1024 * 1024)
+/* Nested bundles followed before the packet is rejected */
+#define OSC_MAX_BUNDLE_DEPTH    4
+/* Arguments read per message; the address map needs at most three */
+#define OSC_MAX_ARGS            4
+
+/* Seconds between the NTP epoch (1900) and the Unix epoch (1970) */
+#define NTP_UNIX_OFFSET         2208988800ULL
+/* Time tag meaning "now" */
+#define OSC_TIMETAG_IMMEDIATE   1ULL
+
+typedef enum {
+    OSC_ADDR_NOTE = 0,
+    OSC_ADDR_NOTEON,
+    OSC_ADDR_NOTEOFF,
+    OSC_ADDR_CC,
+    OSC_ADDR_PROGRAM,
+    OSC_ADDR_PITCHBEND,
+    OSC_ADDR_PRESSURE,
+    OSC_ADDR_GAIN,
+    OSC_ADDR_REVERB,
+    OSC_ADDR_PANIC
+} osc_addr_t;
+
+typedef struct {
+    const char *path;
+    osc_addr_t addr;
+    int min_args;
+} osc_addr_entry_t;
+
+static const osc_addr_entry_t address_map[] = {
+    { "/note",      OSC_ADDR_NOTE,      3 },
+    { "/noteon",    OSC_ADDR_NOTEON,    3 },
+    { "/noteoff",   OSC_ADDR_NOTEOFF,   2 },
+    { "/cc",        OSC_ADDR_CC,        3 },
+    { "/program",   OSC_ADDR_PROGRAM,   2 },
+    { "/pitchbend", OSC_ADDR_PITCHBEND, 2 },
+    { "/pressure",  OSC_ADDR_PRESSURE,  2 },
+    { "/gain",      OSC_ADDR_GAIN,      1 },
+    { "/reverb",    OSC_ADDR_REVERB,    1 },
+    { "/panic",     OSC_ADDR_PANIC,     0 },
+};
+
+struct osc_s {
+    synth_t *synth;
+    event_loop_t *loop;
+    midi_router_t *router;
+    int fd;
+    int port;
+    int sample_rate;
+
+    struct mmsghdr msgs[OSC_BATCH];
+    struct iovec iovs[OSC_BATCH];
+    uint8_t bufs[OSC_BATCH][OSC_PACKET_MAX];
+
+    osc_stats_t stats;
+};
+
+static uint32_t read_be32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static uint64_t read_be64(const uint8_t *p) {
+    return ((uint64_t)read_be32(p) << 32) | read_be32(p + 4);
+}
+
+/**
+ * Read a padded OSC string at *pos, advancing past its padding
+ */
+static const char *read_string(const uint8_t *data, size_t len, size_t *pos) {
+    const uint8_t *start = data + *pos;
+    const uint8_t *end = memchr(start, '\0', len - *pos);
+    if (!end) return NULL;
+    size_t padded = ((size_t)(end - start) + 4) & ~(size_t)3;
+    if (padded > len - *pos) return NULL;
+    *pos += padded;
+    return (const char *)start;
+}
+
+/**
+ * Current time as an NTP time tag
+ */
+static uint64_t now_timetag(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    uint64_t secs = (uint64_t)ts.tv_sec + NTP_UNIX_OFFSET;
+    uint64_t frac = ((uint64_t)ts.tv_nsec << 32) / 1000000000ULL;
+    return (secs << 32) | frac;
+}
+
+/**
+ * Read up to OSC_MAX_ARGS numeric arguments
+ *
+ * @return Number of arguments read, or -1 on a malformed or non-numeric argument
+ */
+static int read_args(const uint8_t *data, size_t len, size_t pos, const char *tags, double *args) {
+    int count = 0;
+    for (const char *t = tags; *t; t++) {
+        double value;
+        switch (*t) {
+            case 'i': {
+                if (len - pos < 4) return -1;
+                value = (int32_t)read_be32(data + pos);
+                pos += 4;
+                break;
+            }
+            case 'f': {
+                if (len - pos < 4) return -1;
+                uint32_t bits = read_be32(data + pos);
+                float f;
+                memcpy(&f, &bits, sizeof(f));
+                value = f;
+                pos += 4;
+                break;
+            }
+            case 'h': {
+                if (len - pos < 8) return -1;
+                value = (double)(int64_t)read_be64(data + pos);
+                pos += 8;
+                break;
+            }
+            case 'd': {
+                if (len - pos < 8) return -1;
+                uint64_t bits = read_be64(data + pos);
+                memcpy(&value, &bits, sizeof(value));
+                pos += 8;
+                break;
+            }
+            case 'T': value = 1.0; break;
+            case 'F': value = 0.0; break;
+            default:
+                return -1;
+        }
+        if (count < OSC_MAX_ARGS) args[count] = value;
+        count++;
+    }
+    return count < OSC_MAX_ARGS ? count : OSC_MAX_ARGS;
+}
+
+static const osc_addr_entry_t *lookup_address(const char *path) {
+    for (size_t i = 0; i < sizeof(address_map) / sizeof(address_map[0]); i++) {
+        if (strcmp(address_map[i].path, path) == 0) return &address_map[i];
+    }
+    return NULL;
+}
+
+static bool to_data_byte(double v, uint8_t *out) {
+    long n = lround(v);
+    if (!isfinite(v) || n < 0 || n > 127) return false;
+    *out = (uint8_t)n;
+    return true;
+}
+
+/**
+ * Build the MIDI message for a channel address
+ *
+ * @return Message length, or 0 if an argument is out of range
+ */
+static size_t build_midi(osc_addr_t addr, const double *args, int nargs, uint8_t *msg) {
+    long ch = lround(args[0]);
+    if (!isfinite(args[0]) || ch < 1 || ch > 16) return 0;
+    uint8_t chan = (uint8_t)(ch - 1);
+
+    switch (addr) {
+        case OSC_ADDR_NOTE:
+        case OSC_ADDR_NOTEON:
+            msg[0] = 0x90 | chan;
+            if (!to_data_byte(args[1], &msg[1]) || !to_data_byte(args[2], &msg[2])) return 0;
+            return 3;
+        case OSC_ADDR_NOTEOFF:
+            msg[0] = 0x80 | chan;
+            msg[2] = 0;
+            if (!to_data_byte(args[1], &msg[1])) return 0;
+            if (nargs > 2 && !to_data_byte(args[2], &msg[2])) return 0;
+            return 3;
+        case OSC_ADDR_CC:
+            msg[0] = 0xB0 | chan;
+            if (!to_data_byte(args[1], &msg[1]) || !to_data_byte(args[2], &msg[2])) return 0;
+            return 3;
+        case OSC_ADDR_PROGRAM:
+            msg[0] = 0xC0 | chan;
+            if (!to_data_byte(args[1], &msg[1])) return 0;
+            return 2;
+        case OSC_ADDR_PRESSURE:
+            msg[0] = 0xD0 | chan;
+            if (!to_data_byte(args[1], &msg[1])) return 0;
+            return 2;
+        case OSC_ADDR_PITCHBEND: {
+            long bend = lround(args[1]);
+            if (!isfinite(args[1]) || bend < -8192 || bend > 8191) return 0;
+            unsigned value = (unsigned)(bend + 8192);
+            msg[0] = 0xE0 | chan;
+            msg[1] = value & 0x7F;
+            msg[2] = (value >> 7) & 0x7F;
+            return 3;
+        }
+        default:
+            return 0;
+    }
+}
+
+/**
+ * Route a MIDI message, then apply it now or queue it for its time tag
+ */
+static void dispatch_midi(osc_t *osc, uint8_t *msg, size_t len, uint64_t timetag, uint64_t now) {
+    if (osc->router && !midi_router_apply(osc->router, msg, len)) return;
+
+    if (timetag != OSC_TIMETAG_IMMEDIATE && timetag > now) {
+        double delta = (double)(timetag - now) / 4294967296.0;
+        uint64_t frame = synth_get_frame_time(osc->synth) +
+                         (uint64_t)(delta * osc->sample_rate + 0.5);
+        if (synth_schedule_midi(osc->synth, frame, msg, len) == 0) {
+            osc->stats.scheduled++;
+            return;
+        }
+        osc->stats.queue_full++;
+    }
+    synth_process_midi_data(osc->synth, msg, len);
+}
+
+static int handle_message(osc_t *osc, const uint8_t *data, size_t len, uint64_t timetag, uint64_t now) {
+    size_t pos = 0;
+    const char *path = read_string(data, len, &pos);
+    if (!path || path[0] != '/') return -1;
+
+    /* The type tag string may be omitted by old senders: no arguments */
+    const char *tags = "";
+    if (pos < len) {
+        tags = read_string(data, len, &pos);
+        if (!tags || tags[0] != ',') return -1;
+        tags++;
+    }
+
+    double args[OSC_MAX_ARGS] = { 0 };
+    int nargs = read_args(data, len, pos, tags, args);
+    if (nargs < 0) return -1;
+
+    osc->stats.messages++;
+    const osc_addr_entry_t *entry = lookup_address(path);
+    if (!entry) {
+        osc->stats.unknown++;
+        syslog(LOG_DEBUG, "OSC: no mapping for %s", path);
+        return 0;
+    }
+    if (nargs < entry->min_args) return -1;
+
+    switch (entry->addr) {
+        case OSC_ADDR_GAIN:
+            return synth_set_gain(osc->synth, (float)args[0]) == 0 ? 0 : -1;
+        case OSC_ADDR_REVERB:
+            return synth_set_reverb(osc->synth, args[0] > 0.0, (float)args[0]) == 0 ? 0 : -1;
+        case OSC_ADDR_PANIC:
+            synth_all_notes_off(osc->synth);
+            return 0;
+        default: {
+            uint8_t msg[3];
+            size_t mlen = build_midi(entry->addr, args, nargs, msg);
+            if (mlen == 0) return -1;
+            dispatch_midi(osc, msg, mlen, timetag, now);
+            return 0;
+        }
+    }
+}
+
+static int handle_element(osc_t *osc, const uint8_t *data, size_t len,
+                          uint64_t timetag, uint64_t now, int depth) {
+    if (len < 4 || len % 4 != 0) return -1;
+    if (data[0] == '/') return handle_message(osc, data, len, timetag, now);
+    if (len < 16 || memcmp(data, "#bundle", 8) != 0) return -1;
+    if (depth >= OSC_MAX_BUNDLE_DEPTH) return -1;
+
+    osc->stats.bundles++;
+    uint64_t tag = read_be64(data + 8);
+    if (tag != OSC_TIMETAG_IMMEDIATE && tag <= now) {
+        osc->stats.late++;
+    }
+
+    size_t pos = 16;
+    int ret = 0;
+    while (pos < len) {
+        if (len - pos < 4) return -1;
+        uint32_t size = read_be32(data + pos);
+        pos += 4;
+        if (size > len - pos) return -1;
+        if (handle_element(osc, data + pos, size, tag, now, depth + 1) < 0) ret = -1;
+        pos += size;
+    }
+    return ret;
+}
+
+int osc_handle_packet(osc_t *osc, const uint8_t *data, size_t len) {
+    if (!osc || !data) return -1;
+    if (handle_element(osc, data, len, OSC_TIMETAG_IMMEDIATE, now_timetag(), 0) < 0) {
+        osc->stats.errors++;
+        return -1;
+    }
+    return 0;
+}
+
+static void on_readable(void *data, int fd, uint32_t events) {
+    osc_t *osc = data;
+    (void)events;
+
+    for (int batch = 0; batch < OSC_BATCHES_PER_WAKEUP; batch++) {
+        for (int i = 0; i < OSC_BATCH; i++) {
+            osc->msgs[i].msg_hdr.msg_flags = 0;
+        }
+        int n = recvmmsg(fd, osc->msgs, OSC_BATCH, MSG_DONTWAIT, NULL);
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                syslog(LOG_WARNING, "OSC: receive failed: %s", strerror(errno));
+            }
+            return;
+        }
+        if (n == 0) return;
+
+        osc->stats.batches++;
+        osc->stats.packets += (uint64_t)n;
+        uint64_t span = trace_begin();
+        for (int i = 0; i < n; i++) {
+            if (osc->msgs[i].msg_hdr.msg_flags & MSG_TRUNC) {
+                osc->stats.errors++;
+                continue;
+            }
+            osc_handle_packet(osc, osc->bufs[i], osc->msgs[i].msg_len);
+        }
+        trace_end(span, "osc", n);
+        if (n < OSC_BATCH) return;
+    }
+}
+
+osc_t *osc_init(const midisynthd_config_t *config, synth_t *synth, event_loop_t *loop) {
+    if (!config || !synth || !loop || config->osc_port <= 0 || config->osc_port > 65535) {
+        syslog(LOG_ERR, "Invalid parameters for OSC init");
+        return NULL;
+    }
+
+    osc_t *osc = calloc(1, sizeof(*osc));
+    if (!osc) {
+        syslog(LOG_ERR, "Failed to allocate OSC object");
+        return NULL;
+    }
+    memstat_add(MEMSTAT_QUEUES, sizeof(*osc));
+    osc->synth = synth;
+    osc->loop = loop;
+    osc->port = config->osc_port;
+    osc->sample_rate = config->sample_rate > 0 ? config->sample_rate : CONFIG_DEFAULT_SAMPLE_RATE;
+    osc->fd = -1;
+
+    for (int i = 0; i < OSC_BATCH; i++) {
+        osc->iovs[i].iov_base = osc->bufs[i];
+        osc->iovs[i].iov_len = OSC_PACKET_MAX;
+        osc->msgs[i].msg_hdr.msg_iov = &osc->iovs[i];
+        osc->msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    midi_router_t *router = midi_router_create(config);
+    if (midi_router_is_active(router)) {
+        osc->router = router;
+    } else {
+        midi_router_destroy(router);
+    }
+
+    osc->fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (osc->fd < 0) {
+        syslog(LOG_ERR, "OSC: socket failed: %s", strerror(errno));
+        osc_cleanup(osc);
+        return NULL;
+    }
+
+    int rcvbuf = OSC_RCVBUF_SIZE;
+    if (setsockopt(osc->fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf)) < 0) {
+        syslog(LOG_DEBUG, "OSC: cannot enlarge receive buffer: %s", strerror(errno));
+    }
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)osc->port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(osc->fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        syslog(LOG_ERR, "OSC: cannot bind 127.0.0.1:%d: %s", osc->port, strerror(errno));
+        osc_cleanup(osc);
+        return NULL;
+    }
+
+    if (event_loop_add_fd(loop, osc->fd, on_readable, osc) < 0) {
+        syslog(LOG_ERR, "OSC: cannot watch socket");
+        osc_cleanup(osc);
+        return NULL;
+    }
+
+    syslog(LOG_INFO, "OSC input listening on 127.0.0.1:%d", osc->port);
+    return osc;
+}
+
+int osc_get_stats(osc_t *osc, osc_stats_t *stats) {
+    if (!osc || !stats) return -1;
+    *stats = osc->stats;
+    return 0;
+}
+
+void osc_cleanup(osc_t *osc) {
+    if (!osc) return;
+
+    if (osc->fd >= 0) {
+        event_loop_remove_fd(osc->loop, osc->fd);
+        close(osc->fd);
+        syslog(LOG_INFO, "OSC: %llu packets in %llu batches, %llu messages, %llu bundles, "
+               "%llu scheduled, %llu late, %llu unmapped, %llu errors",
+               (unsigned long long)osc->stats.packets, (unsigned long long)osc->stats.batches,
+               (unsigned long long)osc->stats.messages, (unsigned long long)osc->stats.bundles,
+               (unsigned long long)osc->stats.scheduled, (unsigned long long)osc->stats.late,
+               (unsigned long long)osc->stats.unknown, (unsigned long long)osc->stats.errors);
+    }
+    midi_router_destroy(osc->router);
+    memstat_sub(MEMSTAT_QUEUES, sizeof(*osc));
+    free(osc);
+}
@@ -0,0 +1,103 @@
+/*
+ * midisynthd - System-level MIDI Synthesizer Daemon for Linux
+ * Copyright (C) 2025 ArchLars
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef MIDISYNTHD_OSC_H
+#define MIDISYNTHD_OSC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "config.h"
+#include "synth.h"
+#include "event_loop.h"
+
+/* Datagrams fetched per recvmmsg() call */
+#define OSC_BATCH               32
+/* Largest datagram accepted; longer ones are counted as errors */
+#define OSC_PACKET_MAX          4096
+
+typedef struct osc_s osc_t;
+
+/**
+ * OSC input counters
+ */
+typedef struct {
+    uint64_t packets;           /* Datagrams received */
+    uint64_t batches;           /* recvmmsg() calls that returned data */
+    uint64_t messages;          /* Messages handled, including those in bundles */
+    uint64_t bundles;
+    uint64_t scheduled;         /* MIDI messages queued for a future frame */
+    uint64_t late;              /* Bundles whose time had already passed */
+    uint64_t queue_full;        /* Timed messages applied early, schedule queue full */
+    uint64_t unknown;           /* Messages with an unmapped address */
+    uint64_t errors;            /* Malformed or truncated packets */
+} osc_stats_t;
+
+/**
+ * Open the OSC input on 127.0.0.1:config->osc_port
+ *
+ * Fixed addresses, channels 1-16:
+ *
+ *   /note ch key vel, /noteon ch key vel, /noteoff ch key
+ *   /cc ch controller value, /program ch program
+ *   /pitchbend ch value (-8192 to 8191), /pressure ch value
+ *   /gain level, /reverb level (0 turns reverb off), /panic
+ *
+ * Integer and float arguments are accepted for any parameter. MIDI
+ * messages inside a bundle with a future time tag are scheduled on the
+ * render clock; everything else is applied on arrival.
+ *
+ * @param config Configuration holding the port and route rules
+ * @param synth Synthesizer receiving the events
+ * @param loop Event loop the socket is read from
+ * @return OSC instance, or NULL on error
+ */
+osc_t *osc_init(const midisynthd_config_t *config, synth_t *synth, event_loop_t *loop);
+
+/**
+ * Close the OSC input and log its counters
+ *
+ * Safe to call with NULL pointer.
+ *
+ * @param osc OSC instance
+ */
+void osc_cleanup(osc_t *osc);
+
+/**
+ * Get OSC input counters
+ *
+ * @param osc OSC instance
+ * @param stats Receives the counters
+ * @return 0 on success, -1 on error
+ */
+int osc_get_stats(osc_t *osc, osc_stats_t *stats);
+
+/**
+ * Handle one OSC packet (message or bundle)
+ *
+ * Used by the socket reader; exposed so packets can be injected directly.
+ *
+ * @param osc OSC instance
+ * @param data Packet bytes
+ * @param len Packet length
+ * @return 0 if the packet was well formed, -1 otherwise
+ */
+int osc_handle_packet(osc_t *osc, const uint8_t *data, size_t len);
+
+#endif /* MIDISYNTHD_OSC_H */
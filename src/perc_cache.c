@@ -0,0 +1,441 @@
+/*
+ * midisynthd - System-level MIDI Synthesizer Daemon for Linux
+ * Copyright (C) 2025 ArchLars
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include "perc_cache.h"
+#include "memstat.h"
+#include "threads.h"
+#include "trace.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <syslog.h>
+#include <time.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+#define PERC_CACHE_SLOTS        (128 * PERC_CACHE_LAYERS)
+/* Worker wakeups without requests, to free retired entries */
+#define PERC_CACHE_RECLAIM_MS   250
+
+/**
+ * One rendered hit, interleaved stereo
+ *
+ * Published to the audio thread through a slot and never changed after;
+ * an entry replaced or evicted is retired and freed once the audio thread
+ * has moved on and no hit plays it.
+ */
+typedef struct perc_entry_s {
+    struct perc_entry_s *next;  /* Retired list, worker only */
+    unsigned generation;
+    int frames;                 /* 0 marks a note that is not cached */
+    int exclusive;
+    int playing;                /* Hits mixing it, counted by the audio thread */
+    uint64_t last_played;
+    uint64_t retired_epoch;
+    size_t bytes;
+    float data[];
+} perc_entry_t;
+
+typedef struct {
+    perc_entry_t *entry;
+    int pos;                    /* Frame of the entry at the period start, negative before it */
+    float gain;
+    int fade;                   /* Frames left of a fade-out, 0 when not fading */
+} perc_hit_t;
+
+struct perc_cache_s {
+    perc_render_t render;
+    void *data;
+    int max_frames;
+    size_t budget;
+
+    perc_entry_t *slots[PERC_CACHE_SLOTS];
+    unsigned char requested[PERC_CACHE_SLOTS];
+    unsigned generation;
+    bool silence;
+
+    /* Audio thread */
+    perc_hit_t hits[PERC_CACHE_MAX_HITS];
+    int hit_count;
+    uint64_t play_clock;
+    uint64_t mix_epoch;         /* Periods mixed, read by the worker */
+
+    /* Worker */
+    pthread_t thread;
+    bool thread_started;
+    volatile int running;
+    sem_t wake;
+    float *scratch[2];
+    perc_entry_t *retired;
+    size_t retired_bytes;
+    unsigned swept_generation;
+
+    perc_cache_stats_t stats;
+};
+
+static int slot_of(int note, int velocity) {
+    return note * PERC_CACHE_LAYERS + velocity * PERC_CACHE_LAYERS / 128;
+}
+
+static int layer_velocity(int layer) {
+    int velocity = layer * (128 / PERC_CACHE_LAYERS) + 64 / PERC_CACHE_LAYERS;
+    return velocity > 127 ? 127 : velocity;
+}
+
+/**
+ * Take an entry out of its slot; it is freed by reclaim_retired()
+ */
+static void retire_slot(perc_cache_t *cache, int slot) {
+    perc_entry_t *entry = cache->slots[slot];
+    if (!entry) return;
+    __atomic_store_n(&cache->slots[slot], NULL, __ATOMIC_RELEASE);
+    entry->retired_epoch = __atomic_load_n(&cache->mix_epoch, __ATOMIC_ACQUIRE);
+    entry->next = cache->retired;
+    cache->retired = entry;
+    cache->retired_bytes += entry->bytes;
+    __atomic_fetch_sub(&cache->stats.entries, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * Free retired entries no hit can still reach
+ *
+ * Two mixed periods after the slot was cleared, every play that loaded
+ * the entry has counted itself in @c playing.
+ */
+static void reclaim_retired(perc_cache_t *cache) {
+    uint64_t epoch = __atomic_load_n(&cache->mix_epoch, __ATOMIC_ACQUIRE);
+    perc_entry_t **link = &cache->retired;
+    while (*link) {
+        perc_entry_t *entry = *link;
+        if (epoch >= entry->retired_epoch + 2 && __atomic_load_n(&entry->playing, __ATOMIC_ACQUIRE) == 0) {
+            *link = entry->next;
+            cache->retired_bytes -= entry->bytes;
+            __atomic_fetch_sub(&cache->stats.bytes, entry->bytes, __ATOMIC_RELAXED);
+            memstat_sub(MEMSTAT_BUFFERS, entry->bytes);
+            free(entry);
+        } else {
+            link = &entry->next;
+        }
+    }
+}
+
+/**
+ * Retire the least recently played entry to make room
+ */
+static bool evict_one(perc_cache_t *cache) {
+    int victim = -1;
+    for (int i = 0; i < PERC_CACHE_SLOTS; i++) {
+        perc_entry_t *entry = cache->slots[i];
+        if (entry && (victim < 0 ||
+            __atomic_load_n(&entry->last_played, __ATOMIC_RELAXED) <
+            __atomic_load_n(&cache->slots[victim]->last_played, __ATOMIC_RELAXED))) {
+            victim = i;
+        }
+    }
+    if (victim < 0) return false;
+    retire_slot(cache, victim);
+    __atomic_fetch_add(&cache->stats.evictions, 1, __ATOMIC_RELAXED);
+    return true;
+}
+
+static void render_slot(perc_cache_t *cache, int slot) {
+    unsigned generation = __atomic_load_n(&cache->generation, __ATOMIC_ACQUIRE);
+    perc_entry_t *current = cache->slots[slot];
+    if (current && current->generation == generation) {
+        return;
+    }
+
+    int exclusive = 0;
+    uint64_t span = trace_begin();
+    int frames = cache->render(cache->data, slot / PERC_CACHE_LAYERS, layer_velocity(slot % PERC_CACHE_LAYERS),
+                               cache->scratch[0], cache->scratch[1], cache->max_frames, &exclusive);
+    trace_end(span, "perc-render", frames);
+    if (frames < 0) {
+        frames = 0;
+        __atomic_fetch_add(&cache->stats.uncacheable, 1, __ATOMIC_RELAXED);
+    }
+    /* Channel state changed while rendering: the result is already stale */
+    if (__atomic_load_n(&cache->generation, __ATOMIC_ACQUIRE) != generation) {
+        return;
+    }
+
+    size_t bytes = sizeof(perc_entry_t) + 2 * sizeof(float) * (size_t)frames;
+    retire_slot(cache, slot);
+    reclaim_retired(cache);
+    while (__atomic_load_n(&cache->stats.bytes, __ATOMIC_RELAXED) + bytes > cache->budget) {
+        size_t held = __atomic_load_n(&cache->stats.bytes, __ATOMIC_RELAXED) - cache->retired_bytes;
+        if (held + bytes <= cache->budget) {
+            /* Retired entries still playing hold the room; retry on a later pass */
+            __atomic_store_n(&cache->requested[slot], 1, __ATOMIC_RELEASE);
+            return;
+        }
+        if (!evict_one(cache)) {
+            return;
+        }
+        reclaim_retired(cache);
+    }
+
+    perc_entry_t *entry = malloc(bytes);
+    if (!entry) return;
+    memset(entry, 0, sizeof(*entry));
+    entry->generation = generation;
+    entry->frames = frames;
+    entry->exclusive = exclusive;
+    entry->bytes = bytes;
+    for (int i = 0; i < frames; i++) {
+        entry->data[2 * i] = cache->scratch[0][i];
+        entry->data[2 * i + 1] = cache->scratch[1][i];
+    }
+    memstat_add(MEMSTAT_BUFFERS, bytes);
+    __atomic_fetch_add(&cache->stats.bytes, bytes, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&cache->stats.entries, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&cache->stats.renders, 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&cache->slots[slot], entry, __ATOMIC_RELEASE);
+}
+
+static void *worker_thread(void *arg) {
+    perc_cache_t *cache = arg;
+    threads_register("msd-perc-cache", true);
+
+    while (cache->running) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += PERC_CACHE_RECLAIM_MS * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        if (sem_timedwait(&cache->wake, &deadline) < 0 && errno == EINTR) {
+            continue;
+        }
+
+        /* Stale entries only take memory; hand it back right away */
+        unsigned generation = __atomic_load_n(&cache->generation, __ATOMIC_ACQUIRE);
+        if (generation != cache->swept_generation) {
+            for (int i = 0; i < PERC_CACHE_SLOTS; i++) {
+                if (cache->slots[i] && cache->slots[i]->generation != generation) {
+                    retire_slot(cache, i);
+                }
+            }
+            cache->swept_generation = generation;
+        }
+
+        for (int i = 0; i < PERC_CACHE_SLOTS && cache->running; i++) {
+            if (__atomic_exchange_n(&cache->requested[i], 0, __ATOMIC_ACQ_REL)) {
+                render_slot(cache, i);
+            }
+        }
+        reclaim_retired(cache);
+    }
+
+    threads_unregister();
+    return NULL;
+}
+
+perc_cache_t *perc_cache_create(size_t budget, int sample_rate, perc_render_t render, void *data) {
+    if (budget == 0 || sample_rate <= 0 || !render) {
+        return NULL;
+    }
+
+    perc_cache_t *cache = calloc(1, sizeof(perc_cache_t));
+    if (!cache) {
+        syslog(LOG_ERR, "Failed to allocate percussion cache");
+        return NULL;
+    }
+    cache->render = render;
+    cache->data = data;
+    cache->budget = budget;
+    cache->stats.budget = budget;
+    cache->max_frames = sample_rate * PERC_CACHE_MAX_SECONDS;
+    cache->scratch[0] = malloc(sizeof(float) * (size_t)cache->max_frames);
+    cache->scratch[1] = malloc(sizeof(float) * (size_t)cache->max_frames);
+    if (!cache->scratch[0] || !cache->scratch[1] || sem_init(&cache->wake, 0, 0) < 0) {
+        syslog(LOG_ERR, "Failed to allocate percussion cache");
+        free(cache->scratch[0]);
+        free(cache->scratch[1]);
+        free(cache);
+        return NULL;
+    }
+    memstat_add(MEMSTAT_BUFFERS, 2 * sizeof(float) * (size_t)cache->max_frames);
+
+    cache->running = 1;
+    if (pthread_create(&cache->thread, NULL, worker_thread, cache) != 0) {
+        syslog(LOG_ERR, "Failed to start percussion cache thread");
+        perc_cache_destroy(cache);
+        return NULL;
+    }
+    cache->thread_started = true;
+
+    syslog(LOG_INFO, "Percussion cache: %zu KiB, %d velocity layers", budget / 1024, PERC_CACHE_LAYERS);
+    return cache;
+}
+
+void perc_cache_destroy(perc_cache_t *cache) {
+    if (!cache) return;
+
+    cache->running = 0;
+    if (cache->thread_started) {
+        sem_post(&cache->wake);
+        pthread_join(cache->thread, NULL);
+    }
+    sem_destroy(&cache->wake);
+
+    for (int i = 0; i < PERC_CACHE_SLOTS; i++) {
+        retire_slot(cache, i);
+    }
+    while (cache->retired) {
+        perc_entry_t *entry = cache->retired;
+        cache->retired = entry->next;
+        cache->retired_bytes -= entry->bytes;
+        memstat_sub(MEMSTAT_BUFFERS, entry->bytes);
+        free(entry);
+    }
+    memstat_sub(MEMSTAT_BUFFERS, 2 * sizeof(float) * (size_t)cache->max_frames);
+    free(cache->scratch[0]);
+    free(cache->scratch[1]);
+    free(cache);
+}
+
+bool perc_cache_play(perc_cache_t *cache, int note, int velocity, int offset) {
+    if (!cache || note < 0 || note > 127 || velocity <= 0 || velocity > 127) {
+        return false;
+    }
+
+    int slot = slot_of(note, velocity);
+    perc_entry_t *entry = __atomic_load_n(&cache->slots[slot], __ATOMIC_ACQUIRE);
+    if (!entry || entry->generation != __atomic_load_n(&cache->generation, __ATOMIC_ACQUIRE)) {
+        if (!__atomic_exchange_n(&cache->requested[slot], 1, __ATOMIC_ACQ_REL)) {
+            sem_post(&cache->wake);
+        }
+        __atomic_fetch_add(&cache->stats.misses, 1, __ATOMIC_RELAXED);
+        return false;
+    }
+    if (entry->frames == 0 || cache->hit_count == PERC_CACHE_MAX_HITS) {
+        __atomic_fetch_add(&cache->stats.misses, 1, __ATOMIC_RELAXED);
+        return false;
+    }
+
+    /* A new hit chokes the others of its exclusive class, e.g. hi-hats */
+    if (entry->exclusive) {
+        for (int i = 0; i < cache->hit_count; i++) {
+            perc_hit_t *hit = &cache->hits[i];
+            if (hit->entry->exclusive == entry->exclusive && hit->fade == 0) {
+                hit->fade = PERC_CACHE_FADE;
+            }
+        }
+    }
+
+    /* Rendered at the layer's middle velocity; amplitude follows velocity squared */
+    float ratio = (float)velocity / (float)layer_velocity(slot % PERC_CACHE_LAYERS);
+    perc_hit_t *hit = &cache->hits[cache->hit_count++];
+    hit->entry = entry;
+    hit->pos = -offset;
+    hit->gain = ratio * ratio;
+    hit->fade = 0;
+    __atomic_fetch_add(&entry->playing, 1, __ATOMIC_ACQ_REL);
+    __atomic_store_n(&entry->last_played, ++cache->play_clock, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&cache->stats.hits, 1, __ATOMIC_RELAXED);
+    return true;
+}
+
+void perc_cache_mix(perc_cache_t *cache, float *out[], int nout, int len) {
+    if (!cache) return;
+
+    bool silence = __atomic_exchange_n(&cache->silence, false, __ATOMIC_ACQ_REL);
+    float *left = nout > 0 ? out[0] : NULL;
+    float *right = nout > 1 ? out[1] : NULL;
+
+    for (int h = 0; h < cache->hit_count; ) {
+        perc_hit_t *hit = &cache->hits[h];
+        const perc_entry_t *entry = hit->entry;
+        if (silence && hit->fade == 0) {
+            hit->fade = PERC_CACHE_FADE;
+        }
+
+        bool done = false;
+        for (int i = 0; i < len; i++) {
+            int pos = hit->pos + i;
+            if (pos < 0) continue;
+            if (pos >= entry->frames) {
+                done = true;
+                break;
+            }
+            float gain = hit->gain;
+            if (hit->fade > 0) {
+                gain *= (float)hit->fade / PERC_CACHE_FADE;
+                if (--hit->fade == 0) {
+                    done = true;
+                    break;
+                }
+            }
+            if (left) left[i] += entry->data[2 * pos] * gain;
+            if (right) right[i] += entry->data[2 * pos + 1] * gain;
+        }
+        hit->pos += len;
+
+        if (done) {
+            __atomic_fetch_sub(&hit->entry->playing, 1, __ATOMIC_ACQ_REL);
+            *hit = cache->hits[--cache->hit_count];
+        } else {
+            h++;
+        }
+    }
+
+    __atomic_store_n(&cache->mix_epoch, cache->mix_epoch + 1, __ATOMIC_RELEASE);
+}
+
+void perc_cache_invalidate(perc_cache_t *cache) {
+    if (!cache) return;
+    __atomic_fetch_add(&cache->generation, 1, __ATOMIC_ACQ_REL);
+    __atomic_fetch_add(&cache->stats.invalidations, 1, __ATOMIC_RELAXED);
+}
+
+void perc_cache_silence(perc_cache_t *cache) {
+    if (!cache) return;
+    __atomic_store_n(&cache->silence, true, __ATOMIC_RELEASE);
+}
+
+int perc_cache_get_stats(perc_cache_t *cache, perc_cache_stats_t *stats) {
+    if (!cache || !stats) return -1;
+    stats->hits = __atomic_load_n(&cache->stats.hits, __ATOMIC_RELAXED);
+    stats->misses = __atomic_load_n(&cache->stats.misses, __ATOMIC_RELAXED);
+    stats->renders = __atomic_load_n(&cache->stats.renders, __ATOMIC_RELAXED);
+    stats->uncacheable = __atomic_load_n(&cache->stats.uncacheable, __ATOMIC_RELAXED);
+    stats->evictions = __atomic_load_n(&cache->stats.evictions, __ATOMIC_RELAXED);
+    stats->invalidations = __atomic_load_n(&cache->stats.invalidations, __ATOMIC_RELAXED);
+    stats->entries = __atomic_load_n(&cache->stats.entries, __ATOMIC_RELAXED);
+    stats->bytes = __atomic_load_n(&cache->stats.bytes, __ATOMIC_RELAXED);
+    stats->budget = cache->budget;
+    return 0;
+}
+
+void perc_cache_log(perc_cache_t *cache) {
+    perc_cache_stats_t s;
+    if (perc_cache_get_stats(cache, &s) < 0) return;
+    uint64_t notes = s.hits + s.misses;
+    syslog(LOG_INFO, "Percussion cache: %llu of %llu notes cached (%.1f%%), %d entries in %zu/%zu KiB, "
+           "%llu renders (%llu not cacheable), %llu evictions, %llu invalidations",
+           (unsigned long long)s.hits, (unsigned long long)notes,
+           notes ? 100.0 * (double)s.hits / (double)notes : 0.0,
+           s.entries, s.bytes / 1024, s.budget / 1024,
+           (unsigned long long)s.renders, (unsigned long long)s.uncacheable,
+           (unsigned long long)s.evictions, (unsigned long long)s.invalidations);
+}
@@ -0,0 +1,157 @@
+/*
+ * midisynthd - System-level MIDI Synthesizer Daemon for Linux
+ * Copyright (C) 2025 ArchLars
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef MIDISYNTHD_PERC_CACHE_H
+#define MIDISYNTHD_PERC_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Velocity layers kept per note; a layer is rendered at its middle velocity */
+#define PERC_CACHE_LAYERS       8
+/* Cached hits mixed at once; further hits play as live voices */
+#define PERC_CACHE_MAX_HITS     64
+/* Longest hit kept, tails beyond it are faded out */
+#define PERC_CACHE_MAX_SECONDS  2
+/* Frames a choked or silenced hit fades over */
+#define PERC_CACHE_FADE         64
+
+typedef struct perc_cache_s perc_cache_t;
+
+/**
+ * Render one hit for the cache
+ *
+ * Called on the cache's worker thread. Renders @p note at @p velocity
+ * from silence until it has died away, at most @p max_frames.
+ *
+ * @param data User data given to perc_cache_create()
+ * @param note MIDI note
+ * @param velocity Velocity to render at
+ * @param left Receives the left channel
+ * @param right Receives the right channel
+ * @param max_frames Capacity of @p left and @p right
+ * @param exclusive Receives the exclusive class of the hit, 0 for none
+ * @return Frames rendered, or -1 when the hit must not be cached
+ */
+typedef int (*perc_render_t)(void *data, int note, int velocity, float *left, float *right,
+                             int max_frames, int *exclusive);
+
+/**
+ * Percussion cache counters
+ */
+typedef struct {
+    uint64_t hits;              /* Notes played from the cache */
+    uint64_t misses;            /* Notes left to a live voice */
+    uint64_t renders;           /* Entries rendered */
+    uint64_t uncacheable;       /* Renders refused by the render function */
+    uint64_t evictions;         /* Entries dropped to stay within the budget */
+    uint64_t invalidations;     /* Times every entry was made stale */
+    int entries;                /* Entries currently held */
+    size_t bytes;               /* Memory held by entries */
+    size_t budget;
+} perc_cache_stats_t;
+
+/**
+ * Create a percussion render cache and start its worker thread
+ *
+ * The first note on a (note, velocity layer) misses and is played live;
+ * the worker then renders it with @p render, and later notes mix that
+ * buffer. Entries rendered since the last perc_cache_invalidate() are
+ * used, and the least recently played go when @p budget is reached.
+ *
+ * @param budget Bytes of rendered audio to keep
+ * @param sample_rate Sample rate of the rendered audio
+ * @param render Render function
+ * @param data User data passed to @p render
+ * @return Cache, or NULL on error
+ */
+perc_cache_t *perc_cache_create(size_t budget, int sample_rate, perc_render_t render, void *data);
+
+/**
+ * Stop the worker and free every entry
+ *
+ * Nothing may mix the cache any more. Safe to call with NULL pointer.
+ *
+ * @param cache Cache
+ */
+void perc_cache_destroy(perc_cache_t *cache);
+
+/**
+ * Start a cached hit
+ *
+ * Audio thread only. On a miss the entry is requested from the worker
+ * and the caller plays the note live.
+ *
+ * @param cache Cache
+ * @param note MIDI note
+ * @param velocity Note velocity, 1-127
+ * @param offset Frame in the current period the hit starts at
+ * @return true when the hit plays from the cache
+ */
+bool perc_cache_play(perc_cache_t *cache, int note, int velocity, int offset);
+
+/**
+ * Add the cached hits to a period
+ *
+ * Audio thread only; call once per period after the hits were started.
+ *
+ * @param cache Cache
+ * @param out Output buffers, left and right first
+ * @param nout Number of output buffers
+ * @param len Period length in frames
+ */
+void perc_cache_mix(perc_cache_t *cache, float *out[], int nout, int len);
+
+/**
+ * Make every entry stale, e.g. after a controller change
+ *
+ * Hits already playing continue. Safe from any thread.
+ *
+ * @param cache Cache
+ */
+void perc_cache_invalidate(perc_cache_t *cache);
+
+/**
+ * Fade out every playing hit at the next period
+ *
+ * Safe from any thread.
+ *
+ * @param cache Cache
+ */
+void perc_cache_silence(perc_cache_t *cache);
+
+/**
+ * Get cache counters
+ *
+ * @param cache Cache
+ * @param stats Receives the counters
+ * @return 0 on success, -1 on error
+ */
+int perc_cache_get_stats(perc_cache_t *cache, perc_cache_stats_t *stats);
+
+/**
+ * Log cache counters to syslog
+ *
+ * @param cache Cache, may be NULL
+ */
+void perc_cache_log(perc_cache_t *cache);
+
+#endif /* MIDISYNTHD_PERC_CACHE_H */
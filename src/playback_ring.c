@@ -0,0 +1,96 @@
+/*
+ * midisynthd - System-level MIDI Synthesizer Daemon for Linux
+ * Copyright (C) 2025 ArchLars
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include "playback_ring.h"
+#include <stdlib.h>
+#include <string.h>
+
+int playback_ring_init(playback_ring_t *ring, int block, int blocks) {
+    memset(ring, 0, sizeof(*ring));
+    if (block <= 0 || blocks <= 0) return -1;
+    ring->block = block;
+    ring->frames = (uint64_t)block * (uint64_t)blocks;
+    ring->buf[0] = calloc((size_t)ring->frames, sizeof(float));
+    ring->buf[1] = calloc((size_t)ring->frames, sizeof(float));
+    if (!ring->buf[0] || !ring->buf[1]) {
+        playback_ring_free(ring);
+        return -1;
+    }
+    return 0;
+}
+
+void playback_ring_free(playback_ring_t *ring) {
+    free(ring->buf[0]);
+    free(ring->buf[1]);
+    ring->buf[0] = ring->buf[1] = NULL;
+}
+
+bool playback_ring_mix(playback_ring_t *ring, int len, int nout, float *out[]) {
+    uint64_t read = ring->read;
+    uint64_t avail = __atomic_load_n(&ring->write, __ATOMIC_ACQUIRE) - read;
+    int frames = avail < (uint64_t)len ? (int)avail : len;
+
+    for (int done = 0; done < frames; ) {
+        uint64_t pos = (read + (uint64_t)done) % ring->frames;
+        int chunk = frames - done;
+        if ((uint64_t)chunk > ring->frames - pos) {
+            chunk = (int)(ring->frames - pos);
+        }
+        for (int c = 0; c < 2 && c < nout; c++) {
+            if (!out[c]) continue;
+            float *dst = out[c] + done;
+            const float *src = ring->buf[c] + pos;
+            for (int i = 0; i < chunk; i++) {
+                dst[i] += src[i];
+            }
+        }
+        done += chunk;
+    }
+    __atomic_store_n(&ring->read, read + (uint64_t)frames, __ATOMIC_RELEASE);
+
+    if (frames < len) {
+        ring->underruns++;
+        __atomic_store_n(&ring->play_offset, ring->play_offset + (uint64_t)(len - frames), __ATOMIC_RELAXED);
+    }
+    return ring->frames - (avail - (uint64_t)frames) >= (uint64_t)ring->block;
+}
+
+bool playback_ring_claim(playback_ring_t *ring, float *out[2]) {
+    uint64_t write = ring->write;
+    uint64_t used = write - __atomic_load_n(&ring->read, __ATOMIC_ACQUIRE);
+    if (ring->frames - used < (uint64_t)ring->block) {
+        return false;
+    }
+    uint64_t pos = write % ring->frames;
+    for (int c = 0; c < 2; c++) {
+        out[c] = ring->buf[c] + pos;
+        memset(out[c], 0, (size_t)ring->block * sizeof(float));
+    }
+    return true;
+}
+
+void playback_ring_commit(playback_ring_t *ring) {
+    __atomic_store_n(&ring->write, ring->write + (uint64_t)ring->block, __ATOMIC_RELEASE);
+}
+
+uint64_t playback_ring_clock(const playback_ring_t *ring, uint64_t live_frame) {
+    uint64_t offset = __atomic_load_n(&ring->play_offset, __ATOMIC_RELAXED);
+    return live_frame > offset ? live_frame - offset : 0;
+}
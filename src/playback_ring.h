@@ -0,0 +1,103 @@
+/*
+ * midisynthd - System-level MIDI Synthesizer Daemon for Linux
+ * Copyright (C) 2025 ArchLars
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef MIDISYNTHD_PLAYBACK_RING_H
+#define MIDISYNTHD_PLAYBACK_RING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Stereo ring between the playback engine, which renders whole blocks
+ * ahead, and the live audio thread, which mixes them into its periods
+ *
+ * Single producer, single consumer and lock-free. Declared in the header
+ * so the synthesizer can embed it.
+ */
+typedef struct {
+    float *buf[2];
+    uint64_t frames;            /* Capacity, a whole number of blocks */
+    int block;                  /* Frames rendered at a time */
+    uint64_t read;              /* Frames mixed, advanced by the consumer */
+    uint64_t write;             /* Frames rendered, advanced by the producer */
+    uint64_t play_offset;       /* Consumer frames the ring fell behind by */
+    uint64_t underruns;         /* Periods the ring could not cover, consumer only */
+} playback_ring_t;
+
+/**
+ * Allocate the ring buffers
+ *
+ * @param ring Ring to initialize
+ * @param block Frames rendered at a time
+ * @param blocks Capacity in blocks
+ * @return 0 on success, -1 when out of memory
+ */
+int playback_ring_init(playback_ring_t *ring, int block, int blocks);
+
+/**
+ * Free the ring buffers
+ *
+ * @param ring Ring, may be uninitialized zeroed memory
+ */
+void playback_ring_free(playback_ring_t *ring);
+
+/**
+ * Add rendered audio to a period, consumer side
+ *
+ * What the ring cannot cover is left untouched, counted as an underrun,
+ * and the playback clock holds back by as many frames.
+ *
+ * @param ring Ring
+ * @param len Period length in frames
+ * @param nout Number of output buffers; the first two are mixed into
+ * @param out Output buffers, entries may be NULL
+ * @return true when a block of space is free for the producer
+ */
+bool playback_ring_mix(playback_ring_t *ring, int len, int nout, float *out[]);
+
+/**
+ * Claim the next block for rendering, producer side
+ *
+ * Blocks never wrap, so the claimed buffers are contiguous. They are
+ * cleared before they are returned.
+ *
+ * @param ring Ring
+ * @param out Receives the left and right buffers of the block
+ * @return true if a block was free, false when the ring is full
+ */
+bool playback_ring_claim(playback_ring_t *ring, float *out[2]);
+
+/**
+ * Publish the block claimed last to the consumer
+ *
+ * @param ring Ring
+ */
+void playback_ring_commit(playback_ring_t *ring);
+
+/**
+ * Map the live render clock onto the playback audio being heard
+ *
+ * @param ring Ring
+ * @param live_frame Current frame of the live engine
+ * @return Playback frame heard now
+ */
+uint64_t playback_ring_clock(const playback_ring_t *ring, uint64_t live_frame);
+
+#endif /* MIDISYNTHD_PLAYBACK_RING_H */
@@ -0,0 +1,326 @@
+/*
+ * midisynthd - System-level MIDI Synthesizer Daemon for Linux
+ * Copyright (C) 2025 ArchLars
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#define _GNU_SOURCE
+#include "rt_sentinel.h"
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <poll.h>
+#include <pthread.h>
+#include <syslog.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * The definitions below take precedence over libc's for every object in
+ * the process, shared libraries included. Each checks the thread's mark
+ * and forwards to the next definition; the allocator is reached through
+ * glibc's __libc_* entry points, since dlsym() itself allocates.
+ */
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+typedef struct {
+    rt_call_t call;
+    int depth;
+    uint64_t hits;
+    void *frames[RT_SENTINEL_FRAMES];
+    bool ready;                 /* Published; frames no longer change */
+} site_t;
+
+static const char *call_names[RT_CALL_COUNT] = {
+    [RT_CALL_MALLOC]     = "malloc",
+    [RT_CALL_CALLOC]     = "calloc",
+    [RT_CALL_REALLOC]    = "realloc",
+    [RT_CALL_FREE]       = "free",
+    [RT_CALL_SYSLOG]     = "syslog",
+    [RT_CALL_MUTEX_LOCK] = "pthread_mutex_lock",
+    [RT_CALL_SLEEP]      = "sleep",
+    [RT_CALL_POLL]       = "poll",
+    [RT_CALL_READ]       = "read",
+    [RT_CALL_WRITE]      = "write",
+    [RT_CALL_OPEN]       = "open",
+};
+
+static uint64_t counts[RT_CALL_COUNT];
+static site_t sites[RT_SENTINEL_MAX_SITES];
+static int site_count;
+static uint64_t sites_dropped;
+
+static __thread int rt_depth;       /* Nesting of marked sections */
+static __thread bool trapping;      /* Inside trap(); its own calls pass */
+
+static void (*real_vsyslog)(int, const char *, va_list);
+static int (*real_mutex_lock)(pthread_mutex_t *);
+static int (*real_nanosleep)(const struct timespec *, struct timespec *);
+static int (*real_clock_nanosleep)(clockid_t, int, const struct timespec *, struct timespec *);
+static int (*real_usleep)(useconds_t);
+static int (*real_poll)(struct pollfd *, nfds_t, int);
+static ssize_t (*real_read)(int, void *, size_t);
+static ssize_t (*real_write)(int, const void *, size_t);
+static int (*real_open)(const char *, int, ...);
+static FILE *(*real_fopen)(const char *, const char *);
+
+#define RESOLVE(fn, name) \
+    do { if (!fn) fn = (__typeof__(fn))dlsym(RTLD_NEXT, name); } while (0)
+
+__attribute__((constructor))
+static void sentinel_init(void) {
+    /* The first backtrace() loads libgcc; do it before any trap */
+    void *frames[2];
+    backtrace(frames, 2);
+    RESOLVE(real_vsyslog, "vsyslog");
+    RESOLVE(real_mutex_lock, "pthread_mutex_lock");
+    RESOLVE(real_nanosleep, "nanosleep");
+    RESOLVE(real_clock_nanosleep, "clock_nanosleep");
+    RESOLVE(real_usleep, "usleep");
+    RESOLVE(real_poll, "poll");
+    RESOLVE(real_read, "read");
+    RESOLVE(real_write, "write");
+    RESOLVE(real_open, "open");
+    RESOLVE(real_fopen, "fopen");
+}
+
+static bool same_site(const site_t *s, rt_call_t call, void **frames, int depth) {
+    return s->call == call && s->depth == depth &&
+           memcmp(s->frames, frames, (size_t)depth * sizeof(void *)) == 0;
+}
+
+static void record_site(rt_call_t call, void **frames, int depth) {
+    int n = __atomic_load_n(&site_count, __ATOMIC_ACQUIRE);
+    for (int i = 0; i < n && i < RT_SENTINEL_MAX_SITES; i++) {
+        if (__atomic_load_n(&sites[i].ready, __ATOMIC_ACQUIRE) && same_site(&sites[i], call, frames, depth)) {
+            __atomic_fetch_add(&sites[i].hits, 1, __ATOMIC_RELAXED);
+            return;
+        }
+    }
+
+    int slot = __atomic_fetch_add(&site_count, 1, __ATOMIC_ACQ_REL);
+    if (slot >= RT_SENTINEL_MAX_SITES) {
+        __atomic_fetch_add(&sites_dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    site_t *s = &sites[slot];
+    s->call = call;
+    s->depth = depth;
+    s->hits = 1;
+    memcpy(s->frames, frames, (size_t)depth * sizeof(void *));
+    __atomic_store_n(&s->ready, true, __ATOMIC_RELEASE);
+}
+
+/**
+ * Count a call made on a marked thread and sample where it came from
+ */
+__attribute__((noinline))
+static void trap(rt_call_t call) {
+    if (rt_depth == 0 || trapping) return;
+    trapping = true;
+    __atomic_fetch_add(&counts[call], 1, __ATOMIC_RELAXED);
+
+    /* Skip trap() and the interposed function */
+    void *frames[RT_SENTINEL_FRAMES + 2];
+    int depth = backtrace(frames, RT_SENTINEL_FRAMES + 2) - 2;
+    if (depth > 0) {
+        record_site(call, frames + 2, depth);
+    }
+    trapping = false;
+}
+
+void rt_sentinel_enter(void) {
+    rt_depth++;
+}
+
+void rt_sentinel_leave(void) {
+    if (rt_depth > 0) rt_depth--;
+}
+
+void rt_sentinel_get_stats(rt_sentinel_stats_t *stats) {
+    if (!stats) return;
+    memset(stats, 0, sizeof(*stats));
+    for (int i = 0; i < RT_CALL_COUNT; i++) {
+        stats->calls[i] = __atomic_load_n(&counts[i], __ATOMIC_RELAXED);
+        stats->total += stats->calls[i];
+    }
+    int n = __atomic_load_n(&site_count, __ATOMIC_ACQUIRE);
+    stats->sites = n < RT_SENTINEL_MAX_SITES ? n : RT_SENTINEL_MAX_SITES;
+}
+
+void rt_sentinel_reset(void) {
+    for (int i = 0; i < RT_CALL_COUNT; i++) {
+        __atomic_store_n(&counts[i], 0, __ATOMIC_RELAXED);
+    }
+    for (int i = 0; i < RT_SENTINEL_MAX_SITES; i++) {
+        __atomic_store_n(&sites[i].ready, false, __ATOMIC_RELEASE);
+    }
+    __atomic_store_n(&site_count, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&sites_dropped, 0, __ATOMIC_RELAXED);
+}
+
+void rt_sentinel_report(void) {
+    rt_sentinel_stats_t stats;
+    rt_sentinel_get_stats(&stats);
+    if (stats.total == 0) {
+        syslog(LOG_INFO, "RT sentinel: no allocation, logging or blocking call on real-time paths");
+        return;
+    }
+
+    syslog(LOG_WARNING, "RT sentinel: %llu calls on real-time paths from %d call sites",
+           (unsigned long long)stats.total, stats.sites);
+    for (int i = 0; i < RT_CALL_COUNT; i++) {
+        if (stats.calls[i] > 0) {
+            syslog(LOG_WARNING, "RT sentinel:   %s: %llu", call_names[i], (unsigned long long)stats.calls[i]);
+        }
+    }
+    for (int i = 0; i < stats.sites; i++) {
+        const site_t *s = &sites[i];
+        if (!__atomic_load_n(&s->ready, __ATOMIC_ACQUIRE)) continue;
+        syslog(LOG_WARNING, "RT sentinel: site %d, %s x%llu:", i + 1, call_names[s->call],
+               (unsigned long long)__atomic_load_n(&s->hits, __ATOMIC_RELAXED));
+        char **symbols = backtrace_symbols(s->frames, s->depth);
+        for (int f = 0; f < s->depth; f++) {
+            syslog(LOG_WARNING, "RT sentinel:     #%d %s", f, symbols ? symbols[f] : "?");
+        }
+        free(symbols);
+    }
+    uint64_t dropped = __atomic_load_n(&sites_dropped, __ATOMIC_RELAXED);
+    if (dropped > 0) {
+        syslog(LOG_WARNING, "RT sentinel: %llu calls from further sites not sampled",
+               (unsigned long long)dropped);
+    }
+}
+
+/* --- Interposed calls ---------------------------------------------------- */
+
+void *malloc(size_t size) {
+    trap(RT_CALL_MALLOC);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size) {
+    trap(RT_CALL_CALLOC);
+    return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    trap(RT_CALL_REALLOC);
+    return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr) {
+    if (ptr) trap(RT_CALL_FREE);
+    __libc_free(ptr);
+}
+
+void vsyslog(int priority, const char *format, va_list ap) {
+    trap(RT_CALL_SYSLOG);
+    RESOLVE(real_vsyslog, "vsyslog");
+    if (real_vsyslog) real_vsyslog(priority, format, ap);
+}
+
+void syslog(int priority, const char *format, ...) {
+    va_list ap;
+    trap(RT_CALL_SYSLOG);
+    va_start(ap, format);
+    RESOLVE(real_vsyslog, "vsyslog");
+    if (real_vsyslog) real_vsyslog(priority, format, ap);
+    va_end(ap);
+}
+
+/* What syslog() compiles to with _FORTIFY_SOURCE */
+void __syslog_chk(int priority, int flag, const char *format, ...) {
+    va_list ap;
+    (void)flag;
+    trap(RT_CALL_SYSLOG);
+    va_start(ap, format);
+    RESOLVE(real_vsyslog, "vsyslog");
+    if (real_vsyslog) real_vsyslog(priority, format, ap);
+    va_end(ap);
+}
+
+int pthread_mutex_lock(pthread_mutex_t *mutex) {
+    trap(RT_CALL_MUTEX_LOCK);
+    RESOLVE(real_mutex_lock, "pthread_mutex_lock");
+    return real_mutex_lock(mutex);
+}
+
+int nanosleep(const struct timespec *req, struct timespec *rem) {
+    trap(RT_CALL_SLEEP);
+    RESOLVE(real_nanosleep, "nanosleep");
+    return real_nanosleep(req, rem);
+}
+
+int clock_nanosleep(clockid_t clock, int flags, const struct timespec *req, struct timespec *rem) {
+    trap(RT_CALL_SLEEP);
+    RESOLVE(real_clock_nanosleep, "clock_nanosleep");
+    return real_clock_nanosleep(clock, flags, req, rem);
+}
+
+int usleep(useconds_t usec) {
+    trap(RT_CALL_SLEEP);
+    RESOLVE(real_usleep, "usleep");
+    return real_usleep(usec);
+}
+
+int poll(struct pollfd *fds, nfds_t nfds, int timeout) {
+    trap(RT_CALL_POLL);
+    RESOLVE(real_poll, "poll");
+    return real_poll(fds, nfds, timeout);
+}
+
+ssize_t read(int fd, void *buf, size_t count) {
+    trap(RT_CALL_READ);
+    RESOLVE(real_read, "read");
+    return real_read(fd, buf, count);
+}
+
+ssize_t write(int fd, const void *buf, size_t count) {
+    trap(RT_CALL_WRITE);
+    RESOLVE(real_write, "write");
+    return real_write(fd, buf, count);
+}
+
+int open(const char *path, int flags, ...) {
+    mode_t mode = 0;
+    if (flags & (O_CREAT | O_TMPFILE)) {
+        va_list ap;
+        va_start(ap, flags);
+        mode = (mode_t)va_arg(ap, int);
+        va_end(ap);
+    }
+    trap(RT_CALL_OPEN);
+    RESOLVE(real_open, "open");
+    return real_open(path, flags, mode);
+}
+
+FILE *fopen(const char *path, const char *mode) {
+    trap(RT_CALL_OPEN);
+    RESOLVE(real_fopen, "fopen");
+    return real_fopen(path, mode);
+}
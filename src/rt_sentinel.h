@@ -0,0 +1,107 @@
+/*
+ * midisynthd - System-level MIDI Synthesizer Daemon for Linux
+ * Copyright (C) 2025 ArchLars
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef MIDISYNTHD_RT_SENTINEL_H
+#define MIDISYNTHD_RT_SENTINEL_H
+
+#include <stdint.h>
+
+/*
+ * Real-time safety sentinel (debug builds with -DENABLE_RT_SENTINEL=ON)
+ *
+ * Code that must not allocate, log or block is bracketed with
+ * RT_SENTINEL_ENTER() and RT_SENTINEL_LEAVE(). The sentinel interposes
+ * malloc and friends, syslog and common blocking calls for the whole
+ * process, FluidSynth included; a call made on a thread inside such a
+ * section is counted and a backtrace of its call site is kept. Without
+ * the option the markers compile to nothing.
+ */
+
+/* Distinct call sites whose backtraces are kept */
+#define RT_SENTINEL_MAX_SITES   32
+/* Frames kept per call site */
+#define RT_SENTINEL_FRAMES      12
+
+typedef enum {
+    RT_CALL_MALLOC = 0,
+    RT_CALL_CALLOC,
+    RT_CALL_REALLOC,
+    RT_CALL_FREE,
+    RT_CALL_SYSLOG,
+    RT_CALL_MUTEX_LOCK,
+    RT_CALL_SLEEP,
+    RT_CALL_POLL,
+    RT_CALL_READ,
+    RT_CALL_WRITE,
+    RT_CALL_OPEN,
+    RT_CALL_COUNT
+} rt_call_t;
+
+/**
+ * Calls trapped on real-time paths
+ */
+typedef struct {
+    uint64_t total;
+    uint64_t calls[RT_CALL_COUNT];
+    int sites;                  /* Distinct call sites sampled */
+} rt_sentinel_stats_t;
+
+#if HAVE_RT_SENTINEL
+
+/**
+ * Mark the calling thread as running real-time code
+ *
+ * Sections nest; the thread is unmarked at the matching leave.
+ */
+void rt_sentinel_enter(void);
+void rt_sentinel_leave(void);
+
+/**
+ * Get trap counters
+ *
+ * @param stats Receives the counters
+ */
+void rt_sentinel_get_stats(rt_sentinel_stats_t *stats);
+
+/**
+ * Log trap counters and a symbolized backtrace per call site to syslog
+ *
+ * Must not be called from a marked section.
+ */
+void rt_sentinel_report(void);
+
+/**
+ * Forget all counters and call sites
+ */
+void rt_sentinel_reset(void);
+
+#define RT_SENTINEL_ENTER()     rt_sentinel_enter()
+#define RT_SENTINEL_LEAVE()     rt_sentinel_leave()
+#define RT_SENTINEL_REPORT()    rt_sentinel_report()
+
+#else
+
+#define RT_SENTINEL_ENTER()     do { } while (0)
+#define RT_SENTINEL_LEAVE()     do { } while (0)
+#define RT_SENTINEL_REPORT()    do { } while (0)
+
+#endif /* HAVE_RT_SENTINEL */
+
+#endif /* MIDISYNTHD_RT_SENTINEL_H */
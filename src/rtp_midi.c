@@ -0,0 +1,719 @@
+/*
+ * midisynthd - System-level MIDI Synthesizer Daemon for Linux
+ * Copyright (C) 2025 ArchLars
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include "rtp_midi.h"
+#include "midi_parser.h"
+#include "midi_router.h"
+#include "memstat.h"
+#include "monotonic.h"
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <syslog.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+/* Datagrams read per wakeup before yielding to other descriptors */
+#define RTP_MIDI_READS_PER_WAKEUP   16
+/* Interval between receiver feedback packets to each peer */
+#define RTP_MIDI_FEEDBACK_NS        1000000000ULL
+/* AppleMIDI protocol version */
+#define APPLEMIDI_VERSION           2
+/* RTP payload type used by AppleMIDI */
+#define RTP_MIDI_PAYLOAD_TYPE       0x61
+/* Session clock ticks per second (100 us units) */
+#define RTP_MIDI_CLOCK_RATE         10000
+
+typedef struct {
+    bool used;
+    bool data_open;
+    uint32_t ssrc;
+    uint32_t token;
+    char name[64];
+    struct sockaddr_in control_addr;
+    struct sockaddr_in data_addr;
+
+    bool seq_valid;
+    uint16_t last_seq;
+    uint8_t running_status;     /* Carried into the next packet for phantom status */
+
+    bool clock_valid;
+    uint32_t offset;            /* Sender clock minus local clock, 100 us units */
+    uint64_t last_feedback_ns;
+
+    uint8_t notes[16][128];     /* Velocity of notes sounding after routing, 0 if off */
+} rtp_peer_t;
+
+struct rtp_midi_s {
+    synth_t *synth;
+    event_loop_t *loop;
+    midi_router_t *router;
+    int control_fd;
+    int data_fd;
+    int port;
+    int sample_rate;
+    uint32_t ssrc;
+    char name[CONFIG_MAX_STRING_LEN];
+    uint64_t start_ns;
+
+    rtp_peer_t peers[RTP_MIDI_MAX_PEERS];
+    rtp_midi_stats_t stats;
+};
+
+/**
+ * Local session clock in 100 us units
+ */
+static uint64_t local_time(rtp_midi_t *rtp) {
+    return (monotonic_ns() - rtp->start_ns) / (1000000000ULL / RTP_MIDI_CLOCK_RATE);
+}
+
+static uint16_t read_be16(const uint8_t *p) {
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static uint32_t read_be32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static uint64_t read_be64(const uint8_t *p) {
+    return ((uint64_t)read_be32(p) << 32) | read_be32(p + 4);
+}
+
+static void write_be32(uint8_t *p, uint32_t v) {
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static void write_be64(uint8_t *p, uint64_t v) {
+    write_be32(p, (uint32_t)(v >> 32));
+    write_be32(p + 4, (uint32_t)v);
+}
+
+static rtp_peer_t *find_peer(rtp_midi_t *rtp, uint32_t ssrc) {
+    for (int i = 0; i < RTP_MIDI_MAX_PEERS; i++) {
+        if (rtp->peers[i].used && rtp->peers[i].ssrc == ssrc) return &rtp->peers[i];
+    }
+    return NULL;
+}
+
+static void track_note(rtp_peer_t *peer, const uint8_t *msg, size_t len) {
+    if (len < 3) return;
+    uint8_t type = msg[0] & 0xF0;
+    if (type == 0x90 && msg[2] > 0) {
+        peer->notes[msg[0] & 0x0F][msg[1]] = msg[2];
+    } else if (type == 0x80 || type == 0x90) {
+        peer->notes[msg[0] & 0x0F][msg[1]] = 0;
+    }
+}
+
+/**
+ * Route a channel message, then play it at its sender time or now
+ *
+ * @param timed Whether @p ts is a sender timestamp to schedule against
+ */
+static void play(rtp_midi_t *rtp, rtp_peer_t *peer, uint8_t *msg, size_t len, bool timed, uint32_t ts) {
+    if (rtp->router && !midi_router_apply(rtp->router, msg, len)) return;
+    track_note(peer, msg, len);
+
+    if (timed && peer->clock_valid) {
+        uint32_t local = ts - peer->offset;
+        int32_t ahead = (int32_t)(local - (uint32_t)local_time(rtp));
+        double secs = (double)ahead / RTP_MIDI_CLOCK_RATE + RTP_MIDI_PLAYOUT_MS / 1000.0;
+        if (secs > 0.0) {
+            uint64_t frame = synth_get_frame_time(rtp->synth) + (uint64_t)(secs * rtp->sample_rate + 0.5);
+            if (synth_schedule_midi(rtp->synth, frame, msg, len) == 0) {
+                rtp->stats.scheduled++;
+                return;
+            }
+        } else {
+            rtp->stats.late++;
+        }
+    }
+    synth_process_midi_data(rtp->synth, msg, len);
+}
+
+/**
+ * Release every note a peer left sounding
+ */
+static void release_notes(rtp_midi_t *rtp, rtp_peer_t *peer) {
+    for (int ch = 0; ch < 16; ch++) {
+        for (int key = 0; key < 128; key++) {
+            if (peer->notes[ch][key] == 0) continue;
+            uint8_t off[3] = { (uint8_t)(0x80 | ch), (uint8_t)key, 0 };
+            synth_process_midi_data(rtp->synth, off, sizeof(off));
+            peer->notes[ch][key] = 0;
+        }
+    }
+}
+
+static void send_packet(int fd, const struct sockaddr_in *to, const uint8_t *buf, size_t len) {
+    if (sendto(fd, buf, len, 0, (const struct sockaddr *)to, sizeof(*to)) < 0) {
+        syslog(LOG_DEBUG, "RTP-MIDI: send failed: %s", strerror(errno));
+    }
+}
+
+/**
+ * Send an invitation reply (OK or NO)
+ */
+static void send_reply(rtp_midi_t *rtp, int fd, const struct sockaddr_in *to,
+                       const char *cmd, uint32_t token) {
+    uint8_t buf[16 + CONFIG_MAX_STRING_LEN];
+    size_t len = 16;
+    buf[0] = 0xFF;
+    buf[1] = 0xFF;
+    buf[2] = (uint8_t)cmd[0];
+    buf[3] = (uint8_t)cmd[1];
+    write_be32(buf + 4, APPLEMIDI_VERSION);
+    write_be32(buf + 8, token);
+    write_be32(buf + 12, rtp->ssrc);
+    if (cmd[0] == 'O') {
+        size_t n = strlen(rtp->name) + 1;
+        memcpy(buf + 16, rtp->name, n);
+        len += n;
+    }
+    send_packet(fd, to, buf, len);
+}
+
+static void send_feedback(rtp_midi_t *rtp, rtp_peer_t *peer) {
+    uint64_t now = monotonic_ns();
+    if (now - peer->last_feedback_ns < RTP_MIDI_FEEDBACK_NS) return;
+    peer->last_feedback_ns = now;
+
+    uint8_t buf[12] = { 0xFF, 0xFF, 'R', 'S' };
+    write_be32(buf + 4, rtp->ssrc);
+    buf[8] = peer->last_seq >> 8;
+    buf[9] = peer->last_seq & 0xFF;
+    send_packet(rtp->control_fd, &peer->control_addr, buf, sizeof(buf));
+}
+
+static void handle_invitation(rtp_midi_t *rtp, int fd, bool data_port,
+                              const uint8_t *p, size_t len, const struct sockaddr_in *from) {
+    if (len < 16 || read_be32(p + 4) != APPLEMIDI_VERSION) {
+        rtp->stats.errors++;
+        return;
+    }
+    uint32_t token = read_be32(p + 8);
+    uint32_t ssrc = read_be32(p + 12);
+    rtp_peer_t *peer = find_peer(rtp, ssrc);
+
+    if (data_port) {
+        if (!peer) {
+            send_reply(rtp, fd, from, "NO", token);
+            return;
+        }
+        peer->data_addr = *from;
+        peer->data_open = true;
+        send_reply(rtp, fd, from, "OK", token);
+        syslog(LOG_INFO, "RTP-MIDI: session with %s established", peer->name);
+        return;
+    }
+
+    if (!peer) {
+        for (int i = 0; i < RTP_MIDI_MAX_PEERS; i++) {
+            if (!rtp->peers[i].used) {
+                peer = &rtp->peers[i];
+                break;
+            }
+        }
+    }
+    if (!peer) {
+        syslog(LOG_WARNING, "RTP-MIDI: too many sessions, declining invitation");
+        send_reply(rtp, fd, from, "NO", token);
+        return;
+    }
+
+    memset(peer, 0, sizeof(*peer));
+    peer->used = true;
+    peer->ssrc = ssrc;
+    peer->token = token;
+    peer->control_addr = *from;
+    size_t name_len = strnlen((const char *)p + 16, len - 16);
+    if (name_len >= sizeof(peer->name)) name_len = sizeof(peer->name) - 1;
+    memcpy(peer->name, p + 16, name_len);
+    peer->name[name_len] = '\0';
+    if (peer->name[0] == '\0') strcpy(peer->name, "unnamed peer");
+
+    rtp->stats.sessions++;
+    send_reply(rtp, fd, from, "OK", token);
+}
+
+static void handle_bye(rtp_midi_t *rtp, const uint8_t *p, size_t len) {
+    if (len < 16) {
+        rtp->stats.errors++;
+        return;
+    }
+    rtp_peer_t *peer = find_peer(rtp, read_be32(p + 12));
+    if (!peer) return;
+    syslog(LOG_INFO, "RTP-MIDI: session with %s ended", peer->name);
+    release_notes(rtp, peer);
+    peer->used = false;
+}
+
+/**
+ * Clock synchronization: answer the first exchange, then take the offset
+ * from the third as the midpoint of the initiator's round trip
+ */
+static void handle_sync(rtp_midi_t *rtp, int fd, const uint8_t *p, size_t len,
+                        const struct sockaddr_in *from) {
+    if (len < 36) {
+        rtp->stats.errors++;
+        return;
+    }
+    rtp_peer_t *peer = find_peer(rtp, read_be32(p + 4));
+    if (!peer || !peer->data_open) {
+        rtp->stats.errors++;
+        return;
+    }
+
+    uint8_t count = p[8];
+    uint64_t ts1 = read_be64(p + 12);
+    if (count == 0) {
+        uint8_t buf[36];
+        memcpy(buf, p, 36);
+        write_be32(buf + 4, rtp->ssrc);
+        buf[8] = 1;
+        write_be64(buf + 20, local_time(rtp));
+        write_be64(buf + 28, 0);
+        send_packet(fd, from, buf, sizeof(buf));
+    } else if (count == 2) {
+        uint64_t ts2 = read_be64(p + 20);
+        uint64_t ts3 = read_be64(p + 28);
+        peer->offset = (uint32_t)(ts1 / 2 + ts3 / 2 + (ts1 & ts3 & 1) - ts2);
+        peer->clock_valid = true;
+        rtp->stats.syncs++;
+    }
+}
+
+static void handle_session(rtp_midi_t *rtp, int fd, bool data_port,
+                           const uint8_t *p, size_t len, const struct sockaddr_in *from) {
+    if (len < 4) {
+        rtp->stats.errors++;
+        return;
+    }
+    if (p[2] == 'I' && p[3] == 'N') {
+        handle_invitation(rtp, fd, data_port, p, len, from);
+    } else if (p[2] == 'B' && p[3] == 'Y') {
+        handle_bye(rtp, p, len);
+    } else if (p[2] == 'C' && p[3] == 'K' && data_port) {
+        handle_sync(rtp, fd, p, len, from);
+    } else if (p[2] == 'R' && p[3] == 'S') {
+        /* Feedback is for senders; we never send MIDI */
+    } else {
+        rtp->stats.errors++;
+    }
+}
+
+/**
+ * Emit a journal-derived message immediately
+ */
+static void recover(rtp_midi_t *rtp, rtp_peer_t *peer, uint8_t a, uint8_t b, uint8_t c, size_t len) {
+    uint8_t msg[3] = { a, b, c };
+    play(rtp, peer, msg, len, false, 0);
+    rtp->stats.recovered++;
+}
+
+/**
+ * Apply chapters P, C, W and N of one channel journal (RFC 6295 appendix A)
+ *
+ * Later chapters carry no state we act on and are skipped with the rest
+ * of the channel journal.
+ */
+static int apply_channel_journal(rtp_midi_t *rtp, rtp_peer_t *peer, uint8_t chan,
+                                 const uint8_t *p, size_t len, uint8_t toc) {
+    size_t pos = 0;
+
+    if (toc & 0x80) {   /* Chapter P: program change */
+        if (len - pos < 3) return -1;
+        if (p[pos + 1] & 0x80) {
+            recover(rtp, peer, 0xB0 | chan, 0, p[pos + 1] & 0x7F, 3);
+            recover(rtp, peer, 0xB0 | chan, 32, p[pos + 2] & 0x7F, 3);
+        }
+        recover(rtp, peer, 0xC0 | chan, p[pos] & 0x7F, 0, 2);
+        pos += 3;
+    }
+    if (toc & 0x40) {   /* Chapter C: controllers */
+        if (len - pos < 1) return -1;
+        size_t entries = (size_t)(p[pos] & 0x7F) + 1;
+        pos++;
+        if (len - pos < entries * 2) return -1;
+        for (size_t i = 0; i < entries; i++, pos += 2) {
+            /* A set: toggle or count encoding, no value to restore */
+            if (p[pos + 1] & 0x80) continue;
+            recover(rtp, peer, 0xB0 | chan, p[pos] & 0x7F, p[pos + 1] & 0x7F, 3);
+        }
+    }
+    if (toc & 0x20) {   /* Chapter M: parameter system, skipped by its length */
+        if (len - pos < 2) return -1;
+        size_t size = ((size_t)(p[pos] & 0x03) << 8) | p[pos + 1];
+        if (size < 2 || size > len - pos) return -1;
+        pos += size;
+    }
+    if (toc & 0x10) {   /* Chapter W: pitch wheel */
+        if (len - pos < 2) return -1;
+        recover(rtp, peer, 0xE0 | chan, p[pos] & 0x7F, p[pos + 1] & 0x7F, 3);
+        pos += 2;
+    }
+    if (toc & 0x08) {   /* Chapter N: note on logs and note off bits */
+        if (len - pos < 2) return -1;
+        size_t logs = p[pos] & 0x7F;
+        uint8_t low = p[pos + 1] >> 4;
+        uint8_t high = p[pos + 1] & 0x0F;
+        size_t offbytes = low <= high ? (size_t)(high - low + 1) : 0;
+        if (logs == 127 && low == 15 && high == 0) logs = 128;
+        pos += 2;
+        if (len - pos < logs * 2 + offbytes) return -1;
+
+        const uint8_t *log = p + pos;
+        const uint8_t *offbits = p + pos + logs * 2;
+        for (size_t i = 0; i < logs; i++) {
+            uint8_t key = log[i * 2] & 0x7F;
+            uint8_t vel = log[i * 2 + 1] & 0x7F;
+            bool play_note = log[i * 2 + 1] & 0x80;
+            size_t octet = key / 8;
+            bool ended = octet >= low && octet <= high &&
+                         (offbits[octet - low] & (0x80 >> (key % 8)));
+            if (vel > 0 && play_note && !ended && peer->notes[chan][key] == 0) {
+                recover(rtp, peer, 0x90 | chan, key, vel, 3);
+            }
+        }
+        for (size_t i = 0; i < offbytes; i++) {
+            for (int bit = 0; bit < 8; bit++) {
+                if (!(offbits[i] & (0x80 >> bit))) continue;
+                uint8_t key = (uint8_t)((low + i) * 8 + (size_t)bit);
+                if (peer->notes[chan][key]) recover(rtp, peer, 0x80 | chan, key, 0, 3);
+            }
+        }
+    }
+    return 0;
+}
+
+static int apply_journal(rtp_midi_t *rtp, rtp_peer_t *peer, const uint8_t *p, size_t len) {
+    if (len < 3) return -1;
+    bool system = p[0] & 0x40;
+    bool channels = p[0] & 0x20;
+    size_t totchan = (size_t)(p[0] & 0x0F) + 1;
+    size_t pos = 3;
+
+    if (system) {
+        if (len - pos < 2) return -1;
+        size_t size = ((size_t)(p[pos] & 0x03) << 8) | p[pos + 1];
+        if (size < 2 || size > len - pos) return -1;
+        pos += size;
+    }
+    if (!channels) return 0;
+
+    for (size_t i = 0; i < totchan; i++) {
+        if (len - pos < 3) return -1;
+        uint8_t chan = (p[pos] >> 3) & 0x0F;
+        size_t size = ((size_t)(p[pos] & 0x03) << 8) | p[pos + 1];
+        uint8_t toc = p[pos + 2];
+        if (size < 3 || size > len - pos) return -1;
+        if (apply_channel_journal(rtp, peer, chan, p + pos + 3, size - 3, toc) < 0) return -1;
+        pos += size;
+    }
+    rtp->stats.recoveries++;
+    return 0;
+}
+
+/**
+ * Decode an RFC 6295 MIDI list, playing each command at its timestamp
+ */
+static int decode_list(rtp_midi_t *rtp, rtp_peer_t *peer, const uint8_t *p, size_t len,
+                       bool first_delta, bool phantom, uint32_t ts) {
+    uint8_t running = phantom ? peer->running_status : 0;
+    size_t pos = 0;
+    bool first = true;
+
+    while (pos < len) {
+        if (!first || first_delta) {
+            uint32_t delta = 0;
+            int k = 0;
+            for (;; k++) {
+                if (pos >= len || k == 4) return -1;
+                uint8_t b = p[pos++];
+                delta = (delta << 7) | (b & 0x7F);
+                if (!(b & 0x80)) break;
+            }
+            ts += delta;
+        }
+        first = false;
+        if (pos >= len) return -1;
+
+        uint8_t status = p[pos];
+        if (status & 0x80) {
+            pos++;
+            if (status == 0xF0) {
+                size_t end = pos;
+                while (end < len && p[end] != 0xF7 && p[end] != 0xF0 && p[end] != 0xF4) end++;
+                if (end == len) return -1;
+                /* Only complete messages; segmented SysEx is not reassembled */
+                if (p[end] == 0xF7) {
+                    midi_parser_route_synth(rtp->router, rtp->synth, p + pos - 1, end - pos + 2, false, 0);
+                }
+                pos = end + 1;
+                running = 0;
+                rtp->stats.commands++;
+                continue;
+            }
+            if (status >= 0xF8) continue;
+            if (status >= 0xF1) {
+                pos += status == 0xF2 ? 2 : (status == 0xF1 || status == 0xF3) ? 1 : 0;
+                running = 0;
+                continue;
+            }
+            running = status;
+        } else if (!running) {
+            return -1;
+        }
+
+        size_t n = (running & 0xE0) == 0xC0 ? 1 : 2;
+        if (len - pos < n) return -1;
+        uint8_t msg[3] = { running, p[pos], n == 2 ? p[pos + 1] : 0 };
+        if ((msg[1] | msg[2]) & 0x80) return -1;
+        pos += n;
+        rtp->stats.commands++;
+        play(rtp, peer, msg, n + 1, true, ts);
+    }
+
+    peer->running_status = running;
+    return 0;
+}
+
+static void handle_rtp(rtp_midi_t *rtp, const uint8_t *p, size_t len) {
+    if (len < 13 || (p[1] & 0x7F) != RTP_MIDI_PAYLOAD_TYPE) {
+        rtp->stats.errors++;
+        return;
+    }
+    size_t header = 12 + 4 * (size_t)(p[0] & 0x0F);
+    uint16_t seq = read_be16(p + 2);
+    uint32_t ts = read_be32(p + 4);
+    rtp_peer_t *peer = find_peer(rtp, read_be32(p + 8));
+    if (!peer || !peer->data_open || len <= header) {
+        rtp->stats.errors++;
+        return;
+    }
+
+    /* Without a completed sync, anchor the sender clock on the first packet */
+    if (!peer->clock_valid) {
+        peer->offset = ts - (uint32_t)local_time(rtp);
+        peer->clock_valid = true;
+    }
+
+    bool loss = false;
+    if (peer->seq_valid) {
+        int16_t gap = (int16_t)(seq - (uint16_t)(peer->last_seq + 1));
+        if (gap < 0) return;    /* Duplicate or reordered behind newer data */
+        if (gap > 0) {
+            rtp->stats.lost += (uint64_t)gap;
+            loss = true;
+        }
+    }
+    peer->last_seq = seq;
+    peer->seq_valid = true;
+    rtp->stats.packets++;
+
+    const uint8_t *cs = p + header;
+    size_t avail = len - header;
+    bool has_journal = cs[0] & 0x40;
+    bool first_delta = cs[0] & 0x20;
+    bool phantom = cs[0] & 0x10;
+    size_t list_len = cs[0] & 0x0F;
+    size_t cs_header = 1;
+    if (cs[0] & 0x80) {
+        if (avail < 2) {
+            rtp->stats.errors++;
+            return;
+        }
+        list_len = (list_len << 8) | cs[1];
+        cs_header = 2;
+    }
+    if (list_len > avail - cs_header) {
+        rtp->stats.errors++;
+        return;
+    }
+
+    const uint8_t *list = cs + cs_header;
+    if (loss) {
+        /* Lost packets: restore state from the journal before new commands */
+        if (has_journal && apply_journal(rtp, peer, list + list_len, avail - cs_header - list_len) < 0) {
+            rtp->stats.errors++;
+        }
+        peer->running_status = 0;
+    }
+    if (decode_list(rtp, peer, list, list_len, first_delta, phantom, ts) < 0) {
+        rtp->stats.errors++;
+    }
+    send_feedback(rtp, peer);
+}
+
+static void read_socket(rtp_midi_t *rtp, int fd, bool data_port) {
+    uint8_t buf[RTP_MIDI_PACKET_MAX];
+
+    for (int i = 0; i < RTP_MIDI_READS_PER_WAKEUP; i++) {
+        struct sockaddr_in from;
+        socklen_t from_len = sizeof(from);
+        ssize_t n = recvfrom(fd, buf, sizeof(buf), 0, (struct sockaddr *)&from, &from_len);
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                syslog(LOG_WARNING, "RTP-MIDI: receive failed: %s", strerror(errno));
+            }
+            return;
+        }
+        if (n >= 2 && buf[0] == 0xFF && buf[1] == 0xFF) {
+            handle_session(rtp, fd, data_port, buf, (size_t)n, &from);
+        } else if (data_port && n >= 1 && (buf[0] & 0xC0) == 0x80) {
+            uint64_t span = trace_begin();
+            handle_rtp(rtp, buf, (size_t)n);
+            trace_end(span, "rtp-midi", n);
+        } else {
+            rtp->stats.errors++;
+        }
+    }
+}
+
+static void on_control(void *data, int fd, uint32_t events) {
+    (void)events;
+    read_socket(data, fd, false);
+}
+
+static void on_data(void *data, int fd, uint32_t events) {
+    (void)events;
+    read_socket(data, fd, true);
+}
+
+static int open_socket(rtp_midi_t *rtp, int port, event_loop_cb_t cb) {
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        syslog(LOG_ERR, "RTP-MIDI: socket failed: %s", strerror(errno));
+        return -1;
+    }
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)port);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        syslog(LOG_ERR, "RTP-MIDI: cannot bind port %d: %s", port, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    if (event_loop_add_fd(rtp->loop, fd, cb, rtp) < 0) {
+        syslog(LOG_ERR, "RTP-MIDI: cannot watch port %d", port);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+rtp_midi_t *rtp_midi_init(const midisynthd_config_t *config, synth_t *synth, event_loop_t *loop) {
+    if (!config || !synth || !loop || config->rtpmidi_port <= 0 || config->rtpmidi_port > 65534) {
+        syslog(LOG_ERR, "Invalid parameters for RTP-MIDI init");
+        return NULL;
+    }
+
+    rtp_midi_t *rtp = calloc(1, sizeof(*rtp));
+    if (!rtp) {
+        syslog(LOG_ERR, "Failed to allocate RTP-MIDI object");
+        return NULL;
+    }
+    memstat_add(MEMSTAT_QUEUES, sizeof(*rtp));
+    rtp->synth = synth;
+    rtp->loop = loop;
+    rtp->port = config->rtpmidi_port;
+    rtp->sample_rate = config->sample_rate > 0 ? config->sample_rate : CONFIG_DEFAULT_SAMPLE_RATE;
+    rtp->start_ns = monotonic_ns();
+    rtp->ssrc = (uint32_t)(rtp->start_ns ^ ((uint64_t)getpid() << 16) ^ (rtp->start_ns >> 32));
+    snprintf(rtp->name, sizeof(rtp->name), "%s",
+             config->client_name[0] ? config->client_name : CONFIG_DEFAULT_CLIENT_NAME);
+    rtp->data_fd = -1;
+
+    midi_router_t *router = midi_router_create(config);
+    if (midi_router_is_active(router)) {
+        rtp->router = router;
+    } else {
+        midi_router_destroy(router);
+    }
+
+    rtp->control_fd = open_socket(rtp, rtp->port, on_control);
+    if (rtp->control_fd >= 0) {
+        rtp->data_fd = open_socket(rtp, rtp->port + 1, on_data);
+    }
+    if (rtp->data_fd < 0) {
+        rtp_midi_cleanup(rtp);
+        return NULL;
+    }
+
+    syslog(LOG_INFO, "RTP-MIDI session \"%s\" listening on ports %d and %d",
+           rtp->name, rtp->port, rtp->port + 1);
+    return rtp;
+}
+
+int rtp_midi_get_stats(rtp_midi_t *rtp, rtp_midi_stats_t *stats) {
+    if (!rtp || !stats) return -1;
+    *stats = rtp->stats;
+    stats->active_peers = 0;
+    for (int i = 0; i < RTP_MIDI_MAX_PEERS; i++) {
+        if (rtp->peers[i].used) stats->active_peers++;
+    }
+    return 0;
+}
+
+void rtp_midi_cleanup(rtp_midi_t *rtp) {
+    if (!rtp) return;
+
+    for (int i = 0; i < RTP_MIDI_MAX_PEERS; i++) {
+        rtp_peer_t *peer = &rtp->peers[i];
+        if (!peer->used) continue;
+        release_notes(rtp, peer);
+        /* Tell the peer the session is over */
+        uint8_t buf[16] = { 0xFF, 0xFF, 'B', 'Y' };
+        write_be32(buf + 4, APPLEMIDI_VERSION);
+        write_be32(buf + 8, peer->token);
+        write_be32(buf + 12, rtp->ssrc);
+        send_packet(rtp->control_fd, &peer->control_addr, buf, sizeof(buf));
+    }
+
+    if (rtp->control_fd >= 0) {
+        event_loop_remove_fd(rtp->loop, rtp->control_fd);
+        close(rtp->control_fd);
+        syslog(LOG_INFO, "RTP-MIDI: %llu packets, %llu commands (%llu scheduled, %llu late), "
+               "%llu lost, %llu journals applied, %llu errors",
+               (unsigned long long)rtp->stats.packets, (unsigned long long)rtp->stats.commands,
+               (unsigned long long)rtp->stats.scheduled, (unsigned long long)rtp->stats.late,
+               (unsigned long long)rtp->stats.lost, (unsigned long long)rtp->stats.recoveries,
+               (unsigned long long)rtp->stats.errors);
+    }
+    if (rtp->data_fd >= 0) {
+        event_loop_remove_fd(rtp->loop, rtp->data_fd);
+        close(rtp->data_fd);
+    }
+    midi_router_destroy(rtp->router);
+    memstat_sub(MEMSTAT_QUEUES, sizeof(*rtp));
+    free(rtp);
+}
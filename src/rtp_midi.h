@@ -0,0 +1,90 @@
+/*
+ * midisynthd - System-level MIDI Synthesizer Daemon for Linux
+ * Copyright (C) 2025 ArchLars
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef MIDISYNTHD_RTP_MIDI_H
+#define MIDISYNTHD_RTP_MIDI_H
+
+#include <stdint.h>
+#include "config.h"
+#include "synth.h"
+#include "event_loop.h"
+
+/* Remote sessions accepted at once */
+#define RTP_MIDI_MAX_PEERS      4
+/* Fixed delay added to sender timestamps so network jitter does not move notes */
+#define RTP_MIDI_PLAYOUT_MS     5
+/* Largest datagram accepted */
+#define RTP_MIDI_PACKET_MAX     1500
+
+typedef struct rtp_midi_s rtp_midi_t;
+
+/**
+ * RTP-MIDI session counters
+ */
+typedef struct {
+    uint64_t sessions;          /* Invitations accepted */
+    uint64_t packets;           /* RTP MIDI packets received */
+    uint64_t commands;          /* MIDI commands decoded */
+    uint64_t scheduled;         /* Commands queued for a render frame */
+    uint64_t late;              /* Commands whose play time had passed */
+    uint64_t lost;              /* Packets missing from the sequence */
+    uint64_t recoveries;        /* Recovery journals applied after a loss */
+    uint64_t recovered;         /* Commands generated from journals */
+    uint64_t syncs;             /* Completed clock synchronizations */
+    uint64_t errors;            /* Malformed or unexpected packets */
+    int active_peers;
+} rtp_midi_stats_t;
+
+/**
+ * Open an AppleMIDI session endpoint
+ *
+ * Listens for invitations on config->rtpmidi_port (control) and the next
+ * port (data) on all interfaces. Remote peers initiate the session and
+ * clock synchronization; the daemon only accepts. MIDI commands are played
+ * at their sender timestamp, mapped onto the render clock, plus
+ * RTP_MIDI_PLAYOUT_MS.
+ *
+ * @param config Configuration holding the port, client name and route rules
+ * @param synth Synthesizer receiving the events
+ * @param loop Event loop the sockets are read from
+ * @return Endpoint, or NULL on error
+ */
+rtp_midi_t *rtp_midi_init(const midisynthd_config_t *config, synth_t *synth, event_loop_t *loop);
+
+/**
+ * End all sessions and close the endpoint
+ *
+ * Notes still held by remote peers are released. Safe to call with NULL
+ * pointer.
+ *
+ * @param rtp Endpoint
+ */
+void rtp_midi_cleanup(rtp_midi_t *rtp);
+
+/**
+ * Get session counters
+ *
+ * @param rtp Endpoint
+ * @param stats Receives the counters
+ * @return 0 on success, -1 on error
+ */
+int rtp_midi_get_stats(rtp_midi_t *rtp, rtp_midi_stats_t *stats);
+
+#endif /* MIDISYNTHD_RTP_MIDI_H */
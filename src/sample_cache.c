@@ -0,0 +1,464 @@
+/*
+ * midisynthd - System-level MIDI Synthesizer Daemon for Linux
+ * Copyright (C) 2025 ArchLars
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include "sample_cache.h"
+#include "memstat.h"
+#include "monotonic.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <syslog.h>
+#include <time.h>
+#include <sys/timerfd.h>
+
+#define CGROUP_ROOT                 "/sys/fs/cgroup"
+#define PSI_SYSTEM_MEMORY           "/proc/pressure/memory"
+
+typedef enum {
+    ENTRY_FREE = 0,
+    ENTRY_HELD,                 /* Selected on a hidden channel */
+    ENTRY_RELEASED              /* Known, loaded only while a MIDI channel selects it */
+} entry_state_t;
+
+typedef struct {
+    entry_state_t state;
+    synth_preset_t preset;
+    int channel;                /* Hidden channel while held */
+    uint64_t last_use_ns;       /* Latest tick it was selected on a MIDI channel */
+    bool selected;              /* Selected on a MIDI channel at the latest tick */
+    bool evicted;               /* Released by the cache, a new selection reloads it */
+} cache_entry_t;
+
+struct sample_cache_s {
+    synth_t *synth;
+    event_loop_t *loop;
+    int timer_fd;
+    int psi_fd;
+    int events_fd;              /* cgroup memory.events */
+    uint64_t high_events;       /* Latest "high" count read from memory.events */
+    bool started;
+
+    int first_channel;          /* Hidden channels: first_channel .. + capacity - 1 */
+    int channels;
+    bool *channel_used;
+
+    cache_entry_t entries[SAMPLE_CACHE_MAX_ENTRIES];
+    sample_cache_stats_t stats;
+};
+
+static bool same_preset(const synth_preset_t *a, const synth_preset_t *b) {
+    return a->sfont_id == b->sfont_id && a->bank == b->bank && a->program == b->program;
+}
+
+static cache_entry_t *find_entry(sample_cache_t *cache, const synth_preset_t *preset) {
+    for (int i = 0; i < SAMPLE_CACHE_MAX_ENTRIES; i++) {
+        cache_entry_t *e = &cache->entries[i];
+        if (e->state != ENTRY_FREE && same_preset(&e->preset, preset)) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Take a free entry, or forget the released one unused for the longest
+ */
+static cache_entry_t *new_entry(sample_cache_t *cache, const synth_preset_t *preset) {
+    cache_entry_t *victim = NULL;
+    for (int i = 0; i < SAMPLE_CACHE_MAX_ENTRIES; i++) {
+        cache_entry_t *e = &cache->entries[i];
+        if (e->state == ENTRY_FREE) {
+            victim = e;
+            break;
+        }
+        if (e->state == ENTRY_RELEASED && !e->selected &&
+            (!victim || e->last_use_ns < victim->last_use_ns)) {
+            victim = e;
+        }
+    }
+    if (!victim) return NULL;
+
+    memset(victim, 0, sizeof(*victim));
+    victim->state = ENTRY_RELEASED;
+    victim->preset = *preset;
+    victim->channel = -1;
+    return victim;
+}
+
+/**
+ * Held entry not selected on any MIDI channel and unused for the longest
+ */
+static cache_entry_t *coldest_held(sample_cache_t *cache) {
+    cache_entry_t *coldest = NULL;
+    for (int i = 0; i < SAMPLE_CACHE_MAX_ENTRIES; i++) {
+        cache_entry_t *e = &cache->entries[i];
+        if (e->state == ENTRY_HELD && !e->selected &&
+            (!coldest || e->last_use_ns < coldest->last_use_ns)) {
+            coldest = e;
+        }
+    }
+    return coldest;
+}
+
+static void release_entry(sample_cache_t *cache, cache_entry_t *e) {
+    synth_hold_preset(cache->synth, e->channel, NULL);
+    cache->channel_used[e->channel - cache->first_channel] = false;
+    syslog(LOG_DEBUG, "Sample cache: released preset %d:%d:%d on channel %d",
+           e->preset.sfont_id, e->preset.bank, e->preset.program, e->channel);
+    e->state = ENTRY_RELEASED;
+    e->channel = -1;
+    e->evicted = true;
+    cache->stats.held--;
+}
+
+static int hold_entry(sample_cache_t *cache, cache_entry_t *e) {
+    if (cache->stats.held >= cache->stats.capacity) {
+        cache_entry_t *victim = coldest_held(cache);
+        if (!victim) return -1;     /* Every held preset is in use */
+        release_entry(cache, victim);
+        cache->stats.evictions++;
+    }
+
+    int slot = 0;
+    while (cache->channel_used[slot]) slot++;
+    if (synth_hold_preset(cache->synth, cache->first_channel + slot, &e->preset) < 0) {
+        return -1;
+    }
+    cache->channel_used[slot] = true;
+    e->channel = cache->first_channel + slot;
+    e->state = ENTRY_HELD;
+    cache->stats.held++;
+    return 0;
+}
+
+void sample_cache_tick(sample_cache_t *cache) {
+    if (!cache) return;
+    uint64_t now = monotonic_ns();
+
+    for (int i = 0; i < SAMPLE_CACHE_MAX_ENTRIES; i++) {
+        cache->entries[i].selected = false;
+    }
+
+    /* A GM or GS reset reselects the default preset on every channel,
+     * hidden ones included, so held presets are put back */
+    bool reset = false;
+    for (int i = 0; i < SAMPLE_CACHE_MAX_ENTRIES; i++) {
+        cache_entry_t *e = &cache->entries[i];
+        synth_preset_t current;
+        if (e->state != ENTRY_HELD) continue;
+        if (synth_get_preset(cache->synth, e->channel, &current) < 0 ||
+            !same_preset(&current, &e->preset)) {
+            synth_hold_preset(cache->synth, e->channel, &e->preset);
+            reset = true;
+        }
+    }
+    if (reset) {
+        for (int slot = 0; slot < cache->channels; slot++) {
+            if (!cache->channel_used[slot]) {
+                synth_hold_preset(cache->synth, cache->first_channel + slot, NULL);
+            }
+        }
+        syslog(LOG_DEBUG, "Sample cache: channels were reset, held presets restored");
+    }
+
+    for (int ch = 0; ch < 16; ch++) {
+        synth_preset_t preset;
+        if (synth_get_preset(cache->synth, ch, &preset) < 0) continue;
+
+        cache_entry_t *e = find_entry(cache, &preset);
+        if (!e) e = new_entry(cache, &preset);
+        if (!e) continue;
+
+        if (e->evicted) {
+            uint64_t ns = synth_get_program_change_ns(cache->synth, ch);
+            cache->stats.reloads++;
+            cache->stats.reload_ns_total += ns;
+            if (ns > cache->stats.reload_ns_max) cache->stats.reload_ns_max = ns;
+            e->evicted = false;
+            syslog(LOG_DEBUG, "Sample cache: preset %d:%d:%d reloaded in %.2f ms",
+                   preset.sfont_id, preset.bank, preset.program, ns / 1e6);
+        }
+        e->selected = true;
+        e->last_use_ns = now;
+    }
+
+    for (int i = 0; i < SAMPLE_CACHE_MAX_ENTRIES; i++) {
+        cache_entry_t *e = &cache->entries[i];
+        if (e->state == ENTRY_RELEASED && e->selected) {
+            hold_entry(cache, e);
+        }
+    }
+}
+
+int sample_cache_pressure(sample_cache_t *cache) {
+    if (!cache) return 0;
+
+    int keep = cache->stats.held / 2;
+    if (keep < cache->stats.floor) keep = cache->stats.floor;
+
+    int released = 0;
+    while (cache->stats.held > keep) {
+        cache_entry_t *victim = coldest_held(cache);
+        if (!victim) break;
+        release_entry(cache, victim);
+        released++;
+    }
+    cache->stats.pressure_events++;
+    cache->stats.pressure_evictions += (uint64_t)released;
+    syslog(LOG_INFO, "Memory pressure: sample cache released %d presets, %d held",
+           released, cache->stats.held);
+    return released;
+}
+
+static void on_timer(void *data, int fd, uint32_t events) {
+    sample_cache_t *cache = data;
+    uint64_t expirations;
+    (void)events;
+    if (read(fd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN) {
+        return;
+    }
+    sample_cache_tick(cache);
+}
+
+static void on_psi(void *data, int fd, uint32_t events) {
+    sample_cache_t *cache = data;
+    if (events & POLLERR) {
+        /* The trigger is gone with its cgroup */
+        syslog(LOG_WARNING, "Memory pressure trigger closed");
+        event_loop_remove_fd(cache->loop, fd);
+        close(fd);
+        cache->psi_fd = -1;
+        return;
+    }
+    if (events & POLLPRI) {
+        sample_cache_pressure(cache);
+    }
+}
+
+/**
+ * Read the "high" counter from a cgroup memory.events file
+ */
+static int read_high_events(int fd, uint64_t *count) {
+    char buf[512];
+    ssize_t n = pread(fd, buf, sizeof(buf) - 1, 0);
+    if (n <= 0) return -1;
+    buf[n] = '\0';
+
+    for (char *line = buf; line && *line; line = strchr(line, '\n')) {
+        if (*line == '\n') line++;
+        unsigned long long v;
+        if (sscanf(line, "high %llu", &v) == 1) {
+            *count = v;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static void on_memory_events(void *data, int fd, uint32_t events) {
+    sample_cache_t *cache = data;
+    uint64_t count;
+    (void)events;
+    /* Reading also clears the pending notification */
+    if (read_high_events(fd, &count) < 0) return;
+    if (count > cache->high_events) {
+        sample_cache_pressure(cache);
+    }
+    cache->high_events = count;
+}
+
+/**
+ * Path of the daemon's cgroup v2 directory, empty if unknown
+ */
+static void cgroup_dir(char *dir, size_t size) {
+    dir[0] = '\0';
+    FILE *f = fopen("/proc/self/cgroup", "r");
+    if (!f) return;
+
+    char line[512];
+    while (fgets(line, sizeof(line), f)) {
+        if (strncmp(line, "0::", 3) == 0) {
+            line[strcspn(line, "\n")] = '\0';
+            snprintf(dir, size, "%s%s", CGROUP_ROOT, line + 3);
+            break;
+        }
+    }
+    fclose(f);
+}
+
+static int open_psi_trigger(const char *path) {
+    int fd = open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) return -1;
+    if (write(fd, SAMPLE_CACHE_PSI_TRIGGER, strlen(SAMPLE_CACHE_PSI_TRIGGER) + 1) < 0) {
+        syslog(LOG_DEBUG, "Cannot set PSI trigger on %s: %s", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * Watch PSI and memory.events; either one is enough
+ */
+static void watch_pressure(sample_cache_t *cache) {
+    char dir[512], path[600];
+    cgroup_dir(dir, sizeof(dir));
+
+    if (dir[0] != '\0') {
+        snprintf(path, sizeof(path), "%s/memory.pressure", dir);
+        cache->psi_fd = open_psi_trigger(path);
+    }
+    if (cache->psi_fd < 0) {
+        snprintf(path, sizeof(path), "%s", PSI_SYSTEM_MEMORY);
+        cache->psi_fd = open_psi_trigger(path);
+    }
+    if (cache->psi_fd >= 0) {
+        if (event_loop_add_fd_events(cache->loop, cache->psi_fd, POLLPRI, on_psi, cache) < 0) {
+            close(cache->psi_fd);
+            cache->psi_fd = -1;
+        } else {
+            syslog(LOG_INFO, "Watching memory pressure on %s", path);
+        }
+    }
+
+    if (dir[0] != '\0') {
+        snprintf(path, sizeof(path), "%s/memory.events", dir);
+        cache->events_fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (cache->events_fd >= 0) {
+            if (read_high_events(cache->events_fd, &cache->high_events) < 0 ||
+                event_loop_add_fd_events(cache->loop, cache->events_fd, POLLPRI,
+                                         on_memory_events, cache) < 0) {
+                close(cache->events_fd);
+                cache->events_fd = -1;
+            } else {
+                syslog(LOG_INFO, "Watching memory.high events on %s", path);
+            }
+        }
+    }
+
+    if (cache->psi_fd < 0 && cache->events_fd < 0) {
+        syslog(LOG_WARNING, "No memory pressure source available, sample cache only bounded by its size");
+    }
+}
+
+sample_cache_t *sample_cache_create(const midisynthd_config_t *config, synth_t *synth, event_loop_t *loop) {
+    if (!config || !synth || !loop || config->sample_cache <= 0) {
+        syslog(LOG_ERR, "Invalid parameters for sample cache");
+        return NULL;
+    }
+
+    int channels = synth_count_channels(synth);
+    if (channels < 16 + config->sample_cache) {
+        syslog(LOG_ERR, "Sample cache needs %d hidden channels, synthesizer has %d",
+               config->sample_cache, channels - 16);
+        return NULL;
+    }
+
+    sample_cache_t *cache = calloc(1, sizeof(*cache));
+    if (!cache) return NULL;
+    cache->channel_used = calloc((size_t)config->sample_cache, sizeof(bool));
+    if (!cache->channel_used) {
+        free(cache);
+        return NULL;
+    }
+    cache->synth = synth;
+    cache->loop = loop;
+    cache->psi_fd = -1;
+    cache->events_fd = -1;
+    cache->first_channel = 16;
+    cache->channels = config->sample_cache;
+    cache->stats.capacity = config->sample_cache;
+    cache->stats.floor = config->sample_cache_floor < config->sample_cache ?
+                         config->sample_cache_floor : config->sample_cache;
+
+    /* Hidden channels start out on the default preset; free them */
+    for (int slot = 0; slot < cache->channels; slot++) {
+        synth_hold_preset(synth, cache->first_channel + slot, NULL);
+    }
+
+    cache->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    struct itimerspec its = {
+        .it_interval = { 0, SAMPLE_CACHE_TICK_MS * 1000000L },
+        .it_value = { 0, SAMPLE_CACHE_TICK_MS * 1000000L },
+    };
+    if (cache->timer_fd < 0 || timerfd_settime(cache->timer_fd, 0, &its, NULL) < 0 ||
+        event_loop_add_fd(loop, cache->timer_fd, on_timer, cache) < 0) {
+        syslog(LOG_ERR, "Failed to start sample cache timer: %s", strerror(errno));
+        sample_cache_cleanup(cache);
+        return NULL;
+    }
+
+    watch_pressure(cache);
+    cache->started = true;
+    memstat_add(MEMSTAT_QUEUES, sizeof(*cache));
+    syslog(LOG_INFO, "Sample cache: %d presets, floor %d", cache->stats.capacity, cache->stats.floor);
+    sample_cache_tick(cache);
+    return cache;
+}
+
+void sample_cache_cleanup(sample_cache_t *cache) {
+    if (!cache) return;
+
+    int fds[] = { cache->timer_fd, cache->psi_fd, cache->events_fd };
+    for (size_t i = 0; i < sizeof(fds) / sizeof(fds[0]); i++) {
+        if (fds[i] >= 0) {
+            event_loop_remove_fd(cache->loop, fds[i]);
+            close(fds[i]);
+        }
+    }
+
+    if (cache->started) {
+        sample_cache_log(cache);
+        memstat_sub(MEMSTAT_QUEUES, sizeof(*cache));
+    }
+    for (int i = 0; i < SAMPLE_CACHE_MAX_ENTRIES; i++) {
+        if (cache->entries[i].state == ENTRY_HELD) {
+            synth_hold_preset(cache->synth, cache->entries[i].channel, NULL);
+        }
+    }
+    free(cache->channel_used);
+    free(cache);
+}
+
+int sample_cache_get_stats(sample_cache_t *cache, sample_cache_stats_t *stats) {
+    if (!cache || !stats) return -1;
+    *stats = cache->stats;
+    return 0;
+}
+
+void sample_cache_log(sample_cache_t *cache) {
+    if (!cache) return;
+    const sample_cache_stats_t *s = &cache->stats;
+    double avg_ms = s->reloads ? (double)s->reload_ns_total / s->reloads / 1e6 : 0.0;
+    syslog(LOG_INFO, "Sample cache: %d/%d presets held (floor %d), %llu evictions, "
+           "%llu pressure events releasing %llu, %llu reloads (avg %.2f ms, max %.2f ms)",
+           s->held, s->capacity, s->floor,
+           (unsigned long long)s->evictions,
+           (unsigned long long)s->pressure_events,
+           (unsigned long long)s->pressure_evictions,
+           (unsigned long long)s->reloads,
+           avg_ms, s->reload_ns_max / 1e6);
+}
@@ -0,0 +1,118 @@
+/*
+ * midisynthd - System-level MIDI Synthesizer Daemon for Linux
+ * Copyright (C) 2025 ArchLars
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef MIDISYNTHD_SAMPLE_CACHE_H
+#define MIDISYNTHD_SAMPLE_CACHE_H
+
+#include <stdint.h>
+#include "config.h"
+#include "synth.h"
+#include "event_loop.h"
+
+/* Presets tracked, held or not; the oldest released ones are forgotten */
+#define SAMPLE_CACHE_MAX_ENTRIES    512
+/* How often the MIDI channels are checked for newly selected presets */
+#define SAMPLE_CACHE_TICK_MS        250
+/* PSI trigger: memory stalls of 150 ms within a 2 s window */
+#define SAMPLE_CACHE_PSI_TRIGGER    "some 150000 2000000"
+
+typedef struct sample_cache_s sample_cache_t;
+
+/**
+ * Sample cache counters
+ */
+typedef struct {
+    int capacity;               /* Presets that can be held */
+    int floor;                  /* Presets kept under memory pressure */
+    int held;                   /* Presets currently held */
+    uint64_t evictions;         /* Presets released to make room */
+    uint64_t pressure_events;   /* PSI triggers and memory.high events */
+    uint64_t pressure_evictions; /* Presets released under memory pressure */
+    uint64_t reloads;           /* Released presets selected again */
+    uint64_t reload_ns_max;     /* Slowest program change that reloaded samples */
+    uint64_t reload_ns_total;
+} sample_cache_stats_t;
+
+/**
+ * Start the sample residency manager
+ *
+ * Requires dynamic sample loading, which synth_init() enables when
+ * config->sample_cache is set: FluidSynth then loads a preset's samples
+ * when a channel selects it and frees them when no channel uses it. The
+ * cache keeps the config->sample_cache most recently used presets loaded
+ * by holding them on hidden channels, releasing the least recently used
+ * one when a new preset needs room.
+ *
+ * Under memory pressure, reported by a PSI trigger on the daemon's cgroup
+ * (or system-wide) or by the cgroup's memory.high event count, held presets
+ * not selected on any MIDI channel are released oldest first until half
+ * remain, but never fewer than config->sample_cache_floor.
+ *
+ * @param config Configuration holding the cache size and floor
+ * @param synth Synthesizer, created with the same configuration
+ * @param loop Event loop the timer and pressure files are watched on
+ * @return Cache, or NULL on error
+ */
+sample_cache_t *sample_cache_create(const midisynthd_config_t *config, synth_t *synth, event_loop_t *loop);
+
+/**
+ * Release all held presets and stop watching
+ *
+ * Safe to call with NULL pointer.
+ *
+ * @param cache Cache instance
+ */
+void sample_cache_cleanup(sample_cache_t *cache);
+
+/**
+ * Record the presets selected on the MIDI channels
+ *
+ * Runs every SAMPLE_CACHE_TICK_MS from the event loop. Newly selected
+ * presets are held, and presets held before a GM reset are held again.
+ *
+ * @param cache Cache instance
+ */
+void sample_cache_tick(sample_cache_t *cache);
+
+/**
+ * Shrink the cache as for a memory pressure event
+ *
+ * @param cache Cache instance
+ * @return Number of presets released
+ */
+int sample_cache_pressure(sample_cache_t *cache);
+
+/**
+ * Get cache counters
+ *
+ * @param cache Cache instance
+ * @param stats Receives the counters
+ * @return 0 on success, -1 on error
+ */
+int sample_cache_get_stats(sample_cache_t *cache, sample_cache_stats_t *stats);
+
+/**
+ * Log cache counters and reload latency to syslog
+ *
+ * @param cache Cache instance, NULL logs nothing
+ */
+void sample_cache_log(sample_cache_t *cache);
+
+#endif /* MIDISYNTHD_SAMPLE_CACHE_H */
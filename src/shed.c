@@ -0,0 +1,77 @@
+/*
+ * midisynthd - System-level MIDI Synthesizer Daemon for Linux
+ * Copyright (C) 2025 ArchLars
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include "shed.h"
+
+void shed_cost_learn(shed_cost_t *cost, int voices, int len, uint64_t elapsed_ns) {
+    if (len <= 0) {
+        return;
+    }
+    double per_frame = (double)elapsed_ns / (double)len;
+
+    if (voices <= 0) {
+        cost->base_ns = cost->base_samples++ == 0 ? per_frame :
+            cost->base_ns + (per_frame - cost->base_ns) / SHED_COST_SMOOTHING;
+        return;
+    }
+
+    double per_voice = (per_frame - cost->base_ns) / (double)voices;
+    if (per_voice > 0.0) {
+        cost->voice_ns = cost->voice_samples++ == 0 ? per_voice :
+            cost->voice_ns + (per_voice - cost->voice_ns) / SHED_COST_SMOOTHING;
+    }
+}
+
+int shed_cost_excess(const shed_cost_t *cost, int voices, int len, int sample_rate, int threshold) {
+    if (threshold <= 0 || voices <= 0 || len <= 0 || sample_rate <= 0 ||
+        cost->voice_samples < SHED_COST_WARMUP || cost->voice_ns <= 0.0) {
+        return 0;
+    }
+
+    double limit = (double)len * 1e9 / sample_rate * threshold / 100.0;
+    double fixed = cost->base_ns * len;
+    double per_voice = cost->voice_ns * len;
+    /* Nothing to gain when the effects alone miss the budget */
+    if (fixed + per_voice * voices <= limit || fixed >= limit) {
+        return 0;
+    }
+    return voices - (int)((limit - fixed) / per_voice);
+}
+
+int shed_pick_channel(const shed_channel_t channels[SHED_CHANNELS], unsigned skip) {
+    int pick = -1;
+    for (int ch = 0; ch < SHED_CHANNELS; ch++) {
+        const shed_channel_t *c = &channels[ch];
+        if ((skip & (1u << ch)) || c->notes <= 0) continue;
+        if (pick < 0) {
+            pick = ch;
+            continue;
+        }
+        const shed_channel_t *p = &channels[pick];
+        if (c->pedal != p->pedal) {
+            if (c->pedal) pick = ch;
+        } else if (c->level != p->level) {
+            if (c->level < p->level) pick = ch;
+        } else if (c->notes < p->notes) {
+            pick = ch;
+        }
+    }
+    return pick;
+}
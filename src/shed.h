@@ -0,0 +1,95 @@
+/*
+ * midisynthd - System-level MIDI Synthesizer Daemon for Linux
+ * Copyright (C) 2025 ArchLars
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef MIDISYNTHD_SHED_H
+#define MIDISYNTHD_SHED_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Periods averaged into the cost estimates, and periods with voices
+ * learned before the estimate is trusted */
+#define SHED_COST_SMOOTHING     16
+#define SHED_COST_WARMUP        32
+/* MIDI channels ranked for shedding */
+#define SHED_CHANNELS           16
+
+/**
+ * Render cost per frame, learned as a fixed part and a part per voice
+ */
+typedef struct {
+    double base_ns;
+    double voice_ns;
+    uint64_t base_samples;
+    uint64_t voice_samples;
+} shed_cost_t;
+
+/**
+ * State of a channel that decides how early it is shed
+ */
+typedef struct {
+    bool pedal;                 /* Sustain or sostenuto held down */
+    int level;                  /* Channel volume times expression, 0-16129 */
+    int notes;                  /* Notes sounding, 0 when idle */
+} shed_channel_t;
+
+/**
+ * Fold a timed period into the cost estimates
+ *
+ * Periods without voices measure the fixed cost of a frame, mostly
+ * effects; the rest is split evenly over the voices that played. Only
+ * periods that shed nothing may be learned from, since voices faded out
+ * during a period are counted but cost less than a full period.
+ *
+ * @param cost Estimates
+ * @param voices Voices playing as the period started
+ * @param len Period length in frames
+ * @param elapsed_ns Time the period took to render
+ */
+void shed_cost_learn(shed_cost_t *cost, int voices, int len, uint64_t elapsed_ns);
+
+/**
+ * Predict how many voices a period has to lose to meet its budget
+ *
+ * @param cost Estimates
+ * @param voices Voices playing
+ * @param len Period length in frames
+ * @param sample_rate Sample rate in Hz
+ * @param threshold Share of the period budget rendering may use, percent
+ * @return Voices over budget, 0 when the period fits, the estimate is
+ *         not trusted yet or the fixed cost alone misses the budget
+ */
+int shed_cost_excess(const shed_cost_t *cost, int voices, int len, int sample_rate, int threshold);
+
+/**
+ * Choose the channel to shed next
+ *
+ * Only channels with notes sounding are chosen. Channels with a pedal
+ * held go first, as their voices are mostly notes the player has let go
+ * of, then channels from the softest up; of equally loud channels the
+ * one with fewer notes goes first.
+ *
+ * @param channels State of every channel
+ * @param skip Bit mask of channels not to choose
+ * @return Channel, or -1 when every channel is skipped or idle
+ */
+int shed_pick_channel(const shed_channel_t channels[SHED_CHANNELS], unsigned skip);
+
+#endif /* MIDISYNTHD_SHED_H */
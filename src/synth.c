@@ -21,6 +21,17 @@
 #include "synth.h"
 #include "config.h"
 #include "audio.h"
+#include "audio_null.h"
+#include "memstat.h"
+#include "monotonic.h"
+#include "threads.h"
+#include "rt_sentinel.h"
+#include "conceal.h"
+#include "perc_cache.h"
+#include "meter.h"
+#include "playback_ring.h"
+#include "shed.h"
+#include "trace.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -28,11 +39,53 @@
 #include <unistd.h>
 #include <syslog.h>
 #include <errno.h>
+#include <math.h>
+#include <time.h>
 #include <sys/stat.h>
+#include <sys/eventfd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
 
 #include <fluidsynth.h>
 #include <fluidsynth/midi.h>
 
+/* Output and effect buffers a period can be split across */
+#define SYNTH_MAX_SPLIT_BUFFERS     64
+/* Below the audio threads: a late block only costs playback headroom */
+#define SYNTH_PLAYBACK_RT_PRIORITY  40
+/* Attenuation (cB) that takes a shed voice below FluidSynth's noise floor */
+#define SYNTH_SHED_ATTENUATION      1440.0f
+/* Xrun concealment: share of the period budget rendering may use, and
+ * frames rendered between deadline checks */
+#define SYNTH_CONCEAL_DEADLINE      95
+#define SYNTH_CONCEAL_CHUNK         64
+/* Percussion cache: MIDI channel 10, voices of the engine rendering hits,
+ * frames rendered per step and level below which a hit has died away */
+#define SYNTH_PERC_CHANNEL          9
+#define SYNTH_PERC_POLYPHONY        32
+#define SYNTH_PERC_STEP             64
+#define SYNTH_PERC_SILENCE          1e-4f
+/* Level meters: frames rendered per pass through the channel outputs */
+#define SYNTH_METER_FRAMES          256
+
+/**
+ * Message waiting for its render frame
+ */
+typedef struct {
+    uint64_t frame;
+    uint8_t msg[3];
+    uint8_t len;
+} synth_timed_event_t;
+
+/**
+ * Schedule queue slot; seq tells producers and the consumer whose turn it is
+ */
+typedef struct {
+    unsigned seq;
+    synth_timed_event_t ev;
+} synth_queue_slot_t;
+
 /**
  * Internal synthesizer structure
  */
@@ -40,10 +93,121 @@ struct synth_s {
     fluid_settings_t *settings;
     fluid_synth_t *synth;
     fluid_audio_driver_t *audio_driver;
+    audio_null_t *null_audio;
+    audio_driver_t driver;
     const midisynthd_config_t *config;
     audio_t *audio;
     int soundfont_id;
     bool initialized;
+
+    /* Output gain: the runtime gain from configuration or OSC, scaled by
+     * the last Universal Real Time Master Volume. Any input thread may
+     * change either, JACK's process callback among them, so they are
+     * accessed atomically and gain_seq counts their changes */
+    float gain;
+    float master_volume;
+    unsigned gain_seq;
+
+    /* Render timing, written by the audio thread only */
+    int sample_rate;
+    uint64_t last_callback_ns;
+    uint64_t periods;
+    uint64_t late_periods;
+    uint64_t overruns;
+    double load_sum;
+    double peak_load;
+    uint64_t freewheel_periods;
+    volatile int stats_reset;
+    bool freewheel;             /* JACK drives rendering faster than real time */
+
+    /* Voice shedding, audio thread only */
+    int shed_threshold;         /* Percent of the period budget, 0 disables */
+    shed_cost_t cost;
+    int period_voices;          /* Voices rendered by the current period */
+    bool period_shed;           /* The current period sheds a channel */
+    unsigned shed_mask;         /* Channels shed since a period last fit */
+    unsigned shed_muted;        /* Channels silenced for the current period */
+    float shed_restore[SHED_CHANNELS];  /* Their attenuation before */
+    int shed_from;              /* Voices playing when they were silenced */
+    /* Notes sounding per channel, from every thread that plays notes:
+     * keys down, and keys let go of while the sustain pedal is down */
+    uint64_t notes_down[16][2];
+    uint64_t notes_held[16][2];
+    unsigned sustain_mask;
+    uint64_t shed_periods;
+    uint64_t shed_voices;
+
+    /* Xrun concealment, audio thread only */
+    conceal_t *conceal;         /* NULL when disabled */
+    uint64_t concealed_periods;
+    uint64_t concealed_frames;
+    uint64_t resyncs;
+
+    /* Percussion cache: hits are rendered by a side engine on the cache's
+     * worker and mixed by the audio thread */
+    perc_cache_t *perc;
+    synth_t *perc_engine;
+
+    /* Level meters, fed by the rendering thread. For channel levels every
+     * MIDI channel renders to its own output pair in meter_out, which is
+     * metered and then mixed down into the caller's buffers */
+    meter_t *meter;             /* NULL when disabled */
+    bool meter_channels;        /* FluidSynth has one output pair per channel */
+    float *meter_buf;           /* Backs the buffers below */
+    float *meter_out[METER_CHANNELS * 2];
+    float *meter_perc[2];       /* Cached percussion hits of one period */
+    int meter_perc_frames;
+
+    /* Render clock: frames rendered, and frame and time at which the
+     * latest period started */
+    uint64_t frame_clock;
+    uint64_t period_start_frame;
+    uint64_t period_start_ns;
+
+    /* Timed events: bounded ring filled by any thread, drained by the
+     * audio thread into a list sorted by frame that only it touches */
+    synth_queue_slot_t queue[SYNTH_SCHEDULE_QUEUE_SIZE];
+    unsigned queue_head;
+    unsigned queue_tail;
+    synth_timed_event_t pending[SYNTH_SCHEDULE_QUEUE_SIZE];
+    int pending_count;
+    uint64_t dispatch_failures; /* Timed events the engine rejected, atomic */
+
+    /* Memory accounted to memstat, handed back on cleanup */
+    synth_soundfont_memory_t sf_memory[CONFIG_MAX_SOUNDFONTS];
+    int sf_memory_count;
+    size_t voice_bytes;
+    size_t buffer_bytes;
+    size_t queue_bytes;
+
+    /* Dynamic sample loading for the sample cache: program changes may
+     * read sample data from disk, so they are timed and never scheduled
+     * onto the audio thread */
+    bool dynamic_samples;
+    uint64_t program_change_ns[16];
+    bool sm24_loader;           /* 16-bit loader added to the synth */
+    bool sm24_user;             /* Holds a reference on the sm24 table */
+
+    /* Lazy start: soundfonts and audio come up on the first input and go
+     * again when idle; meanwhile input waits in the schedule queue */
+    bool lazy;
+    bool active;
+    bool activation_requested;
+    int wakeup_fd;              /* eventfd signalled when activation is wanted */
+    uint64_t last_input_ns;
+    uint64_t deferred_dropped;
+
+    /* Playback latency class: a second engine renders ahead in large
+     * blocks into a ring that the live audio callback mixes from */
+    synth_t *playback;          /* Live engine: its playback engine, if any */
+    synth_t *live;              /* Playback engine: the engine mixing it */
+    playback_ring_t ring;       /* SYNTH_PLAYBACK_BLOCKS blocks, one rendered per wakeup */
+    uint64_t blocks;
+    sem_t wake;
+    bool wake_pending;
+    volatile int running;
+    pthread_t thread;
+    bool thread_started;
 };
 
 /**
@@ -54,7 +218,10 @@ static const char* fluidsynth_driver_names[] = {
     [AUDIO_DRIVER_JACK]       = "jack",
     [AUDIO_DRIVER_PIPEWIRE]   = "pipewire", 
     [AUDIO_DRIVER_PULSEAUDIO] = "pulseaudio",
-    [AUDIO_DRIVER_ALSA]       = "alsa"
+    [AUDIO_DRIVER_ALSA]       = "alsa",
+    [AUDIO_DRIVER_NULL]       = "null",
+    [AUDIO_DRIVER_FREEWHEEL]  = "freewheel",
+    [AUDIO_DRIVER_OFFLINE]    = "offline"
 };
 
 /**
@@ -92,30 +259,50 @@ static const char* find_available_soundfont(void) {
 }
 
 /**
- * Setup FluidSynth settings based on configuration
+ * Determine which audio driver the synthesizer renders to
  */
-static int setup_fluidsynth_settings(synth_t *synth) {
-    const midisynthd_config_t *config = synth->config;
-
-    /* Determine which audio driver FluidSynth should use */
-    audio_driver_t driver = config->audio_driver;
+static audio_driver_t resolve_audio_driver(const synth_t *synth) {
+    audio_driver_t driver = synth->config->audio_driver;
     if (synth->audio && audio_is_initialized(synth->audio)) {
         driver = audio_get_driver_type(synth->audio);
     }
-    if (driver == AUDIO_DRIVER_AUTO) {
+    if (driver == AUDIO_DRIVER_AUTO || driver < 0 || driver >= AUDIO_DRIVER_COUNT) {
         driver = AUDIO_DRIVER_ALSA; /* sane fallback */
     }
+    return driver;
+}
 
-    const char *driver_name = (driver < AUDIO_DRIVER_COUNT)
-                                  ? fluidsynth_driver_names[driver]
-                                  : "alsa";
+/**
+ * Setup FluidSynth settings based on configuration
+ *
+ * @param channel_outputs Render one output pair per channel for the level
+ *                        meters; engines read through fluid_synth_write_float
+ *                        only see pair 0 and must keep the mixed output
+ */
+static int setup_fluidsynth_settings(synth_t *synth, bool channel_outputs) {
+    const midisynthd_config_t *config = synth->config;
 
-    if (fluid_settings_setstr(synth->settings, "audio.driver", driver_name) != FLUID_OK) {
+    /* Determine which audio driver FluidSynth should use */
+    audio_driver_t driver = resolve_audio_driver(synth);
+    const char *driver_name = fluidsynth_driver_names[driver];
+
+    if (audio_driver_is_internal(driver)) {
+        syslog(LOG_DEBUG, "Audio rendered by internal '%s' driver", driver_name);
+    } else if (fluid_settings_setstr(synth->settings, "audio.driver", driver_name) != FLUID_OK) {
         syslog(LOG_WARNING, "Failed to set audio driver to '%s'", driver_name);
     } else {
         syslog(LOG_DEBUG, "Set FluidSynth audio driver to '%s'", driver_name);
     }
     
+    /* Select a specific ALSA PCM, e.g. a loopback device */
+    if (driver == AUDIO_DRIVER_ALSA && config->audio_device[0] != '\0') {
+        if (fluid_settings_setstr(synth->settings, "audio.alsa.device", config->audio_device) != FLUID_OK) {
+            syslog(LOG_WARNING, "Failed to set ALSA device to '%s'", config->audio_device);
+        } else {
+            syslog(LOG_DEBUG, "Set ALSA device to '%s'", config->audio_device);
+        }
+    }
+    
     /* Set sample rate */
     if (fluid_settings_setnum(synth->settings, "synth.sample-rate", config->sample_rate) != FLUID_OK) {
         syslog(LOG_WARNING, "Failed to set sample rate to %d", config->sample_rate);
@@ -160,6 +347,32 @@ static int setup_fluidsynth_settings(synth_t *synth) {
         }
     }
     
+    /* Load sample data per preset on selection; hidden channels above the
+     * 16 MIDI channels hold the presets kept by the sample cache */
+    if (config->sample_cache > 0) {
+        int channels = 16 + (config->sample_cache + 15) / 16 * 16;
+        if (fluid_settings_setint(synth->settings, "synth.dynamic-sample-loading", 1) != FLUID_OK ||
+            fluid_settings_setint(synth->settings, "synth.midi-channels", channels) != FLUID_OK) {
+            syslog(LOG_WARNING, "Failed to enable dynamic sample loading");
+        } else {
+            synth->dynamic_samples = true;
+            syslog(LOG_DEBUG, "Enabled dynamic sample loading with %d channels", channels);
+        }
+    }
+    
+    /* Level meters: one output pair per MIDI channel. The JACK driver
+     * would register a port pair for each, so there only the mixed output
+     * is metered */
+    if (channel_outputs && config->level_meters && driver != AUDIO_DRIVER_JACK) {
+        if (fluid_settings_setint(synth->settings, "synth.audio-channels", METER_CHANNELS) != FLUID_OK ||
+            fluid_settings_setint(synth->settings, "synth.audio-groups", METER_CHANNELS) != FLUID_OK) {
+            syslog(LOG_WARNING, "Failed to set up per-channel outputs, only the output level is metered");
+        } else {
+            synth->meter_channels = true;
+            syslog(LOG_DEBUG, "Rendering %d channel output pairs for the level meters", METER_CHANNELS);
+        }
+    }
+    
     /* Set JACK client name if using JACK */
     if (config->audio_driver == AUDIO_DRIVER_JACK || config->audio_driver == AUDIO_DRIVER_AUTO) {
         if (fluid_settings_setstr(synth->settings, "audio.jack.id", config->client_name) != FLUID_OK) {
@@ -192,6 +405,183 @@ static int setup_fluidsynth_settings(synth_t *synth) {
     return 0;
 }
 
+/**
+ * Account a loaded soundfont's sample data and metadata
+ */
+static void account_soundfont(synth_t *synth, int sf_id, const char *path, bool drop_sm24) {
+    if (synth->sf_memory_count >= CONFIG_MAX_SOUNDFONTS) {
+        return;
+    }
+    
+    memstat_sf2_t est;
+    if (memstat_sf2_estimate(path, &est) < 0) {
+        syslog(LOG_DEBUG, "Cannot size soundfont %s, not accounted", path);
+        return;
+    }
+    
+    synth_soundfont_memory_t *m = &synth->sf_memory[synth->sf_memory_count++];
+    m->id = sf_id;
+    snprintf(m->path, sizeof(m->path), "%s", path);
+    m->saved_bytes = drop_sm24 ? est.sm24_bytes : 0;
+    m->sample_bytes = est.sample_bytes - m->saved_bytes;
+    m->metadata_bytes = est.metadata_bytes;
+    memstat_add(MEMSTAT_SAMPLES, m->sample_bytes);
+    memstat_add(MEMSTAT_PRESETS, m->metadata_bytes);
+    syslog(LOG_INFO, "Soundfont %d: %zu KiB sample data, %zu KiB metadata (%d presets, %d zones)",
+           sf_id, m->sample_bytes / 1024, m->metadata_bytes / 1024, est.presets, est.zones);
+    if (m->saved_bytes > 0) {
+        syslog(LOG_INFO, "Soundfont %d: 24-bit extension ignored, %zu KiB saved",
+               sf_id, m->saved_bytes / 1024);
+    }
+}
+
+/*
+ * Soundfonts whose sm24 chunk is hidden from FluidSynth. The loader's file
+ * callbacks get no user data, and with dynamic sample loading a file is
+ * reopened long after synth_init(), so the table is shared by all engines:
+ * entries are only added while any engine holds a reference, and the table
+ * empties when the last one is cleaned up.
+ */
+static struct {
+    char path[CONFIG_MAX_PATH_LEN];
+    long sm24_offset;
+} sm24_hidden[CONFIG_MAX_SOUNDFONTS];
+static int sm24_hidden_count;
+static int sm24_users;
+static pthread_mutex_t sm24_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Offset of the hidden sm24 chunk header of a soundfont, 0 if it is kept
+ */
+static long sm24_lookup(const char *path) {
+    long offset = 0;
+    pthread_mutex_lock(&sm24_lock);
+    for (int i = 0; i < sm24_hidden_count; i++) {
+        if (strcmp(sm24_hidden[i].path, path) == 0) {
+            offset = sm24_hidden[i].sm24_offset;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&sm24_lock);
+    return offset;
+}
+
+typedef struct {
+    FILE *file;
+    long sm24_offset;           /* Chunk header to rename, 0 if none */
+} sf_file_t;
+
+static void *sf_file_open(const char *filename) {
+    FILE *file = fopen(filename, "rb");
+    if (!file) return NULL;
+    sf_file_t *h = calloc(1, sizeof(*h));
+    if (!h) {
+        fclose(file);
+        return NULL;
+    }
+    h->file = file;
+    h->sm24_offset = sm24_lookup(filename);
+    return h;
+}
+
+/**
+ * Read through, renaming the sm24 chunk so FluidSynth skips it as unknown
+ * and keeps 16-bit samples only
+ */
+static int sf_file_read(void *buf, fluid_long_long_t count, void *handle) {
+    sf_file_t *h = handle;
+    if (count <= 0) return FLUID_OK;
+    long pos = ftell(h->file);
+    if (pos < 0 || fread(buf, (size_t)count, 1, h->file) != 1) return FLUID_FAILED;
+
+    if (h->sm24_offset > 0 && pos < h->sm24_offset + 4 && pos + (long)count > h->sm24_offset) {
+        static const char junk[4] = { 'J', 'U', 'N', 'K' };
+        for (long i = 0; i < 4; i++) {
+            long at = h->sm24_offset + i - pos;
+            if (at >= 0 && at < (long)count) ((char *)buf)[at] = junk[i];
+        }
+    }
+    return FLUID_OK;
+}
+
+static int sf_file_seek(void *handle, fluid_long_long_t offset, int origin) {
+    sf_file_t *h = handle;
+    return fseek(h->file, (long)offset, origin) == 0 ? FLUID_OK : FLUID_FAILED;
+}
+
+static fluid_long_long_t sf_file_tell(void *handle) {
+    sf_file_t *h = handle;
+    return ftell(h->file);
+}
+
+static int sf_file_close(void *handle) {
+    sf_file_t *h = handle;
+    int ret = fclose(h->file) == 0 ? FLUID_OK : FLUID_FAILED;
+    free(h);
+    return ret;
+}
+
+/**
+ * Install a loader that hides sm24 chunks when any soundfont asks for it
+ *
+ * Must run before the first soundfont is loaded.
+ */
+static void setup_sm24_loader(synth_t *synth) {
+    const midisynthd_config_t *config = synth->config;
+    int hidden = 0;
+
+    /* Held throughout so another engine's cleanup cannot empty the table
+     * before this one holds its reference */
+    pthread_mutex_lock(&sm24_lock);
+    for (int i = 0; i < config->soundfont_count && i < CONFIG_MAX_SOUNDFONTS; i++) {
+        memstat_sf2_t est;
+        const char *path = config->soundfonts[i].path;
+        if (!config->soundfonts[i].enabled || !config->soundfonts[i].drop_sm24) continue;
+        if (memstat_sf2_estimate(path, &est) < 0 || est.sm24_offset == 0) {
+            syslog(LOG_DEBUG, "Soundfont %s has no 24-bit extension", path);
+            continue;
+        }
+        int j = 0;
+        while (j < sm24_hidden_count && strcmp(sm24_hidden[j].path, path) != 0) j++;
+        if (j == sm24_hidden_count && j < CONFIG_MAX_SOUNDFONTS) {
+            snprintf(sm24_hidden[j].path, CONFIG_MAX_PATH_LEN, "%s", path);
+            sm24_hidden[j].sm24_offset = est.sm24_offset;
+            sm24_hidden_count++;
+        }
+        hidden++;
+    }
+    if (hidden > 0 && !synth->sm24_user) {
+        sm24_users++;
+        synth->sm24_user = true;
+    }
+    pthread_mutex_unlock(&sm24_lock);
+
+    /* A lazily started engine reloads its soundfonts through the same loader */
+    if (hidden == 0 || synth->sm24_loader) return;
+
+    fluid_sfloader_t *loader = new_fluid_defsfloader(synth->settings);
+    if (!loader || fluid_sfloader_set_callbacks(loader, sf_file_open, sf_file_read, sf_file_seek,
+                                                sf_file_tell, sf_file_close) != FLUID_OK) {
+        syslog(LOG_WARNING, "Failed to set up 16-bit soundfont loader, loading 24-bit samples");
+        if (loader) delete_fluid_sfloader(loader);
+        return;
+    }
+    /* Added loaders are tried before the default one; the synth owns it */
+    fluid_synth_add_sfloader(synth->synth, loader);
+    synth->sm24_loader = true;
+}
+
+/**
+ * Grow the accounted voice pool; FluidSynth never shrinks it
+ */
+static void account_voices(synth_t *synth, int polyphony) {
+    size_t bytes = memstat_voice_bytes(polyphony);
+    if (bytes > synth->voice_bytes) {
+        memstat_add(MEMSTAT_VOICES, bytes - synth->voice_bytes);
+        synth->voice_bytes = bytes;
+    }
+}
+
 /**
  * Load soundfonts into the synthesizer
  */
@@ -199,6 +589,8 @@ static int load_soundfonts(synth_t *synth) {
     const midisynthd_config_t *config = synth->config;
     int loaded_count = 0;
     
+    setup_sm24_loader(synth);
+    
     /* Try to load configured soundfonts first */
     for (int i = 0; i < config->soundfont_count && i < CONFIG_MAX_SOUNDFONTS; i++) {
         if (!config->soundfonts[i].enabled) {
@@ -224,6 +616,8 @@ static int load_soundfonts(synth_t *synth) {
         
         loaded_count++;
         syslog(LOG_INFO, "Successfully loaded soundfont: %s (ID: %d)", sf_path, sf_id);
+        bool dropped = synth->sm24_loader && config->soundfonts[i].drop_sm24 && sm24_lookup(sf_path) > 0;
+        account_soundfont(synth, sf_id, sf_path, dropped);
         
         /* Set bank offset if specified */
         if (config->soundfonts[i].bank_offset != 0) {
@@ -244,6 +638,7 @@ static int load_soundfonts(synth_t *synth) {
                 synth->soundfont_id = sf_id;
                 loaded_count++;
                 syslog(LOG_INFO, "Successfully loaded default soundfont: %s (ID: %d)", default_sf, sf_id);
+                account_soundfont(synth, sf_id, default_sf, false);
             } else {
                 syslog(LOG_ERR, "Failed to load default soundfont: %s", default_sf);
             }
@@ -295,201 +690,1337 @@ static void setup_effects(synth_t *synth) {
 }
 
 /**
- * Initialize the synthesizer engine
+ * Record timing of one rendered period against its real-time budget
  */
-synth_t* synth_init(const midisynthd_config_t *config, audio_t *audio) {
-    if (!config) {
-        syslog(LOG_ERR, "Invalid configuration passed to synth_init");
-        return NULL;
-    }
-    
-    synth_t *synth = calloc(1, sizeof(synth_t));
-    if (!synth) {
-        syslog(LOG_ERR, "Failed to allocate memory for synthesizer");
-        return NULL;
-    }
-    
-    synth->config = config;
-    synth->audio = audio;
-    synth->soundfont_id = FLUID_FAILED;
-    synth->initialized = false;
-    
-    /* Create FluidSynth settings */
-    synth->settings = new_fluid_settings();
-    if (!synth->settings) {
-        syslog(LOG_ERR, "Failed to create FluidSynth settings");
-        goto error;
+static void account_period(synth_t *synth, int len, uint64_t start_ns, uint64_t end_ns) {
+    if (synth->stats_reset) {
+        synth->periods = 0;
+        synth->late_periods = 0;
+        synth->overruns = 0;
+        synth->load_sum = 0.0;
+        synth->peak_load = 0.0;
+        synth->freewheel_periods = 0;
+        synth->last_callback_ns = 0;
+        synth->shed_periods = 0;
+        synth->shed_voices = 0;
+        synth->concealed_periods = 0;
+        synth->concealed_frames = 0;
+        synth->resyncs = 0;
+        synth->stats_reset = 0;
     }
-    
-    /* Configure FluidSynth settings */
-    if (setup_fluidsynth_settings(synth) < 0) {
-        syslog(LOG_ERR, "Failed to configure FluidSynth settings");
-        goto error;
+
+    /* Freewheeling has no real-time budget to measure against, and the
+     * first period after it must not count as late */
+    if (start_ns == 0) {
+        synth->freewheel_periods++;
+        synth->last_callback_ns = 0;
+        return;
     }
-    
-    /* Create FluidSynth synthesizer */
-    synth->synth = new_fluid_synth(synth->settings);
-    if (!synth->synth) {
-        syslog(LOG_ERR, "Failed to create FluidSynth synthesizer");
-        goto error;
+
+    uint64_t budget_ns = (uint64_t)len * 1000000000ULL / (uint64_t)synth->sample_rate;
+    double load = budget_ns ? 100.0 * (double)(end_ns - start_ns) / (double)budget_ns : 0.0;
+
+    /* A callback arriving more than 1.5 periods after the previous one means
+     * the device ran dry in between, which is what an xrun sounds like */
+    if (synth->last_callback_ns && start_ns - synth->last_callback_ns > budget_ns + budget_ns / 2) {
+        synth->late_periods++;
     }
-    
-    /* Load soundfonts */
-    if (load_soundfonts(synth) < 0) {
-        syslog(LOG_ERR, "Failed to load any soundfonts");
-        goto error;
+    if (load > 100.0) {
+        synth->overruns++;
     }
-    
-    /* Setup effects */
-    setup_effects(synth);
-    
-    /* Create audio driver */
-    synth->audio_driver = new_fluid_audio_driver(synth->settings, synth->synth);
-    if (!synth->audio_driver) {
-        syslog(LOG_ERR, "Failed to create FluidSynth audio driver");
-        goto error;
+    if (load > synth->peak_load) {
+        synth->peak_load = load;
     }
-    
-    synth->initialized = true;
-    syslog(LOG_INFO, "FluidSynth synthesizer initialized successfully");
-    
-    /* Log the actual driver being used */
-    char *actual_driver = NULL;
-    if (fluid_settings_dupstr(synth->settings, "audio.driver", &actual_driver) == FLUID_OK) {
-        syslog(LOG_INFO, "Using audio driver: %s", actual_driver);
-        if (actual_driver) {
-            free(actual_driver);
-        }
+    synth->load_sum += load;
+    synth->periods++;
+    synth->last_callback_ns = start_ns;
+    if (!synth->period_shed) {
+        shed_cost_learn(&synth->cost, synth->period_voices, len, end_ns - start_ns);
     }
-    
-    return synth;
-    
-error:
-    synth_cleanup(synth);
-    return NULL;
 }
 
 /**
- * Clean up synthesizer resources
+ * Track a key going down or up for choosing channels to shed
  */
-void synth_cleanup(synth_t *synth) {
-    if (!synth) {
+static void track_note(synth_t *synth, int channel, int key, bool on) {
+    uint64_t bit = 1ULL << (key & 63);
+    uint64_t *down = &synth->notes_down[channel][key >> 6];
+    if (on) {
+        __atomic_fetch_or(down, bit, __ATOMIC_RELAXED);
         return;
     }
-    
-    syslog(LOG_DEBUG, "Cleaning up FluidSynth synthesizer");
-    
-    if (synth->audio_driver) {
-        delete_fluid_audio_driver(synth->audio_driver);
-        synth->audio_driver = NULL;
-    }
-    
-    if (synth->synth) {
-        delete_fluid_synth(synth->synth);
-        synth->synth = NULL;
-    }
-    
-    if (synth->settings) {
-        delete_fluid_settings(synth->settings);
-        synth->settings = NULL;
+    if (__atomic_fetch_and(down, ~bit, __ATOMIC_RELAXED) & bit &&
+        __atomic_load_n(&synth->sustain_mask, __ATOMIC_RELAXED) & (1u << channel)) {
+        __atomic_fetch_or(&synth->notes_held[channel][key >> 6], bit, __ATOMIC_RELAXED);
     }
-    
-    synth->initialized = false;
-    free(synth);
 }
 
 /**
- * Send a Note On MIDI event to the synthesizer
+ * Track the sustain pedal; letting it up ends the notes it held
  */
-int synth_note_on(synth_t *synth, int channel, int key, int velocity) {
-    if (!synth || !synth->initialized || !synth->synth) {
-        return -1;
-    }
-    
-    if (channel < 0 || channel >= 16 || key < 0 || key > 127 || velocity < 0 || velocity > 127) {
-        syslog(LOG_DEBUG, "Invalid MIDI parameters: channel=%d, key=%d, velocity=%d", channel, key, velocity);
-        return -1;
+static void track_sustain(synth_t *synth, int channel, bool down) {
+    if (down) {
+        __atomic_fetch_or(&synth->sustain_mask, 1u << channel, __ATOMIC_RELAXED);
+        return;
     }
-    
-    int result = fluid_synth_noteon(synth->synth, channel, key, velocity);
-    if (result != FLUID_OK) {
-        syslog(LOG_DEBUG, "FluidSynth note on failed: channel=%d, key=%d, velocity=%d", channel, key, velocity);
-        return -1;
+    __atomic_fetch_and(&synth->sustain_mask, ~(1u << channel), __ATOMIC_RELAXED);
+    for (int i = 0; i < 2; i++) {
+        __atomic_store_n(&synth->notes_held[channel][i], 0, __ATOMIC_RELAXED);
     }
-    
-    return 0;
 }
 
 /**
- * Send a Note Off MIDI event to the synthesizer
+ * Track all keys of a channel going up, or all its sound ending
  */
-int synth_note_off(synth_t *synth, int channel, int key, int velocity) {
-    if (!synth || !synth->initialized || !synth->synth) {
-        return -1;
-    }
-    
-    if (channel < 0 || channel >= 16 || key < 0 || key > 127) {
-        syslog(LOG_DEBUG, "Invalid MIDI parameters: channel=%d, key=%d", channel, key);
-        return -1;
-    }
-    
-    int result = fluid_synth_noteoff(synth->synth, channel, key);
-    if (result != FLUID_OK) {
-        syslog(LOG_DEBUG, "FluidSynth note off failed: channel=%d, key=%d", channel, key);
-        return -1;
+static void track_all_off(synth_t *synth, int channel, bool sound) {
+    bool held = !sound && (__atomic_load_n(&synth->sustain_mask, __ATOMIC_RELAXED) & (1u << channel));
+    for (int i = 0; i < 2; i++) {
+        uint64_t down = __atomic_exchange_n(&synth->notes_down[channel][i], 0, __ATOMIC_RELAXED);
+        if (held) {
+            __atomic_fetch_or(&synth->notes_held[channel][i], down, __ATOMIC_RELAXED);
+        } else if (sound) {
+            __atomic_store_n(&synth->notes_held[channel][i], 0, __ATOMIC_RELAXED);
+        }
     }
-    
-    return 0;
 }
 
 /**
- * Send a Program Change MIDI event to the synthesizer
+ * Notes sounding on a channel as tracked
  */
-int synth_program_change(synth_t *synth, int channel, int program) {
-    if (!synth || !synth->initialized || !synth->synth) {
-        return -1;
-    }
-    
-    if (channel < 0 || channel >= 16 || program < 0 || program > 127) {
-        syslog(LOG_DEBUG, "Invalid MIDI parameters: channel=%d, program=%d", channel, program);
-        return -1;
-    }
-    
-    int result = fluid_synth_program_change(synth->synth, channel, program);
-    if (result != FLUID_OK) {
-        syslog(LOG_DEBUG, "FluidSynth program change failed: channel=%d, program=%d", channel, program);
-        return -1;
+static int sounding_notes(synth_t *synth, int channel) {
+    int notes = 0;
+    for (int i = 0; i < 2; i++) {
+        notes += __builtin_popcountll(__atomic_load_n(&synth->notes_down[channel][i], __ATOMIC_RELAXED) |
+                                      __atomic_load_n(&synth->notes_held[channel][i], __ATOMIC_RELAXED));
     }
-    
-    return 0;
+    return notes;
 }
 
 /**
- * Send a Control Change MIDI event to the synthesizer
+ * Let the channels shed last period play again, their voices gone by now
  */
-int synth_control_change(synth_t *synth, int channel, int control, int value) {
-    if (!synth || !synth->initialized || !synth->synth) {
-        return -1;
-    }
-    
-    if (channel < 0 || channel >= 16 || control < 0 || control > 127 || value < 0 || value > 127) {
-        syslog(LOG_DEBUG, "Invalid MIDI parameters: channel=%d, control=%d, value=%d", channel, control, value);
-        return -1;
+static void restore_shed(synth_t *synth, int voices) {
+    if (synth->shed_from > voices) {
+        synth->shed_voices += (uint64_t)(synth->shed_from - voices);
     }
-    
-    int result = fluid_synth_cc(synth->synth, channel, control, value);
-    if (result != FLUID_OK) {
-        syslog(LOG_DEBUG, "FluidSynth control change failed: channel=%d, control=%d, value=%d", channel, control, value);
-        return -1;
+    for (int ch = 0; ch < SHED_CHANNELS; ch++) {
+        if (synth->shed_muted & (1u << ch)) {
+            fluid_synth_set_gen(synth->synth, ch, GEN_ATTENUATION, synth->shed_restore[ch]);
+        }
     }
-    
-    return 0;
+    synth->shed_muted = 0;
 }
 
 /**
- * Send a Pitch Bend MIDI event to the synthesizer
+ * Silence a channel when a period is predicted to overrun its budget
+ *
+ * The prediction uses the costs learned from earlier periods and the
+ * voices playing as the period starts. FluidSynth only lets voices be
+ * changed from inside its own lock, so shedding goes through the channel
+ * controls, which take it: the chosen channel is attenuated to silence
+ * for one period, which FluidSynth ramps over its internal block and then
+ * frees the voices as below the noise floor. Notes started on it during
+ * that period are lost with them. One channel with notes sounding goes
+ * per period until the prediction fits, pedal-held channels first, then
+ * the softest, then those with the fewest notes.
  */
-int synth_pitch_bend(synth_t *synth, int channel, int value) {
+static void shed_voices(synth_t *synth, int len) {
+    int voices = fluid_synth_get_active_voice_count(synth->synth);
+    synth->period_voices = voices;
+    synth->period_shed = false;
+
+    if (synth->shed_muted) {
+        restore_shed(synth, voices);
+    }
+
+    if (shed_cost_excess(&synth->cost, voices, len, synth->sample_rate, synth->shed_threshold) <= 0) {
+        synth->shed_mask = 0;
+        return;
+    }
+
+    shed_channel_t channels[SHED_CHANNELS];
+    for (int ch = 0; ch < SHED_CHANNELS; ch++) {
+        int sustain = 0, sostenuto = 0, volume = 0, expression = 0;
+        fluid_synth_get_cc(synth->synth, ch, 64, &sustain);
+        fluid_synth_get_cc(synth->synth, ch, 66, &sostenuto);
+        fluid_synth_get_cc(synth->synth, ch, 7, &volume);
+        fluid_synth_get_cc(synth->synth, ch, 11, &expression);
+        channels[ch].pedal = sustain >= 64 || sostenuto >= 64;
+        channels[ch].level = volume * expression;
+        channels[ch].notes = sounding_notes(synth, ch);
+    }
+    int ch = shed_pick_channel(channels, synth->shed_mask);
+    if (ch < 0) {
+        return;
+    }
+
+    synth->shed_restore[ch] = fluid_synth_get_gen(synth->synth, ch, GEN_ATTENUATION);
+    if (fluid_synth_set_gen(synth->synth, ch, GEN_ATTENUATION, SYNTH_SHED_ATTENUATION) != FLUID_OK) {
+        return;
+    }
+    synth->shed_mask |= 1u << ch;
+    synth->shed_muted |= 1u << ch;
+    synth->shed_from = voices;
+    synth->shed_periods++;
+    synth->period_shed = true;
+}
+
+static int dispatch_midi(synth_t *synth, const uint8_t *data, size_t length);
+
+/**
+ * Move newly queued timed events into the sorted pending list
+ */
+static void drain_schedule_queue(synth_t *synth) {
+    unsigned tail = synth->queue_tail;
+
+    while (synth->pending_count < SYNTH_SCHEDULE_QUEUE_SIZE) {
+        synth_queue_slot_t *slot = &synth->queue[tail % SYNTH_SCHEDULE_QUEUE_SIZE];
+        if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != tail + 1) {
+            break;
+        }
+        const synth_timed_event_t *ev = &slot->ev;
+        /* Insertion keeps events with equal frames in arrival order */
+        int i = synth->pending_count;
+        while (i > 0 && synth->pending[i - 1].frame > ev->frame) {
+            synth->pending[i] = synth->pending[i - 1];
+            i--;
+        }
+        synth->pending[i] = *ev;
+        synth->pending_count++;
+        /* Hand the slot back to producers for the next lap */
+        __atomic_store_n(&slot->seq, tail + SYNTH_SCHEDULE_QUEUE_SIZE, __ATOMIC_RELEASE);
+        tail++;
+    }
+    synth->queue_tail = tail;
+}
+
+/**
+ * Play a channel 10 note message on the audio thread
+ *
+ * Note-ons mix a cached hit when there is one and start a live voice
+ * otherwise; note-offs only reach live voices.
+ *
+ * @param offset Frame in the period the message applies at
+ * @return true when the message was handled
+ */
+static bool dispatch_percussion(synth_t *synth, const uint8_t *msg, size_t len, int offset) {
+    uint8_t type = msg[0] & 0xF0;
+    if (!synth->perc || len < 3 || (msg[0] & 0x0F) != SYNTH_PERC_CHANNEL ||
+        (type != MIDI_NOTE_ON && type != MIDI_NOTE_OFF)) {
+        return false;
+    }
+    if (type == MIDI_NOTE_ON && msg[2] > 0) {
+        if (!perc_cache_play(synth->perc, msg[1], msg[2], offset)) {
+            fluid_synth_noteon(synth->synth, SYNTH_PERC_CHANNEL, msg[1], msg[2]);
+        }
+    } else {
+        fluid_synth_noteoff(synth->synth, SYNTH_PERC_CHANNEL, msg[1]);
+    }
+    return true;
+}
+
+/**
+ * Add one buffer to another
+ */
+static void add_samples(float *dst, const float *src, int frames) {
+    for (int i = 0; i < frames; i++) {
+        dst[i] += src[i];
+    }
+}
+
+/**
+ * Render into the caller's buffers, through the channel meters when on
+ *
+ * FluidSynth mixes output pair n into the caller's pair n % nout, so
+ * rendering a pair per channel and mixing them down the same way hands
+ * the caller the audio it would otherwise get. Effects are routed as
+ * without meters, through the caller's effect buffers unchanged.
+ */
+static int process_block(synth_t *synth, int len, int nfx, float *fx[], int nout, float *out[]) {
+    if (!synth->meter_buf || nout < 2 || nout % 2 != 0 || nfx > SYNTH_MAX_SPLIT_BUFFERS) {
+        return fluid_synth_process(synth->synth, len, nfx, fx, nout, out);
+    }
+
+    int result = FLUID_OK;
+    for (int pos = 0; pos < len; pos += SYNTH_METER_FRAMES) {
+        int frames = len - pos < SYNTH_METER_FRAMES ? len - pos : SYNTH_METER_FRAMES;
+        memset(synth->meter_buf, 0, METER_CHANNELS * 2 * SYNTH_METER_FRAMES * sizeof(float));
+
+        float *sub_fx[SYNTH_MAX_SPLIT_BUFFERS];
+        for (int i = 0; i < nfx; i++) sub_fx[i] = fx[i] ? fx[i] + pos : NULL;
+        if (fluid_synth_process(synth->synth, frames, nfx, sub_fx, METER_CHANNELS * 2, synth->meter_out) != FLUID_OK) {
+            result = FLUID_FAILED;
+        }
+
+        for (int ch = 0; ch < METER_CHANNELS; ch++) {
+            const float *left = synth->meter_out[2 * ch];
+            const float *right = synth->meter_out[2 * ch + 1];
+            meter_add_channel(synth->meter, ch, left, right, frames);
+            if (out[(2 * ch) % nout]) add_samples(out[(2 * ch) % nout] + pos, left, frames);
+            if (out[(2 * ch + 1) % nout]) add_samples(out[(2 * ch + 1) % nout] + pos, right, frames);
+        }
+    }
+    return result;
+}
+
+/**
+ * Render a period, splitting it at the frames of pending timed events
+ *
+ * With a deadline the period is also rendered in SYNTH_CONCEAL_CHUNK
+ * pieces, and rendering stops early when the pace so far says the rest
+ * would finish after it. Events in the part left out stay pending for the
+ * next period.
+ *
+ * @param deadline_ns Monotonic time to be done by, 0 for none
+ * @param rendered Receives the frames rendered from the start, may be NULL
+ */
+static int render_scheduled(synth_t *synth, int len, int nfx, float *fx[], int nout, float *out[],
+                            uint64_t deadline_ns, int *rendered) {
+    drain_schedule_queue(synth);
+    if (rendered) {
+        *rendered = len;
+    }
+    if (synth->pending_count == 0 && deadline_ns == 0) {
+        uint64_t span = trace_begin();
+        int result = process_block(synth, len, nfx, fx, nout, out);
+        trace_end(span, "render", len);
+        return result;
+    }
+
+    bool can_split = nfx <= SYNTH_MAX_SPLIT_BUFFERS && nout <= SYNTH_MAX_SPLIT_BUFFERS;
+    uint64_t base = synth->frame_clock;
+    uint64_t start_ns = deadline_ns ? monotonic_ns() : 0;
+    int consumed = 0;
+    int pos = 0;
+    int result = FLUID_OK;
+
+    while (pos < len) {
+        if (deadline_ns && can_split && pos > 0) {
+            uint64_t now = monotonic_ns();
+            uint64_t rest = (now - start_ns) * (uint64_t)(len - pos) / (uint64_t)pos;
+            if (now + rest > deadline_ns) {
+                if (rendered) {
+                    *rendered = pos;
+                }
+                break;
+            }
+        }
+
+        uint64_t span = trace_begin();
+        int dispatched = consumed;
+        while (consumed < synth->pending_count && synth->pending[consumed].frame <= base + (uint64_t)pos) {
+            const synth_timed_event_t *ev = &synth->pending[consumed];
+            if (!dispatch_percussion(synth, ev->msg, ev->len, pos) &&
+                dispatch_midi(synth, ev->msg, ev->len) < 0) {
+                __atomic_add_fetch(&synth->dispatch_failures, 1, __ATOMIC_RELAXED);
+            }
+            consumed++;
+        }
+        if (consumed > dispatched) {
+            trace_end(span, "dispatch", consumed - dispatched);
+        }
+
+        int end = len;
+        if (can_split && consumed < synth->pending_count &&
+            synth->pending[consumed].frame < base + (uint64_t)len) {
+            end = (int)(synth->pending[consumed].frame - base);
+        }
+        if (deadline_ns && can_split && end - pos > SYNTH_CONCEAL_CHUNK) {
+            end = pos + SYNTH_CONCEAL_CHUNK;
+        }
+
+        float *sub_fx[SYNTH_MAX_SPLIT_BUFFERS];
+        float *sub_out[SYNTH_MAX_SPLIT_BUFFERS];
+        float **fx_ptr = fx, **out_ptr = out;
+        if (pos > 0) {
+            for (int i = 0; i < nfx; i++) sub_fx[i] = fx[i] ? fx[i] + pos : NULL;
+            for (int i = 0; i < nout; i++) sub_out[i] = out[i] ? out[i] + pos : NULL;
+            fx_ptr = nfx > 0 ? sub_fx : fx;
+            out_ptr = sub_out;
+        }
+        span = trace_begin();
+        if (process_block(synth, end - pos, nfx, fx_ptr, nout, out_ptr) != FLUID_OK) {
+            result = FLUID_FAILED;
+        }
+        trace_end(span, "render", end - pos);
+        pos = end;
+    }
+
+    if (consumed > 0) {
+        synth->pending_count -= consumed;
+        memmove(synth->pending, synth->pending + consumed,
+                (size_t)synth->pending_count * sizeof(synth->pending[0]));
+    }
+    return result;
+}
+
+/**
+ * Add rendered playback audio to a live period and ask for more
+ *
+ * Runs on the live audio thread. What the ring cannot cover is left
+ * silent and the playback clock holds back by as much.
+ */
+static void mix_playback(synth_t *pb, int len, int nout, float *out[]) {
+    /* One wakeup per block of free space, not one per period */
+    if (playback_ring_mix(&pb->ring, len, nout, out) &&
+        !__atomic_exchange_n(&pb->wake_pending, true, __ATOMIC_ACQ_REL)) {
+        sem_post(&pb->wake);
+    }
+}
+
+/**
+ * Render playback blocks until the ring is full
+ */
+static void fill_playback(synth_t *pb) {
+    int block = pb->ring.block;
+    float *out[2];
+    while (pb->running && playback_ring_claim(&pb->ring, out)) {
+        uint64_t span = trace_begin();
+        render_scheduled(pb, block, 2, out, 2, out, 0, NULL);
+        trace_end(span, "playback-block", block);
+        meter_advance(pb->meter, block);
+        __atomic_store_n(&pb->frame_clock, pb->frame_clock + (uint64_t)block, __ATOMIC_RELEASE);
+        pb->blocks++;
+        playback_ring_commit(&pb->ring);
+    }
+}
+
+/**
+ * Playback engine thread: sleeps until the live output drained a block
+ */
+static void *playback_thread(void *arg) {
+    synth_t *pb = (synth_t *)arg;
+    threads_register("msd-playback", true);
+
+    while (pb->running) {
+        if (sem_wait(&pb->wake) < 0) {
+            continue;   /* EINTR */
+        }
+        __atomic_store_n(&pb->wake_pending, false, __ATOMIC_RELEASE);
+        RT_SENTINEL_ENTER();
+        fill_playback(pb);
+        RT_SENTINEL_LEAVE();
+    }
+
+    threads_unregister();
+    return NULL;
+}
+
+/**
+ * Stop the playback thread; the engine itself goes with synth_cleanup()
+ */
+static void stop_playback_thread(synth_t *pb) {
+    if (!pb->thread_started) {
+        return;
+    }
+    pb->running = 0;
+    sem_post(&pb->wake);
+    pthread_join(pb->thread, NULL);
+    pb->thread_started = false;
+    sem_destroy(&pb->wake);
+}
+
+/**
+ * Create the level meters and, for channel levels, the buffers the
+ * channels render into
+ */
+static int create_meter(synth_t *synth) {
+    synth->meter = meter_create(synth->sample_rate, synth->meter_channels);
+    if (!synth->meter) {
+        return -1;
+    }
+    if (!synth->meter_channels) {
+        return 0;
+    }
+
+    int perc_frames = synth->config->buffer_size;
+    size_t floats = METER_CHANNELS * 2 * (size_t)SYNTH_METER_FRAMES + 2 * (size_t)perc_frames;
+    synth->meter_buf = calloc(floats, sizeof(float));
+    if (!synth->meter_buf) {
+        return -1;
+    }
+    synth->buffer_bytes += floats * sizeof(float);
+    memstat_add(MEMSTAT_BUFFERS, floats * sizeof(float));
+
+    float *p = synth->meter_buf;
+    for (int i = 0; i < METER_CHANNELS * 2; i++, p += SYNTH_METER_FRAMES) {
+        synth->meter_out[i] = p;
+    }
+    for (int i = 0; i < 2; i++, p += perc_frames) {
+        synth->meter_perc[i] = p;
+    }
+    synth->meter_perc_frames = perc_frames;
+    return 0;
+}
+
+/**
+ * Create an engine rendering beside the live one
+ *
+ * It has its own FluidSynth instance and soundfonts, so rendering it
+ * never waits on the live engine's lock. It renders through the offline
+ * driver, driven by its owner.
+ *
+ * @param name Engine name for log messages
+ * @param polyphony Voices, 0 for the configured polyphony
+ * @param dynamic_samples Load sample data only for presets in use
+ * @param channel_outputs Per-channel output pairs for the level meters
+ */
+static synth_t *create_side_engine(synth_t *live, const char *name, int polyphony,
+                                   bool dynamic_samples, bool channel_outputs) {
+    synth_t *engine = calloc(1, sizeof(synth_t));
+    if (!engine) {
+        syslog(LOG_ERR, "Failed to allocate %s engine", name);
+        return NULL;
+    }
+    engine->config = live->config;
+    engine->soundfont_id = FLUID_FAILED;
+    engine->wakeup_fd = -1;
+    engine->driver = AUDIO_DRIVER_OFFLINE;
+    engine->sample_rate = live->sample_rate;
+    for (unsigned i = 0; i < SYNTH_SCHEDULE_QUEUE_SIZE; i++) {
+        engine->queue[i].seq = i;
+    }
+
+    engine->settings = new_fluid_settings();
+    if (!engine->settings || setup_fluidsynth_settings(engine, channel_outputs) < 0) {
+        syslog(LOG_ERR, "Failed to configure %s engine", name);
+        goto error;
+    }
+    if (polyphony > 0) {
+        fluid_settings_setint(engine->settings, "synth.polyphony", polyphony);
+    }
+    if (dynamic_samples && !engine->dynamic_samples &&
+        fluid_settings_setint(engine->settings, "synth.dynamic-sample-loading", 1) != FLUID_OK) {
+        syslog(LOG_DEBUG, "%s engine: dynamic sample loading unavailable", name);
+    }
+    engine->synth = new_fluid_synth(engine->settings);
+    if (!engine->synth) {
+        syslog(LOG_ERR, "Failed to create %s engine", name);
+        goto error;
+    }
+    account_voices(engine, fluid_synth_get_polyphony(engine->synth));
+    engine->queue_bytes = sizeof(engine->queue) + sizeof(engine->pending);
+    memstat_add(MEMSTAT_QUEUES, engine->queue_bytes);
+    setup_effects(engine);
+    engine->buffer_bytes = memstat_effect_bytes(engine->sample_rate);
+    memstat_add(MEMSTAT_BUFFERS, engine->buffer_bytes);
+
+    if (load_soundfonts(engine) < 0) {
+        syslog(LOG_ERR, "Failed to load soundfonts for %s engine", name);
+        goto error;
+    }
+    engine->initialized = true;
+    engine->active = true;
+    return engine;
+
+error:
+    synth_cleanup(engine);
+    return NULL;
+}
+
+/**
+ * Create the render-ahead engine for playback inputs
+ */
+static synth_t *create_playback_engine(synth_t *live) {
+    const midisynthd_config_t *config = live->config;
+
+    synth_t *pb = create_side_engine(live, "playback", 0, false, live->meter_channels);
+    if (!pb) {
+        return NULL;
+    }
+    pb->live = live;
+    if (playback_ring_init(&pb->ring, config->playback_block, SYNTH_PLAYBACK_BLOCKS) < 0) {
+        syslog(LOG_ERR, "Failed to allocate playback ring");
+        goto error;
+    }
+    size_t ring_bytes = 2 * (size_t)pb->ring.frames * sizeof(float);
+    pb->buffer_bytes += ring_bytes;
+    memstat_add(MEMSTAT_BUFFERS, ring_bytes);
+
+    /* Channel levels of playback inputs are measured on this engine */
+    if (live->meter_channels && pb->meter_channels && create_meter(pb) < 0) {
+        syslog(LOG_ERR, "Failed to allocate playback level meters");
+        goto error;
+    }
+
+    /* Prefill so the first live periods already have playback audio */
+    pb->running = 1;
+    fill_playback(pb);
+    if (sem_init(&pb->wake, 0, 0) < 0 ||
+        pthread_create(&pb->thread, NULL, playback_thread, pb) != 0) {
+        syslog(LOG_ERR, "Failed to start playback engine thread");
+        goto error;
+    }
+    pb->thread_started = true;
+
+    if (config->realtime_priority) {
+        struct sched_param param;
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = SYNTH_PLAYBACK_RT_PRIORITY;
+        if (pthread_setschedparam(pb->thread, SCHED_FIFO, &param) != 0) {
+            syslog(LOG_DEBUG, "Playback engine: real-time priority unavailable");
+        }
+    }
+
+    syslog(LOG_INFO, "Playback engine started: %d-frame blocks, %.1f ms ahead",
+           pb->ring.block, 1000.0 * (double)pb->ring.frames / pb->sample_rate);
+    return pb;
+
+error:
+    synth_cleanup(pb);
+    return NULL;
+}
+
+/* Channel 10 controllers a pre-rendered hit depends on */
+static const int perc_controllers[] = {
+    0, 1, 2, 4, 5, 7, 8, 10, 11, 32, 71, 72, 73, 74, 75, 76, 77, 78, 79, 91, 92, 93, 94, 95
+};
+
+/**
+ * Check whether a controller change makes cached hits stale
+ *
+ * Pedals only act on note-offs, which cached hits ignore, and the mode
+ * messages other than Reset All Controllers leave the sound alone.
+ */
+static bool perc_controller_changes_sound(int control) {
+    if (control >= 64 && control <= 69) return false;
+    if (control >= 120) return control == 121;
+    return true;
+}
+
+/**
+ * Render one percussion hit for the cache (cache worker thread)
+ *
+ * The side engine takes channel 10's kit and controllers from the live
+ * engine, plays the note from silence and is rendered until the hit and
+ * its effect tails have died away.
+ */
+static int render_perc_hit(void *data, int note, int velocity, float *left, float *right,
+                           int max_frames, int *exclusive) {
+    synth_t *synth = (synth_t *)data;
+    fluid_synth_t *pe = synth->perc_engine->synth;
+    const int ch = SYNTH_PERC_CHANNEL;
+
+    int sfont_id, bank, program;
+    if (fluid_synth_get_program(synth->synth, ch, &sfont_id, &bank, &program) != FLUID_OK ||
+        fluid_synth_program_select(pe, ch, sfont_id, bank, program) != FLUID_OK) {
+        return -1;
+    }
+    for (size_t i = 0; i < sizeof(perc_controllers) / sizeof(perc_controllers[0]); i++) {
+        int value;
+        if (fluid_synth_get_cc(synth->synth, ch, perc_controllers[i], &value) == FLUID_OK) {
+            fluid_synth_cc(pe, ch, perc_controllers[i], value);
+        }
+    }
+    int bend;
+    if (fluid_synth_get_pitch_bend(synth->synth, ch, &bend) == FLUID_OK) {
+        fluid_synth_pitch_bend(pe, ch, bend);
+    }
+    fluid_synth_set_gain(pe, fluid_synth_get_gain(synth->synth));
+
+    if (fluid_synth_noteon(pe, ch, note, velocity) != FLUID_OK) {
+        return -1;
+    }
+
+    /* Looped samples sound until their note-off, so they stay live */
+    fluid_voice_t *voices[SYNTH_PERC_POLYPHONY];
+    memset(voices, 0, sizeof(voices));
+    fluid_synth_get_voicelist(pe, voices, SYNTH_PERC_POLYPHONY, -1);
+    bool looped = false;
+    *exclusive = 0;
+    for (int i = 0; i < SYNTH_PERC_POLYPHONY && voices[i]; i++) {
+        int mode = (int)fluid_voice_gen_get(voices[i], GEN_SAMPLEMODE);
+        int exclusive_class = (int)fluid_voice_gen_get(voices[i], GEN_EXCLUSIVECLASS);
+        looped = looped || mode == 1 || mode == 3;
+        if (exclusive_class > *exclusive) *exclusive = exclusive_class;
+    }
+
+    int frames = 0;
+    while (!looped && frames < max_frames) {
+        int n = max_frames - frames < SYNTH_PERC_STEP ? max_frames - frames : SYNTH_PERC_STEP;
+        fluid_synth_write_float(pe, n, left, frames, 1, right, frames, 1);
+        float peak = 0.0f;
+        for (int i = frames; i < frames + n; i++) {
+            if (fabsf(left[i]) > peak) peak = fabsf(left[i]);
+            if (fabsf(right[i]) > peak) peak = fabsf(right[i]);
+        }
+        frames += n;
+        if (peak < SYNTH_PERC_SILENCE && fluid_synth_get_active_voice_count(pe) == 0) {
+            break;
+        }
+    }
+
+    /* Cut off at max_frames: fade rather than click */
+    if (!looped && frames == max_frames) {
+        int fade = frames < PERC_CACHE_FADE ? frames : PERC_CACHE_FADE;
+        for (int i = 0; i < fade; i++) {
+            float gain = (float)(fade - i) / (float)fade;
+            left[frames - fade + i] *= gain;
+            right[frames - fade + i] *= gain;
+        }
+    }
+
+    /* Let the effect tails run out so the next hit starts from silence */
+    fluid_synth_all_sounds_off(pe, ch);
+    float tail[2][SYNTH_PERC_STEP];
+    for (int done = 0; done < synth->sample_rate; done += SYNTH_PERC_STEP) {
+        fluid_synth_write_float(pe, SYNTH_PERC_STEP, tail[0], 0, 1, tail[1], 0, 1);
+        float peak = 0.0f;
+        for (int i = 0; i < SYNTH_PERC_STEP; i++) {
+            if (fabsf(tail[0][i]) > peak) peak = fabsf(tail[0][i]);
+            if (fabsf(tail[1][i]) > peak) peak = fabsf(tail[1][i]);
+        }
+        if (peak < SYNTH_PERC_SILENCE) break;
+    }
+
+    return looped ? -1 : frames;
+}
+
+/**
+ * Create the percussion cache and the engine rendering its hits
+ */
+static int create_percussion_cache(synth_t *synth) {
+    synth->perc_engine = create_side_engine(synth, "percussion", SYNTH_PERC_POLYPHONY, true, false);
+    if (!synth->perc_engine) {
+        return -1;
+    }
+    size_t budget = (size_t)synth->config->percussion_cache * 1024 * 1024;
+    synth->perc = perc_cache_create(budget, synth->sample_rate, render_perc_hit, synth);
+    if (!synth->perc) {
+        synth_cleanup(synth->perc_engine);
+        synth->perc_engine = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Mix cached percussion hits, counting them toward channel 10's level
+ */
+static void mix_percussion(synth_t *synth, int len, int nout, float *out[]) {
+    if (len > synth->meter_perc_frames || nout < 2) {
+        perc_cache_mix(synth->perc, out, nout, len);
+        return;
+    }
+    memset(synth->meter_perc[0], 0, (size_t)len * sizeof(float));
+    memset(synth->meter_perc[1], 0, (size_t)len * sizeof(float));
+    perc_cache_mix(synth->perc, synth->meter_perc, 2, len);
+    meter_add_channel(synth->meter, SYNTH_PERC_CHANNEL, synth->meter_perc[0], synth->meter_perc[1], len);
+    if (out[0]) add_samples(out[0], synth->meter_perc[0], len);
+    if (out[1]) add_samples(out[1], synth->meter_perc[1], len);
+}
+
+/**
+ * Audio driver callback: render one period and time it
+ */
+static int synth_audio_callback(void *data, int len, int nfx, float *fx[], int nout, float *out[]) {
+    synth_t *synth = (synth_t *)data;
+    threads_register("msd-audio", true);
+    RT_SENTINEL_ENTER();
+    uint64_t period_span = trace_begin();
+
+    /* A start time of 0 stops the frame clock extrapolating from wall time */
+    bool freewheel = __atomic_load_n(&synth->freewheel, __ATOMIC_RELAXED);
+    uint64_t start_ns = freewheel ? 0 : monotonic_ns();
+    __atomic_store_n(&synth->period_start_frame, synth->frame_clock, __ATOMIC_RELAXED);
+    __atomic_store_n(&synth->period_start_ns, start_ns, __ATOMIC_RELAXED);
+    /* Offline rendering and freewheel, JACK's or the null driver's, have
+     * no deadline to protect */
+    bool realtime = !freewheel && synth->driver != AUDIO_DRIVER_OFFLINE &&
+                    synth->driver != AUDIO_DRIVER_FREEWHEEL;
+    uint64_t budget_ns = (uint64_t)len * 1000000000ULL / (uint64_t)synth->sample_rate;
+    if (realtime) {
+        shed_voices(synth, len);
+    } else if (synth->shed_muted) {
+        restore_shed(synth, fluid_synth_get_active_voice_count(synth->synth));
+    }
+    bool conceal = realtime && synth->conceal;
+    uint64_t deadline_ns = conceal ? start_ns + budget_ns * SYNTH_CONCEAL_DEADLINE / 100 : 0;
+    int rendered = len;
+    int result = render_scheduled(synth, len, nfx, fx, nout, out, deadline_ns, &rendered);
+    uint64_t mix_span = trace_begin();
+    if (conceal) {
+        /* Same test as a late period in account_period() */
+        bool gap = synth->last_callback_ns && start_ns - synth->last_callback_ns > budget_ns + budget_ns / 2;
+        if (conceal_resume(synth->conceal, out, nout, rendered, gap) && gap) {
+            synth->resyncs++;
+        }
+        conceal_record(synth->conceal, out, nout, rendered);
+        if (rendered < len) {
+            conceal_fill(synth->conceal, out, nout, rendered, len);
+            synth->concealed_periods++;
+            synth->concealed_frames += (uint64_t)(len - rendered);
+        }
+    }
+    if (synth->perc) {
+        mix_percussion(synth, len, nout, out);
+    }
+    if (synth->playback) {
+        mix_playback(synth->playback, len, nout, out);
+    }
+    trace_end(mix_span, "mix", rendered);
+    if (synth->meter && nout >= 2) {
+        meter_add_master(synth->meter, out[0], out[1], len);
+        meter_advance(synth->meter, len);
+    }
+    __atomic_store_n(&synth->frame_clock, synth->frame_clock + (uint64_t)len, __ATOMIC_RELEASE);
+    account_period(synth, len, start_ns, freewheel ? 0 : monotonic_ns());
+    trace_end(period_span, "period", len);
+    RT_SENTINEL_LEAVE();
+
+    return result;
+}
+
+/**
+ * Claim a schedule queue slot and publish a message in it
+ */
+static int queue_push(synth_t *synth, uint64_t frame, const uint8_t *msg, size_t len) {
+    /* Claim a slot: its seq equals the head position when it is free */
+    synth_queue_slot_t *slot;
+    unsigned head = __atomic_load_n(&synth->queue_head, __ATOMIC_RELAXED);
+    for (;;) {
+        slot = &synth->queue[head % SYNTH_SCHEDULE_QUEUE_SIZE];
+        int diff = (int)(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - head);
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&synth->queue_head, &head, head + 1, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return -1;  /* Full */
+        } else {
+            head = __atomic_load_n(&synth->queue_head, __ATOMIC_RELAXED);
+        }
+    }
+    
+    slot->ev.frame = frame;
+    slot->ev.len = (uint8_t)len;
+    memcpy(slot->ev.msg, msg, len);
+    __atomic_store_n(&slot->seq, head + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/**
+ * Empty the schedule queue while no audio thread consumes it
+ *
+ * @param apply Dispatch the messages in arrival order, or drop them
+ */
+static int flush_schedule_queue(synth_t *synth, bool apply) {
+    int count = 0;
+    unsigned tail = synth->queue_tail;
+    for (;;) {
+        synth_queue_slot_t *slot = &synth->queue[tail % SYNTH_SCHEDULE_QUEUE_SIZE];
+        if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != tail + 1) {
+            break;
+        }
+        if (apply && dispatch_midi(synth, slot->ev.msg, slot->ev.len) < 0) {
+            __atomic_add_fetch(&synth->dispatch_failures, 1, __ATOMIC_RELAXED);
+        }
+        __atomic_store_n(&slot->seq, tail + SYNTH_SCHEDULE_QUEUE_SIZE, __ATOMIC_RELEASE);
+        tail++;
+        count++;
+    }
+    synth->queue_tail = tail;
+    return count;
+}
+
+/**
+ * Load soundfonts and start rendering
+ */
+static int start_engine(synth_t *synth) {
+    const midisynthd_config_t *config = synth->config;
+    
+    /* Load soundfonts */
+    if (load_soundfonts(synth) < 0) {
+        syslog(LOG_ERR, "Failed to load any soundfonts");
+        return -1;
+    }
+    
+    /* Input that arrived while loading plays first, before rendering starts */
+    if (synth->lazy) {
+        int replayed = flush_schedule_queue(synth, true);
+        __atomic_store_n(&synth->active, true, __ATOMIC_RELEASE);
+        replayed += flush_schedule_queue(synth, true);
+        if (replayed > 0) {
+            syslog(LOG_DEBUG, "Replayed %d events received during startup", replayed);
+        }
+    }
+    
+    /* Create audio driver; rendering goes through our callback so every
+     * period can be timed against its deadline */
+    audio_driver_t driver = resolve_audio_driver(synth);
+    synth->driver = driver;
+    if (driver == AUDIO_DRIVER_OFFLINE) {
+        syslog(LOG_DEBUG, "Offline rendering, audio is pulled by the host");
+    } else if (audio_driver_is_internal(driver)) {
+        synth->null_audio = audio_null_start(config, driver == AUDIO_DRIVER_FREEWHEEL,
+                                             synth_audio_callback, synth);
+        if (!synth->null_audio) {
+            syslog(LOG_ERR, "Failed to start %s audio backend", fluidsynth_driver_names[driver]);
+            return -1;
+        }
+    } else {
+        synth->audio_driver = new_fluid_audio_driver2(synth->settings, synth_audio_callback, synth);
+        if (!synth->audio_driver) {
+            syslog(LOG_ERR, "Failed to create FluidSynth audio driver");
+            return -1;
+        }
+    }
+    
+    /* Log the actual driver being used */
+    char *actual_driver = NULL;
+    if (audio_driver_is_internal(driver)) {
+        syslog(LOG_INFO, "Using audio driver: %s", fluidsynth_driver_names[driver]);
+    } else if (fluid_settings_dupstr(synth->settings, "audio.driver", &actual_driver) == FLUID_OK) {
+        syslog(LOG_INFO, "Using audio driver: %s", actual_driver);
+        if (actual_driver) {
+            free(actual_driver);
+        }
+    }
+    return 0;
+}
+
+/**
+ * Stop rendering and unload the soundfonts, keeping the FluidSynth instance
+ */
+static void stop_engine(synth_t *synth) {
+    __atomic_store_n(&synth->active, false, __ATOMIC_RELEASE);
+    
+    if (synth->audio_driver) {
+        delete_fluid_audio_driver(synth->audio_driver);
+        synth->audio_driver = NULL;
+    }
+    if (synth->null_audio) {
+        audio_null_stop(synth->null_audio);
+        synth->null_audio = NULL;
+    }
+    
+    /* Events still queued would play as stale notes on the next start */
+    flush_schedule_queue(synth, false);
+    synth->pending_count = 0;
+    
+    fluid_synth_all_sounds_off(synth->synth, -1);
+    while (fluid_synth_sfcount(synth->synth) > 0) {
+        fluid_sfont_t *sfont = fluid_synth_get_sfont(synth->synth, 0);
+        if (!sfont || fluid_synth_sfunload(synth->synth, fluid_sfont_get_id(sfont), 1) != FLUID_OK) {
+            break;
+        }
+    }
+    for (int i = 0; i < synth->sf_memory_count; i++) {
+        memstat_sub(MEMSTAT_SAMPLES, synth->sf_memory[i].sample_bytes);
+        memstat_sub(MEMSTAT_PRESETS, synth->sf_memory[i].metadata_bytes);
+    }
+    synth->sf_memory_count = 0;
+    synth->soundfont_id = FLUID_FAILED;
+}
+
+/**
+ * Initialize the synthesizer engine
+ */
+synth_t* synth_init(const midisynthd_config_t *config, audio_t *audio) {
+    if (!config) {
+        syslog(LOG_ERR, "Invalid configuration passed to synth_init");
+        return NULL;
+    }
+    
+    synth_t *synth = calloc(1, sizeof(synth_t));
+    if (!synth) {
+        syslog(LOG_ERR, "Failed to allocate memory for synthesizer");
+        return NULL;
+    }
+    
+    synth->config = config;
+    synth->audio = audio;
+    synth->gain = config->gain;
+    synth->master_volume = 1.0f;
+    synth->soundfont_id = FLUID_FAILED;
+    synth->initialized = false;
+    synth->wakeup_fd = -1;
+    synth->shed_threshold = config->shed_threshold;
+    for (unsigned i = 0; i < SYNTH_SCHEDULE_QUEUE_SIZE; i++) {
+        synth->queue[i].seq = i;
+    }
+    
+    if (config->xrun_concealment) {
+        synth->conceal = conceal_create();
+        if (!synth->conceal) {
+            syslog(LOG_ERR, "Failed to allocate xrun concealment");
+            goto error;
+        }
+    }
+    
+    /* Create FluidSynth settings */
+    synth->settings = new_fluid_settings();
+    if (!synth->settings) {
+        syslog(LOG_ERR, "Failed to create FluidSynth settings");
+        goto error;
+    }
+    
+    /* Configure FluidSynth settings */
+    if (setup_fluidsynth_settings(synth, true) < 0) {
+        syslog(LOG_ERR, "Failed to configure FluidSynth settings");
+        goto error;
+    }
+    
+    /* Create FluidSynth synthesizer */
+    synth->synth = new_fluid_synth(synth->settings);
+    if (!synth->synth) {
+        syslog(LOG_ERR, "Failed to create FluidSynth synthesizer");
+        goto error;
+    }
+    account_voices(synth, fluid_synth_get_polyphony(synth->synth));
+    synth->queue_bytes = sizeof(synth->queue) + sizeof(synth->pending);
+    memstat_add(MEMSTAT_QUEUES, synth->queue_bytes);
+    
+    /* Setup effects */
+    setup_effects(synth);
+    
+    double sample_rate = config->sample_rate;
+    fluid_settings_getnum(synth->settings, "synth.sample-rate", &sample_rate);
+    synth->sample_rate = sample_rate > 0 ? (int)sample_rate : CONFIG_DEFAULT_SAMPLE_RATE;
+    synth->buffer_bytes = memstat_effect_bytes(synth->sample_rate);
+    memstat_add(MEMSTAT_BUFFERS, synth->buffer_bytes);
+    
+    if (config->level_meters && create_meter(synth) < 0) {
+        syslog(LOG_ERR, "Failed to allocate level meters");
+        goto error;
+    }
+    
+    if (config->lazy_start) {
+        synth->wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (synth->wakeup_fd < 0) {
+            syslog(LOG_ERR, "Failed to create wakeup eventfd: %s", strerror(errno));
+            goto error;
+        }
+        synth->lazy = true;
+        synth->initialized = true;
+        syslog(LOG_INFO, "FluidSynth synthesizer created, soundfonts and audio load on first input");
+        return synth;
+    }
+    
+    /* Started before the audio driver so its ring is full by the first period */
+    if (config_has_playback_inputs(config)) {
+        audio_driver_t driver = resolve_audio_driver(synth);
+        if (driver == AUDIO_DRIVER_OFFLINE || driver == AUDIO_DRIVER_FREEWHEEL) {
+            syslog(LOG_WARNING, "No real-time output to render ahead of, playback inputs run live");
+        } else {
+            synth->playback = create_playback_engine(synth);
+            if (!synth->playback) {
+                goto error;
+            }
+        }
+    }
+    
+    if (config->percussion_cache > 0) {
+        audio_driver_t driver = resolve_audio_driver(synth);
+        if (driver == AUDIO_DRIVER_OFFLINE || driver == AUDIO_DRIVER_FREEWHEEL) {
+            syslog(LOG_DEBUG, "Percussion cache not used without a real-time output");
+        } else if (create_percussion_cache(synth) < 0) {
+            syslog(LOG_WARNING, "Percussion cache unavailable, channel 10 plays live");
+        }
+    }
+    
+    if (start_engine(synth) < 0) {
+        goto error;
+    }
+    
+    synth->active = true;
+    synth->initialized = true;
+    syslog(LOG_INFO, "FluidSynth synthesizer initialized successfully");
+    return synth;
+    
+error:
+    synth_cleanup(synth);
+    return NULL;
+}
+
+/**
+ * Clean up synthesizer resources
+ */
+void synth_cleanup(synth_t *synth) {
+    if (!synth) {
+        return;
+    }
+    
+    syslog(LOG_DEBUG, "Cleaning up FluidSynth synthesizer");
+    
+    if (synth->audio_driver) {
+        delete_fluid_audio_driver(synth->audio_driver);
+        synth->audio_driver = NULL;
+    }
+    
+    if (synth->null_audio) {
+        audio_null_stop(synth->null_audio);
+        synth->null_audio = NULL;
+    }
+    
+    /* Nothing mixes the playback engine once the audio driver is gone */
+    if (synth->playback) {
+        syslog(LOG_INFO, "Playback engine: %llu blocks rendered, %llu underruns",
+               (unsigned long long)synth->playback->blocks,
+               (unsigned long long)synth->playback->ring.underruns);
+        synth_cleanup(synth->playback);
+        synth->playback = NULL;
+    }
+    stop_playback_thread(synth);
+    if (synth->perc) {
+        perc_cache_log(synth->perc);
+        perc_cache_destroy(synth->perc);
+        synth->perc = NULL;
+    }
+    if (synth->perc_engine) {
+        synth_cleanup(synth->perc_engine);
+        synth->perc_engine = NULL;
+    }
+    if (synth->shed_periods > 0) {
+        syslog(LOG_INFO, "Voice shedding: %llu voices shed in %llu periods",
+               (unsigned long long)synth->shed_voices, (unsigned long long)synth->shed_periods);
+    }
+    if (synth->concealed_periods > 0 || synth->resyncs > 0) {
+        syslog(LOG_INFO, "Xrun concealment: %llu periods (%llu frames) concealed, %llu resyncs",
+               (unsigned long long)synth->concealed_periods, (unsigned long long)synth->concealed_frames,
+               (unsigned long long)synth->resyncs);
+    }
+    conceal_destroy(synth->conceal);
+    meter_destroy(synth->meter);
+    free(synth->meter_buf);
+    
+    if (synth->synth) {
+        delete_fluid_synth(synth->synth);
+        synth->synth = NULL;
+    }
+    
+    if (synth->settings) {
+        delete_fluid_settings(synth->settings);
+        synth->settings = NULL;
+    }
+    
+    for (int i = 0; i < synth->sf_memory_count; i++) {
+        memstat_sub(MEMSTAT_SAMPLES, synth->sf_memory[i].sample_bytes);
+        memstat_sub(MEMSTAT_PRESETS, synth->sf_memory[i].metadata_bytes);
+    }
+    synth->sf_memory_count = 0;
+    if (synth->sm24_user) {
+        pthread_mutex_lock(&sm24_lock);
+        if (--sm24_users == 0) sm24_hidden_count = 0;
+        pthread_mutex_unlock(&sm24_lock);
+        synth->sm24_user = false;
+    }
+    if (synth->wakeup_fd >= 0) {
+        close(synth->wakeup_fd);
+    }
+    playback_ring_free(&synth->ring);
+    memstat_sub(MEMSTAT_VOICES, synth->voice_bytes);
+    memstat_sub(MEMSTAT_BUFFERS, synth->buffer_bytes);
+    memstat_sub(MEMSTAT_QUEUES, synth->queue_bytes);
+    synth->voice_bytes = synth->buffer_bytes = synth->queue_bytes = 0;
+    
+    synth->initialized = false;
+    free(synth);
+}
+
+/**
+ * Hand a channel 10 note message to the audio thread
+ *
+ * With the percussion cache on, channel 10 notes are played by
+ * dispatch_percussion(); note-offs take the same path so they stay
+ * behind their note-ons.
+ *
+ * @return true when the message was queued
+ */
+static bool queue_percussion(synth_t *synth, uint8_t status, int key, int velocity) {
+    if (!synth->perc || (status & 0x0F) != SYNTH_PERC_CHANNEL) {
+        return false;
+    }
+    uint8_t msg[3] = { status, (uint8_t)key, (uint8_t)velocity };
+    return queue_push(synth, synth_get_frame_time(synth), msg, sizeof(msg)) == 0;
+}
+
+/*
+ * Channel messages. The *_event variants validate silently and leave the
+ * logging to the public wrappers, since they also run on the audio thread
+ * for timed events, where a failure is only counted.
+ */
+
+static int note_on_event(synth_t *synth, int channel, int key, int velocity) {
+    if (channel < 0 || channel >= 16 || key < 0 || key > 127 || velocity < 0 || velocity > 127) {
+        return -1;
+    }
+    track_note(synth, channel, key, velocity > 0);
+    if (queue_percussion(synth, MIDI_NOTE_ON | channel, key, velocity)) {
+        return 0;
+    }
+    return fluid_synth_noteon(synth->synth, channel, key, velocity) == FLUID_OK ? 0 : -1;
+}
+
+static int note_off_event(synth_t *synth, int channel, int key) {
+    if (channel < 0 || channel >= 16 || key < 0 || key > 127) {
+        return -1;
+    }
+    track_note(synth, channel, key, false);
+    if (queue_percussion(synth, MIDI_NOTE_OFF | channel, key, 0)) {
+        return 0;
+    }
+    return fluid_synth_noteoff(synth->synth, channel, key) == FLUID_OK ? 0 : -1;
+}
+
+static int program_change_event(synth_t *synth, int channel, int program) {
+    if (channel < 0 || channel >= 16 || program < 0 || program > 127) {
+        return -1;
+    }
+    uint64_t start_ns = synth->dynamic_samples ? monotonic_ns() : 0;
+    int result = fluid_synth_program_change(synth->synth, channel, program);
+    if (start_ns) {
+        __atomic_store_n(&synth->program_change_ns[channel], monotonic_ns() - start_ns, __ATOMIC_RELAXED);
+    }
+    if (result != FLUID_OK) {
+        return -1;
+    }
+    if (channel == SYNTH_PERC_CHANNEL) {
+        perc_cache_invalidate(synth->perc);
+    }
+    return 0;
+}
+
+static int control_change_event(synth_t *synth, int channel, int control, int value) {
+    if (channel < 0 || channel >= 16 || control < 0 || control > 127 || value < 0 || value > 127) {
+        return -1;
+    }
+    if (fluid_synth_cc(synth->synth, channel, control, value) != FLUID_OK) {
+        return -1;
+    }
+    if (control == 64) {
+        track_sustain(synth, channel, value >= 64);
+    } else if (control == 120 || control == 123) {
+        track_all_off(synth, channel, control == 120);
+    } else if (control == 121) {
+        track_sustain(synth, channel, false);
+    }
+    if (channel == SYNTH_PERC_CHANNEL && synth->perc) {
+        if (control == 120) {
+            perc_cache_silence(synth->perc);
+        } else if (perc_controller_changes_sound(control)) {
+            perc_cache_invalidate(synth->perc);
+        }
+    }
+    return 0;
+}
+
+static int pitch_bend_event(synth_t *synth, int channel, int value) {
+    if (channel < 0 || channel >= 16 || value < 0 || value > 16383) {
+        return -1;
+    }
+    if (fluid_synth_pitch_bend(synth->synth, channel, value) != FLUID_OK) {
+        return -1;
+    }
+    if (channel == SYNTH_PERC_CHANNEL) {
+        perc_cache_invalidate(synth->perc);
+    }
+    return 0;
+}
+
+static int channel_pressure_event(synth_t *synth, int channel, int pressure) {
+    if (channel < 0 || channel >= 16 || pressure < 0 || pressure > 127) {
+        return -1;
+    }
+    return fluid_synth_channel_pressure(synth->synth, channel, pressure) == FLUID_OK ? 0 : -1;
+}
+
+static int key_pressure_event(synth_t *synth, int channel, int key, int pressure) {
+    if (channel < 0 || channel >= 16 || key < 0 || key > 127 || pressure < 0 || pressure > 127) {
+        return -1;
+    }
+    return fluid_synth_key_pressure(synth->synth, channel, key, pressure) == FLUID_OK ? 0 : -1;
+}
+
+/**
+ * Send a Note On MIDI event to the synthesizer
+ */
+int synth_note_on(synth_t *synth, int channel, int key, int velocity) {
+    if (!synth || !synth->initialized || !synth->synth) {
+        return -1;
+    }
+    
+    if (channel < 0 || channel >= 16 || key < 0 || key > 127 || velocity < 0 || velocity > 127) {
+        syslog(LOG_DEBUG, "Invalid MIDI parameters: channel=%d, key=%d, velocity=%d", channel, key, velocity);
+        return -1;
+    }
+    
+    if (note_on_event(synth, channel, key, velocity) < 0) {
+        syslog(LOG_DEBUG, "FluidSynth note on failed: channel=%d, key=%d, velocity=%d", channel, key, velocity);
+        return -1;
+    }
+    
+    return 0;
+}
+
+/**
+ * Send a Note Off MIDI event to the synthesizer
+ */
+int synth_note_off(synth_t *synth, int channel, int key, int velocity) {
+    if (!synth || !synth->initialized || !synth->synth) {
+        return -1;
+    }
+    
+    if (channel < 0 || channel >= 16 || key < 0 || key > 127) {
+        syslog(LOG_DEBUG, "Invalid MIDI parameters: channel=%d, key=%d", channel, key);
+        return -1;
+    }
+    
+    if (note_off_event(synth, channel, key) < 0) {
+        syslog(LOG_DEBUG, "FluidSynth note off failed: channel=%d, key=%d", channel, key);
+        return -1;
+    }
+    
+    return 0;
+}
+
+/**
+ * Send a Program Change MIDI event to the synthesizer
+ */
+int synth_program_change(synth_t *synth, int channel, int program) {
+    if (!synth || !synth->initialized || !synth->synth) {
+        return -1;
+    }
+    
+    if (channel < 0 || channel >= 16 || program < 0 || program > 127) {
+        syslog(LOG_DEBUG, "Invalid MIDI parameters: channel=%d, program=%d", channel, program);
+        return -1;
+    }
+    
+    if (program_change_event(synth, channel, program) < 0) {
+        syslog(LOG_DEBUG, "FluidSynth program change failed: channel=%d, program=%d", channel, program);
+        return -1;
+    }
+    
+    return 0;
+}
+
+/**
+ * Send a Control Change MIDI event to the synthesizer
+ */
+int synth_control_change(synth_t *synth, int channel, int control, int value) {
+    if (!synth || !synth->initialized || !synth->synth) {
+        return -1;
+    }
+    
+    if (channel < 0 || channel >= 16 || control < 0 || control > 127 || value < 0 || value > 127) {
+        syslog(LOG_DEBUG, "Invalid MIDI parameters: channel=%d, control=%d, value=%d", channel, control, value);
+        return -1;
+    }
+    
+    if (control_change_event(synth, channel, control, value) < 0) {
+        syslog(LOG_DEBUG, "FluidSynth control change failed: channel=%d, control=%d, value=%d", channel, control, value);
+        return -1;
+    }
+    
+    return 0;
+}
+
+/**
+ * Send a Pitch Bend MIDI event to the synthesizer
+ */
+int synth_pitch_bend(synth_t *synth, int channel, int value) {
     if (!synth || !synth->initialized || !synth->synth) {
         return -1;
     }
@@ -499,8 +2030,7 @@ int synth_pitch_bend(synth_t *synth, int channel, int value) {
         return -1;
     }
     
-    int result = fluid_synth_pitch_bend(synth->synth, channel, value);
-    if (result != FLUID_OK) {
+    if (pitch_bend_event(synth, channel, value) < 0) {
         syslog(LOG_DEBUG, "FluidSynth pitch bend failed: channel=%d, value=%d", channel, value);
         return -1;
     }
@@ -509,58 +2039,178 @@ int synth_pitch_bend(synth_t *synth, int channel, int value) {
 }
 
 /**
- * Send a Channel Pressure (Aftertouch) MIDI event to the synthesizer
+ * Send a Channel Pressure (Aftertouch) MIDI event to the synthesizer
+ */
+int synth_channel_pressure(synth_t *synth, int channel, int pressure) {
+    if (!synth || !synth->initialized || !synth->synth) {
+        return -1;
+    }
+    
+    if (channel < 0 || channel >= 16 || pressure < 0 || pressure > 127) {
+        syslog(LOG_DEBUG, "Invalid MIDI parameters: channel=%d, pressure=%d", channel, pressure);
+        return -1;
+    }
+    
+    if (channel_pressure_event(synth, channel, pressure) < 0) {
+        syslog(LOG_DEBUG, "FluidSynth channel pressure failed: channel=%d, pressure=%d", channel, pressure);
+        return -1;
+    }
+    
+    return 0;
+}
+
+/**
+ * Send a Key Pressure (Polyphonic Aftertouch) MIDI event to the synthesizer
+ */
+int synth_key_pressure(synth_t *synth, int channel, int key, int pressure) {
+    if (!synth || !synth->initialized || !synth->synth) {
+        return -1;
+    }
+    
+    if (channel < 0 || channel >= 16 || key < 0 || key > 127 || pressure < 0 || pressure > 127) {
+        syslog(LOG_DEBUG, "Invalid MIDI parameters: channel=%d, key=%d, pressure=%d", channel, key, pressure);
+        return -1;
+    }
+    
+    if (key_pressure_event(synth, channel, key, pressure) < 0) {
+        syslog(LOG_DEBUG, "FluidSynth key pressure failed: channel=%d, key=%d, pressure=%d", channel, key, pressure);
+        return -1;
+    }
+    
+    return 0;
+}
+
+/**
+ * Apply the runtime gain scaled by Master Volume; cached percussion hits
+ * were rendered at the old level
+ *
+ * Lock-free for the real-time threads that handle Master Volume: a change
+ * to either term while the product is applied makes it apply again, so
+ * the last one to finish sets the current level.
+ */
+static void apply_gain(synth_t *synth) {
+    unsigned seq;
+    do {
+        seq = __atomic_load_n(&synth->gain_seq, __ATOMIC_SEQ_CST);
+        float gain, volume;
+        __atomic_load(&synth->gain, &gain, __ATOMIC_RELAXED);
+        __atomic_load(&synth->master_volume, &volume, __ATOMIC_RELAXED);
+        fluid_synth_set_gain(synth->synth, gain * volume);
+    } while (__atomic_load_n(&synth->gain_seq, __ATOMIC_SEQ_CST) != seq);
+    perc_cache_invalidate(synth->perc);
+}
+
+/**
+ * Change the runtime gain or Master Volume and apply the product
+ *
+ * @param term &synth->gain or &synth->master_volume
  */
-int synth_channel_pressure(synth_t *synth, int channel, int pressure) {
-    if (!synth || !synth->initialized || !synth->synth) {
+static void set_gain_term(synth_t *synth, float *term, float value) {
+    __atomic_store(term, &value, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&synth->gain_seq, 1, __ATOMIC_SEQ_CST);
+    apply_gain(synth);
+}
+
+/**
+ * Handle a System Exclusive message
+ */
+int synth_sysex(synth_t *synth, const uint8_t *data, size_t length) {
+    if (!synth || !synth->initialized || !synth->synth || !data) {
         return -1;
     }
     
-    if (channel < 0 || channel >= 16 || pressure < 0 || pressure > 127) {
-        syslog(LOG_DEBUG, "Invalid MIDI parameters: channel=%d, pressure=%d", channel, pressure);
-        return -1;
+    if (synth_defer_midi(synth, data, length)) {
+        return 0;
     }
     
-    int result = fluid_synth_channel_pressure(synth->synth, channel, pressure);
-    if (result != FLUID_OK) {
-        syslog(LOG_DEBUG, "FluidSynth channel pressure failed: channel=%d, pressure=%d", channel, pressure);
+    if (length < 3 || data[0] != MIDI_SYSTEM_EXCLUSIVE || data[length - 1] != 0xF7) {
         return -1;
     }
     
-    return 0;
+    const uint8_t *m = data + 1;    /* Without F0/F7 */
+    size_t n = length - 2;
+    
+    /* Resets and GS/XG parameters may change the drum kit's sound */
+    perc_cache_invalidate(synth->perc);
+    
+    /* Universal Non-Real Time: GM System On (09 01), Off (09 02), GM2 On (09 03) */
+    bool reset = n == 4 && m[0] == 0x7E && m[2] == 0x09 && m[3] >= 0x01 && m[3] <= 0x03;
+    
+    /* Roland GS Reset */
+    static const uint8_t gs_reset[] = { 0x42, 0x12, 0x40, 0x00, 0x7F, 0x00, 0x41 };
+    reset = reset || (n == 9 && m[0] == 0x41 && memcmp(m + 2, gs_reset, sizeof(gs_reset)) == 0);
+    
+    /* Yamaha XG System On */
+    static const uint8_t xg_on[] = { 0x4C, 0x00, 0x00, 0x7E, 0x00 };
+    reset = reset || (n == 7 && m[0] == 0x43 && (m[1] & 0xF0) == 0x10 &&
+                      memcmp(m + 2, xg_on, sizeof(xg_on)) == 0);
+    
+    if (reset) {
+        set_gain_term(synth, &synth->master_volume, 1.0f);
+        for (int ch = 0; ch < 16; ch++) {
+            track_sustain(synth, ch, false);
+            track_all_off(synth, ch, true);
+        }
+        return fluid_synth_system_reset(synth->synth) == FLUID_OK ? 0 : -1;
+    }
+    
+    /* Universal Real Time: Master Volume (04 01 lsb msb) */
+    if (n == 6 && m[0] == 0x7F && m[2] == 0x04 && m[3] == 0x01) {
+        int volume = m[4] | (m[5] << 7);
+        set_gain_term(synth, &synth->master_volume, (float)volume / 16383.0f);
+        return 0;
+    }
+    
+    int handled = 0;
+    if (fluid_synth_sysex(synth->synth, (const char *)m, (int)n, NULL, NULL, &handled, 0) != FLUID_OK) {
+        return -1;
+    }
+    return handled ? 0 : -1;
 }
 
 /**
- * Send a Key Pressure (Polyphonic Aftertouch) MIDI event to the synthesizer
+ * Parse and process a raw MIDI message
  */
-int synth_key_pressure(synth_t *synth, int channel, int key, int pressure) {
-    if (!synth || !synth->initialized || !synth->synth) {
+int synth_process_midi_data(synth_t *synth, const uint8_t *data, size_t length) {
+    if (!synth || !data || length == 0) {
         return -1;
     }
     
-    if (channel < 0 || channel >= 16 || key < 0 || key > 127 || pressure < 0 || pressure > 127) {
-        syslog(LOG_DEBUG, "Invalid MIDI parameters: channel=%d, key=%d, pressure=%d", channel, key, pressure);
-        return -1;
+    if (data[0] != MIDI_SYSTEM_EXCLUSIVE && synth_defer_midi(synth, data, length)) {
+        return 0;
     }
     
-    int result = fluid_synth_key_pressure(synth->synth, channel, key, pressure);
-    if (result != FLUID_OK) {
-        syslog(LOG_DEBUG, "FluidSynth key pressure failed: channel=%d, key=%d, pressure=%d", channel, key, pressure);
+    /* Applied now, a playback message would land on the next block
+     * boundary; scheduling keeps its timing at a constant delay */
+    if (synth->live && data[0] != MIDI_SYSTEM_EXCLUSIVE &&
+        synth_schedule_midi(synth, synth_get_frame_time(synth), data, length) == 0) {
+        return 0;
+    }
+    if (dispatch_midi(synth, data, length) < 0) {
+        if (data[0] != MIDI_SYSTEM_EXCLUSIVE) {
+            syslog(LOG_DEBUG, "MIDI message not applied: status=0x%02X, length=%zu", data[0], length);
+        }
         return -1;
     }
-    
     return 0;
 }
 
 /**
- * Parse and process a raw MIDI message
+ * Apply a raw MIDI message to the running engine
+ *
+ * Never logs: timed events are dispatched on the audio thread, which
+ * counts their failures in dispatch_failures instead.
  */
-int synth_process_midi_data(synth_t *synth, const uint8_t *data, size_t length) {
-    if (!synth || !data || length == 0) {
+static int dispatch_midi(synth_t *synth, const uint8_t *data, size_t length) {
+    uint8_t status = data[0];
+
+    if (!synth->initialized || !synth->synth) {
         return -1;
     }
 
-    uint8_t status = data[0];
+    if (status == MIDI_SYSTEM_EXCLUSIVE) {
+        return synth_sysex(synth, data, length);
+    }
 
     if (status < 0x80) {
         /* Running status or invalid message not supported */
@@ -574,29 +2224,29 @@ int synth_process_midi_data(synth_t *synth, const uint8_t *data, size_t length)
         case MIDI_NOTE_ON:
             if (length < 3) return -1;
             if (data[2] == 0) {
-                return synth_note_off(synth, channel, data[1], 0);
+                return note_off_event(synth, channel, data[1]);
             }
-            return synth_note_on(synth, channel, data[1], data[2]);
+            return note_on_event(synth, channel, data[1], data[2]);
         case MIDI_NOTE_OFF:
             if (length < 3) return -1;
-            return synth_note_off(synth, channel, data[1], data[2]);
+            return note_off_event(synth, channel, data[1]);
         case MIDI_KEY_PRESSURE:
             if (length < 3) return -1;
-            return synth_key_pressure(synth, channel, data[1], data[2]);
+            return key_pressure_event(synth, channel, data[1], data[2]);
         case MIDI_CONTROL_CHANGE:
             if (length < 3) return -1;
-            return synth_control_change(synth, channel, data[1], data[2]);
+            return control_change_event(synth, channel, data[1], data[2]);
         case MIDI_PROGRAM_CHANGE:
             if (length < 2) return -1;
-            return synth_program_change(synth, channel, data[1]);
+            return program_change_event(synth, channel, data[1]);
         case MIDI_CHANNEL_PRESSURE:
             if (length < 2) return -1;
-            return synth_channel_pressure(synth, channel, data[1]);
+            return channel_pressure_event(synth, channel, data[1]);
         case MIDI_PITCH_BEND:
             if (length < 3) return -1;
             {
                 int bend = data[1] | (data[2] << 7);
-                return synth_pitch_bend(synth, channel, bend);
+                return pitch_bend_event(synth, channel, bend);
             }
         default:
             break;
@@ -623,6 +2273,10 @@ int synth_all_sound_off(synth_t *synth, int channel) {
         syslog(LOG_DEBUG, "FluidSynth all sound off failed: channel=%d", channel);
         return -1;
     }
+    track_all_off(synth, channel, true);
+    if (channel == SYNTH_PERC_CHANNEL) {
+        perc_cache_silence(synth->perc);
+    }
     
     return 0;
 }
@@ -641,8 +2295,13 @@ int synth_all_notes_off(synth_t *synth) {
         if (result != FLUID_OK) {
             syslog(LOG_DEBUG, "FluidSynth all notes off failed: channel=%d", channel);
         }
+        track_all_off(synth, channel, false);
     }
     
+    perc_cache_silence(synth->perc);
+    if (synth->playback) {
+        synth_all_notes_off(synth->playback);
+    }
     return 0;
 }
 
@@ -658,6 +2317,8 @@ int synth_reset_controllers(synth_t *synth) {
     for (int i = 0; i < 16; i++) {
         fluid_synth_all_sounds_off(synth->synth, i);
         fluid_synth_all_notes_off(synth->synth, i);
+        track_sustain(synth, i, false);
+        track_all_off(synth, i, true);
         
         /* Reset controllers to defaults */
         fluid_synth_cc(synth->synth, i, 7, 100);    /* Volume */
@@ -675,6 +2336,9 @@ int synth_reset_controllers(synth_t *synth) {
         }
     }
     
+    perc_cache_silence(synth->perc);
+    perc_cache_invalidate(synth->perc);
+    
     syslog(LOG_INFO, "Synthesizer reset completed");
     return 0;
 }
@@ -692,7 +2356,7 @@ int synth_set_gain(synth_t *synth, float gain) {
         return -1;
     }
     
-    fluid_synth_set_gain(synth->synth, gain);
+    set_gain_term(synth, &synth->gain, gain);
     return 0;
 }
 
@@ -704,7 +2368,9 @@ float synth_get_gain(synth_t *synth) {
         return -1.0f;
     }
     
-    return fluid_synth_get_gain(synth->synth);
+    float gain;
+    __atomic_load(&synth->gain, &gain, __ATOMIC_RELAXED);
+    return gain;
 }
 
 /**
@@ -734,6 +2400,353 @@ int synth_get_status(synth_t *synth, synth_status_t *status) {
         status->buffer_size = buffer_size;
     }
     
+    /* Playback inputs render on their own engine; add their channels */
+    if (synth->meter && meter_get(synth->meter, &status->levels) == 0 && synth->playback) {
+        meter_snapshot_t playback;
+        if (meter_get(synth->playback->meter, &playback) == 0) {
+            meter_merge(&status->levels, &playback);
+        }
+    }
+    
+    return 0;
+}
+
+/**
+ * Get render timing statistics collected by the audio callback
+ */
+int synth_get_render_stats(synth_t *synth, synth_render_stats_t *stats) {
+    if (!synth || !synth->initialized || !stats) {
+        return -1;
+    }
+    
+    memset(stats, 0, sizeof(synth_render_stats_t));
+    if (synth->stats_reset) {
+        return 0; /* Reset pending, audio thread has not run since */
+    }
+    
+    stats->periods = synth->periods;
+    stats->late_periods = synth->late_periods;
+    stats->overruns = synth->overruns;
+    stats->peak_load = synth->peak_load;
+    stats->freewheel_periods = synth->freewheel_periods;
+    stats->shed_periods = synth->shed_periods;
+    stats->shed_voices = synth->shed_voices;
+    stats->voice_cost_ns = synth->cost.voice_ns;
+    stats->concealed_periods = synth->concealed_periods;
+    stats->concealed_frames = synth->concealed_frames;
+    stats->resyncs = synth->resyncs;
+    stats->failed_events = __atomic_load_n(&synth->dispatch_failures, __ATOMIC_RELAXED);
+    if (synth->playback) {
+        stats->playback_blocks = synth->playback->blocks;
+        stats->playback_underruns = synth->playback->ring.underruns;
+        stats->failed_events += __atomic_load_n(&synth->playback->dispatch_failures, __ATOMIC_RELAXED);
+    }
+    if (stats->periods > 0) {
+        stats->avg_load = synth->load_sum / (double)stats->periods;
+    }
+    
+    return 0;
+}
+
+/**
+ * Request the audio thread to clear its render statistics
+ */
+void synth_reset_render_stats(synth_t *synth) {
+    if (synth) {
+        synth->stats_reset = 1;
+    }
+}
+
+/**
+ * Render audio on the caller's thread (offline driver only)
+ */
+int synth_render(synth_t *synth, int frames, float *left, float *right) {
+    if (!synth || !synth->initialized || !left || !right || frames <= 0) {
+        return -1;
+    }
+    
+    if (synth->driver != AUDIO_DRIVER_OFFLINE) {
+        syslog(LOG_DEBUG, "synth_render requires the offline audio driver");
+        return -1;
+    }
+    
+    /* fluid_synth_process mixes into the buffers */
+    memset(left, 0, (size_t)frames * sizeof(float));
+    memset(right, 0, (size_t)frames * sizeof(float));
+    
+    /* Reverb and chorus mix into the same buffers */
+    float *out[2] = { left, right };
+    return synth_audio_callback(synth, frames, 2, out, 2, out) == FLUID_OK ? 0 : -1;
+}
+
+/**
+ * Current position of the render clock
+ */
+uint64_t synth_get_frame_time(synth_t *synth) {
+    if (!synth || !synth->initialized) {
+        return 0;
+    }
+    
+    /* Playback audio is heard as the live engine mixes it */
+    if (synth->live) {
+        return playback_ring_clock(&synth->ring, synth_get_frame_time(synth->live));
+    }
+    
+    uint64_t start_ns = __atomic_load_n(&synth->period_start_ns, __ATOMIC_RELAXED);
+    if (synth->driver == AUDIO_DRIVER_OFFLINE || start_ns == 0 ||
+        __atomic_load_n(&synth->freewheel, __ATOMIC_RELAXED)) {
+        return __atomic_load_n(&synth->frame_clock, __ATOMIC_ACQUIRE);
+    }
+    
+    /* The device plays in real time, so extrapolate from the latest period */
+    uint64_t start_frame = __atomic_load_n(&synth->period_start_frame, __ATOMIC_RELAXED);
+    uint64_t elapsed_ns = monotonic_ns() - start_ns;
+    return start_frame + elapsed_ns * (uint64_t)synth->sample_rate / 1000000000ULL;
+}
+
+/**
+ * Queue a channel message for a render frame
+ */
+int synth_schedule_midi(synth_t *synth, uint64_t frame, const uint8_t *msg, size_t len) {
+    if (!synth || !synth->initialized || !msg || len == 0 || len > 3 ||
+        msg[0] < 0x80 || msg[0] >= 0xF0) {
+        return -1;
+    }
+    
+    /* While the engine is down the message waits for it, unscheduled */
+    if (synth_defer_midi(synth, msg, len)) {
+        return 0;
+    }
+    
+    /* A program change may load samples; keep that off the audio thread */
+    if (synth->dynamic_samples && !synth->live && (msg[0] & 0xF0) == 0xC0) {
+        return -1;
+    }
+    
+    /* The playback engine renders up to a full ring ahead of what is heard;
+     * delaying by as much keeps every event ahead of its render position */
+    if (synth->live) {
+        frame += synth->ring.frames;
+    }
+    
+    return queue_push(synth, frame, msg, len);
+}
+
+/**
+ * Hold a message back while the engine is not running
+ */
+int synth_defer_midi(synth_t *synth, const uint8_t *msg, size_t len) {
+    if (!synth || !synth->lazy || !msg || len == 0) {
+        return 0;
+    }
+    if (__atomic_load_n(&synth->active, __ATOMIC_ACQUIRE)) {
+        if (msg[0] < 0xF8) {
+            __atomic_store_n(&synth->last_input_ns, monotonic_ns(), __ATOMIC_RELAXED);
+        }
+        return 0;
+    }
+    
+    /* Clock and active sensing keep arriving from idle controllers and must
+     * not bring the engine up */
+    if (msg[0] >= 0xF8) {
+        return 1;
+    }
+    
+    __atomic_store_n(&synth->last_input_ns, monotonic_ns(), __ATOMIC_RELAXED);
+    if (len > 3 || msg[0] < 0x80 || queue_push(synth, 0, msg, len) < 0) {
+        __atomic_fetch_add(&synth->deferred_dropped, 1, __ATOMIC_RELAXED);
+    }
+    synth_request_activation(synth);
+    return 1;
+}
+
+/**
+ * Ask the main loop to bring the engine up
+ */
+void synth_request_activation(synth_t *synth) {
+    if (!synth || !synth->lazy) {
+        return;
+    }
+    if (__atomic_load_n(&synth->active, __ATOMIC_ACQUIRE) ||
+        __atomic_exchange_n(&synth->activation_requested, true, __ATOMIC_ACQ_REL)) {
+        return;
+    }
+    uint64_t one = 1;
+    if (write(synth->wakeup_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        syslog(LOG_WARNING, "Failed to signal engine activation: %s", strerror(errno));
+    }
+}
+
+/**
+ * Load soundfonts and start audio on a lazily started synth
+ */
+int synth_activate(synth_t *synth) {
+    if (!synth || !synth->initialized) {
+        return -1;
+    }
+    __atomic_store_n(&synth->activation_requested, false, __ATOMIC_RELEASE);
+    if (__atomic_load_n(&synth->active, __ATOMIC_ACQUIRE)) {
+        return 0;
+    }
+    
+    if (start_engine(synth) < 0) {
+        stop_engine(synth);
+        return -1;
+    }
+    __atomic_store_n(&synth->last_input_ns, monotonic_ns(), __ATOMIC_RELAXED);
+    
+    uint64_t dropped = __atomic_exchange_n(&synth->deferred_dropped, 0, __ATOMIC_RELAXED);
+    if (dropped > 0) {
+        syslog(LOG_WARNING, "%llu events received during startup were dropped",
+               (unsigned long long)dropped);
+    }
+    syslog(LOG_INFO, "Synthesizer engine started");
+    return 0;
+}
+
+/**
+ * Stop audio and unload soundfonts on a lazily started synth
+ */
+int synth_deactivate(synth_t *synth) {
+    if (!synth || !synth->initialized || !synth->lazy) {
+        return -1;
+    }
+    if (!__atomic_load_n(&synth->active, __ATOMIC_ACQUIRE)) {
+        return 0;
+    }
+    stop_engine(synth);
+    syslog(LOG_INFO, "Synthesizer engine stopped");
+    return 0;
+}
+
+/**
+ * Check whether soundfonts are loaded and audio is running
+ */
+bool synth_is_active(synth_t *synth) {
+    return synth && __atomic_load_n(&synth->active, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * File descriptor that becomes readable when activation is requested
+ */
+int synth_get_wakeup_fd(synth_t *synth) {
+    return synth ? synth->wakeup_fd : -1;
+}
+
+/**
+ * Monotonic time of the last channel or SysEx message received
+ */
+uint64_t synth_get_last_input_ns(synth_t *synth) {
+    return synth ? __atomic_load_n(&synth->last_input_ns, __ATOMIC_RELAXED) : 0;
+}
+
+/**
+ * Engine for inputs in the playback latency class
+ */
+synth_t *synth_get_playback(synth_t *synth) {
+    return synth ? synth->playback : NULL;
+}
+
+/**
+ * Get percussion cache counters
+ */
+int synth_get_percussion_stats(synth_t *synth, perc_cache_stats_t *stats) {
+    if (!synth) return -1;
+    return perc_cache_get_stats(synth->perc, stats);
+}
+
+/**
+ * Check whether a synth renders ahead for playback inputs
+ */
+bool synth_is_playback(synth_t *synth) {
+    return synth && synth->live;
+}
+
+/**
+ * Duration of the latest program change on a channel
+ */
+uint64_t synth_get_program_change_ns(synth_t *synth, int channel) {
+    if (!synth || channel < 0 || channel >= 16) {
+        return 0;
+    }
+    return __atomic_load_n(&synth->program_change_ns[channel], __ATOMIC_RELAXED);
+}
+
+/**
+ * Number of FluidSynth channels, hidden ones included
+ */
+int synth_count_channels(synth_t *synth) {
+    if (!synth || !synth->initialized || !synth->synth) {
+        return -1;
+    }
+    return fluid_synth_count_midi_channels(synth->synth);
+}
+
+/**
+ * Get the soundfont, bank and program selected on a channel
+ */
+int synth_get_preset(synth_t *synth, int channel, synth_preset_t *preset) {
+    if (!synth || !synth->initialized || !synth->synth || !preset) {
+        return -1;
+    }
+    
+    int sfont_id, bank, program;
+    if (fluid_synth_get_program(synth->synth, channel, &sfont_id, &bank, &program) != FLUID_OK ||
+        sfont_id <= 0) {
+        return -1;
+    }
+    preset->sfont_id = sfont_id;
+    preset->bank = bank;
+    preset->program = program;
+    return 0;
+}
+
+/**
+ * Select or release a preset on a hidden channel
+ */
+int synth_hold_preset(synth_t *synth, int channel, const synth_preset_t *preset) {
+    if (!synth || !synth->initialized || !synth->synth || channel < 16) {
+        return -1;
+    }
+    
+    int result = preset ? fluid_synth_program_select(synth->synth, channel, preset->sfont_id,
+                                                     preset->bank, preset->program)
+                        : fluid_synth_unset_program(synth->synth, channel);
+    return result == FLUID_OK ? 0 : -1;
+}
+
+/**
+ * Follow JACK freewheel mode (JACK audio driver only)
+ */
+int synth_set_freewheel(synth_t *synth, bool enabled) {
+    if (synth && synth->live) {
+        return synth_set_freewheel(synth->live, enabled);
+    }
+    if (!synth || !synth->initialized || synth->driver != AUDIO_DRIVER_JACK) {
+        return -1;
+    }
+    
+    __atomic_store_n(&synth->freewheel, enabled, __ATOMIC_RELAXED);
+    return 0;
+}
+
+/**
+ * Turn reverb on or off and set its level
+ */
+int synth_set_reverb(synth_t *synth, bool enabled, float level) {
+    if (!synth || !synth->initialized || !synth->synth) {
+        return -1;
+    }
+    
+    if (level < 0.0f || level > 10.0f) {
+        syslog(LOG_DEBUG, "Invalid reverb level: %.2f", level);
+        return -1;
+    }
+    
+    fluid_synth_reverb_on(synth->synth, 0, enabled ? 1 : 0);
+    if (enabled) {
+        fluid_synth_set_reverb_group_level(synth->synth, 0, level);
+    }
     return 0;
 }
 
@@ -747,7 +2760,7 @@ int synth_update_settings(synth_t *synth, const midisynthd_config_t *new_config)
     
     /* Update gain */
     if (new_config->gain != synth->config->gain) {
-        fluid_synth_set_gain(synth->synth, new_config->gain);
+        set_gain_term(synth, &synth->gain, new_config->gain);
         syslog(LOG_INFO, "Updated synthesizer gain to %.2f", new_config->gain);
     }
     
@@ -786,6 +2799,14 @@ int synth_update_settings(synth_t *synth, const midisynthd_config_t *new_config)
         }
     }
     
+    if (synth->playback) {
+        synth_update_settings(synth->playback, new_config);
+    }
+    if (synth->perc_engine) {
+        synth_update_settings(synth->perc_engine, new_config);
+        perc_cache_invalidate(synth->perc);
+    }
+    
     /* Update config pointer */
     synth->config = new_config;
     
@@ -847,20 +2868,77 @@ int synth_handle_midi_event(synth_t *synth, snd_seq_event_t *ev) {
  * Check if the synthesizer is properly initialized and ready
  */
 bool synth_is_ready(synth_t *synth) {
-    return synth && synth->initialized && synth->synth && synth->audio_driver;
+    return synth && synth->initialized && synth->synth &&
+           (synth->audio_driver || synth->null_audio || synth->driver == AUDIO_DRIVER_OFFLINE);
 }
 
 int synth_unload_soundfont(synth_t *synth, int soundfont_id) {
     if (!synth || !synth->synth) return -1;
-    if (fluid_synth_sfunload(synth->synth, soundfont_id, 1) == FLUID_OK)
-        return 0;
-    return -1;
+    if (fluid_synth_sfunload(synth->synth, soundfont_id, 1) != FLUID_OK)
+        return -1;
+    for (int i = 0; i < synth->sf_memory_count; i++) {
+        if (synth->sf_memory[i].id == soundfont_id) {
+            memstat_sub(MEMSTAT_SAMPLES, synth->sf_memory[i].sample_bytes);
+            memstat_sub(MEMSTAT_PRESETS, synth->sf_memory[i].metadata_bytes);
+            synth->sf_memory[i] = synth->sf_memory[--synth->sf_memory_count];
+            break;
+        }
+    }
+    return 0;
+}
+
+int synth_get_soundfont_memory(synth_t *synth, int index, synth_soundfont_memory_t *info) {
+    if (!synth || !info || index < 0 || index >= synth->sf_memory_count) return -1;
+    *info = synth->sf_memory[index];
+    return 0;
+}
+
+void synth_estimate_memory(const midisynthd_config_t *config, memstat_t *est) {
+    if (!est) return;
+    memset(est, 0, sizeof(*est));
+    if (!config) return;
+
+    for (int i = 0; i < config->soundfont_count && i < CONFIG_MAX_SOUNDFONTS; i++) {
+        memstat_sf2_t sf;
+        if (config->soundfonts[i].enabled && memstat_sf2_estimate(config->soundfonts[i].path, &sf) == 0) {
+            est->current[MEMSTAT_SAMPLES] += sf.sample_bytes -
+                                             (config->soundfonts[i].drop_sm24 ? sf.sm24_bytes : 0);
+            est->current[MEMSTAT_PRESETS] += sf.metadata_bytes;
+        }
+    }
+    est->current[MEMSTAT_VOICES] = memstat_voice_bytes(config->polyphony);
+    est->current[MEMSTAT_BUFFERS] = memstat_effect_bytes(config->sample_rate > 0 ? config->sample_rate
+                                                                                : CONFIG_DEFAULT_SAMPLE_RATE);
+    est->current[MEMSTAT_QUEUES] = SYNTH_SCHEDULE_QUEUE_SIZE *
+                                   (sizeof(synth_queue_slot_t) + sizeof(synth_timed_event_t));
+    if (config->level_meters) {
+        est->current[MEMSTAT_BUFFERS] += (METER_CHANNELS * 2 * (size_t)SYNTH_METER_FRAMES +
+                                          2 * (size_t)config->buffer_size) * sizeof(float);
+    }
+    /* The playback engine is a second full engine plus its ring */
+    if (config_has_playback_inputs(config)) {
+        for (int i = 0; i < MEMSTAT_COUNT; i++) {
+            est->current[i] *= 2;
+        }
+        est->current[MEMSTAT_BUFFERS] += 2 * sizeof(float) * (size_t)config->playback_block * SYNTH_PLAYBACK_BLOCKS;
+    }
+    /* The percussion engine loads only the kits it plays; count its budget */
+    if (config->percussion_cache > 0) {
+        est->current[MEMSTAT_VOICES] += memstat_voice_bytes(SYNTH_PERC_POLYPHONY);
+        est->current[MEMSTAT_BUFFERS] += (size_t)config->percussion_cache * 1024 * 1024;
+    }
+    for (int i = 0; i < MEMSTAT_COUNT; i++) {
+        est->peak[i] = est->current[i];
+        est->total += est->current[i];
+    }
+    est->total_peak = est->total;
 }
 
 int synth_set_polyphony(synth_t *synth, int polyphony) {
     if (!synth || !synth->synth || polyphony <= 0) return -1;
     if (fluid_synth_set_polyphony(synth->synth, polyphony) != FLUID_OK)
         return -1;
+    account_voices(synth, polyphony);
     return 0;
 }
 
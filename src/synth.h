@@ -25,6 +25,9 @@
 #include <stdbool.h>
 #include <fluidsynth.h>
 #include <alsa/asoundlib.h>
+#include "memstat.h"
+#include "perc_cache.h"
+#include "meter.h"
 
 /* Forward declarations */
 typedef struct synth_s synth_t;
@@ -109,8 +112,56 @@ typedef struct {
     char current_preset[64];    /* Name of current preset on channel 0 */
     double sample_rate;         /* Current audio sample rate */
     int buffer_size;            /* Audio buffer size in frames */
+    meter_snapshot_t levels;    /* Output levels; windows stays 0 while level_meters is off */
 } synth_status_t;
 
+/**
+ * Render timing statistics measured in the audio callback
+ *
+ * Load figures are render time as a percentage of the real-time budget of
+ * the period (period frames / sample rate).
+ */
+typedef struct {
+    uint64_t periods;           /* Periods rendered since last reset */
+    uint64_t late_periods;      /* Callbacks arriving > 1.5 periods late (xruns) */
+    uint64_t overruns;          /* Periods whose render exceeded the budget */
+    double avg_load;            /* Mean render load (%) */
+    double peak_load;           /* Worst render load (%) */
+    uint64_t freewheel_periods; /* Periods rendered in JACK freewheel, not timed */
+    uint64_t playback_blocks;   /* Blocks rendered by the playback engine since start */
+    uint64_t playback_underruns; /* Live periods the playback engine fell behind in */
+    uint64_t shed_periods;      /* Periods that shed a channel to meet their budget */
+    uint64_t shed_voices;       /* Voices shed in those periods */
+    double voice_cost_ns;       /* Learned render cost of one voice per frame */
+    uint64_t concealed_periods; /* Periods cut short and finished with concealment */
+    uint64_t concealed_frames;  /* Frames filled by concealment */
+    uint64_t resyncs;           /* Periods faded in after the device ran dry */
+    uint64_t failed_events;     /* Timed events the engine rejected since start */
+} synth_render_stats_t;
+
+/**
+ * Memory held by one loaded soundfont
+ *
+ * Sizes come from the file's chunk headers; metadata is an estimate of
+ * FluidSynth's in-memory preset and zone tables.
+ */
+typedef struct {
+    int id;                     /* FluidSynth soundfont ID */
+    char path[512];             /* As configured, CONFIG_MAX_PATH_LEN */
+    size_t sample_bytes;        /* Sample data, including 24-bit extension */
+    size_t metadata_bytes;      /* Preset, instrument and zone tables */
+    size_t saved_bytes;         /* 24-bit extension left unloaded (soundfont_24bit=no) */
+} synth_soundfont_memory_t;
+
+/**
+ * Preset selected on a FluidSynth channel
+ */
+typedef struct {
+    int sfont_id;               /* FluidSynth soundfont ID, from 1 */
+    int bank;                   /* 128 for percussion */
+    int program;
+} synth_preset_t;
+
 /**
  * Initialize the FluidSynth synthesis engine
  * 
@@ -240,6 +291,22 @@ int synth_key_pressure(synth_t *synth, int channel, int note, int pressure);
  */
 int synth_process_midi_data(synth_t *synth, const uint8_t *data, size_t length);
 
+/**
+ * Handle a System Exclusive message
+ * 
+ * GM System On/Off, GM2 System On, GS Reset and XG System On reset the
+ * synthesizer and restore full Master Volume; Universal Real Time Master
+ * Volume scales the runtime gain set by configuration or synth_set_gain().
+ * Other messages (e.g. MIDI Tuning Standard) are passed on to
+ * FluidSynth.
+ * 
+ * @param synth Synthesizer instance
+ * @param data Complete message including the F0 and F7 bytes
+ * @param length Message length in bytes
+ * @return 0 on success, negative on error
+ */
+int synth_sysex(synth_t *synth, const uint8_t *data, size_t length);
+
 /**
  * Stop all playing notes immediately
  * 
@@ -278,7 +345,7 @@ int synth_set_gain(synth_t *synth, float gain);
  * Get the current master gain setting
  * 
  * @param synth Synthesizer instance
- * @return Current gain value, or negative on error
+ * @return Current gain value, without Master Volume, or negative on error
  */
 float synth_get_gain(synth_t *synth);
 
@@ -292,15 +359,304 @@ float synth_get_gain(synth_t *synth);
  */
 int synth_unload_soundfont(synth_t *synth, int soundfont_id);
 
+/**
+ * Get the memory held by a loaded soundfont
+ *
+ * Totals across all categories are kept by memstat; this breaks sample
+ * data and metadata down per soundfont.
+ *
+ * @param synth Synthesizer instance
+ * @param index Soundfont index, from 0
+ * @param info Receives the sizes
+ * @return 0 on success, -1 when index is past the last soundfont
+ */
+int synth_get_soundfont_memory(synth_t *synth, int index, synth_soundfont_memory_t *info);
+
+/**
+ * Estimate the memory a configuration needs, without loading anything
+ *
+ * Sizes the enabled soundfonts from their files and the voice pool, effect
+ * buffers and event queues from the settings, as synth_init() would
+ * account them.
+ *
+ * @param config Configuration to size
+ * @param est Receives the estimate in current and peak
+ */
+void synth_estimate_memory(const midisynthd_config_t *config, memstat_t *est);
+
 /**
  * Get current synthesizer status and performance statistics
  * 
+ * With config->level_meters set, levels holds the peak and RMS output
+ * level of the latest 1/METER_RATE_HZ s window, measured in the render
+ * path. Channel levels are measured on every output but JACK, where
+ * FluidSynth would register a port pair per channel; they include the
+ * playback engine and cached percussion hits.
+ * 
  * @param synth Synthesizer instance
  * @param status Pointer to status structure to fill
  * @return 0 on success, negative on error
  */
 int synth_get_status(synth_t *synth, synth_status_t *status);
 
+/**
+ * Get render timing statistics collected by the audio callback
+ *
+ * @param synth Synthesizer instance
+ * @param stats Pointer to statistics structure to fill
+ * @return 0 on success, negative on error
+ */
+int synth_get_render_stats(synth_t *synth, synth_render_stats_t *stats);
+
+/**
+ * Clear render timing statistics
+ *
+ * The reset is carried out by the audio thread on its next period, so
+ * statistics read immediately afterwards may still be zero.
+ *
+ * @param synth Synthesizer instance
+ */
+void synth_reset_render_stats(synth_t *synth);
+
+/**
+ * Render audio on the caller's thread
+ *
+ * Only available with the offline audio driver, where no device or render
+ * thread exists and the host decides when audio is produced. Events sent
+ * before the call take effect at the start of the rendered block, which
+ * makes the output a deterministic function of the event sequence.
+ *
+ * @param synth Synthesizer instance
+ * @param frames Number of frames to render
+ * @param left Receives the left channel
+ * @param right Receives the right channel
+ * @return 0 on success, negative on error or when not in offline mode
+ */
+int synth_render(synth_t *synth, int frames, float *left, float *right);
+
+/* Timed events that can be queued ahead of rendering, a power of two */
+#define SYNTH_SCHEDULE_QUEUE_SIZE   1024
+/* Blocks the playback engine renders ahead of the live output */
+#define SYNTH_PLAYBACK_BLOCKS       2
+
+/**
+ * Current position of the render clock in frames
+ *
+ * Counts frames rendered so far and, except in offline and freewheel mode,
+ * adds the time since the current period started, so the value keeps
+ * advancing between audio callbacks.
+ *
+ * @param synth Synthesizer instance
+ * @return Frame position, or 0 if the synthesizer is not running
+ */
+uint64_t synth_get_frame_time(synth_t *synth);
+
+/**
+ * Queue a channel message for a given render frame
+ *
+ * The audio thread splits the period at the event's frame, so the message
+ * takes effect at that frame rounded to FluidSynth's 64-frame block instead
+ * of at the period boundary. Messages whose frame has already passed are
+ * applied at the start of the next period. Safe to call from several
+ * threads at once.
+ *
+ * Program changes are refused while the sample cache is enabled, since
+ * with dynamic sample loading they may read from disk; callers then
+ * apply them at once, as for a full queue.
+ *
+ * @param synth Synthesizer instance
+ * @param frame Frame on the synth_get_frame_time() clock
+ * @param msg Channel message, 1 to 3 bytes
+ * @param len Message length
+ * @return 0 if queued, -1 if the message is invalid or the queue is full
+ */
+int synth_schedule_midi(synth_t *synth, uint64_t frame, const uint8_t *msg, size_t len);
+
+/**
+ * Time taken by the latest program change on a channel
+ *
+ * Only measured while the sample cache is enabled, where the change
+ * includes loading the preset's sample data if it is not resident.
+ *
+ * @param synth Synthesizer instance
+ * @param channel MIDI channel (0-15)
+ * @return Nanoseconds, or 0 if not measured
+ */
+uint64_t synth_get_program_change_ns(synth_t *synth, int channel);
+
+/**
+ * Number of FluidSynth channels
+ *
+ * 16 unless the sample cache reserved hidden channels above the MIDI
+ * channels to hold presets on.
+ *
+ * @param synth Synthesizer instance
+ * @return Channel count, or -1 on error
+ */
+int synth_count_channels(synth_t *synth);
+
+/**
+ * Get the preset selected on a channel
+ *
+ * @param synth Synthesizer instance
+ * @param channel Any FluidSynth channel, including hidden ones
+ * @param preset Receives the soundfont, bank and program
+ * @return 0 on success, -1 on error or if no soundfont is selected
+ */
+int synth_get_preset(synth_t *synth, int channel, synth_preset_t *preset);
+
+/**
+ * Hold a preset on a hidden channel
+ *
+ * Hidden channels never receive MIDI, so a preset selected there only
+ * keeps its sample data loaded when dynamic sample loading is on.
+ *
+ * @param synth Synthesizer instance
+ * @param channel Hidden channel, 16 or above
+ * @param preset Preset to select, or NULL to release the channel
+ * @return 0 on success, -1 on error
+ */
+int synth_hold_preset(synth_t *synth, int channel, const synth_preset_t *preset);
+
+/**
+ * Hold a message back while a lazily started engine is down
+ *
+ * Called by the input drivers before dispatching. While the engine is
+ * down channel messages are queued and replayed in order once it is up,
+ * and activation is requested; SysEx received meanwhile is dropped.
+ * System real-time messages are swallowed without counting as input.
+ * While the engine is up this only records the time of the input.
+ *
+ * @param synth Synthesizer instance
+ * @param msg Complete MIDI message
+ * @param len Message length
+ * @return 1 if the message was consumed, 0 if it should be dispatched
+ */
+int synth_defer_midi(synth_t *synth, const uint8_t *msg, size_t len);
+
+/**
+ * Ask for a lazily started engine to be brought up
+ *
+ * Does not block; makes synth_get_wakeup_fd() readable so the main loop
+ * can call synth_activate().
+ *
+ * @param synth Synthesizer instance
+ */
+void synth_request_activation(synth_t *synth);
+
+/**
+ * Load soundfonts and start audio output
+ *
+ * Messages received since the request are applied before the first
+ * period is rendered. Only needed with lazy_start; otherwise synth_init()
+ * does this.
+ *
+ * @param synth Synthesizer instance
+ * @return 0 on success or if already active, -1 on error
+ */
+int synth_activate(synth_t *synth);
+
+/**
+ * Stop audio output and unload soundfonts
+ *
+ * The FluidSynth instance and its channel state are kept, so the MIDI
+ * ports stay usable and the next input starts the engine again.
+ *
+ * @param synth Synthesizer instance
+ * @return 0 on success or if already inactive, -1 if not lazily started
+ */
+int synth_deactivate(synth_t *synth);
+
+/**
+ * Check whether soundfonts are loaded and audio is running
+ *
+ * @param synth Synthesizer instance
+ * @return true if the engine is up
+ */
+bool synth_is_active(synth_t *synth);
+
+/**
+ * Get the descriptor signalled by synth_request_activation()
+ *
+ * @param synth Synthesizer instance
+ * @return eventfd, or -1 if the synth was not started lazily
+ */
+int synth_get_wakeup_fd(synth_t *synth);
+
+/**
+ * Time of the last MIDI input, on CLOCK_MONOTONIC
+ *
+ * Only tracked with lazy_start.
+ *
+ * @param synth Synthesizer instance
+ * @return Nanoseconds, or 0 if nothing was received yet
+ */
+uint64_t synth_get_last_input_ns(synth_t *synth);
+
+/**
+ * Get the engine for inputs in the playback latency class
+ *
+ * Created by synth_init() when an input is declared playback. It renders
+ * config->playback_block frames per wakeup on its own thread, up to
+ * SYNTH_PLAYBACK_BLOCKS blocks ahead, and the live engine's audio
+ * callback mixes the result into its output. Messages sent to it are
+ * delayed by those blocks so their spacing is kept. Pass it to an input
+ * driver in place of the live synth; it takes the same calls.
+ *
+ * @param synth Live synthesizer instance
+ * @return Playback engine, or NULL if there is none
+ */
+synth_t *synth_get_playback(synth_t *synth);
+
+/**
+ * Check whether a synth is a playback engine
+ *
+ * @param synth Synthesizer instance
+ * @return true for the engine returned by synth_get_playback()
+ */
+bool synth_is_playback(synth_t *synth);
+
+/**
+ * Get percussion cache counters
+ *
+ * The cache exists when config->percussion_cache is set and audio goes to
+ * a real-time output. Note-ons on MIDI channel 10 then mix a pre-rendered
+ * hit where one is held for the kit, note and velocity layer; the first
+ * note of each plays live while a side engine renders it. Cached hits are
+ * one-shots and ignore their note-off.
+ *
+ * @param synth Synthesizer instance
+ * @param stats Receives the counters
+ * @return 0 on success, -1 if there is no cache
+ */
+int synth_get_percussion_stats(synth_t *synth, perc_cache_stats_t *stats);
+
+/**
+ * Enter or leave JACK freewheel mode
+ *
+ * While freewheeling JACK runs process cycles back to back, as fast as the
+ * clients can render. The render clock then only advances with rendered
+ * frames, and periods are counted in freewheel_periods instead of being
+ * timed against a real-time budget, so an offline export neither shows up
+ * as xruns nor skews the load figures. Called from the JACK freewheel
+ * callback; does not block.
+ *
+ * @param synth Synthesizer instance
+ * @param enabled Whether JACK is freewheeling
+ * @return 0 on success, -1 if audio is not rendered through JACK
+ */
+int synth_set_freewheel(synth_t *synth, bool enabled);
+
+/**
+ * Turn reverb on or off and set its level
+ *
+ * @param synth Synthesizer instance
+ * @param enabled Whether reverb is active
+ * @param level Reverb level, 0.0 to 10.0
+ * @return 0 on success, negative on error
+ */
+int synth_set_reverb(synth_t *synth, bool enabled, float level);
+
 /**
  * Update runtime-changeable synthesizer settings
  *
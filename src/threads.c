@@ -0,0 +1,234 @@
+/*
+ * midisynthd - System-level MIDI Synthesizer Daemon for Linux
+ * Copyright (C) 2025 ArchLars
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#define _GNU_SOURCE
+#include "threads.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+/* Slot states; a slot is only read once it is SLOT_USED */
+#define SLOT_FREE       0
+#define SLOT_CLAIMED    1
+#define SLOT_USED       2
+
+typedef struct {
+    int state;
+    pid_t tid;
+    char role[THREADS_NAME_LEN];
+} slot_t;
+
+static slot_t slots[THREADS_MAX];
+static __thread bool registered;
+
+static pid_t current_tid(void) {
+    return (pid_t)syscall(SYS_gettid);
+}
+
+/**
+ * Whether a thread of this process still exists
+ */
+static bool task_exists(pid_t tid) {
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/self/task/%d", (int)tid);
+    return access(path, F_OK) == 0;
+}
+
+/**
+ * Claim a slot: a free one, or one whose thread has gone away
+ */
+static slot_t *claim_slot(void) {
+    for (int pass = 0; pass < 2; pass++) {
+        for (int i = 0; i < THREADS_MAX; i++) {
+            slot_t *s = &slots[i];
+            int expected = pass == 0 ? SLOT_FREE : SLOT_USED;
+            if (pass == 1 && task_exists(__atomic_load_n(&s->tid, __ATOMIC_RELAXED))) {
+                continue;
+            }
+            if (__atomic_compare_exchange_n(&s->state, &expected, SLOT_CLAIMED, false,
+                                            __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+                return s;
+            }
+        }
+    }
+    return NULL;
+}
+
+int threads_register(const char *role, bool rename) {
+    if (registered) return 0;
+    if (!role) return -1;
+
+    pid_t tid = current_tid();
+    slot_t *slot = NULL;
+    for (int i = 0; i < THREADS_MAX && !slot; i++) {
+        if (__atomic_load_n(&slots[i].state, __ATOMIC_ACQUIRE) == SLOT_USED && slots[i].tid == tid) {
+            slot = &slots[i];
+        }
+    }
+    if (!slot) {
+        slot = claim_slot();
+        if (!slot) return -1;
+    }
+
+    snprintf(slot->role, sizeof(slot->role), "%s", role);
+    __atomic_store_n(&slot->tid, tid, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->state, SLOT_USED, __ATOMIC_RELEASE);
+    if (rename) {
+        pthread_setname_np(pthread_self(), slot->role);
+    }
+    registered = true;
+    return 0;
+}
+
+void threads_unregister(void) {
+    if (!registered) return;
+
+    pid_t tid = current_tid();
+    for (int i = 0; i < THREADS_MAX; i++) {
+        if (__atomic_load_n(&slots[i].state, __ATOMIC_ACQUIRE) == SLOT_USED && slots[i].tid == tid) {
+            __atomic_store_n(&slots[i].state, SLOT_FREE, __ATOMIC_RELEASE);
+        }
+    }
+    registered = false;
+}
+
+/**
+ * Format a CPU set as a compact list
+ */
+static void format_affinity(const cpu_set_t *set, char *buf, size_t size) {
+    size_t len = 0;
+    buf[0] = '\0';
+    for (int cpu = 0; cpu < CPU_SETSIZE && len < size; cpu++) {
+        if (!CPU_ISSET(cpu, set)) continue;
+        int last = cpu;
+        while (last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, set)) last++;
+        int n = last > cpu ? snprintf(buf + len, size - len, "%s%d-%d", len ? "," : "", cpu, last)
+                           : snprintf(buf + len, size - len, "%s%d", len ? "," : "", cpu);
+        if (n < 0) break;
+        len += (size_t)n;
+        cpu = last;
+    }
+}
+
+/**
+ * Fill CPU time and context switches from /proc
+ */
+static void read_task_stats(thread_info_t *info) {
+    char path[64];
+    char buf[2048];
+
+    /* schedstat has nanoseconds on CPU; stat only clock ticks */
+    snprintf(path, sizeof(path), "/proc/self/task/%d/schedstat", (int)info->tid);
+    FILE *f = fopen(path, "r");
+    if (f) {
+        unsigned long long ns = 0;
+        if (fscanf(f, "%llu", &ns) == 1) info->cpu_ns = ns;
+        fclose(f);
+    }
+    if (info->cpu_ns == 0) {
+        snprintf(path, sizeof(path), "/proc/self/task/%d/stat", (int)info->tid);
+        f = fopen(path, "r");
+        if (f) {
+            size_t n = fread(buf, 1, sizeof(buf) - 1, f);
+            buf[n] = '\0';
+            fclose(f);
+            /* Fields after the command name, which may contain spaces */
+            const char *p = strrchr(buf, ')');
+            unsigned long long utime = 0, stime = 0;
+            if (p && sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu",
+                            &utime, &stime) == 2) {
+                long hz = sysconf(_SC_CLK_TCK);
+                if (hz > 0) info->cpu_ns = (utime + stime) * (1000000000ULL / (unsigned long long)hz);
+            }
+        }
+    }
+
+    snprintf(path, sizeof(path), "/proc/self/task/%d/status", (int)info->tid);
+    f = fopen(path, "r");
+    if (f) {
+        size_t n = fread(buf, 1, sizeof(buf) - 1, f);
+        buf[n] = '\0';
+        fclose(f);
+        unsigned long long v;
+        const char *p = strstr(buf, "\nvoluntary_ctxt_switches:");
+        if (p && sscanf(p + 25, " %llu", &v) == 1) info->voluntary_switches = v;
+        p = strstr(buf, "\nnonvoluntary_ctxt_switches:");
+        if (p && sscanf(p + 28, " %llu", &v) == 1) info->involuntary_switches = v;
+    }
+}
+
+int threads_get(int index, thread_info_t *info) {
+    if (index < 0 || index >= THREADS_MAX || !info) return -1;
+
+    slot_t *s = &slots[index];
+    if (__atomic_load_n(&s->state, __ATOMIC_ACQUIRE) != SLOT_USED) return -1;
+
+    memset(info, 0, sizeof(*info));
+    memcpy(info->role, s->role, sizeof(info->role));
+    info->role[sizeof(info->role) - 1] = '\0';
+    info->tid = s->tid;
+    info->alive = task_exists(info->tid);
+    if (!info->alive) return 0;
+
+    /* With a TID these act on the one thread, not the whole process */
+    info->policy = sched_getscheduler(info->tid);
+    struct sched_param param;
+    if (sched_getparam(info->tid, &param) == 0) info->priority = param.sched_priority;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(info->tid, sizeof(set), &set) == 0) {
+        format_affinity(&set, info->affinity, sizeof(info->affinity));
+    }
+    read_task_stats(info);
+    return 0;
+}
+
+const char *threads_policy_name(int policy) {
+    switch (policy & ~SCHED_RESET_ON_FORK) {
+        case SCHED_OTHER: return "SCHED_OTHER";
+        case SCHED_FIFO:  return "SCHED_FIFO";
+        case SCHED_RR:    return "SCHED_RR";
+        case SCHED_BATCH: return "SCHED_BATCH";
+        case SCHED_IDLE:  return "SCHED_IDLE";
+        default:          return "unknown";
+    }
+}
+
+void threads_log(void) {
+    thread_info_t info;
+    for (int i = 0; i < THREADS_MAX; i++) {
+        if (threads_get(i, &info) < 0) continue;
+        if (!info.alive) {
+            syslog(LOG_INFO, "Thread %s (tid %d): exited", info.role, (int)info.tid);
+            continue;
+        }
+        syslog(LOG_INFO, "Thread %s (tid %d): %s prio %d, CPUs %s, %.3f s CPU, "
+               "%llu voluntary / %llu involuntary switches",
+               info.role, (int)info.tid, threads_policy_name(info.policy), info.priority,
+               info.affinity, (double)info.cpu_ns / 1e9,
+               (unsigned long long)info.voluntary_switches,
+               (unsigned long long)info.involuntary_switches);
+    }
+}
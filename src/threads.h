@@ -0,0 +1,87 @@
+/*
+ * midisynthd - System-level MIDI Synthesizer Daemon for Linux
+ * Copyright (C) 2025 ArchLars
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef MIDISYNTHD_THREADS_H
+#define MIDISYNTHD_THREADS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/* Threads the registry can hold at once */
+#define THREADS_MAX             32
+
+/* Linux thread names are at most 15 characters */
+#define THREADS_NAME_LEN        16
+
+/**
+ * Registered thread and its scheduling and CPU accounting
+ */
+typedef struct {
+    char role[THREADS_NAME_LEN];    /* Role, also the thread name when renamed */
+    pid_t tid;
+    bool alive;                     /* Still present in /proc */
+    int policy;                     /* SCHED_* policy */
+    int priority;                   /* Real-time priority, 0 for SCHED_OTHER */
+    char affinity[64];              /* Allowed CPUs as a list, e.g. "0-3,6" */
+    uint64_t cpu_ns;                /* CPU time consumed */
+    uint64_t voluntary_switches;    /* Blocked or yielded */
+    uint64_t involuntary_switches;  /* Preempted */
+} thread_info_t;
+
+/**
+ * Register the calling thread under a role
+ *
+ * Meant to be called from the thread itself, including threads created by
+ * FluidSynth, JACK or PipeWire that run our callbacks: after the first
+ * call on a thread this only reads a thread-local flag, so it can sit at
+ * the top of a real-time callback.
+ *
+ * @param role Role name, at most 15 characters
+ * @param rename Also set the thread name to the role, so it shows in top
+ * @return 0 on success, -1 if the registry is full
+ */
+int threads_register(const char *role, bool rename);
+
+/**
+ * Remove the calling thread from the registry before it exits
+ */
+void threads_unregister(void);
+
+/**
+ * Read a registry entry with current scheduling and CPU figures
+ *
+ * @param index Entry index, 0 to THREADS_MAX - 1
+ * @param info Receives the entry
+ * @return 0 on success, -1 if the slot is empty
+ */
+int threads_get(int index, thread_info_t *info);
+
+/**
+ * Name of a scheduling policy, e.g. "SCHED_FIFO"
+ */
+const char *threads_policy_name(int policy);
+
+/**
+ * Log one line per registered thread
+ */
+void threads_log(void);
+
+#endif /* MIDISYNTHD_THREADS_H */
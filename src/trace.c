@@ -0,0 +1,221 @@
+/*
+ * midisynthd - System-level MIDI Synthesizer Daemon for Linux
+ * Copyright (C) 2025 ArchLars
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#define _GNU_SOURCE
+#include "trace.h"
+#include "memstat.h"
+#include "monotonic.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+typedef struct {
+    const char *name;
+    uint64_t start_ns;
+    uint64_t dur_ns;
+    int64_t arg;
+} trace_span_t;
+
+/**
+ * Span ring of one thread; only that thread writes it
+ */
+typedef struct {
+    pid_t tid;
+    uint64_t head;              /* Spans written, published with release */
+    trace_span_t spans[TRACE_EVENTS];
+} trace_buffer_t;
+
+static trace_buffer_t *buffers;
+static int claimed;
+static int recording;
+static uint64_t origin_ns;
+static uint64_t unbuffered;
+
+/* Calling thread's buffer, and the tracer run it was claimed in */
+static __thread trace_buffer_t *local;
+static __thread unsigned local_run;
+static unsigned run;
+
+int trace_start(void) {
+    if (__atomic_load_n(&recording, __ATOMIC_ACQUIRE)) {
+        return 0;
+    }
+    buffers = calloc(TRACE_MAX_THREADS, sizeof(trace_buffer_t));
+    if (!buffers) {
+        syslog(LOG_ERR, "Failed to allocate trace buffers");
+        return -1;
+    }
+    memstat_add(MEMSTAT_BUFFERS, TRACE_MAX_THREADS * sizeof(trace_buffer_t));
+    claimed = 0;
+    unbuffered = 0;
+    origin_ns = monotonic_ns();
+    __atomic_add_fetch(&run, 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&recording, 1, __ATOMIC_RELEASE);
+    syslog(LOG_INFO, "Span tracer started: %d spans per thread, up to %d threads",
+           TRACE_EVENTS, TRACE_MAX_THREADS);
+    return 0;
+}
+
+void trace_stop(void) {
+    if (!__atomic_exchange_n(&recording, 0, __ATOMIC_ACQ_REL)) {
+        return;
+    }
+    memstat_sub(MEMSTAT_BUFFERS, TRACE_MAX_THREADS * sizeof(trace_buffer_t));
+    free(buffers);
+    buffers = NULL;
+}
+
+bool trace_enabled(void) {
+    return __atomic_load_n(&recording, __ATOMIC_RELAXED) != 0;
+}
+
+uint64_t trace_begin(void) {
+    return __atomic_load_n(&recording, __ATOMIC_RELAXED) ? monotonic_ns() : 0;
+}
+
+/**
+ * Claim a buffer for the calling thread on its first span of a run
+ */
+static trace_buffer_t *thread_buffer(void) {
+    unsigned current = __atomic_load_n(&run, __ATOMIC_ACQUIRE);
+    if (local_run == current) {
+        return local;
+    }
+    local_run = current;
+    local = NULL;
+    int index = __atomic_fetch_add(&claimed, 1, __ATOMIC_ACQ_REL);
+    if (index < TRACE_MAX_THREADS) {
+        local = &buffers[index];
+        local->tid = (pid_t)syscall(SYS_gettid);
+    }
+    return local;
+}
+
+void trace_end(uint64_t start, const char *name, int64_t arg) {
+    if (start == 0 || !__atomic_load_n(&recording, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+    uint64_t end = monotonic_ns();
+    trace_buffer_t *buf = thread_buffer();
+    if (!buf) {
+        __atomic_fetch_add(&unbuffered, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    uint64_t head = buf->head;
+    trace_span_t *span = &buf->spans[head % TRACE_EVENTS];
+    span->name = name;
+    span->start_ns = start;
+    span->dur_ns = end - start;
+    span->arg = arg;
+    __atomic_store_n(&buf->head, head + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Name of a thread, which threads_register() sets to its role
+ *
+ * @return false if the thread has exited
+ */
+static bool thread_name(pid_t tid, char *name, size_t len) {
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/self/task/%d/comm", (int)tid);
+    FILE *f = fopen(path, "r");
+    if (!f) return false;
+    bool ok = fgets(name, (int)len, f) != NULL;
+    fclose(f);
+    name[strcspn(name, "\n\"\\")] = '\0';
+    return ok;
+}
+
+int trace_write(const char *path) {
+    if (!path || !__atomic_load_n(&recording, __ATOMIC_ACQUIRE)) {
+        return -1;
+    }
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        syslog(LOG_ERR, "Failed to open trace file %s", path);
+        return -1;
+    }
+
+    int pid = (int)getpid();
+    int threads = __atomic_load_n(&claimed, __ATOMIC_ACQUIRE);
+    if (threads > TRACE_MAX_THREADS) threads = TRACE_MAX_THREADS;
+    int written = 0;
+    bool first = true;
+
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    for (int t = 0; t < threads; t++) {
+        trace_buffer_t *buf = &buffers[t];
+        uint64_t head = __atomic_load_n(&buf->head, __ATOMIC_ACQUIRE);
+        int tid = (int)__atomic_load_n(&buf->tid, __ATOMIC_RELAXED);
+        char name[32];
+        if (!thread_name(tid, name, sizeof(name))) {
+            snprintf(name, sizeof(name), "exited");
+        }
+        fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                first ? "" : ",\n", pid, tid, name);
+        first = false;
+
+        uint64_t from = head > TRACE_EVENTS ? head - TRACE_EVENTS : 0;
+        for (uint64_t i = from; i < head; i++) {
+            trace_span_t span = buf->spans[i % TRACE_EVENTS];
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            /* Skip slots the thread may be reusing; on a full ring that
+             * includes the oldest, which is the next one written */
+            if (i + TRACE_EVENTS <= __atomic_load_n(&buf->head, __ATOMIC_ACQUIRE)) {
+                continue;
+            }
+            fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f",
+                    span.name, pid, tid, (double)(span.start_ns - origin_ns) / 1000.0,
+                    (double)span.dur_ns / 1000.0);
+            if (span.arg >= 0) {
+                fprintf(f, ",\"args\":{\"n\":%lld}", (long long)span.arg);
+            }
+            fputc('}', f);
+            written++;
+        }
+    }
+    fprintf(f, "\n]}\n");
+
+    if (fclose(f) != 0) {
+        syslog(LOG_ERR, "Failed to write trace file %s", path);
+        return -1;
+    }
+    syslog(LOG_INFO, "Wrote %d spans from %d threads to %s", written, threads, path);
+    return written;
+}
+
+void trace_get_stats(trace_stats_t *stats) {
+    if (!stats) return;
+    memset(stats, 0, sizeof(*stats));
+    if (!__atomic_load_n(&recording, __ATOMIC_ACQUIRE)) return;
+    int threads = __atomic_load_n(&claimed, __ATOMIC_ACQUIRE);
+    stats->threads = threads > TRACE_MAX_THREADS ? TRACE_MAX_THREADS : threads;
+    for (int t = 0; t < stats->threads; t++) {
+        uint64_t head = __atomic_load_n(&buffers[t].head, __ATOMIC_ACQUIRE);
+        stats->spans += head;
+        if (head > TRACE_EVENTS) stats->overwritten += head - TRACE_EVENTS;
+    }
+    stats->unbuffered = __atomic_load_n(&unbuffered, __ATOMIC_RELAXED);
+}
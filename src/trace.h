@@ -0,0 +1,106 @@
+/*
+ * midisynthd - System-level MIDI Synthesizer Daemon for Linux
+ * Copyright (C) 2025 ArchLars
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef MIDISYNTHD_TRACE_H
+#define MIDISYNTHD_TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Span tracer for performance investigations without perf or bpftrace
+ *
+ * Spans are timed with trace_begin() and trace_end() and kept in a
+ * buffer per thread; each thread only writes its own, so recording takes
+ * no lock and never allocates and is safe on real-time threads. Every
+ * buffer keeps its thread's latest TRACE_EVENTS spans. trace_write()
+ * exports them as Chrome trace JSON, which chrome://tracing and the
+ * Perfetto UI open directly. While the tracer is not started,
+ * trace_begin() returns 0 and trace_end() does nothing.
+ */
+
+/* Threads that can record spans */
+#define TRACE_MAX_THREADS       16
+/* Spans kept per thread, a power of two */
+#define TRACE_EVENTS            16384
+
+/**
+ * Tracer counters
+ */
+typedef struct {
+    uint64_t spans;             /* Spans recorded */
+    uint64_t overwritten;       /* Spans dropped for newer ones */
+    uint64_t unbuffered;        /* Spans from threads beyond TRACE_MAX_THREADS */
+    int threads;                /* Threads holding a buffer */
+} trace_stats_t;
+
+/**
+ * Allocate the span buffers and start recording
+ *
+ * @return 0 on success, -1 on allocation failure
+ */
+int trace_start(void);
+
+/**
+ * Stop recording and free the span buffers
+ *
+ * No thread may be inside a span. Safe to call when not started.
+ */
+void trace_stop(void);
+
+/**
+ * Check whether spans are being recorded
+ */
+bool trace_enabled(void);
+
+/**
+ * Start a span
+ *
+ * @return Start timestamp to pass to trace_end(), 0 when not recording
+ */
+uint64_t trace_begin(void);
+
+/**
+ * Record a span from @p start until now on the calling thread
+ *
+ * @param start Value returned by trace_begin(); 0 records nothing
+ * @param name Span name; must outlive the tracer, e.g. a string literal
+ * @param arg Count shown with the span, e.g. frames or events; negative for none
+ */
+void trace_end(uint64_t start, const char *name, int64_t arg);
+
+/**
+ * Write the recorded spans as Chrome trace JSON
+ *
+ * Recording continues. Threads are listed under their thread names.
+ *
+ * @param path Output file, replaced
+ * @return Spans written, or -1 on error
+ */
+int trace_write(const char *path);
+
+/**
+ * Get tracer counters
+ *
+ * @param stats Receives the counters
+ */
+void trace_get_stats(trace_stats_t *stats);
+
+#endif /* MIDISYNTHD_TRACE_H */
@@ -0,0 +1,302 @@
+/*
+ * midisynthd - System-level MIDI Synthesizer Daemon for Linux
+ * Copyright (C) 2025 ArchLars
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include "tune.h"
+#include "synth.h"
+#include "audio.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <syslog.h>
+#include <sys/stat.h>
+
+/* Candidate settings, tried from the safest to the most aggressive */
+static const int tune_buffer_sizes[] = { 1024, 512, 256, 128, 64 };
+static const int tune_period_counts[] = { 4, 3, 2 };
+
+#define TUNE_MAX_TRIALS \
+    ((int)(sizeof(tune_buffer_sizes) / sizeof(tune_buffer_sizes[0]) * \
+           sizeof(tune_period_counts) / sizeof(tune_period_counts[0])))
+
+/* Workload shape: every step each channel restrikes a chord */
+#define TUNE_STEP_MS         20
+#define TUNE_CHORD_NOTES     6
+#define TUNE_PEDAL_STEPS     25
+
+/**
+ * Workload state of one trial
+ */
+typedef struct {
+    unsigned int seed;
+    int held[MIDI_CHANNELS][TUNE_CHORD_NOTES];  /* Keys down, 0 for none */
+} tune_workload_t;
+
+/**
+ * Sleep for the given number of milliseconds
+ */
+static void sleep_ms(int ms) {
+    struct timespec ts;
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = (long)(ms % 1000) * 1000000L;
+    while (nanosleep(&ts, &ts) < 0 && errno == EINTR) {
+    }
+}
+
+/**
+ * Drive a dense synthetic workload for the given duration
+ *
+ * All 16 channels restrike six-note chords every step while the sustain
+ * pedal is held for long stretches, so voices pile up towards the
+ * polyphony limit much like a heavy orchestral file with pedalling.
+ */
+static void drive_workload(synth_t *synth, int duration_ms, tune_workload_t *work) {
+    int steps = duration_ms / TUNE_STEP_MS;
+
+    for (int step = 0; step < steps; step++) {
+        for (int ch = 0; ch < MIDI_CHANNELS; ch++) {
+            if (step % TUNE_PEDAL_STEPS == 0) {
+                synth_control_change(synth, ch, MIDI_CC_SUSTAIN_PEDAL,
+                                     (step / TUNE_PEDAL_STEPS) % 2 ? 0 : 127);
+            }
+
+            int root = 36 + (int)(rand_r(&work->seed) % 48);
+            for (int n = 0; n < TUNE_CHORD_NOTES; n++) {
+                if (work->held[ch][n] > 0) {
+                    synth_note_off(synth, ch, work->held[ch][n], 0);
+                }
+                work->held[ch][n] = root + n * 4;
+                synth_note_on(synth, ch, work->held[ch][n], 64 + (int)(rand_r(&work->seed) % 64));
+            }
+            synth_pitch_bend(synth, ch, 8192 + (int)(rand_r(&work->seed) % 1024) - 512);
+        }
+        sleep_ms(TUNE_STEP_MS);
+    }
+}
+
+/**
+ * Run one trial with the given period size and count
+ */
+static int run_trial(const midisynthd_config_t *base, int buffer_size, int audio_periods,
+                     tune_result_t *result) {
+    midisynthd_config_t cfg = *base;
+    cfg.buffer_size = buffer_size;
+    cfg.audio_periods = audio_periods;
+
+    memset(result, 0, sizeof(*result));
+    result->buffer_size = buffer_size;
+    result->audio_periods = audio_periods;
+    result->latency_ms = 1000.0 * buffer_size * audio_periods / cfg.sample_rate;
+
+    synth_t *synth = synth_init(&cfg, NULL);
+    if (!synth) {
+        syslog(LOG_WARNING, "Tuner: backend refused %d x %d frames", audio_periods, buffer_size);
+        return -1;
+    }
+
+    /* Spread instruments across channels, channel 10 stays on drums */
+    for (int ch = 0; ch < MIDI_CHANNELS; ch++) {
+        if (ch != MIDI_PERCUSSION_CHANNEL) {
+            synth_program_change(synth, ch, (ch * 8) % (MIDI_MAX_PROGRAM + 1));
+        }
+    }
+
+    /* Every trial plays the same notes from a fresh engine */
+    tune_workload_t work;
+    memset(&work, 0, sizeof(work));
+    work.seed = 0x5eed;
+    drive_workload(synth, TUNE_WARMUP_MS, &work);
+    synth_reset_render_stats(synth);
+    drive_workload(synth, TUNE_TRIAL_MS - TUNE_WARMUP_MS, &work);
+
+    synth_render_stats_t stats;
+    int ret = synth_get_render_stats(synth, &stats);
+    synth_all_notes_off(synth);
+    synth_cleanup(synth);
+    if (ret < 0) {
+        return -1;
+    }
+
+    result->avg_load = stats.avg_load;
+    result->peak_load = stats.peak_load;
+    result->late_periods = stats.late_periods;
+    result->overruns = stats.overruns;
+    result->stable = stats.periods > 0 &&
+                     stats.late_periods == 0 &&
+                     stats.overruns == 0 &&
+                     stats.peak_load < TUNE_MAX_PEAK_LOAD;
+    return 0;
+}
+
+int tune_select(const tune_result_t *results, int count, int *buffer_size, int *audio_periods) {
+    if (!results || !buffer_size || !audio_periods) {
+        return -1;
+    }
+
+    int best = -1;
+    for (int i = 0; i < count; i++) {
+        if (!results[i].stable) {
+            continue;
+        }
+        if (best < 0 || results[i].latency_ms < results[best].latency_ms) {
+            best = i;
+        }
+    }
+    if (best < 0) {
+        return -1;
+    }
+
+    /* Safety margin: one extra period, or a larger period at the cap */
+    *buffer_size = results[best].buffer_size;
+    *audio_periods = results[best].audio_periods;
+    if (*audio_periods < 8) {
+        (*audio_periods)++;
+    } else if (*buffer_size < 8192) {
+        *buffer_size *= 2;
+    }
+
+    return best;
+}
+
+/**
+ * Print the trial table
+ */
+static void print_results(const tune_result_t *results, int count, int best) {
+    printf("\n%8s %8s %10s %9s %9s %6s %9s  %s\n",
+           "Buffer", "Periods", "Latency", "Avg CPU", "Peak CPU", "Xruns", "Overruns", "Result");
+    for (int i = 0; i < count; i++) {
+        const tune_result_t *r = &results[i];
+        printf("%8d %8d %7.1f ms %8.1f%% %8.1f%% %6llu %9llu  %s%s\n",
+               r->buffer_size, r->audio_periods, r->latency_ms,
+               r->avg_load, r->peak_load,
+               (unsigned long long)r->late_periods,
+               (unsigned long long)r->overruns,
+               r->stable ? "stable" : "unstable",
+               i == best ? " (lowest stable)" : "");
+    }
+    printf("\n");
+}
+
+/**
+ * Make sure the directory holding @p path exists
+ */
+static void ensure_parent_dir(const char *path) {
+    char dir[CONFIG_MAX_PATH_LEN];
+    strncpy(dir, path, sizeof(dir) - 1);
+    dir[sizeof(dir) - 1] = '\0';
+
+    char *slash = strrchr(dir, '/');
+    if (slash && slash != dir) {
+        *slash = '\0';
+        if (mkdir(dir, 0755) < 0 && errno != EEXIST) {
+            syslog(LOG_WARNING, "Cannot create %s: %s", dir, strerror(errno));
+        }
+    }
+}
+
+int tune_run(const midisynthd_config_t *config, const char *output_path) {
+    if (!config) {
+        return -1;
+    }
+
+    midisynthd_config_t base = *config;
+    /* Trials render straight away on the live engine; there is no input to
+     * wait for or render ahead */
+    base.lazy_start = false;
+    base.shed_threshold = 0;    /* Trials must see the overruns shedding and */
+    base.xrun_concealment = false;  /* concealment would hide */
+    base.percussion_cache = 0;      /* its render engine reloads the soundfonts */
+    base.midi_playback = base.osc_playback = base.rtpmidi_playback = false;
+    if (base.audio_driver == AUDIO_DRIVER_AUTO) {
+        base.audio_driver = audio_detect_best_driver();
+    }
+
+    printf("Tuning %s output at %d Hz, %d voices, %.1f s per trial\n",
+           config_audio_driver_to_string(base.audio_driver),
+           base.sample_rate, base.polyphony, TUNE_TRIAL_MS / 1000.0);
+
+    tune_result_t results[TUNE_MAX_TRIALS];
+    int count = 0;
+
+    /* Step down period sizes and counts; stop once a size fails outright */
+    for (size_t i = 0; i < sizeof(tune_buffer_sizes) / sizeof(tune_buffer_sizes[0]); i++) {
+        bool size_stable = false;
+
+        for (size_t j = 0; j < sizeof(tune_period_counts) / sizeof(tune_period_counts[0]); j++) {
+            tune_result_t *r = &results[count];
+            printf("  trying %4d frames x %d periods ... ", tune_buffer_sizes[i], tune_period_counts[j]);
+            fflush(stdout);
+
+            if (run_trial(&base, tune_buffer_sizes[i], tune_period_counts[j], r) < 0) {
+                printf("failed to open\n");
+                break;
+            }
+            count++;
+            printf("%s (peak %.1f%%, %llu xruns)\n", r->stable ? "stable" : "unstable",
+                   r->peak_load, (unsigned long long)r->late_periods);
+
+            if (!r->stable) {
+                break;
+            }
+            size_stable = true;
+        }
+
+        if (!size_stable) {
+            break;
+        }
+    }
+
+    int buffer_size = 0;
+    int audio_periods = 0;
+    int best = tune_select(results, count, &buffer_size, &audio_periods);
+    print_results(results, count, best);
+
+    if (best < 0) {
+        printf("No stable setting found; keeping buffer_size=%d audio_periods=%d\n",
+               config->buffer_size, config->audio_periods);
+        return -1;
+    }
+
+    printf("Recommended: buffer_size=%d audio_periods=%d (%.1f ms)\n",
+           buffer_size, audio_periods,
+           1000.0 * buffer_size * audio_periods / base.sample_rate);
+
+    if (!output_path) {
+        return 0;
+    }
+
+    char value[16];
+    ensure_parent_dir(output_path);
+    snprintf(value, sizeof(value), "%d", buffer_size);
+    if (config_write_option(output_path, "buffer_size", value) < 0) {
+        fprintf(stderr, "Failed to write %s\n", output_path);
+        return -1;
+    }
+    snprintf(value, sizeof(value), "%d", audio_periods);
+    if (config_write_option(output_path, "audio_periods", value) < 0) {
+        fprintf(stderr, "Failed to write %s\n", output_path);
+        return -1;
+    }
+
+    printf("Written to %s\n", output_path);
+    return 0;
+}
@@ -0,0 +1,76 @@
+/*
+ * midisynthd - System-level MIDI Synthesizer Daemon for Linux
+ * Copyright (C) 2025 ArchLars
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef MIDISYNTHD_TUNE_H
+#define MIDISYNTHD_TUNE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "config.h"
+
+/* Peak render load (% of period budget) above which a setting is unstable */
+#define TUNE_MAX_PEAK_LOAD   70.0
+
+/* Length of each trial and the warm-up discarded at its start */
+#define TUNE_TRIAL_MS        4000
+#define TUNE_WARMUP_MS       500
+
+/**
+ * Outcome of one buffer_size/audio_periods trial
+ */
+typedef struct {
+    int buffer_size;            /* Period size in frames */
+    int audio_periods;          /* Number of periods */
+    double latency_ms;          /* Output buffering latency */
+    double avg_load;            /* Mean render load (%) */
+    double peak_load;           /* Worst render load (%) */
+    uint64_t late_periods;      /* Late callbacks (xruns) observed */
+    uint64_t overruns;          /* Periods that exceeded their budget */
+    bool stable;                /* Whether the trial met the stability criteria */
+} tune_result_t;
+
+/**
+ * Run the latency tuner
+ *
+ * Opens the configured audio backend with decreasing period sizes and
+ * counts while driving a synthetic heavy MIDI workload, prints a
+ * latency/CPU table and writes the selected setting to @p output_path.
+ *
+ * @param config Loaded and validated configuration
+ * @param output_path Configuration file to update, or NULL to only print
+ * @return 0 on success, -1 if no stable setting was found or on error
+ */
+int tune_run(const midisynthd_config_t *config, const char *output_path);
+
+/**
+ * Pick the setting to recommend from a set of trial results
+ *
+ * Chooses the lowest-latency stable trial and adds a safety margin of one
+ * period (or doubles the period size when already at the maximum count).
+ *
+ * @param results Trial results
+ * @param count Number of results
+ * @param buffer_size Receives the recommended period size
+ * @param audio_periods Receives the recommended period count
+ * @return Index of the lowest stable trial, or -1 if none was stable
+ */
+int tune_select(const tune_result_t *results, int count, int *buffer_size, int *audio_periods);
+
+#endif /* MIDISYNTHD_TUNE_H */
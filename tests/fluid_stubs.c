@@ -0,0 +1,74 @@
+#include <stdlib.h>
+#include <string.h>
+#include <fluidsynth.h>
+
+/* Minimal FluidSynth MIDI driver and event stubs for unit testing the ALSA
+ * sequencer input without a sequencer or a synthesizer */
+
+struct _fluid_midi_event_t {
+    int type;
+    int channel;
+    int param1;
+    int param2;
+};
+
+static handle_midi_event_func_t stub_handler;
+static void *stub_handler_data;
+
+/* Events FluidSynth handled itself, and the last of them */
+int stub_fluid_handled = 0;
+fluid_midi_event_t stub_fluid_last;
+
+/* Deliver one event to the driver's handler as the sequencer thread would */
+int fluid_stub_event(int type, int channel, int param1, int param2) {
+    fluid_midi_event_t ev = { type, channel, param1, param2 };
+    return stub_handler(stub_handler_data, &ev);
+}
+
+fluid_midi_driver_t *new_fluid_midi_driver(fluid_settings_t *settings, handle_midi_event_func_t handler,
+                                           void *event_handler_data) {
+    (void)settings;
+    stub_handler = handler;
+    stub_handler_data = event_handler_data;
+    return (fluid_midi_driver_t *)calloc(1, 1);
+}
+
+void delete_fluid_midi_driver(fluid_midi_driver_t *driver) {
+    stub_handler = NULL;
+    free(driver);
+}
+
+int fluid_settings_setstr(fluid_settings_t *settings, const char *name, const char *str) {
+    (void)settings; (void)name; (void)str;
+    return FLUID_OK;
+}
+
+int fluid_settings_setint(fluid_settings_t *settings, const char *name, int val) {
+    (void)settings; (void)name; (void)val;
+    return FLUID_OK;
+}
+
+int fluid_settings_dupstr(fluid_settings_t *settings, const char *name, char **str) {
+    (void)settings; (void)name; (void)str;
+    return FLUID_FAILED;
+}
+
+int fluid_synth_handle_midi_event(void *data, fluid_midi_event_t *event) {
+    (void)data;
+    stub_fluid_handled++;
+    stub_fluid_last = *event;
+    return FLUID_OK;
+}
+
+int fluid_midi_event_get_type(const fluid_midi_event_t *evt) { return evt->type; }
+int fluid_midi_event_get_channel(const fluid_midi_event_t *evt) { return evt->channel; }
+int fluid_midi_event_get_key(const fluid_midi_event_t *evt) { return evt->param1; }
+int fluid_midi_event_get_velocity(const fluid_midi_event_t *evt) { return evt->param2; }
+int fluid_midi_event_get_control(const fluid_midi_event_t *evt) { return evt->param1; }
+int fluid_midi_event_get_value(const fluid_midi_event_t *evt) { return evt->param2; }
+int fluid_midi_event_get_program(const fluid_midi_event_t *evt) { return evt->param1; }
+int fluid_midi_event_get_pitch(const fluid_midi_event_t *evt) { return evt->param1; }
+
+int fluid_midi_event_set_channel(fluid_midi_event_t *evt, int chan) { evt->channel = chan; return FLUID_OK; }
+int fluid_midi_event_set_key(fluid_midi_event_t *evt, int key) { evt->param1 = key; return FLUID_OK; }
+int fluid_midi_event_set_velocity(fluid_midi_event_t *evt, int vel) { evt->param2 = vel; return FLUID_OK; }
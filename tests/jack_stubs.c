@@ -8,14 +8,35 @@
 typedef struct {
     int (*process)(jack_nframes_t, void*);
     void *arg;
+    JackFreewheelCallback freewheel;
+    void *freewheel_arg;
 } dummy_client;
 
+static dummy_client *stub_client;
+static const jack_midi_event_t *stub_events;
+static uint32_t stub_event_count;
+
+/* Run one process cycle delivering @p events on the MIDI input port */
+void jack_stub_cycle(jack_nframes_t nframes, const jack_midi_event_t *events, uint32_t count) {
+    stub_events = events;
+    stub_event_count = count;
+    stub_client->process(nframes, stub_client->arg);
+    stub_events = NULL;
+    stub_event_count = 0;
+}
+
+void jack_stub_freewheel(int starting) {
+    stub_client->freewheel(starting, stub_client->freewheel_arg);
+}
+
 jack_client_t *jack_client_open(const char *name, jack_options_t options, jack_status_t *status, ...) {
     (void)name; (void)options; if (status) *status = 0;
-    return (jack_client_t*)calloc(1, sizeof(dummy_client));
+    stub_client = calloc(1, sizeof(dummy_client));
+    return (jack_client_t*)stub_client;
 }
 
 int jack_client_close(jack_client_t *client) {
+    if ((dummy_client*)client == stub_client) stub_client = NULL;
     free(client); return 0;
 }
 
@@ -28,13 +49,22 @@ int jack_set_process_callback(jack_client_t *client, JackProcessCallback cb, voi
     dummy_client *c = (dummy_client*)client; c->process=cb; c->arg=arg; return 0;
 }
 
+int jack_set_freewheel_callback(jack_client_t *client, JackFreewheelCallback cb, void *arg) {
+    dummy_client *c = (dummy_client*)client; c->freewheel=cb; c->freewheel_arg=arg; return 0;
+}
+
 int jack_activate(jack_client_t *client) { (void)client; return 0; }
 
 void *jack_port_get_buffer(jack_port_t *port, jack_nframes_t nframes) { (void)port; (void)nframes; return NULL; }
 
-uint32_t jack_midi_get_event_count(void *buf) { (void)buf; return 0; }
+uint32_t jack_midi_get_event_count(void *buf) { (void)buf; return stub_event_count; }
 
-int jack_midi_event_get(jack_midi_event_t *ev, void *buf, uint32_t index) { (void)ev; (void)buf; (void)index; return -1; }
+int jack_midi_event_get(jack_midi_event_t *ev, void *buf, uint32_t index) {
+    (void)buf;
+    if (index >= stub_event_count) return -1;
+    *ev = stub_events[index];
+    return 0;
+}
 
 const char **jack_get_ports(jack_client_t *client, const char *port_name_pattern, const char *type_name_pattern, unsigned long flags) { (void)client;(void)port_name_pattern;(void)type_name_pattern;(void)flags; return NULL; }
 
@@ -0,0 +1,547 @@
+/*
+ * midisynthd - System-level MIDI Synthesizer Daemon for Linux
+ * Copyright (C) 2025 ArchLars
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+/*
+ * End-to-end MIDI-in to audio-out latency harness.
+ *
+ * For every buffer_size/audio_periods/backend combination the harness
+ * starts midisynthd with a generated configuration whose output goes to
+ * the playback side of snd-aloop, injects notes through an ALSA sequencer
+ * client (optionally routed through the snd-seq-dummy "Midi Through"
+ * port) and detects the onset on the loopback capture side. Capture
+ * frames are placed on CLOCK_MONOTONIC with hardware timestamps, so the
+ * result covers the sequencer, the daemon's dispatch, rendering and the
+ * device buffering.
+ *
+ * Requires: modprobe snd-aloop snd-seq-dummy
+ *
+ * Not registered with ctest since it needs kernel modules and a
+ * soundfont; run it by hand:
+ *
+ *   ./tests/latency_harness --daemon ./midisynthd --sizes 64,128,256 \
+ *       --periods 2,3 --iterations 2000 --csv latency.csv
+ *
+ * Backends other than alsa write to their server's default sink; route
+ * that sink to the Loopback card before measuring them.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <getopt.h>
+#include <math.h>
+#include <time.h>
+#include <sys/wait.h>
+
+#include <alsa/asoundlib.h>
+
+#define HARNESS_CLIENT_NAME     "msd-latency"
+#define HARNESS_MAX_VALUES      16
+#define HARNESS_CHUNK_FRAMES    64
+#define HARNESS_ONSET_LEVEL     0.01    /* -40 dBFS */
+#define HARNESS_QUIET_MS        50
+#define HARNESS_TIMEOUT_MS      1000
+#define HARNESS_STARTUP_MS      10000
+
+typedef struct {
+    const char *daemon;
+    const char *playback;
+    const char *capture;
+    const char *soundfont;
+    const char *csv;
+    int sizes[HARNESS_MAX_VALUES];
+    int size_count;
+    int periods[HARNESS_MAX_VALUES];
+    int period_count;
+    char backends[HARNESS_MAX_VALUES][32];
+    int backend_count;
+    int iterations;
+    int sample_rate;
+    bool through;
+} harness_options_t;
+
+typedef struct {
+    double min, median, p95, p99, max, mean;
+    int samples;
+    int missed;
+} latency_summary_t;
+
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static int parse_int_list(const char *arg, int *out, int max) {
+    int count = 0;
+    char buf[256];
+    strncpy(buf, arg, sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = '\0';
+    for (char *tok = strtok(buf, ","); tok && count < max; tok = strtok(NULL, ",")) {
+        int v = atoi(tok);
+        if (v > 0) out[count++] = v;
+    }
+    return count;
+}
+
+/* --- Daemon control ------------------------------------------------------ */
+
+static int write_config(const char *path, const harness_options_t *opt, const char *backend,
+                        int buffer_size, int periods) {
+    FILE *f = fopen(path, "w");
+    if (!f) return -1;
+    fprintf(f, "# Generated by latency_harness\n");
+    if (opt->soundfont) fprintf(f, "soundfont=%s\n", opt->soundfont);
+    fprintf(f, "audio_driver=%s\n", backend);
+    if (strcmp(backend, "alsa") == 0) fprintf(f, "audio_device=%s\n", opt->playback);
+    fprintf(f, "sample_rate=%d\n", opt->sample_rate);
+    fprintf(f, "buffer_size=%d\n", buffer_size);
+    fprintf(f, "audio_periods=%d\n", periods);
+    fprintf(f, "midi_driver=alsa_seq\n");
+    fprintf(f, "midi_autoconnect=no\n");
+    fprintf(f, "client_name=msd-latency-target\n");
+    fprintf(f, "reverb_enabled=no\n");
+    fprintf(f, "chorus_enabled=no\n");
+    return fclose(f);
+}
+
+static pid_t start_daemon(const char *daemon, const char *config_path) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        execl(daemon, daemon, "--config", config_path, "--quiet", (char *)NULL);
+        fprintf(stderr, "exec %s: %s\n", daemon, strerror(errno));
+        _exit(127);
+    }
+    return pid;
+}
+
+static void stop_daemon(pid_t pid) {
+    if (pid <= 0) return;
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+}
+
+/* --- Sequencer ----------------------------------------------------------- */
+
+static int find_client(snd_seq_t *seq, const char *name) {
+    snd_seq_client_info_t *info;
+    snd_seq_client_info_alloca(&info);
+    snd_seq_client_info_set_client(info, -1);
+    while (snd_seq_query_next_client(seq, info) >= 0) {
+        /* FluidSynth may decorate the configured name, e.g. "FLUID Synth (id)" */
+        if (strstr(snd_seq_client_info_get_name(info), name) != NULL) {
+            return snd_seq_client_info_get_client(info);
+        }
+    }
+    return -1;
+}
+
+static int wait_for_client(snd_seq_t *seq, const char *name, int timeout_ms) {
+    for (int waited = 0; waited < timeout_ms; waited += 50) {
+        int client = find_client(seq, name);
+        if (client >= 0) return client;
+        usleep(50000);
+    }
+    return -1;
+}
+
+static int connect_target(snd_seq_t *seq, int port, int target, bool through) {
+    if (!through) {
+        return snd_seq_connect_to(seq, port, target, 0);
+    }
+
+    int thru = find_client(seq, "Midi Through");
+    if (thru < 0) {
+        fprintf(stderr, "Midi Through not found (modprobe snd-seq-dummy)\n");
+        return -1;
+    }
+
+    snd_seq_port_subscribe_t *sub;
+    snd_seq_addr_t sender = { .client = (unsigned char)thru, .port = 0 };
+    snd_seq_addr_t dest = { .client = (unsigned char)target, .port = 0 };
+    snd_seq_port_subscribe_alloca(&sub);
+    snd_seq_port_subscribe_set_sender(sub, &sender);
+    snd_seq_port_subscribe_set_dest(sub, &dest);
+    int err = snd_seq_subscribe_port(seq, sub);
+    if (err < 0 && err != -EBUSY) return err;
+    return snd_seq_connect_to(seq, port, thru, 0);
+}
+
+static void send_event(snd_seq_t *seq, int port, snd_seq_event_t *ev) {
+    snd_seq_ev_set_source(ev, port);
+    snd_seq_ev_set_subs(ev);
+    snd_seq_ev_set_direct(ev);
+    snd_seq_event_output_direct(seq, ev);
+}
+
+/* --- Capture ------------------------------------------------------------- */
+
+static snd_pcm_t *open_capture(const char *device, int rate) {
+    snd_pcm_t *pcm = NULL;
+    if (snd_pcm_open(&pcm, device, SND_PCM_STREAM_CAPTURE, 0) < 0) {
+        return NULL;
+    }
+    if (snd_pcm_set_params(pcm, SND_PCM_FORMAT_S16_LE, SND_PCM_ACCESS_RW_INTERLEAVED,
+                           2, (unsigned int)rate, 1, 5000) < 0) {
+        snd_pcm_close(pcm);
+        return NULL;
+    }
+
+    /* Hardware timestamps on the same clock as the send times */
+    snd_pcm_sw_params_t *sw;
+    snd_pcm_sw_params_alloca(&sw);
+    snd_pcm_sw_params_current(pcm, sw);
+    snd_pcm_sw_params_set_tstamp_mode(pcm, sw, SND_PCM_TSTAMP_ENABLE);
+    snd_pcm_sw_params_set_tstamp_type(pcm, sw, SND_PCM_TSTAMP_TYPE_MONOTONIC);
+    if (snd_pcm_sw_params(pcm, sw) < 0) {
+        fprintf(stderr, "Monotonic capture timestamps unavailable\n");
+        snd_pcm_close(pcm);
+        return NULL;
+    }
+
+    snd_pcm_start(pcm);
+    return pcm;
+}
+
+typedef struct {
+    snd_pcm_t *pcm;
+    int rate;
+    uint64_t frames_read;
+    int16_t buf[HARNESS_CHUNK_FRAMES * 2];
+} capture_t;
+
+/**
+ * Read one chunk; returns its frame count and the time of its first frame
+ */
+static int capture_chunk(capture_t *cap, uint64_t *first_ns) {
+    snd_pcm_sframes_t n = snd_pcm_readi(cap->pcm, cap->buf, HARNESS_CHUNK_FRAMES);
+    if (n < 0) {
+        snd_pcm_recover(cap->pcm, (int)n, 1);
+        return 0;
+    }
+    cap->frames_read += (uint64_t)n;
+
+    /* At tstamp the hardware pointer was frames_read + avail */
+    snd_pcm_uframes_t avail = 0;
+    snd_htimestamp_t ts;
+    if (snd_pcm_htimestamp(cap->pcm, &avail, &ts) < 0) {
+        return 0;
+    }
+    uint64_t ts_ns = (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+    uint64_t behind = (uint64_t)avail + (uint64_t)n;
+    *first_ns = ts_ns - behind * 1000000000ULL / (uint64_t)cap->rate;
+    return (int)n;
+}
+
+static double chunk_peak(const capture_t *cap, int frames, int *first_loud) {
+    double peak = 0.0;
+    *first_loud = -1;
+    for (int i = 0; i < frames * 2; i++) {
+        double v = fabs(cap->buf[i] / 32768.0);
+        if (v > peak) peak = v;
+        if (v >= HARNESS_ONSET_LEVEL && *first_loud < 0) *first_loud = i / 2;
+    }
+    return peak;
+}
+
+static void wait_for_quiet(capture_t *cap) {
+    uint64_t start = monotonic_ns();
+    uint64_t quiet_since = start;
+    uint64_t first_ns;
+    int loud;
+    while (monotonic_ns() - quiet_since < HARNESS_QUIET_MS * 1000000ULL &&
+           monotonic_ns() - start < 2 * HARNESS_TIMEOUT_MS * 1000000ULL) {
+        int n = capture_chunk(cap, &first_ns);
+        if (n > 0 && chunk_peak(cap, n, &loud) >= HARNESS_ONSET_LEVEL) {
+            quiet_since = monotonic_ns();
+        }
+    }
+}
+
+/**
+ * Send one note and return the onset latency in ms, or -1 on timeout
+ */
+static double measure_once(capture_t *cap, snd_seq_t *seq, int port) {
+    snd_seq_event_t ev;
+    wait_for_quiet(cap);
+
+    snd_seq_ev_clear(&ev);
+    snd_seq_ev_set_noteon(&ev, 0, 72, 127);
+    uint64_t sent_ns = monotonic_ns();
+    send_event(seq, port, &ev);
+
+    double latency = -1.0;
+    while (monotonic_ns() - sent_ns < HARNESS_TIMEOUT_MS * 1000000ULL) {
+        uint64_t first_ns;
+        int loud;
+        int n = capture_chunk(cap, &first_ns);
+        if (n <= 0 || chunk_peak(cap, n, &loud) < HARNESS_ONSET_LEVEL) {
+            continue;
+        }
+        uint64_t onset_ns = first_ns + (uint64_t)loud * 1000000000ULL / (uint64_t)cap->rate;
+        if (onset_ns >= sent_ns) {
+            latency = (double)(onset_ns - sent_ns) / 1e6;
+            break;
+        }
+    }
+
+    snd_seq_ev_clear(&ev);
+    snd_seq_ev_set_noteoff(&ev, 0, 72, 0);
+    send_event(seq, port, &ev);
+    snd_seq_ev_clear(&ev);
+    snd_seq_ev_set_controller(&ev, 0, 120, 0); /* All Sound Off */
+    send_event(seq, port, &ev);
+    return latency;
+}
+
+/* --- Statistics ---------------------------------------------------------- */
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(const double *sorted, int n, double p) {
+    int idx = (int)ceil(p / 100.0 * n) - 1;
+    if (idx < 0) idx = 0;
+    if (idx >= n) idx = n - 1;
+    return sorted[idx];
+}
+
+static void summarize(double *values, int n, int missed, latency_summary_t *s) {
+    memset(s, 0, sizeof(*s));
+    s->samples = n;
+    s->missed = missed;
+    if (n == 0) return;
+
+    qsort(values, (size_t)n, sizeof(double), compare_double);
+    double sum = 0.0;
+    for (int i = 0; i < n; i++) sum += values[i];
+    s->min = values[0];
+    s->max = values[n - 1];
+    s->mean = sum / n;
+    s->median = percentile(values, n, 50.0);
+    s->p95 = percentile(values, n, 95.0);
+    s->p99 = percentile(values, n, 99.0);
+}
+
+/* --- Driver -------------------------------------------------------------- */
+
+static int run_combination(const harness_options_t *opt, const char *backend,
+                           int buffer_size, int periods, latency_summary_t *summary) {
+    char config_path[] = "/tmp/midisynthd-latency-XXXXXX";
+    int fd = mkstemp(config_path);
+    if (fd < 0) return -1;
+    close(fd);
+
+    int ret = -1;
+    pid_t pid = -1;
+    snd_seq_t *seq = NULL;
+    capture_t cap = { .rate = opt->sample_rate };
+    double *values = calloc((size_t)opt->iterations, sizeof(double));
+
+    if (!values || write_config(config_path, opt, backend, buffer_size, periods) != 0) {
+        goto out;
+    }
+
+    if (snd_seq_open(&seq, "default", SND_SEQ_OPEN_DUPLEX, 0) < 0) {
+        fprintf(stderr, "Cannot open ALSA sequencer\n");
+        goto out;
+    }
+    snd_seq_set_client_name(seq, HARNESS_CLIENT_NAME);
+    int port = snd_seq_create_simple_port(seq, "out", SND_SEQ_PORT_CAP_READ | SND_SEQ_PORT_CAP_SUBS_READ,
+                                          SND_SEQ_PORT_TYPE_MIDI_GENERIC | SND_SEQ_PORT_TYPE_APPLICATION);
+
+    pid = start_daemon(opt->daemon, config_path);
+    int target = wait_for_client(seq, "msd-latency-target", HARNESS_STARTUP_MS);
+    if (pid < 0 || target < 0) {
+        fprintf(stderr, "midisynthd did not come up with %s %dx%d\n", backend, periods, buffer_size);
+        goto out;
+    }
+    if (connect_target(seq, port, target, opt->through) < 0) {
+        fprintf(stderr, "Cannot connect to midisynthd\n");
+        goto out;
+    }
+
+    cap.pcm = open_capture(opt->capture, opt->sample_rate);
+    if (!cap.pcm) {
+        fprintf(stderr, "Cannot open capture %s (modprobe snd-aloop)\n", opt->capture);
+        goto out;
+    }
+
+    /* Discard start-up transients */
+    for (int i = 0; i < 5; i++) measure_once(&cap, seq, port);
+
+    int n = 0, missed = 0;
+    for (int i = 0; i < opt->iterations; i++) {
+        double ms = measure_once(&cap, seq, port);
+        if (ms < 0) missed++;
+        else values[n++] = ms;
+        if ((i + 1) % 100 == 0) {
+            fprintf(stderr, "\r  %s %4d x %d: %d/%d", backend, buffer_size, periods, i + 1, opt->iterations);
+        }
+    }
+    fprintf(stderr, "\n");
+
+    summarize(values, n, missed, summary);
+    ret = 0;
+
+out:
+    if (cap.pcm) snd_pcm_close(cap.pcm);
+    stop_daemon(pid);
+    if (seq) snd_seq_close(seq);
+    free(values);
+    unlink(config_path);
+    return ret;
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s [OPTIONS]\n\n", prog);
+    printf("  --daemon PATH       midisynthd binary (default ./midisynthd)\n");
+    printf("  --playback DEV      ALSA device the daemon plays to (default hw:Loopback,0,0)\n");
+    printf("  --capture DEV       ALSA device to capture from (default plughw:Loopback,1,0)\n");
+    printf("  --soundfont SF2     Soundfont for the daemon\n");
+    printf("  --backends LIST     Audio backends, comma separated (default alsa)\n");
+    printf("  --sizes LIST        buffer_size values (default 64,128,256,512)\n");
+    printf("  --periods LIST      audio_periods values (default 2,3)\n");
+    printf("  --iterations N      Notes per combination (default 2000)\n");
+    printf("  --rate HZ           Sample rate (default 48000)\n");
+    printf("  --through           Route via snd-seq-dummy Midi Through\n");
+    printf("  --csv FILE          Append results as CSV\n");
+}
+
+int main(int argc, char *argv[]) {
+    harness_options_t opt = {
+        .daemon = "./midisynthd",
+        .playback = "hw:Loopback,0,0",
+        .capture = "plughw:Loopback,1,0",
+        .sizes = { 64, 128, 256, 512 },
+        .size_count = 4,
+        .periods = { 2, 3 },
+        .period_count = 2,
+        .backends = { "alsa" },
+        .backend_count = 1,
+        .iterations = 2000,
+        .sample_rate = 48000,
+    };
+
+    static struct option long_options[] = {
+        {"daemon",     required_argument, 0, 'd'},
+        {"playback",   required_argument, 0, 'p'},
+        {"capture",    required_argument, 0, 'c'},
+        {"soundfont",  required_argument, 0, 's'},
+        {"backends",   required_argument, 0, 'b'},
+        {"sizes",      required_argument, 0, 'B'},
+        {"periods",    required_argument, 0, 'P'},
+        {"iterations", required_argument, 0, 'n'},
+        {"rate",       required_argument, 0, 'r'},
+        {"through",    no_argument,       0, 't'},
+        {"csv",        required_argument, 0, 'o'},
+        {"help",       no_argument,       0, 'h'},
+        {0, 0, 0, 0}
+    };
+
+    int c;
+    while ((c = getopt_long(argc, argv, "d:p:c:s:b:B:P:n:r:to:h", long_options, NULL)) != -1) {
+        switch (c) {
+            case 'd': opt.daemon = optarg; break;
+            case 'p': opt.playback = optarg; break;
+            case 'c': opt.capture = optarg; break;
+            case 's': opt.soundfont = optarg; break;
+            case 'B': opt.size_count = parse_int_list(optarg, opt.sizes, HARNESS_MAX_VALUES); break;
+            case 'P': opt.period_count = parse_int_list(optarg, opt.periods, HARNESS_MAX_VALUES); break;
+            case 'n': opt.iterations = atoi(optarg); break;
+            case 'r': opt.sample_rate = atoi(optarg); break;
+            case 't': opt.through = true; break;
+            case 'o': opt.csv = optarg; break;
+            case 'b': {
+                char buf[256];
+                strncpy(buf, optarg, sizeof(buf) - 1);
+                buf[sizeof(buf) - 1] = '\0';
+                opt.backend_count = 0;
+                for (char *tok = strtok(buf, ","); tok && opt.backend_count < HARNESS_MAX_VALUES;
+                     tok = strtok(NULL, ",")) {
+                    strncpy(opt.backends[opt.backend_count], tok, sizeof(opt.backends[0]) - 1);
+                    opt.backends[opt.backend_count++][sizeof(opt.backends[0]) - 1] = '\0';
+                }
+                break;
+            }
+            case 'h':
+                usage(argv[0]);
+                return 0;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (opt.iterations <= 0 || opt.sample_rate <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    FILE *csv = NULL;
+    if (opt.csv) {
+        csv = fopen(opt.csv, "a");
+        if (!csv) {
+            fprintf(stderr, "Cannot open %s: %s\n", opt.csv, strerror(errno));
+            return 1;
+        }
+        if (ftell(csv) == 0) {
+            fprintf(csv, "timestamp,backend,buffer_size,audio_periods,rate,through,"
+                         "samples,missed,min_ms,median_ms,p95_ms,p99_ms,max_ms,mean_ms\n");
+        }
+    }
+
+    printf("%-10s %6s %7s %8s %8s %8s %8s %8s %8s %7s\n",
+           "Backend", "Buffer", "Periods", "Nominal", "Min", "Median", "p95", "p99", "Max", "Missed");
+
+    int failures = 0;
+    for (int b = 0; b < opt.backend_count; b++) {
+        for (int i = 0; i < opt.size_count; i++) {
+            for (int j = 0; j < opt.period_count; j++) {
+                latency_summary_t s;
+                if (run_combination(&opt, opt.backends[b], opt.sizes[i], opt.periods[j], &s) < 0) {
+                    failures++;
+                    continue;
+                }
+                double nominal = 1000.0 * opt.sizes[i] * opt.periods[j] / opt.sample_rate;
+                printf("%-10s %6d %7d %8.2f %8.2f %8.2f %8.2f %8.2f %8.2f %7d\n",
+                       opt.backends[b], opt.sizes[i], opt.periods[j], nominal,
+                       s.min, s.median, s.p95, s.p99, s.max, s.missed);
+                fflush(stdout);
+                if (csv) {
+                    fprintf(csv, "%ld,%s,%d,%d,%d,%d,%d,%d,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f\n",
+                            (long)time(NULL), opt.backends[b], opt.sizes[i], opt.periods[j],
+                            opt.sample_rate, opt.through ? 1 : 0, s.samples, s.missed,
+                            s.min, s.median, s.p95, s.p99, s.max, s.mean);
+                    fflush(csv);
+                }
+            }
+        }
+    }
+
+    if (csv) fclose(csv);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,86 @@
+#include <stdlib.h>
+#include <string.h>
+#include "midi_pipewire.h"
+
+#if HAVE_PIPEWIRE
+#include <pipewire/pipewire.h>
+#include <pipewire/filter.h>
+
+/* Minimal PipeWire API stubs for unit testing without a PipeWire daemon */
+
+static const struct pw_filter_events *stub_events;
+static void *stub_data;
+static void *stub_port;
+static uint8_t stub_pod[4096];
+static struct spa_chunk stub_chunk;
+static struct spa_data stub_spa_data = { .maxsize = sizeof(stub_pod), .data = stub_pod, .chunk = &stub_chunk };
+static struct spa_buffer stub_spa_buffer = { .n_datas = 1, .datas = &stub_spa_data };
+static struct pw_buffer stub_buffer = { .buffer = &stub_spa_buffer };
+
+/* Run one graph cycle delivering @p pod on the input port */
+void pw_stub_cycle(uint64_t position, uint32_t duration, const void *pod, uint32_t size) {
+    struct spa_io_position pos;
+    memset(&pos, 0, sizeof(pos));
+    pos.clock.position = position;
+    pos.clock.duration = duration;
+    memcpy(stub_pod, pod, size);
+    stub_chunk.offset = 0;
+    stub_chunk.size = size;
+    stub_events->process(stub_data, &pos);
+}
+
+void pw_init(int *argc, char **argv[]) { (void)argc; (void)argv; }
+void pw_deinit(void) {}
+
+struct pw_thread_loop *pw_thread_loop_new(const char *name, const struct spa_dict *props) {
+    (void)name; (void)props;
+    return (struct pw_thread_loop *)calloc(1, 1);
+}
+int pw_thread_loop_start(struct pw_thread_loop *loop) { (void)loop; return 0; }
+void pw_thread_loop_stop(struct pw_thread_loop *loop) { (void)loop; }
+void pw_thread_loop_destroy(struct pw_thread_loop *loop) { free(loop); }
+void pw_thread_loop_lock(struct pw_thread_loop *loop) { (void)loop; }
+void pw_thread_loop_unlock(struct pw_thread_loop *loop) { (void)loop; }
+struct pw_loop *pw_thread_loop_get_loop(struct pw_thread_loop *loop) { return (struct pw_loop *)loop; }
+
+struct pw_properties *pw_properties_new(const char *key, ...) {
+    (void)key;
+    return NULL;
+}
+
+struct pw_filter *pw_filter_new_simple(struct pw_loop *loop, const char *name, struct pw_properties *props,
+                                       const struct pw_filter_events *events, void *data) {
+    (void)loop; (void)name; (void)props;
+    stub_events = events;
+    stub_data = data;
+    return (struct pw_filter *)calloc(1, 1);
+}
+
+void *pw_filter_add_port(struct pw_filter *filter, enum pw_direction direction, enum pw_filter_port_flags flags,
+                         size_t port_data_size, struct pw_properties *props,
+                         const struct spa_pod **params, uint32_t n_params) {
+    (void)filter; (void)direction; (void)flags; (void)props; (void)params; (void)n_params;
+    stub_port = calloc(1, port_data_size);
+    return stub_port;
+}
+
+int pw_filter_connect(struct pw_filter *filter, enum pw_filter_flags flags, const struct spa_pod **params, uint32_t n_params) {
+    (void)filter; (void)flags; (void)params; (void)n_params;
+    return 0;
+}
+
+void pw_filter_destroy(struct pw_filter *filter) {
+    free(filter);
+    free(stub_port);
+    stub_port = NULL;
+}
+
+struct pw_buffer *pw_filter_dequeue_buffer(void *port_data) {
+    return port_data == stub_port ? &stub_buffer : NULL;
+}
+
+int pw_filter_queue_buffer(void *port_data, struct pw_buffer *buffer) { (void)port_data; (void)buffer; return 0; }
+
+const char *pw_filter_state_as_string(enum pw_filter_state state) { (void)state; return "state"; }
+
+#endif
@@ -1,5 +1,6 @@
 #include "config.h"
 #include "synth.h"
+#include "audio.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
@@ -75,14 +76,89 @@ int synth_note_off(synth_t *s, int ch, int note, int vel) {
     return 0; 
 }
 
+int synth_control_change(synth_t *s, int ch, int control, int value) {
+    (void)ch; (void)control; (void)value;
+    return s ? 0 : -1;
+}
+
+int synth_program_change(synth_t *s, int ch, int program) {
+    (void)ch; (void)program;
+    return s ? 0 : -1;
+}
+
+int synth_pitch_bend(synth_t *s, int ch, int value) {
+    (void)ch; (void)value;
+    return s ? 0 : -1;
+}
+
+int synth_all_notes_off(synth_t *s) {
+    return s ? 0 : -1;
+}
+
+int synth_get_render_stats(synth_t *s, synth_render_stats_t *stats) {
+    if (!s || !stats) return -1;
+    memset(stats, 0, sizeof(*stats));
+    return 0;
+}
+
+void synth_reset_render_stats(synth_t *s) {
+    (void)s;
+}
+
+audio_driver_t audio_detect_best_driver(void) {
+    return AUDIO_DRIVER_ALSA;
+}
+
+const char *config_audio_driver_to_string(audio_driver_t driver) {
+    (void)driver;
+    return "alsa";
+}
+
+int config_write_option(const char *filename, const char *key, const char *value) {
+    (void)filename; (void)key; (void)value;
+    return 0;
+}
+
+/* FluidSynth handles, set by tests that stub FluidSynth as well */
+fluid_settings_t *stub_fluid_settings = NULL;
+fluid_synth_t *stub_fluid_synth = NULL;
+
 fluid_settings_t *synth_get_settings(synth_t *s) {
     (void)s;
-    return NULL;  /* Stub - return NULL for tests */
+    return stub_fluid_settings;
 }
 
 fluid_synth_t *synth_get_fluidsynth(synth_t *s) {
     (void)s;
-    return NULL;  /* Stub - return NULL for tests */
+    return stub_fluid_synth;
+}
+
+int synth_defer_midi(synth_t *s, const uint8_t *msg, size_t len) {
+    (void)s; (void)msg; (void)len;
+    return 0;
+}
+
+bool synth_is_playback(synth_t *s) {
+    (void)s;
+    return false;
+}
+
+/* Last message passed to synth_process_midi_data() */
+int stub_midi_count = 0;
+uint8_t stub_last_midi[3];
+
+int synth_process_midi_data(synth_t *s, const uint8_t *data, size_t length) {
+    if (!s || !data || length == 0) return -1;
+    stub_midi_count++;
+    memcpy(stub_last_midi, data, length < sizeof(stub_last_midi) ? length : sizeof(stub_last_midi));
+    if ((data[0] & 0xF0) == 0x90 && length >= 3) return synth_note_on(s, data[0] & 0x0F, data[1], data[2]);
+    if ((data[0] & 0xF0) == 0x80 && length >= 3) return synth_note_off(s, data[0] & 0x0F, data[1], data[2]);
+    return 0;
+}
+
+int synth_sysex(synth_t *s, const uint8_t *data, size_t length) {
+    (void)data; (void)length;
+    return s ? 0 : -1;
 }
 
 int synth_handle_midi_event(synth_t *s, snd_seq_event_t *ev) {
@@ -96,3 +172,118 @@ int synth_handle_midi_event(synth_t *s, snd_seq_event_t *ev) {
             return 0;
     }
 }
+
+/* Recorded by the stubs below for tests that need to inspect them */
+uint64_t stub_frame_time = 1000;
+int stub_scheduled_count = 0;
+uint64_t stub_scheduled_frame = 0;
+uint8_t stub_scheduled_msg[3];
+float stub_gain = 0.0f;
+bool stub_reverb_enabled = false;
+float stub_reverb_level = 0.0f;
+bool stub_freewheel = false;
+
+uint64_t synth_get_frame_time(synth_t *s) {
+    return s ? stub_frame_time : 0;
+}
+
+int synth_schedule_midi(synth_t *s, uint64_t frame, const uint8_t *msg, size_t len) {
+    if (!s || !msg || len == 0 || len > sizeof(stub_scheduled_msg)) return -1;
+    stub_scheduled_count++;
+    stub_scheduled_frame = frame;
+    memcpy(stub_scheduled_msg, msg, len);
+    return 0;
+}
+
+int synth_set_gain(synth_t *s, float gain) {
+    if (!s) return -1;
+    stub_gain = gain;
+    return 0;
+}
+
+int synth_set_freewheel(synth_t *s, bool enabled) {
+    if (!s) return -1;
+    stub_freewheel = enabled;
+    return 0;
+}
+
+int synth_set_reverb(synth_t *s, bool enabled, float level) {
+    if (!s) return -1;
+    stub_reverb_enabled = enabled;
+    stub_reverb_level = level;
+    return 0;
+}
+
+/* FluidSynth channels and their presets, for the sample cache */
+#define STUB_MAX_CHANNELS 64
+int stub_channel_count = 16;
+synth_preset_t stub_presets[STUB_MAX_CHANNELS];
+uint64_t stub_program_change_ns = 0;
+
+uint64_t synth_get_program_change_ns(synth_t *s, int channel) {
+    (void)channel;
+    return s ? stub_program_change_ns : 0;
+}
+
+int synth_count_channels(synth_t *s) {
+    return s ? stub_channel_count : -1;
+}
+
+int synth_get_preset(synth_t *s, int channel, synth_preset_t *preset) {
+    if (!s || !preset || channel < 0 || channel >= stub_channel_count ||
+        stub_presets[channel].sfont_id <= 0) return -1;
+    *preset = stub_presets[channel];
+    return 0;
+}
+
+int synth_hold_preset(synth_t *s, int channel, const synth_preset_t *preset) {
+    if (!s || channel < 16 || channel >= stub_channel_count) return -1;
+    if (preset) {
+        stub_presets[channel] = *preset;
+    } else {
+        memset(&stub_presets[channel], 0, sizeof(stub_presets[channel]));
+    }
+    return 0;
+}
+
+/* Lazy start: engine state, wakeup descriptor and input time */
+bool stub_active = false;
+int stub_activate_count = 0;
+int stub_activate_result = 0;
+int stub_deactivate_count = 0;
+int stub_wakeup_fd = -1;
+uint64_t stub_last_input_ns = 0;
+int stub_active_voices = 0;
+
+int synth_activate(synth_t *s) {
+    if (!s) return -1;
+    stub_activate_count++;
+    if (stub_activate_result == 0) stub_active = true;
+    return stub_activate_result;
+}
+
+int synth_deactivate(synth_t *s) {
+    if (!s) return -1;
+    stub_deactivate_count++;
+    stub_active = false;
+    return 0;
+}
+
+bool synth_is_active(synth_t *s) {
+    return s && stub_active;
+}
+
+int synth_get_wakeup_fd(synth_t *s) {
+    return s ? stub_wakeup_fd : -1;
+}
+
+uint64_t synth_get_last_input_ns(synth_t *s) {
+    return s ? stub_last_input_ns : 0;
+}
+
+int synth_get_status(synth_t *s, synth_status_t *status) {
+    if (!s || !status) return -1;
+    memset(status, 0, sizeof(*status));
+    status->active_voices = stub_active_voices;
+    return 0;
+}
@@ -0,0 +1,98 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "audio_null.h"
+
+static volatile int callbacks;
+static volatile int effects_to_output;
+
+static int counting_render(void *data, int len, int nfx, float *fx[], int nout, float *out[]) {
+    (void)data;
+    effects_to_output = nfx == nout && fx == out;
+    for (int c = 0; c < nout; c++) {
+        for (int i = 0; i < len; i++) {
+            out[c][i] = 0.25f;
+        }
+    }
+    callbacks++;
+    return 0;
+}
+
+static void test_freewheel_renders_periods(void **state) {
+    (void)state;
+    midisynthd_config_t cfg;
+    config_init_defaults(&cfg);
+    cfg.buffer_size = 64;
+    cfg.audio_file[0] = '\0';
+
+    callbacks = 0;
+    audio_null_t *a = audio_null_start(&cfg, true, counting_render, NULL);
+    assert_non_null(a);
+    while (callbacks < 100) {
+        usleep(1000);
+    }
+    uint64_t frames = audio_null_get_frames(a);
+    audio_null_stop(a);
+
+    assert_true(frames >= 64 * 99);
+    assert_int_equal(frames % 64, 0);
+    /* Reverb and chorus are rendered into the output */
+    assert_true(effects_to_output);
+}
+
+static void test_wav_output(void **state) {
+    (void)state;
+    midisynthd_config_t cfg;
+    config_init_defaults(&cfg);
+    cfg.buffer_size = 32;
+    snprintf(cfg.audio_file, sizeof(cfg.audio_file), "/tmp/test_audio_null_%d.wav", (int)getpid());
+
+    callbacks = 0;
+    audio_null_t *a = audio_null_start(&cfg, true, counting_render, NULL);
+    assert_non_null(a);
+    while (callbacks < 10) {
+        usleep(1000);
+    }
+    audio_null_stop(a);
+
+    FILE *f = fopen(cfg.audio_file, "rb");
+    assert_non_null(f);
+    unsigned char h[44];
+    assert_int_equal(fread(h, 1, sizeof(h), f), sizeof(h));
+    assert_memory_equal(h, "RIFF", 4);
+    assert_memory_equal(h + 8, "WAVE", 4);
+    assert_int_equal(h[20], 3);  /* IEEE float */
+    unsigned int data_size = h[40] | (h[41] << 8) | (h[42] << 16) | ((unsigned)h[43] << 24);
+    assert_true(data_size >= 10 * 32 * 2 * sizeof(float));
+    assert_int_equal(data_size % (32 * 2 * sizeof(float)), 0);
+
+    float first;
+    assert_int_equal(fread(&first, sizeof(first), 1, f), 1);
+    assert_true(first == 0.25f);
+    fclose(f);
+    unlink(cfg.audio_file);
+}
+
+static void test_invalid_parameters(void **state) {
+    (void)state;
+    midisynthd_config_t cfg;
+    config_init_defaults(&cfg);
+    assert_null(audio_null_start(NULL, true, counting_render, NULL));
+    assert_null(audio_null_start(&cfg, true, NULL, NULL));
+    audio_null_stop(NULL);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_freewheel_renders_periods),
+        cmocka_unit_test(test_wav_output),
+        cmocka_unit_test(test_invalid_parameters),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,145 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <math.h>
+#include <string.h>
+
+#include "conceal.h"
+
+#define PERIOD 256
+
+static float left[PERIOD], right[PERIOD];
+static float *out[2] = { left, right };
+
+static void render_sine(int start, int frames, int *phase) {
+    for (int i = start; i < start + frames; i++, (*phase)++) {
+        left[i] = 0.5f * sinf((float)*phase * 0.05f);
+        right[i] = -left[i];
+    }
+}
+
+static float peak(int start, int end) {
+    float p = 0.0f;
+    for (int i = start; i < end; i++) {
+        if (fabsf(left[i]) > p) p = fabsf(left[i]);
+    }
+    return p;
+}
+
+static void test_fill_continues_without_step(void **state) {
+    (void)state;
+    conceal_t *c = conceal_create();
+    assert_non_null(c);
+    int phase = 0;
+
+    render_sine(0, PERIOD, &phase);
+    conceal_record(c, out, 2, PERIOD);
+
+    /* Next period only got 100 frames in before its deadline */
+    memset(left, 0, sizeof(left));
+    memset(right, 0, sizeof(right));
+    render_sine(0, 100, &phase);
+    assert_false(conceal_resume(c, out, 2, 100, false));
+    conceal_record(c, out, 2, 100);
+    conceal_fill(c, out, 2, 100, PERIOD);
+
+    /* The sine moves at most 0.025 per frame; the seam must not jump more */
+    for (int i = 99; i < 100 + CONCEAL_XFADE; i++) {
+        assert_true(fabsf(left[i + 1] - left[i]) < 0.05f);
+        assert_true(fabsf(right[i + 1] - right[i]) < 0.05f);
+    }
+    assert_true(peak(100, PERIOD) > 0.1f);
+    conceal_destroy(c);
+}
+
+static void test_late_periods_fade_away(void **state) {
+    (void)state;
+    conceal_t *c = conceal_create();
+    int phase = 0;
+
+    render_sine(0, PERIOD, &phase);
+    conceal_record(c, out, 2, PERIOD);
+
+    float last_peak = 1.0f;
+    for (int p = 0; p < 4; p++) {
+        memset(left, 0, sizeof(left));
+        memset(right, 0, sizeof(right));
+        render_sine(0, 64, &phase);
+        conceal_resume(c, out, 2, 64, false);
+        conceal_record(c, out, 2, 64);
+        conceal_fill(c, out, 2, 64, PERIOD);
+        float tail = peak(PERIOD - 32, PERIOD);
+        assert_true(tail < last_peak);
+        last_peak = tail;
+    }
+    assert_true(last_peak < 0.1f);
+    conceal_destroy(c);
+}
+
+static void test_resume_ramps_out_step(void **state) {
+    (void)state;
+    conceal_t *c = conceal_create();
+    int phase = 0;
+
+    render_sine(0, PERIOD, &phase);
+    conceal_record(c, out, 2, PERIOD);
+    conceal_fill(c, out, 2, 128, PERIOD);
+    float last = left[PERIOD - 1];
+
+    for (int i = 0; i < PERIOD; i++) {
+        left[i] = right[i] = 0.4f;
+    }
+    assert_true(conceal_resume(c, out, 2, PERIOD, false));
+    assert_true(fabsf(left[0] - last) < 1e-6f);
+    assert_true(fabsf(left[CONCEAL_XFADE] - 0.4f) < 1e-6f);
+
+    /* Fully rendered from here on: nothing more to blend */
+    conceal_record(c, out, 2, PERIOD);
+    assert_false(conceal_resume(c, out, 2, PERIOD, false));
+    conceal_destroy(c);
+}
+
+static void test_resume_after_gap_fades_in(void **state) {
+    (void)state;
+    conceal_t *c = conceal_create();
+
+    for (int i = 0; i < PERIOD; i++) {
+        left[i] = right[i] = 0.8f;
+    }
+    assert_true(conceal_resume(c, out, 2, PERIOD, true));
+    assert_true(left[0] == 0.0f);
+    assert_true(left[CONCEAL_XFADE / 2] < 0.8f);
+    assert_true(left[CONCEAL_XFADE] == 0.8f);
+    conceal_destroy(c);
+}
+
+static void test_fill_without_history_is_silent(void **state) {
+    (void)state;
+    conceal_t *c = conceal_create();
+
+    for (int i = 0; i < PERIOD; i++) {
+        left[i] = right[i] = 1.0f;
+    }
+    conceal_fill(c, out, 2, 0, PERIOD);
+    assert_true(peak(0, PERIOD) == 0.0f);
+
+    /* A mono buffer set and NULL pointers are tolerated */
+    float *mono[1] = { left };
+    conceal_record(c, mono, 1, PERIOD);
+    conceal_fill(c, mono, 1, 10, PERIOD);
+    conceal_fill(NULL, out, 2, 0, PERIOD);
+    conceal_destroy(c);
+    conceal_destroy(NULL);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_fill_continues_without_step),
+        cmocka_unit_test(test_late_periods_fade_away),
+        cmocka_unit_test(test_resume_ramps_out_step),
+        cmocka_unit_test(test_resume_after_gap_fades_in),
+        cmocka_unit_test(test_fill_without_history_is_silent),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
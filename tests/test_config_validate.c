@@ -0,0 +1,114 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "config.h"
+
+/*
+ * config_validate() against the real configuration module: values it
+ * corrects and entries it drops. A readable file stands in for the
+ * soundfont so validation does not stop at the critical check.
+ */
+
+static void valid_config(midisynthd_config_t *cfg) {
+    config_init_defaults(cfg);
+    strncpy(cfg->soundfonts[0].path, "/dev/null", CONFIG_MAX_PATH_LEN - 1);
+    cfg->soundfonts[0].enabled = true;
+    cfg->soundfont_count = 1;
+}
+
+static void test_defaults_need_no_fixes(void **state) {
+    (void)state;
+    midisynthd_config_t cfg;
+    valid_config(&cfg);
+    assert_int_equal(config_validate(&cfg), 0);
+}
+
+static void test_invalid_routes_dropped(void **state) {
+    (void)state;
+    midisynthd_config_t cfg;
+    valid_config(&cfg);
+
+    const char *rules[] = { "channel 1 10", "channel 0 10", "transpose 2 12", "frobnicate all 1" };
+    for (size_t i = 0; i < sizeof(rules) / sizeof(rules[0]); i++) {
+        strncpy(cfg.routes[i], rules[i], CONFIG_MAX_STRING_LEN - 1);
+    }
+    cfg.route_count = 4;
+
+    assert_int_equal(config_validate(&cfg), 2);
+    assert_int_equal(cfg.route_count, 2);
+    assert_string_equal(cfg.routes[0], "channel 1 10");
+    assert_string_equal(cfg.routes[1], "transpose 2 12");
+}
+
+static void test_route_lines_from_file(void **state) {
+    (void)state;
+    midisynthd_config_t cfg;
+    valid_config(&cfg);
+
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/midisynthd_routes_%d.conf", (int)getpid());
+    FILE *f = fopen(path, "w");
+    assert_non_null(f);
+    fprintf(f, "route=drop 10 note\nroute=velocity 1 fixed 0\n");
+    fclose(f);
+    assert_int_equal(config_load_file(&cfg, path), 0);
+    unlink(path);
+
+    assert_int_equal(cfg.route_count, 2);
+    assert_int_equal(config_validate(&cfg), 1);
+    assert_int_equal(cfg.route_count, 1);
+    assert_string_equal(cfg.routes[0], "drop 10 note");
+}
+
+static void test_stdin_pipe_rejected_when_daemonized(void **state) {
+    (void)state;
+    midisynthd_config_t cfg;
+    valid_config(&cfg);
+    cfg.midi_driver = MIDI_DRIVER_PIPE;
+    assert_int_equal(config_validate(&cfg), 0);
+
+    cfg.daemonize = true;
+    assert_int_equal(config_validate(&cfg), -1);
+    strcpy(cfg.midi_input, "-");
+    assert_int_equal(config_validate(&cfg), -1);
+
+    strncpy(cfg.midi_input, "/run/midisynthd/midi", CONFIG_MAX_PATH_LEN - 1);
+    assert_int_equal(config_validate(&cfg), 0);
+}
+
+static void test_playback_block_rounded(void **state) {
+    (void)state;
+    midisynthd_config_t cfg;
+    valid_config(&cfg);
+    cfg.buffer_size = 256;
+    cfg.playback_block = 1000;
+    assert_int_equal(config_validate(&cfg), 1);
+    assert_int_equal(cfg.playback_block, 1024);
+
+    /* Never shorter than one live period */
+    cfg.buffer_size = 512;
+    cfg.playback_block = 256;
+    assert_int_equal(config_validate(&cfg), 1);
+    assert_int_equal(cfg.playback_block, 512);
+
+    cfg.buffer_size = 200;
+    cfg.playback_block = 64;
+    assert_int_equal(config_validate(&cfg), 1);
+    assert_int_equal(cfg.playback_block, 256);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_defaults_need_no_fixes),
+        cmocka_unit_test(test_invalid_routes_dropped),
+        cmocka_unit_test(test_route_lines_from_file),
+        cmocka_unit_test(test_stdin_pipe_rejected_when_daemonized),
+        cmocka_unit_test(test_playback_block_rounded),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
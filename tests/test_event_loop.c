@@ -0,0 +1,171 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+
+#include "event_loop.h"
+
+typedef struct {
+    event_loop_t *loop;
+    int calls;
+    uint32_t events;
+    char buf[64];
+    size_t len;
+    bool remove_self;
+} reader_t;
+
+static void on_readable(void *data, int fd, uint32_t events) {
+    reader_t *r = data;
+    r->calls++;
+    r->events |= events;
+    ssize_t n = read(fd, r->buf + r->len, sizeof(r->buf) - r->len);
+    if (n > 0) r->len += (size_t)n;
+    if (r->remove_self) event_loop_remove_fd(r->loop, fd);
+}
+
+/* Run the loop until @p r has been called @p calls times or we give up */
+static void run_until(event_loop_t *loop, reader_t *r, int calls) {
+    for (int i = 0; i < 20 && r->calls < calls; i++) {
+        assert_true(event_loop_run_once(loop, 50) >= 0);
+    }
+}
+
+static void test_create(void **state) {
+    (void)state;
+    event_loop_t *loop = event_loop_create();
+    assert_non_null(loop);
+    const char *backend = event_loop_backend(loop);
+    assert_true(strcmp(backend, "io_uring") == 0 || strcmp(backend, "epoll") == 0);
+
+    /* Nothing watched: times out without dispatching */
+    assert_int_equal(event_loop_run_once(loop, 10), 0);
+    assert_int_equal(event_loop_run_once(loop, 0), 0);
+    event_loop_destroy(loop);
+    event_loop_destroy(NULL);
+}
+
+static void test_readable(void **state) {
+    (void)state;
+    event_loop_t *loop = event_loop_create();
+    int fds[2];
+    assert_int_equal(pipe(fds), 0);
+
+    reader_t r = { .loop = loop };
+    assert_int_equal(event_loop_add_fd(loop, fds[0], on_readable, &r), 0);
+    assert_int_equal(event_loop_add_fd(loop, fds[0], on_readable, &r), -1);
+
+    assert_int_equal(write(fds[1], "abc", 3), 3);
+    run_until(loop, &r, 1);
+    assert_int_equal(r.calls, 1);
+    assert_true(r.events & POLLIN);
+
+    /* Watch is re-armed after dispatch */
+    assert_int_equal(write(fds[1], "de", 2), 2);
+    run_until(loop, &r, 2);
+    assert_int_equal(r.calls, 2);
+    assert_int_equal(r.len, 5);
+    assert_memory_equal(r.buf, "abcde", 5);
+
+    assert_int_equal(event_loop_remove_fd(loop, fds[0]), 0);
+    assert_int_equal(event_loop_remove_fd(loop, fds[0]), -1);
+    assert_int_equal(write(fds[1], "f", 1), 1);
+    for (int i = 0; i < 3; i++) event_loop_run_once(loop, 10);
+    assert_int_equal(r.calls, 2);
+
+    event_loop_destroy(loop);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+static void test_remove_from_callback(void **state) {
+    (void)state;
+    event_loop_t *loop = event_loop_create();
+    int fds[2];
+    assert_int_equal(pipe(fds), 0);
+
+    reader_t r = { .loop = loop, .remove_self = true };
+    assert_int_equal(event_loop_add_fd(loop, fds[0], on_readable, &r), 0);
+    assert_int_equal(write(fds[1], "x", 1), 1);
+    run_until(loop, &r, 1);
+    assert_int_equal(r.calls, 1);
+
+    assert_int_equal(write(fds[1], "y", 1), 1);
+    for (int i = 0; i < 3; i++) event_loop_run_once(loop, 10);
+    assert_int_equal(r.calls, 1);
+
+    /* The descriptor can be watched again */
+    r.remove_self = false;
+    assert_int_equal(event_loop_add_fd(loop, fds[0], on_readable, &r), 0);
+    run_until(loop, &r, 2);
+    assert_int_equal(r.calls, 2);
+
+    event_loop_destroy(loop);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+static void test_hangup(void **state) {
+    (void)state;
+    event_loop_t *loop = event_loop_create();
+    int fds[2];
+    assert_int_equal(pipe(fds), 0);
+
+    reader_t r = { .loop = loop, .remove_self = true };
+    assert_int_equal(event_loop_add_fd(loop, fds[0], on_readable, &r), 0);
+    close(fds[1]);
+    run_until(loop, &r, 1);
+    assert_int_equal(r.calls, 1);
+    assert_true(r.events & POLLHUP);
+
+    event_loop_destroy(loop);
+    close(fds[0]);
+}
+
+static void test_positioned_writes(void **state) {
+    (void)state;
+    event_loop_t *loop = event_loop_create();
+    char path[] = "/tmp/test_event_loop_XXXXXX";
+    int fd = mkstemp(path);
+    assert_true(fd >= 0);
+
+    /* Larger than one write slot, so it is split */
+    size_t big_len = EVENT_LOOP_WRITE_SLOT_SIZE * 2 + 100;
+    uint8_t *big = malloc(big_len);
+    assert_non_null(big);
+    for (size_t i = 0; i < big_len; i++) big[i] = (uint8_t)(i * 7);
+
+    assert_int_equal(event_loop_write(loop, fd, "tail", 4, (off_t)big_len), 0);
+    assert_int_equal(event_loop_write(loop, fd, big, big_len, 0), 0);
+    assert_int_equal(event_loop_write(loop, fd, "x", 1, -1), -1);
+    assert_int_equal(event_loop_flush(loop), 0);
+
+    uint8_t *check = malloc(big_len + 4);
+    assert_non_null(check);
+    assert_int_equal(pread(fd, check, big_len + 4, 0), (ssize_t)(big_len + 4));
+    assert_memory_equal(check, big, big_len);
+    assert_memory_equal(check + big_len, "tail", 4);
+
+    free(check);
+    free(big);
+    event_loop_destroy(loop);
+    close(fd);
+    unlink(path);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_create),
+        cmocka_unit_test(test_readable),
+        cmocka_unit_test(test_remove_from_callback),
+        cmocka_unit_test(test_hangup),
+        cmocka_unit_test(test_positioned_writes),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
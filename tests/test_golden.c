@@ -0,0 +1,560 @@
+#define _GNU_SOURCE
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/syscall.h>
+
+#include "config.h"
+#include "synth.h"
+#include "test_soundfont.h"
+
+/*
+ * Golden-output regression tests.
+ *
+ * Fixed MIDI fixtures are rendered offline through the real engine with a
+ * soundfont generated on the fly, then compared against references stored
+ * in tests/golden/. A matching FNV-1a hash of the float output proves the
+ * render is bit-exact; otherwise the output must stay within
+ * GOLDEN_MIN_SNR_DB of the 16-bit reference, which tolerates FluidSynth
+ * builds that round differently.
+ *
+ * Set MIDISYNTHD_GOLDEN_UPDATE=1 to (re)write the references after an
+ * intentional change in the sound. A fixture without a reference fails,
+ * so a lost reference cannot turn the comparison off.
+ */
+
+#ifndef GOLDEN_DIR
+#define GOLDEN_DIR "golden"
+#endif
+
+#define GOLDEN_SAMPLE_RATE   22050
+#define GOLDEN_BLOCK         64
+#define GOLDEN_MIN_SNR_DB    60.0
+/* Added to the render thread's clock on every read in a slowed render,
+ * more than a GOLDEN_BLOCK period each time */
+#define GOLDEN_SLOW_STEP_NS  5000000ULL
+
+typedef struct {
+    int frame;
+    uint8_t status;
+    uint8_t data1;
+    uint8_t data2;
+} golden_event_t;
+
+typedef struct {
+    const char *name;
+    int frames;
+    bool effects;
+    const golden_event_t *events;
+    int event_count;
+} golden_fixture_t;
+
+static const golden_event_t single_note[] = {
+    { 0,     0x90, 69, 100 },
+    { 5512,  0x80, 69, 0 },
+};
+
+static const golden_event_t sustained_chord[] = {
+    { 0,     0xB0, 64, 127 },
+    { 0,     0x90, 60, 90 },
+    { 700,   0x90, 64, 80 },
+    { 1400,  0x90, 67, 70 },
+    { 2000,  0x80, 60, 0 },
+    { 2000,  0x80, 64, 0 },
+    { 2000,  0x80, 67, 0 },
+    { 6000,  0xB0, 64, 0 },
+};
+
+static const golden_event_t controllers[] = {
+    { 0,     0xB0, 7, 100 },
+    { 0,     0xB0, 10, 0 },
+    { 0,     0x90, 57, 110 },
+    { 1000,  0xE0, 0x00, 0x50 },
+    { 2000,  0xB0, 10, 127 },
+    { 3000,  0xB0, 11, 40 },
+    { 4000,  0xE0, 0x00, 0x40 },
+    { 6000,  0x80, 57, 0 },
+};
+
+static const golden_event_t multichannel[] = {
+    { 0,     0xC1, 0, 0 },
+    { 0,     0x91, 48, 100 },
+    { 0,     0x99, 36, 127 },
+    { 2756,  0x99, 38, 100 },
+    { 2756,  0x92, 72, 60 },
+    { 5512,  0x99, 42, 90 },
+    { 6000,  0x81, 48, 0 },
+    { 7000,  0x82, 72, 0 },
+};
+
+#define FIXTURE(n, frames, fx) { #n, frames, fx, n, (int)(sizeof(n) / sizeof(n[0])) }
+
+static const golden_fixture_t fixtures[] = {
+    FIXTURE(single_note, 11025, false),
+    FIXTURE(sustained_chord, 11025, true),
+    FIXTURE(controllers, 11025, false),
+    FIXTURE(multichannel, 11025, true),
+};
+
+static char sf_path[256];
+
+/* --- WAV helpers --------------------------------------------------------- */
+
+static void put16(FILE *f, uint16_t v) {
+    fputc(v & 0xFF, f);
+    fputc(v >> 8, f);
+}
+
+static void put32(FILE *f, uint32_t v) {
+    put16(f, (uint16_t)(v & 0xFFFF));
+    put16(f, (uint16_t)(v >> 16));
+}
+
+static void put_chunk_header(FILE *f, const char *id, uint32_t size) {
+    fwrite(id, 1, 4, f);
+    put32(f, size);
+}
+
+/* --- Render thread clock ------------------------------------------------- */
+
+/*
+ * Monotonic clock reads made by the render thread land here instead of in
+ * libc. A closed gate holds the thread before its first period until the
+ * test has queued its events, and a slowed clock makes every period it
+ * times look later than its deadline.
+ */
+static volatile int clock_gate = 1;
+static volatile int clock_slow;
+static uint64_t clock_skew_ns;
+
+static bool on_render_thread(void) {
+    char name[16];
+    return pthread_getname_np(pthread_self(), name, sizeof(name)) == 0 && strcmp(name, "msd-audio") == 0;
+}
+
+int clock_gettime(clockid_t clock, struct timespec *ts) {
+    bool render = clock == CLOCK_MONOTONIC && on_render_thread();
+    while (render && !__atomic_load_n(&clock_gate, __ATOMIC_ACQUIRE)) {
+        sched_yield();
+    }
+    int ret = (int)syscall(SYS_clock_gettime, clock, ts);
+    if (ret == 0 && render && clock_slow) {
+        uint64_t ns = (uint64_t)ts->tv_sec * 1000000000ULL + (uint64_t)ts->tv_nsec +
+                      __atomic_add_fetch(&clock_skew_ns, GOLDEN_SLOW_STEP_NS, __ATOMIC_RELAXED);
+        ts->tv_sec = (time_t)(ns / 1000000000ULL);
+        ts->tv_nsec = (long)(ns % 1000000000ULL);
+    }
+    return ret;
+}
+
+/* --- Rendering ----------------------------------------------------------- */
+
+/**
+ * Render a fixture; events are applied at the start of their block
+ */
+static float *render_fixture(const golden_fixture_t *fx) {
+    midisynthd_config_t cfg;
+    config_init_defaults(&cfg);
+    cfg.audio_driver = AUDIO_DRIVER_OFFLINE;
+    cfg.sample_rate = GOLDEN_SAMPLE_RATE;
+    cfg.buffer_size = GOLDEN_BLOCK;
+    cfg.realtime_priority = false;
+    cfg.chorus_enabled = fx->effects;
+    cfg.reverb_enabled = fx->effects;
+    strncpy(cfg.soundfonts[0].path, sf_path, CONFIG_MAX_PATH_LEN - 1);
+    cfg.soundfonts[0].enabled = true;
+    cfg.soundfont_count = 1;
+
+    synth_t *synth = synth_init(&cfg, NULL);
+    if (!synth) return NULL;
+
+    float *out = calloc((size_t)fx->frames * 2, sizeof(float));
+    float left[GOLDEN_BLOCK], right[GOLDEN_BLOCK];
+    int next = 0;
+
+    for (int pos = 0; out && pos < fx->frames; pos += GOLDEN_BLOCK) {
+        while (next < fx->event_count && fx->events[next].frame < pos + GOLDEN_BLOCK) {
+            const golden_event_t *ev = &fx->events[next++];
+            uint8_t msg[3] = { ev->status, ev->data1, ev->data2 };
+            size_t len = (ev->status & 0xF0) == 0xC0 || (ev->status & 0xF0) == 0xD0 ? 2 : 3;
+            synth_process_midi_data(synth, msg, len);
+        }
+
+        int n = fx->frames - pos < GOLDEN_BLOCK ? fx->frames - pos : GOLDEN_BLOCK;
+        if (synth_render(synth, n, left, right) < 0) {
+            free(out);
+            out = NULL;
+            break;
+        }
+        for (int i = 0; i < n; i++) {
+            out[2 * (pos + i)] = left[i];
+            out[2 * (pos + i) + 1] = right[i];
+        }
+    }
+
+    synth_cleanup(synth);
+    return out;
+}
+
+/**
+ * Render a fixture through the freewheel null driver and read back its file
+ *
+ * Events are scheduled at the start of their block before the render
+ * thread's first period, so the render does not depend on timing.
+ */
+static float *render_freewheel(const golden_fixture_t *fx, bool slow, synth_render_stats_t *stats) {
+    midisynthd_config_t cfg;
+    config_init_defaults(&cfg);
+    cfg.audio_driver = AUDIO_DRIVER_FREEWHEEL;
+    cfg.sample_rate = GOLDEN_SAMPLE_RATE;
+    cfg.buffer_size = GOLDEN_BLOCK;
+    cfg.realtime_priority = false;
+    cfg.chorus_enabled = fx->effects;
+    cfg.reverb_enabled = fx->effects;
+    snprintf(cfg.audio_file, sizeof(cfg.audio_file), "/tmp/midisynthd_freewheel_%d.wav", (int)getpid());
+    strncpy(cfg.soundfonts[0].path, sf_path, CONFIG_MAX_PATH_LEN - 1);
+    cfg.soundfonts[0].enabled = true;
+    cfg.soundfont_count = 1;
+
+    __atomic_store_n(&clock_skew_ns, 0, __ATOMIC_RELAXED);
+    clock_slow = slow;
+    __atomic_store_n(&clock_gate, 0, __ATOMIC_RELEASE);
+    synth_t *synth = synth_init(&cfg, NULL);
+    if (!synth) {
+        __atomic_store_n(&clock_gate, 1, __ATOMIC_RELEASE);
+        return NULL;
+    }
+    for (int i = 0; i < fx->event_count; i++) {
+        const golden_event_t *ev = &fx->events[i];
+        uint8_t msg[3] = { ev->status, ev->data1, ev->data2 };
+        size_t len = (ev->status & 0xF0) == 0xC0 || (ev->status & 0xF0) == 0xD0 ? 2 : 3;
+        synth_schedule_midi(synth, (uint64_t)(ev->frame / GOLDEN_BLOCK * GOLDEN_BLOCK), msg, len);
+    }
+    __atomic_store_n(&clock_gate, 1, __ATOMIC_RELEASE);
+
+    uint64_t periods = (uint64_t)(fx->frames + GOLDEN_BLOCK - 1) / GOLDEN_BLOCK;
+    while (synth_get_render_stats(synth, stats) == 0 && stats->periods + stats->freewheel_periods < periods) {
+        usleep(1000);
+    }
+    synth_cleanup(synth);
+    clock_slow = 0;
+
+    float *out = calloc((size_t)fx->frames * 2, sizeof(float));
+    FILE *f = fopen(cfg.audio_file, "rb");
+    if (!out || !f || fseek(f, 44, SEEK_SET) != 0 ||
+        fread(out, sizeof(float), (size_t)fx->frames * 2, f) != (size_t)fx->frames * 2) {
+        free(out);
+        out = NULL;
+    }
+    if (f) fclose(f);
+    unlink(cfg.audio_file);
+    return out;
+}
+
+static uint64_t fnv1a(const float *data, size_t count) {
+    const uint8_t *p = (const uint8_t *)data;
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < count * sizeof(float); i++) {
+        h ^= p[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+static int16_t to_pcm16(float v) {
+    if (v > 1.0f) v = 1.0f;
+    if (v < -1.0f) v = -1.0f;
+    return (int16_t)lrintf(v * 32767.0f);
+}
+
+/* --- Reference files ----------------------------------------------------- */
+
+static void ref_path(char *buf, size_t size, const char *name, const char *ext) {
+    snprintf(buf, size, "%s/%s.%s", GOLDEN_DIR, name, ext);
+}
+
+static int write_reference(const golden_fixture_t *fx, const float *out) {
+    char path[512];
+    ref_path(path, sizeof(path), fx->name, "wav");
+    FILE *f = fopen(path, "wb");
+    if (!f) return -1;
+
+    uint32_t data_size = (uint32_t)fx->frames * 2 * sizeof(int16_t);
+    put_chunk_header(f, "RIFF", 36 + data_size);
+    fwrite("WAVE", 1, 4, f);
+    put_chunk_header(f, "fmt ", 16);
+    put16(f, 1);
+    put16(f, 2);
+    put32(f, GOLDEN_SAMPLE_RATE);
+    put32(f, GOLDEN_SAMPLE_RATE * 4);
+    put16(f, 4);
+    put16(f, 16);
+    put_chunk_header(f, "data", data_size);
+    for (int i = 0; i < fx->frames * 2; i++) {
+        put16(f, (uint16_t)to_pcm16(out[i]));
+    }
+    if (fclose(f) != 0) return -1;
+
+    ref_path(path, sizeof(path), fx->name, "hash");
+    f = fopen(path, "w");
+    if (!f) return -1;
+    fprintf(f, "%016llx\n", (unsigned long long)fnv1a(out, (size_t)fx->frames * 2));
+    return fclose(f) == 0 ? 0 : -1;
+}
+
+/**
+ * Load the 16-bit reference; returns NULL when it does not exist
+ */
+static int16_t *read_reference(const golden_fixture_t *fx, uint64_t *hash) {
+    char path[512];
+    ref_path(path, sizeof(path), fx->name, "hash");
+    FILE *f = fopen(path, "r");
+    if (!f) return NULL;
+    unsigned long long h = 0;
+    int ok = fscanf(f, "%llx", &h) == 1;
+    fclose(f);
+    if (!ok) return NULL;
+    *hash = h;
+
+    ref_path(path, sizeof(path), fx->name, "wav");
+    f = fopen(path, "rb");
+    if (!f) return NULL;
+
+    size_t count = (size_t)fx->frames * 2;
+    int16_t *pcm = calloc(count, sizeof(int16_t));
+    uint8_t raw[2];
+    if (pcm && fseek(f, 44, SEEK_SET) == 0) {
+        for (size_t i = 0; i < count; i++) {
+            if (fread(raw, 1, 2, f) != 2) {
+                free(pcm);
+                pcm = NULL;
+                break;
+            }
+            pcm[i] = (int16_t)(raw[0] | (raw[1] << 8));
+        }
+    }
+    fclose(f);
+    return pcm;
+}
+
+/* --- Tests --------------------------------------------------------------- */
+
+static int setup(void **state) {
+    (void)state;
+    snprintf(sf_path, sizeof(sf_path), "/tmp/midisynthd_golden_%d.sf2", (int)getpid());
+    return test_soundfont_write(sf_path);
+}
+
+static int teardown(void **state) {
+    (void)state;
+    unlink(sf_path);
+    return 0;
+}
+
+static void check_fixture(const golden_fixture_t *fx) {
+    float *out = render_fixture(fx);
+    assert_non_null(out);
+
+    size_t count = (size_t)fx->frames * 2;
+    double energy = 0.0;
+    for (size_t i = 0; i < count; i++) {
+        energy += (double)out[i] * out[i];
+    }
+    assert_true(energy > 0.0);
+
+    const char *update = getenv("MIDISYNTHD_GOLDEN_UPDATE");
+    if (update && strcmp(update, "1") == 0) {
+        assert_int_equal(write_reference(fx, out), 0);
+        free(out);
+        return;
+    }
+
+    uint64_t ref_hash = 0;
+    int16_t *ref = read_reference(fx, &ref_hash);
+    if (!ref) {
+        printf("%s: no reference in %s, run with MIDISYNTHD_GOLDEN_UPDATE=1\n", fx->name, GOLDEN_DIR);
+        free(out);
+        fail();
+    }
+
+    if (fnv1a(out, count) == ref_hash) {
+        free(ref);
+        free(out);
+        return;
+    }
+
+    /* Not bit-exact: compare against the 16-bit reference */
+    double signal = 0.0, noise = 0.0, max_err = 0.0;
+    for (size_t i = 0; i < count; i++) {
+        double r = ref[i] / 32767.0;
+        double e = fabs(r - (double)out[i]);
+        signal += r * r;
+        noise += e * e;
+        if (e > max_err) max_err = e;
+    }
+    double snr = noise > 0.0 ? 10.0 * log10(signal / noise) : INFINITY;
+    printf("%s: not bit-exact, SNR %.1f dB, max error %.6f\n", fx->name, snr, max_err);
+
+    free(ref);
+    free(out);
+    assert_true(snr >= GOLDEN_MIN_SNR_DB);
+}
+
+static void test_single_note(void **state) {
+    (void)state;
+    check_fixture(&fixtures[0]);
+}
+
+static void test_sustained_chord(void **state) {
+    (void)state;
+    check_fixture(&fixtures[1]);
+}
+
+static void test_controllers(void **state) {
+    (void)state;
+    check_fixture(&fixtures[2]);
+}
+
+static void test_multichannel(void **state) {
+    (void)state;
+    check_fixture(&fixtures[3]);
+}
+
+static void test_render_is_deterministic(void **state) {
+    (void)state;
+    float *a = render_fixture(&fixtures[3]);
+    float *b = render_fixture(&fixtures[3]);
+    assert_non_null(a);
+    assert_non_null(b);
+    assert_memory_equal(a, b, (size_t)fixtures[3].frames * 2 * sizeof(float));
+    free(a);
+    free(b);
+}
+
+static void test_freewheel_ignores_slow_periods(void **state) {
+    (void)state;
+    synth_render_stats_t fast_stats, slow_stats;
+    float *fast = render_freewheel(&fixtures[1], false, &fast_stats);
+    float *slow = render_freewheel(&fixtures[1], true, &slow_stats);
+    assert_non_null(fast);
+    assert_non_null(slow);
+
+    /* Periods timed far past their budget, yet nothing is concealed or shed */
+    assert_true(slow_stats.peak_load > 100.0);
+    assert_int_equal(slow_stats.concealed_periods, 0);
+    assert_int_equal(slow_stats.shed_periods, 0);
+    assert_memory_equal(fast, slow, (size_t)fixtures[1].frames * 2 * sizeof(float));
+    free(fast);
+    free(slow);
+}
+
+static void test_rejected_timed_events_are_counted(void **state) {
+    (void)state;
+    midisynthd_config_t cfg;
+    config_init_defaults(&cfg);
+    cfg.audio_driver = AUDIO_DRIVER_OFFLINE;
+    cfg.sample_rate = GOLDEN_SAMPLE_RATE;
+    cfg.buffer_size = GOLDEN_BLOCK;
+    cfg.realtime_priority = false;
+    strncpy(cfg.soundfonts[0].path, sf_path, CONFIG_MAX_PATH_LEN - 1);
+    cfg.soundfonts[0].enabled = true;
+    cfg.soundfont_count = 1;
+
+    synth_t *synth = synth_init(&cfg, NULL);
+    assert_non_null(synth);
+
+    /* Data bytes out of range pass the queue but not the engine */
+    const uint8_t bad[3] = { 0xB0, 7, 0xFF }, good[3] = { 0x90, 69, 100 };
+    assert_int_equal(synth_schedule_midi(synth, 0, bad, sizeof(bad)), 0);
+    assert_int_equal(synth_schedule_midi(synth, 0, good, sizeof(good)), 0);
+    float left[GOLDEN_BLOCK], right[GOLDEN_BLOCK];
+    assert_int_equal(synth_render(synth, GOLDEN_BLOCK, left, right), 0);
+
+    synth_render_stats_t stats;
+    assert_int_equal(synth_get_render_stats(synth, &stats), 0);
+    assert_int_equal(stats.failed_events, 1);
+    synth_cleanup(synth);
+}
+
+/**
+ * Poll until @p done holds, for at most two seconds
+ */
+#define WAIT_FOR(done) \
+    for (int wait_ = 0; !(done) && wait_ < 2000; wait_++) usleep(1000)
+
+static void test_cached_percussion_is_metered(void **state) {
+    (void)state;
+    char oneshot[256];
+    snprintf(oneshot, sizeof(oneshot), "/tmp/midisynthd_oneshot_%d.sf2", (int)getpid());
+    assert_int_equal(test_soundfont_write_oneshot(oneshot), 0);
+
+    /* Per-channel outputs for the meters alongside the cache's side engine */
+    midisynthd_config_t cfg;
+    config_init_defaults(&cfg);
+    cfg.audio_driver = AUDIO_DRIVER_NULL;
+    cfg.sample_rate = GOLDEN_SAMPLE_RATE;
+    cfg.buffer_size = GOLDEN_BLOCK;
+    cfg.realtime_priority = false;
+    cfg.chorus_enabled = false;
+    cfg.reverb_enabled = false;
+    cfg.level_meters = true;
+    cfg.percussion_cache = 1;
+    strncpy(cfg.soundfonts[0].path, oneshot, CONFIG_MAX_PATH_LEN - 1);
+    cfg.soundfonts[0].enabled = true;
+    cfg.soundfont_count = 1;
+
+    synth_t *synth = synth_init(&cfg, NULL);
+    unlink(oneshot);
+    assert_non_null(synth);
+
+    /* The first note plays live while the side engine renders it */
+    const uint8_t on[3] = { 0x99, 69, 127 }, off[3] = { 0x89, 69, 0 };
+    perc_cache_stats_t perc;
+    synth_status_t status;
+    synth_process_midi_data(synth, on, sizeof(on));
+    synth_process_midi_data(synth, off, sizeof(off));
+    WAIT_FOR(synth_get_percussion_stats(synth, &perc) == 0 && perc.renders > 0);
+    WAIT_FOR(synth_get_status(synth, &status) == 0 && status.active_voices == 0);
+    assert_int_equal(perc.uncacheable, 0);
+    assert_int_equal(status.active_voices, 0);
+
+    /* The second is mixed from the cache and must reach channel 10's meter */
+    synth_process_midi_data(synth, on, sizeof(on));
+    float peak = 0.0f;
+    for (int i = 0; i < 200; i++) {
+        if (synth_get_status(synth, &status) == 0 && status.levels.channels[9].peak > peak) {
+            peak = status.levels.channels[9].peak;
+        }
+        usleep(1000);
+    }
+    assert_int_equal(synth_get_percussion_stats(synth, &perc), 0);
+    synth_cleanup(synth);
+
+    assert_int_equal(perc.hits, 1);
+    assert_true(status.levels.channel_levels);
+    assert_true(peak > 0.01f);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_single_note),
+        cmocka_unit_test(test_sustained_chord),
+        cmocka_unit_test(test_controllers),
+        cmocka_unit_test(test_multichannel),
+        cmocka_unit_test(test_render_is_deterministic),
+        cmocka_unit_test(test_freewheel_ignores_slow_periods),
+        cmocka_unit_test(test_rejected_timed_events_are_counted),
+        cmocka_unit_test(test_cached_percussion_is_metered),
+    };
+    return cmocka_run_group_tests(tests, setup, teardown);
+}
@@ -0,0 +1,165 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "config.h"
+#include "synth.h"
+#include "event_loop.h"
+#include "lazy_start.h"
+#include "monotonic.h"
+
+extern bool stub_active;
+extern int stub_activate_count;
+extern int stub_activate_result;
+extern int stub_deactivate_count;
+extern int stub_wakeup_fd;
+extern uint64_t stub_last_input_ns;
+extern int stub_active_voices;
+
+static event_loop_t *loop;
+static synth_t *synth;
+static midisynthd_config_t cfg;
+
+static int setup(void **state) {
+    (void)state;
+    loop = event_loop_create();
+    synth = synth_init(&cfg, NULL);
+    stub_wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    return loop && synth && stub_wakeup_fd >= 0 ? 0 : -1;
+}
+
+static int teardown(void **state) {
+    (void)state;
+    close(stub_wakeup_fd);
+    synth_cleanup(synth);
+    event_loop_destroy(loop);
+    return 0;
+}
+
+static lazy_start_t *create_lazy(int idle_timeout) {
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.lazy_start = true;
+    cfg.idle_timeout = idle_timeout;
+    stub_active = false;
+    stub_activate_count = 0;
+    stub_activate_result = 0;
+    stub_deactivate_count = 0;
+    stub_last_input_ns = 0;
+    stub_active_voices = 0;
+    lazy_start_t *lazy = lazy_start_create(&cfg, synth, loop);
+    assert_non_null(lazy);
+    return lazy;
+}
+
+static void test_lazy_start_requires_lazy_synth(void **state) {
+    (void)state;
+    memset(&cfg, 0, sizeof(cfg));
+    assert_null(lazy_start_create(&cfg, synth, loop));
+
+    cfg.lazy_start = true;
+    int fd = stub_wakeup_fd;
+    stub_wakeup_fd = -1;
+    assert_null(lazy_start_create(&cfg, synth, loop));
+    stub_wakeup_fd = fd;
+}
+
+static void test_lazy_start_activates_on_wakeup(void **state) {
+    (void)state;
+    lazy_start_t *lazy = create_lazy(60);
+    assert_false(synth_is_active(synth));
+
+    /* Nothing pending: the loop times out without starting the engine */
+    assert_int_equal(event_loop_run_once(loop, 0), 0);
+    assert_int_equal(stub_activate_count, 0);
+
+    uint64_t one = 1;
+    assert_int_equal(write(stub_wakeup_fd, &one, sizeof(one)), sizeof(one));
+    assert_true(event_loop_run_once(loop, 100) > 0);
+    assert_int_equal(stub_activate_count, 1);
+    assert_true(synth_is_active(synth));
+
+    /* A second request while running does not start it again */
+    assert_int_equal(lazy_start_activate(lazy), 0);
+    assert_int_equal(stub_activate_count, 1);
+
+    lazy_start_stats_t stats;
+    assert_int_equal(lazy_start_get_stats(lazy, &stats), 0);
+    assert_int_equal(stats.activations, 1);
+    assert_int_equal(stats.failures, 0);
+    assert_true(stats.activation_ns_max >= stats.activation_ns_last);
+    lazy_start_cleanup(lazy);
+}
+
+static void test_lazy_start_counts_failures(void **state) {
+    (void)state;
+    lazy_start_t *lazy = create_lazy(60);
+    stub_activate_result = -1;
+    assert_int_equal(lazy_start_activate(lazy), -1);
+    assert_false(synth_is_active(synth));
+
+    /* The next input retries */
+    stub_activate_result = 0;
+    assert_int_equal(lazy_start_activate(lazy), 0);
+
+    lazy_start_stats_t stats;
+    lazy_start_get_stats(lazy, &stats);
+    assert_int_equal(stats.failures, 1);
+    assert_int_equal(stats.activations, 1);
+    lazy_start_cleanup(lazy);
+}
+
+static void test_lazy_start_idle_timeout(void **state) {
+    (void)state;
+    lazy_start_t *lazy = create_lazy(5);
+    assert_int_equal(lazy_start_activate(lazy), 0);
+
+    /* Recent input keeps the engine loaded */
+    stub_last_input_ns = monotonic_ns();
+    assert_int_equal(lazy_start_check(lazy), 0);
+
+    /* So do voices still sounding after the timeout */
+    stub_last_input_ns = monotonic_ns() - 6000000000ULL;
+    stub_active_voices = 3;
+    assert_int_equal(lazy_start_check(lazy), 0);
+    assert_true(synth_is_active(synth));
+
+    stub_active_voices = 0;
+    assert_int_equal(lazy_start_check(lazy), 1);
+    assert_false(synth_is_active(synth));
+    assert_int_equal(stub_deactivate_count, 1);
+
+    /* Already stopped */
+    assert_int_equal(lazy_start_check(lazy), 0);
+
+    lazy_start_stats_t stats;
+    lazy_start_get_stats(lazy, &stats);
+    assert_int_equal(stats.deactivations, 1);
+    lazy_start_cleanup(lazy);
+}
+
+static void test_lazy_start_zero_timeout_keeps_engine(void **state) {
+    (void)state;
+    lazy_start_t *lazy = create_lazy(0);
+    assert_int_equal(lazy_start_activate(lazy), 0);
+    stub_last_input_ns = 1;
+    assert_int_equal(lazy_start_check(lazy), 0);
+    assert_true(synth_is_active(synth));
+    assert_int_equal(stub_deactivate_count, 0);
+    lazy_start_cleanup(lazy);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_lazy_start_requires_lazy_synth),
+        cmocka_unit_test(test_lazy_start_activates_on_wakeup),
+        cmocka_unit_test(test_lazy_start_counts_failures),
+        cmocka_unit_test(test_lazy_start_idle_timeout),
+        cmocka_unit_test(test_lazy_start_zero_timeout_keeps_engine),
+    };
+    return cmocka_run_group_tests(tests, setup, teardown);
+}
@@ -0,0 +1,79 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "memstat.h"
+#include "test_soundfont.h"
+
+static void test_memstat_peaks(void **state) {
+    (void)state;
+    memstat_t before, stats;
+    memstat_get(&before);
+
+    memstat_add(MEMSTAT_QUEUES, 4096);
+    memstat_add(MEMSTAT_VOICES, 1000);
+    memstat_sub(MEMSTAT_QUEUES, 4096);
+    memstat_get(&stats);
+
+    /* Released memory leaves its peak behind */
+    assert_int_equal(stats.current[MEMSTAT_QUEUES], before.current[MEMSTAT_QUEUES]);
+    assert_true(stats.peak[MEMSTAT_QUEUES] >= before.current[MEMSTAT_QUEUES] + 4096);
+    assert_int_equal(stats.current[MEMSTAT_VOICES], before.current[MEMSTAT_VOICES] + 1000);
+    assert_int_equal(stats.total, before.total + 1000);
+    assert_true(stats.total_peak >= before.total + 5096);
+    assert_true(stats.rss > 0);
+    assert_true(stats.rss_peak >= stats.rss);
+
+    memstat_sub(MEMSTAT_VOICES, 1000);
+    assert_string_equal(memstat_category_name(MEMSTAT_SAMPLES), "samples");
+}
+
+static void test_memstat_sf2_estimate(void **state) {
+    (void)state;
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/midisynthd_memstat_%d.sf2", (int)getpid());
+    assert_int_equal(test_soundfont_write(path), 0);
+
+    memstat_sf2_t est;
+    assert_int_equal(memstat_sf2_estimate(path, &est), 0);
+    unlink(path);
+
+    /* 10000 frames plus 46 frames of padding, 16 bits each */
+    assert_int_equal(est.sample_bytes, (10000 + 46) * 2);
+    assert_int_equal(est.presets, 2);
+    assert_int_equal(est.instruments, 1);
+    assert_int_equal(est.zones, 3);
+    assert_int_equal(est.samples, 1);
+    assert_true(est.metadata_bytes > 0);
+
+    assert_int_equal(est.sm24_bytes, 0);
+    assert_int_equal(est.sm24_offset, 0);
+
+    /* The 24-bit extension adds one byte per frame */
+    assert_int_equal(test_soundfont_write_sm24(path), 0);
+    assert_int_equal(memstat_sf2_estimate(path, &est), 0);
+    assert_int_equal(est.sm24_bytes, 10000 + 46);
+    assert_int_equal(est.sample_bytes, (10000 + 46) * 3);
+    FILE *f = fopen(path, "rb");
+    assert_non_null(f);
+    char id[4];
+    assert_int_equal(fseek(f, est.sm24_offset, SEEK_SET), 0);
+    assert_int_equal(fread(id, 1, 4, f), 4);
+    fclose(f);
+    unlink(path);
+    assert_memory_equal(id, "sm24", 4);
+
+    assert_int_equal(memstat_sf2_estimate("/nonexistent.sf2", &est), -1);
+    assert_int_equal(memstat_sf2_estimate("/proc/self/status", &est), -1);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_memstat_peaks),
+        cmocka_unit_test(test_memstat_sf2_estimate),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
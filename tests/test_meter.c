@@ -0,0 +1,233 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "meter.h"
+
+#define RATE    8000
+#define WINDOW  (RATE / METER_RATE_HZ)
+
+static float buf_l[WINDOW], buf_r[WINDOW];
+
+static void fill_sine(float *buf, int frames, float amplitude) {
+    for (int i = 0; i < frames; i++) {
+        buf[i] = amplitude * sinf(2.0f * (float)M_PI * 100.0f * (float)i / RATE);
+    }
+}
+
+static void test_block_matches_scalar(void **state) {
+    (void)state;
+    float samples[203];
+    srand(7);
+    for (int i = 0; i < 203; i++) {
+        samples[i] = (float)rand() / RAND_MAX * 2.0f - 1.0f;
+    }
+    samples[150] = -1.5f;
+
+    /* Every length, so each vector and tail split is covered */
+    for (int n = 0; n <= 203; n++) {
+        float want_peak = 0.0f;
+        double want_sum = 0.0;
+        for (int i = 0; i < n; i++) {
+            if (fabsf(samples[i]) > want_peak) want_peak = fabsf(samples[i]);
+            want_sum += (double)samples[i] * samples[i];
+        }
+        float peak = 0.0f;
+        double sum = 0.0;
+        meter_block(samples, n, &peak, &sum);
+        assert_true(peak == want_peak);
+        assert_true(fabs(sum - want_sum) < 1e-4 * (want_sum + 1.0));
+    }
+}
+
+static void test_block_unaligned(void **state) {
+    (void)state;
+    float samples[40] = { 0 };
+    samples[20] = -0.75f;
+    float peak = 0.25f;
+    double sum = 1.0;
+    meter_block(samples + 3, 30, &peak, &sum);
+    assert_true(fabsf(peak - 0.75f) < 1e-6f);
+    assert_true(fabs(sum - (1.0 + 0.5625)) < 1e-6);
+}
+
+static void test_sine_levels(void **state) {
+    (void)state;
+    meter_t *meter = meter_create(RATE, true);
+    assert_non_null(meter);
+    fill_sine(buf_l, WINDOW, 0.5f);
+    fill_sine(buf_r, WINDOW, 0.25f);
+
+    meter_add_channel(meter, 2, buf_l, buf_l, WINDOW);
+    meter_add_master(meter, buf_l, buf_r, WINDOW);
+    meter_advance(meter, WINDOW);
+
+    meter_snapshot_t snap;
+    assert_int_equal(meter_get(meter, &snap), 0);
+    assert_int_equal(snap.windows, 1);
+    assert_true(snap.channel_levels);
+    assert_true(fabsf(snap.channels[2].peak - 0.5f) < 0.01f);
+    assert_true(fabsf(snap.channels[2].rms - 0.5f / sqrtf(2.0f)) < 0.01f);
+    assert_true(snap.channels[0].peak == 0.0f);
+    assert_true(fabsf(snap.master[0].rms - 0.5f / sqrtf(2.0f)) < 0.01f);
+    assert_true(fabsf(snap.master[1].peak - 0.25f) < 0.01f);
+    assert_true(fabsf(meter_to_db(snap.master[0].peak) - -6.02f) < 0.1f);
+    assert_int_equal(snap.clipped, 0);
+    meter_destroy(meter);
+}
+
+static void test_publishes_at_fixed_rate(void **state) {
+    (void)state;
+    meter_t *meter = meter_create(RATE, false);
+    meter_snapshot_t snap;
+    fill_sine(buf_l, WINDOW, 0.5f);
+
+    /* Periods shorter than a window: nothing until it is full */
+    for (int i = 0; i < 3; i++) {
+        meter_add_master(meter, buf_l, buf_l, WINDOW / 4);
+        meter_advance(meter, WINDOW / 4);
+    }
+    assert_int_equal(meter_get(meter, &snap), 0);
+    assert_int_equal(snap.windows, 0);
+    assert_true(snap.master[0].peak == 0.0f);
+
+    meter_add_master(meter, buf_l, buf_l, WINDOW / 4);
+    meter_advance(meter, WINDOW / 4);
+    meter_get(meter, &snap);
+    assert_int_equal(snap.windows, 1);
+    assert_true(snap.master[0].peak > 0.4f);
+
+    /* The next window starts empty: silence reads as the floor */
+    meter_advance(meter, WINDOW);
+    meter_get(meter, &snap);
+    assert_int_equal(snap.windows, 2);
+    assert_true(snap.master[0].peak == 0.0f);
+    assert_true(meter_to_db(snap.master[0].rms) == METER_FLOOR_DB);
+    assert_false(snap.channel_levels);
+    meter_destroy(meter);
+}
+
+static void test_clipping_counted(void **state) {
+    (void)state;
+    meter_t *meter = meter_create(RATE, false);
+    fill_sine(buf_l, WINDOW, 0.5f);
+    memset(buf_r, 0, sizeof(buf_r));
+    buf_r[10] = 1.0f;
+
+    meter_add_master(meter, buf_l, buf_r, WINDOW);
+    meter_advance(meter, WINDOW);
+    meter_add_master(meter, buf_l, buf_l, WINDOW);
+    meter_advance(meter, WINDOW);
+    meter_add_master(meter, buf_r, buf_l, WINDOW);
+    meter_advance(meter, WINDOW);
+
+    meter_snapshot_t snap;
+    meter_get(meter, &snap);
+    assert_int_equal(snap.windows, 3);
+    assert_int_equal(snap.clipped, 2);
+    meter_destroy(meter);
+}
+
+static void test_merge_channels(void **state) {
+    (void)state;
+    meter_snapshot_t a, b;
+    memset(&a, 0, sizeof(a));
+    memset(&b, 0, sizeof(b));
+    a.channel_levels = true;
+    a.channels[0] = (meter_level_t){ 0.5f, 0.3f };
+    a.master[0] = (meter_level_t){ 0.9f, 0.5f };
+    b.channels[0] = (meter_level_t){ 0.8f, 0.4f };
+    b.channels[5] = (meter_level_t){ 0.2f, 0.1f };
+
+    /* Without channel levels nothing is added */
+    meter_merge(&a, &b);
+    assert_true(a.channels[0].peak == 0.5f);
+
+    b.channel_levels = true;
+    meter_merge(&a, &b);
+    assert_true(a.channels[0].peak == 0.8f);
+    assert_true(fabsf(a.channels[0].rms - 0.5f) < 1e-6f);
+    assert_true(a.channels[5].peak == 0.2f);
+    assert_true(a.master[0].peak == 0.9f);
+}
+
+static meter_t *shared;
+static volatile int writing;
+
+static void *write_windows(void *arg) {
+    (void)arg;
+    float ramp[64];
+    for (int w = 1; w <= 2000; w++) {
+        for (int i = 0; i < 64; i++) ramp[i] = (float)w / 2000.0f;
+        meter_add_master(shared, ramp, ramp, 64);
+        meter_advance(shared, WINDOW);
+    }
+    writing = 0;
+    return NULL;
+}
+
+static void test_snapshot_consistent_across_threads(void **state) {
+    (void)state;
+    shared = meter_create(RATE, false);
+    writing = 1;
+    pthread_t thread;
+    assert_int_equal(pthread_create(&thread, NULL, write_windows, NULL), 0);
+
+    /* Both sides of a snapshot always come from the same window */
+    meter_snapshot_t snap;
+    while (writing) {
+        if (meter_get(shared, &snap) < 0) {
+            assert_int_equal(snap.windows, 0);
+            continue;
+        }
+        assert_true(snap.master[0].peak == snap.master[1].peak);
+        if (snap.windows > 0) {
+            assert_true(fabsf(snap.master[0].peak - (float)snap.windows / 2000.0f) < 1e-6f);
+        }
+    }
+    pthread_join(thread, NULL);
+    assert_int_equal(meter_get(shared, &snap), 0);
+    assert_int_equal(snap.windows, 2000);
+    meter_destroy(shared);
+}
+
+static void test_invalid_arguments(void **state) {
+    (void)state;
+    meter_snapshot_t snap;
+    assert_null(meter_create(0, false));
+    assert_int_equal(meter_get(NULL, &snap), -1);
+    meter_add_channel(NULL, 0, buf_l, buf_r, 10);
+    meter_add_master(NULL, buf_l, buf_r, 10);
+    meter_advance(NULL, 10);
+    meter_destroy(NULL);
+
+    meter_t *meter = meter_create(RATE, true);
+    fill_sine(buf_l, WINDOW, 0.5f);
+    meter_add_channel(meter, METER_CHANNELS, buf_l, buf_l, WINDOW);
+    meter_add_channel(meter, -1, buf_l, buf_l, WINDOW);
+    meter_advance(meter, WINDOW);
+    meter_get(meter, &snap);
+    for (int ch = 0; ch < METER_CHANNELS; ch++) {
+        assert_true(snap.channels[ch].peak == 0.0f);
+    }
+    meter_destroy(meter);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_block_matches_scalar),
+        cmocka_unit_test(test_block_unaligned),
+        cmocka_unit_test(test_sine_levels),
+        cmocka_unit_test(test_publishes_at_fixed_rate),
+        cmocka_unit_test(test_clipping_counted),
+        cmocka_unit_test(test_merge_channels),
+        cmocka_unit_test(test_snapshot_consistent_across_threads),
+        cmocka_unit_test(test_invalid_arguments),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
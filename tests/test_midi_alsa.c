@@ -0,0 +1,74 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <string.h>
+
+#include "config.h"
+#include "synth.h"
+#include "midi_alsa.h"
+
+extern fluid_settings_t *stub_fluid_settings;
+extern fluid_synth_t *stub_fluid_synth;
+extern int stub_midi_count;
+extern uint8_t stub_last_midi[3];
+extern int stub_fluid_handled;
+
+int fluid_stub_event(int type, int channel, int param1, int param2);
+
+static int dummy_handle;
+
+static midi_alsa_t *open_alsa(midisynthd_config_t *cfg, synth_t **synth) {
+    config_init_defaults(cfg);
+    stub_fluid_settings = (fluid_settings_t *)&dummy_handle;
+    stub_fluid_synth = (fluid_synth_t *)&dummy_handle;
+    *synth = synth_init(cfg, NULL);
+    assert_non_null(*synth);
+    midi_alsa_t *midi = midi_alsa_init(cfg, *synth);
+    assert_non_null(midi);
+    stub_midi_count = 0;
+    stub_fluid_handled = 0;
+    return midi;
+}
+
+static void test_alsa_channel_messages_through_synth(void **state) {
+    (void)state;
+    midisynthd_config_t cfg;
+    synth_t *synth;
+    midi_alsa_t *midi = open_alsa(&cfg, &synth);
+
+    /* Program changes reach the synth so preset loads are timed */
+    assert_int_equal(fluid_stub_event(0xC0, 3, 42, 0), FLUID_OK);
+    assert_int_equal(stub_midi_count, 1);
+    assert_int_equal(stub_last_midi[0], 0xC3);
+    assert_int_equal(stub_last_midi[1], 42);
+
+    /* Notes too, so it sees what each channel plays */
+    assert_int_equal(fluid_stub_event(0x90, 0, 60, 100), FLUID_OK);
+    assert_int_equal(stub_midi_count, 2);
+    assert_int_equal(stub_last_midi[0], 0x90);
+    assert_int_equal(stub_last_midi[1], 60);
+    assert_int_equal(stub_last_midi[2], 100);
+
+    /* Channel 10 for the percussion cache */
+    assert_int_equal(fluid_stub_event(0x90, 9, 36, 100), FLUID_OK);
+    assert_int_equal(fluid_stub_event(0x80, 9, 36, 0), FLUID_OK);
+    assert_int_equal(stub_midi_count, 4);
+    assert_int_equal(stub_last_midi[0], 0x89);
+    assert_int_equal(stub_fluid_handled, 0);
+
+    /* System messages carry no data here and stay with FluidSynth */
+    assert_int_equal(fluid_stub_event(0xFF, 0, 0, 0), FLUID_OK);
+    assert_int_equal(stub_fluid_handled, 1);
+    assert_int_equal(stub_midi_count, 4);
+
+    midi_alsa_cleanup(midi);
+    synth_cleanup(synth);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_alsa_channel_messages_through_synth),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
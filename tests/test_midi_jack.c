@@ -7,6 +7,18 @@
 #include "synth.h"
 #include "midi_jack.h"
 
+#ifdef HAVE_JACK
+extern uint64_t stub_frame_time;
+extern int stub_scheduled_count;
+extern uint64_t stub_scheduled_frame;
+extern uint8_t stub_scheduled_msg[3];
+extern int stub_midi_count;
+extern bool stub_freewheel;
+
+void jack_stub_cycle(jack_nframes_t nframes, const jack_midi_event_t *events, uint32_t count);
+void jack_stub_freewheel(int starting);
+#endif
+
 static void test_jack_init(void **state) {
     (void)state;
 #ifdef HAVE_JACK
@@ -23,9 +35,56 @@ static void test_jack_init(void **state) {
 #endif
 }
 
+static void test_jack_freewheel(void **state) {
+    (void)state;
+#ifdef HAVE_JACK
+    midisynthd_config_t cfg;
+    config_init_defaults(&cfg);
+    synth_t *s = synth_init(&cfg, NULL);
+    assert_non_null(s);
+    midi_jack_t *m = midi_jack_init(&cfg, s);
+    assert_non_null(m);
+
+    uint8_t note_on[] = { 0x90, 60, 100 };
+    uint8_t note_off[] = { 0x80, 60, 0 };
+    jack_midi_event_t events[] = {
+        { .time = 0, .size = sizeof(note_on), .buffer = note_on },
+        { .time = 200, .size = sizeof(note_off), .buffer = note_off },
+    };
+
+    /* Real time: applied as they arrive */
+    stub_scheduled_count = 0;
+    stub_midi_count = 0;
+    jack_stub_cycle(256, events, 2);
+    assert_int_equal(stub_midi_count, 2);
+    assert_int_equal(stub_scheduled_count, 0);
+
+    /* Freewheel: queued at their offset on the render clock */
+    jack_stub_freewheel(1);
+    assert_true(stub_freewheel);
+    assert_int_equal(midi_jack_process_events(m, 0), 0);
+    stub_frame_time = 4096;
+    jack_stub_cycle(256, events, 2);
+    assert_int_equal(stub_midi_count, 2);
+    assert_int_equal(stub_scheduled_count, 2);
+    assert_int_equal(stub_scheduled_frame, 4096 + 200);
+    assert_memory_equal(stub_scheduled_msg, note_off, 3);
+
+    jack_stub_freewheel(0);
+    assert_false(stub_freewheel);
+    jack_stub_cycle(256, events, 1);
+    assert_int_equal(stub_midi_count, 3);
+    assert_int_equal(stub_scheduled_count, 2);
+
+    midi_jack_cleanup(m);
+    synth_cleanup(s);
+#endif
+}
+
 int main(void) {
     const struct CMUnitTest tests[] = {
         cmocka_unit_test(test_jack_init),
+        cmocka_unit_test(test_jack_freewheel),
     };
     return cmocka_run_group_tests(tests, NULL, NULL);
 }
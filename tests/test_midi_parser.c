@@ -0,0 +1,195 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <string.h>
+
+#include "midi_parser.h"
+#include "synth.h"
+
+/* Recorded by stubs.c */
+extern int stub_midi_count;
+extern uint8_t stub_last_midi[3];
+extern int stub_scheduled_count;
+extern uint64_t stub_scheduled_frame;
+extern uint8_t stub_scheduled_msg[3];
+
+typedef struct {
+    uint8_t bytes[1024];
+    size_t lens[64];
+    int count;
+    size_t used;
+} recorder_t;
+
+static void record(void *data, const uint8_t *msg, size_t len) {
+    recorder_t *r = data;
+    memcpy(r->bytes + r->used, msg, len);
+    r->used += len;
+    r->lens[r->count++] = len;
+}
+
+static void test_channel_messages(void **state) {
+    (void)state;
+    recorder_t r = {0};
+    midi_parser_t p;
+    midi_parser_init(&p, record, &r);
+
+    const uint8_t in[] = {
+        0x90, 60, 100,      /* note on */
+        0x80, 60, 0,        /* note off */
+        0xA1, 64, 20,       /* poly pressure */
+        0xB2, 7, 90,        /* CC */
+        0xC3, 5,            /* program */
+        0xD4, 40,           /* channel pressure */
+        0xE5, 0x00, 0x40,   /* pitch bend */
+        0x96, 61, 0,        /* note on velocity 0 */
+    };
+    assert_int_equal(midi_parser_feed(&p, in, sizeof(in)), 8);
+    assert_memory_equal(r.bytes, in, sizeof(in));
+    assert_int_equal(r.lens[4], 2);
+    assert_int_equal(p.stats.note_on, 1);
+    assert_int_equal(p.stats.note_off, 2);
+    assert_int_equal(p.stats.key_pressure, 1);
+    assert_int_equal(p.stats.control_change, 1);
+    assert_int_equal(p.stats.program_change, 1);
+    assert_int_equal(p.stats.channel_pressure, 1);
+    assert_int_equal(p.stats.pitch_bend, 1);
+    assert_int_equal(p.stats.errors, 0);
+}
+
+static void test_running_status_across_chunks(void **state) {
+    (void)state;
+    recorder_t r = {0};
+    midi_parser_t p;
+    midi_parser_init(&p, record, &r);
+
+    const uint8_t a[] = { 0x90, 60, 100, 62 };
+    const uint8_t b[] = { 90, 64, 80 };
+    assert_int_equal(midi_parser_feed(&p, a, sizeof(a)), 1);
+    assert_int_equal(midi_parser_feed(&p, b, sizeof(b)), 2);
+
+    const uint8_t expect[] = { 0x90, 60, 100, 0x90, 62, 90, 0x90, 64, 80 };
+    assert_memory_equal(r.bytes, expect, sizeof(expect));
+    assert_int_equal(p.stats.running_status, 2);
+}
+
+static void test_realtime_interleaved(void **state) {
+    (void)state;
+    recorder_t r = {0};
+    midi_parser_t p;
+    midi_parser_init(&p, record, &r);
+
+    const uint8_t in[] = { 0x90, 0xF8, 60, 0xFE, 100 };
+    assert_int_equal(midi_parser_feed(&p, in, sizeof(in)), 1);
+    const uint8_t expect[] = { 0x90, 60, 100 };
+    assert_memory_equal(r.bytes, expect, sizeof(expect));
+    assert_int_equal(p.stats.realtime, 2);
+}
+
+static void test_sysex(void **state) {
+    (void)state;
+    recorder_t r = {0};
+    midi_parser_t p;
+    midi_parser_init(&p, record, &r);
+
+    const uint8_t gm_on[] = { 0xF0, 0x7E, 0x7F, 0x09, 0x01, 0xF7 };
+    const uint8_t after[] = { 0x91, 50, 60 };
+    assert_int_equal(midi_parser_feed(&p, gm_on, 3), 0);
+    assert_int_equal(midi_parser_feed(&p, gm_on + 3, 3), 1);
+    assert_int_equal(midi_parser_feed(&p, after, sizeof(after)), 1);
+    assert_int_equal(r.lens[0], sizeof(gm_on));
+    assert_memory_equal(r.bytes, gm_on, sizeof(gm_on));
+    assert_int_equal(p.stats.sysex, 1);
+
+    /* SysEx cancels running status */
+    const uint8_t stray[] = { 0xF0, 0x7E, 0xF7, 10, 20 };
+    assert_int_equal(midi_parser_feed(&p, stray, sizeof(stray)), 1);
+    assert_int_equal(p.stats.errors, 2);
+}
+
+static void test_sysex_overflow_and_truncation(void **state) {
+    (void)state;
+    recorder_t r = {0};
+    midi_parser_t p;
+    midi_parser_init(&p, record, &r);
+
+    uint8_t big[MIDI_PARSER_SYSEX_MAX + 8];
+    memset(big, 0x11, sizeof(big));
+    big[0] = 0xF0;
+    big[sizeof(big) - 1] = 0xF7;
+    assert_int_equal(midi_parser_feed(&p, big, sizeof(big)), 0);
+    assert_int_equal(p.stats.errors, 1);
+
+    /* A status byte inside SysEx abandons it and starts a new message */
+    const uint8_t cut[] = { 0xF0, 0x41, 0x10, 0x90, 60, 100 };
+    assert_int_equal(midi_parser_feed(&p, cut, sizeof(cut)), 1);
+    assert_int_equal(p.stats.errors, 2);
+    assert_int_equal(p.stats.note_on, 1);
+    assert_int_equal(p.stats.sysex, 0);
+}
+
+static void test_system_common(void **state) {
+    (void)state;
+    recorder_t r = {0};
+    midi_parser_t p;
+    midi_parser_init(&p, record, &r);
+
+    const uint8_t in[] = { 0xB0, 7, 100, 0xF2, 0x10, 0x20, 8, 9, 0xF6 };
+    assert_int_equal(midi_parser_feed(&p, in, sizeof(in)), 1);
+    assert_int_equal(p.stats.system_common, 2);
+    assert_int_equal(p.stats.errors, 2);   /* data after song position has no status */
+}
+
+static void test_route_synth(void **state) {
+    (void)state;
+    midisynthd_config_t config;
+    memset(&config, 0, sizeof(config));
+    strcpy(config.routes[0], "channel 1 2");
+    strcpy(config.routes[1], "drop 3 note sysex");
+    config.route_count = 2;
+    midi_router_t *router = midi_router_create(&config);
+    assert_non_null(router);
+    synth_t *synth = synth_init(&config, NULL);
+
+    /* Dispatched at once in a rewritten copy, the input is left alone */
+    const uint8_t on[] = { 0x90, 60, 100 };
+    stub_midi_count = 0;
+    assert_int_equal(midi_parser_route_synth(router, synth, on, sizeof(on), false, 0), 0);
+    assert_int_equal(stub_midi_count, 1);
+    assert_int_equal(stub_last_midi[0], 0x91);
+    assert_int_equal(on[0], 0x90);
+
+    /* Queued at the frame when scheduling */
+    stub_scheduled_count = 0;
+    assert_int_equal(midi_parser_route_synth(router, synth, on, sizeof(on), true, 4096), 1);
+    assert_int_equal(stub_scheduled_count, 1);
+    assert_int_equal(stub_scheduled_frame, 4096);
+    assert_int_equal(stub_scheduled_msg[0], 0x91);
+
+    /* Dropped by a rule */
+    const uint8_t dropped[] = { 0x92, 60, 100 };
+    assert_int_equal(midi_parser_route_synth(router, synth, dropped, sizeof(dropped), true, 0), -1);
+    assert_int_equal(stub_scheduled_count, 1);
+
+    /* SysEx is never queued, and a rule drops it whole */
+    const uint8_t sysex[] = { 0xF0, 0x7E, 0x7F, 0x09, 0x01, 0xF7 };
+    assert_int_equal(midi_parser_route_synth(NULL, synth, sysex, sizeof(sysex), true, 0), 0);
+    assert_int_equal(stub_scheduled_count, 1);
+    assert_int_equal(midi_parser_route_synth(router, synth, sysex, sizeof(sysex), true, 0), -1);
+
+    synth_cleanup(synth);
+    midi_router_destroy(router);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_channel_messages),
+        cmocka_unit_test(test_running_status_across_chunks),
+        cmocka_unit_test(test_realtime_interleaved),
+        cmocka_unit_test(test_sysex),
+        cmocka_unit_test(test_sysex_overflow_and_truncation),
+        cmocka_unit_test(test_system_common),
+        cmocka_unit_test(test_route_synth),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
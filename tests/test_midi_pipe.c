@@ -0,0 +1,206 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "config.h"
+#include "synth.h"
+#include "event_loop.h"
+#include "midi_pipe.h"
+
+static void run_loop(event_loop_t *loop, midi_pipe_t *midi, uint64_t events) {
+    midi_pipe_stats_t stats;
+    for (int i = 0; i < 50; i++) {
+        event_loop_run_once(loop, 20);
+        midi_pipe_get_stats(midi, &stats);
+        if (stats.events >= events) break;
+    }
+}
+
+static void test_fifo_input(void **state) {
+    (void)state;
+    char dir[] = "/tmp/test_midi_pipe_XXXXXX";
+    assert_non_null(mkdtemp(dir));
+
+    midisynthd_config_t cfg;
+    config_init_defaults(&cfg);
+    cfg.midi_driver = MIDI_DRIVER_PIPE;
+    snprintf(cfg.midi_input, sizeof(cfg.midi_input), "%s/midi.fifo", dir);
+
+    event_loop_t *loop = event_loop_create();
+    synth_t *s = synth_init(&cfg, NULL);
+    midi_pipe_t *midi = midi_pipe_init(&cfg, s, loop);
+    assert_non_null(midi);
+
+    int fd = open(cfg.midi_input, O_WRONLY);
+    assert_true(fd >= 0);
+    /* Running status across writes */
+    const uint8_t a[] = { 0x90, 60, 100, 62 };
+    const uint8_t b[] = { 90, 0xB0, 7, 100 };
+    assert_int_equal(write(fd, a, sizeof(a)), sizeof(a));
+    assert_int_equal(write(fd, b, sizeof(b)), sizeof(b));
+    close(fd);
+
+    run_loop(loop, midi, 3);
+    midi_pipe_stats_t stats;
+    assert_int_equal(midi_pipe_get_stats(midi, &stats), 0);
+    assert_int_equal(stats.events, 3);
+    assert_int_equal(stats.bytes, 8);
+    assert_int_equal(stats.parser.note_on, 2);
+    assert_int_equal(stats.parser.control_change, 1);
+    assert_int_equal(stats.parser.running_status, 1);
+
+    /* A writer closing does not end the input */
+    fd = open(cfg.midi_input, O_WRONLY);
+    assert_true(fd >= 0);
+    const uint8_t c[] = { 0x80, 60, 0 };
+    assert_int_equal(write(fd, c, sizeof(c)), sizeof(c));
+    close(fd);
+    run_loop(loop, midi, 4);
+    midi_pipe_get_stats(midi, &stats);
+    assert_int_equal(stats.events, 4);
+
+    midi_pipe_cleanup(midi);
+    assert_int_equal(access(cfg.midi_input, F_OK), -1);
+    synth_cleanup(s);
+    event_loop_destroy(loop);
+    rmdir(dir);
+}
+
+static void test_socket_input(void **state) {
+    (void)state;
+    char dir[] = "/tmp/test_midi_pipe_XXXXXX";
+    assert_non_null(mkdtemp(dir));
+
+    midisynthd_config_t cfg;
+    config_init_defaults(&cfg);
+    cfg.midi_driver = MIDI_DRIVER_PIPE;
+    snprintf(cfg.midi_input, sizeof(cfg.midi_input), "unix:%s/midi.sock", dir);
+
+    event_loop_t *loop = event_loop_create();
+    synth_t *s = synth_init(&cfg, NULL);
+    midi_pipe_t *midi = midi_pipe_init(&cfg, s, loop);
+    assert_non_null(midi);
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s/midi.sock", dir);
+
+    int c1 = socket(AF_UNIX, SOCK_STREAM, 0);
+    int c2 = socket(AF_UNIX, SOCK_STREAM, 0);
+    assert_int_equal(connect(c1, (struct sockaddr *)&addr, sizeof(addr)), 0);
+    assert_int_equal(connect(c2, (struct sockaddr *)&addr, sizeof(addr)), 0);
+    event_loop_run_once(loop, 20);
+
+    /* Each client has its own running status */
+    const uint8_t a[] = { 0x90, 60, 100 };
+    const uint8_t b[] = { 0xC1, 5 };
+    const uint8_t a2[] = { 61, 100 };
+    assert_int_equal(write(c1, a, sizeof(a)), sizeof(a));
+    assert_int_equal(write(c2, b, sizeof(b)), sizeof(b));
+    run_loop(loop, midi, 2);
+    assert_int_equal(write(c1, a2, sizeof(a2)), sizeof(a2));
+    run_loop(loop, midi, 3);
+    close(c1);
+    close(c2);
+    for (int i = 0; i < 3; i++) event_loop_run_once(loop, 10);
+
+    midi_pipe_stats_t stats;
+    midi_pipe_get_stats(midi, &stats);
+    assert_int_equal(stats.events, 3);
+    assert_int_equal(stats.parser.note_on, 2);
+    assert_int_equal(stats.parser.program_change, 1);
+    assert_int_equal(stats.parser.errors, 0);
+
+    midi_pipe_cleanup(midi);
+    synth_cleanup(s);
+    event_loop_destroy(loop);
+    rmdir(dir);
+}
+
+static void test_throughput(void **state) {
+    (void)state;
+    char dir[] = "/tmp/test_midi_pipe_XXXXXX";
+    assert_non_null(mkdtemp(dir));
+
+    midisynthd_config_t cfg;
+    config_init_defaults(&cfg);
+    snprintf(cfg.midi_input, sizeof(cfg.midi_input), "%s/midi.fifo", dir);
+
+    event_loop_t *loop = event_loop_create();
+    synth_t *s = synth_init(&cfg, NULL);
+    midi_pipe_t *midi = midi_pipe_init(&cfg, s, loop);
+    assert_non_null(midi);
+    int fd = open(cfg.midi_input, O_WRONLY | O_NONBLOCK);
+    assert_true(fd >= 0);
+
+    /* 64 KiB of running-status note on/off pairs */
+    uint8_t buf[65536];
+    buf[0] = 0x90;
+    for (size_t i = 1; i + 1 < sizeof(buf); i += 2) {
+        buf[i] = (uint8_t)(i % 128);
+        buf[i + 1] = (i / 2) % 2 ? 0 : 100;
+    }
+    size_t len = sizeof(buf) - 1;
+    uint64_t expected = (len - 1) / 2;
+
+    size_t off = 0;
+    while (off < len) {
+        ssize_t n = write(fd, buf + off, len - off);
+        if (n > 0) off += (size_t)n;
+        event_loop_run_once(loop, 0);
+    }
+    run_loop(loop, midi, expected);
+    close(fd);
+
+    midi_pipe_stats_t stats;
+    midi_pipe_get_stats(midi, &stats);
+    assert_int_equal(stats.events, expected);
+    assert_true(stats.busy_ns > 0);
+    assert_true(stats.capacity_per_sec > 0.0);
+    assert_true(stats.events_per_sec > 0.0);
+    printf("pipe MIDI decode capacity: %.0f events/s\n", stats.capacity_per_sec);
+
+    midi_pipe_cleanup(midi);
+    synth_cleanup(s);
+    event_loop_destroy(loop);
+    rmdir(dir);
+}
+
+static void test_invalid_path(void **state) {
+    (void)state;
+    midisynthd_config_t cfg;
+    config_init_defaults(&cfg);
+    /* A regular file is not a FIFO */
+    char path[] = "/tmp/test_midi_pipe_file_XXXXXX";
+    int fd = mkstemp(path);
+    assert_true(fd >= 0);
+    close(fd);
+    strcpy(cfg.midi_input, path);
+
+    event_loop_t *loop = event_loop_create();
+    synth_t *s = synth_init(&cfg, NULL);
+    assert_null(midi_pipe_init(&cfg, s, loop));
+    assert_null(midi_pipe_init(&cfg, s, NULL));
+    synth_cleanup(s);
+    event_loop_destroy(loop);
+    unlink(path);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_fifo_input),
+        cmocka_unit_test(test_socket_input),
+        cmocka_unit_test(test_throughput),
+        cmocka_unit_test(test_invalid_path),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,98 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdint.h>
+
+#include "config.h"
+#include "synth.h"
+#include "midi_pipewire.h"
+
+#if HAVE_PIPEWIRE
+#include <spa/control/control.h>
+#include <spa/pod/builder.h>
+
+extern uint64_t stub_frame_time;
+extern int stub_scheduled_count;
+extern uint64_t stub_scheduled_frame;
+extern uint8_t stub_scheduled_msg[3];
+
+void pw_stub_cycle(uint64_t position, uint32_t duration, const void *pod, uint32_t size);
+
+/* Build a control sequence of MIDI events, one per offset */
+static uint32_t build_sequence(uint8_t *buf, uint32_t size, const uint32_t *offsets,
+                               const uint8_t (*events)[3], const uint32_t *lens, int count) {
+    struct spa_pod_builder b;
+    struct spa_pod_frame f;
+    spa_pod_builder_init(&b, buf, size);
+    spa_pod_builder_push_sequence(&b, &f, 0);
+    for (int i = 0; i < count; i++) {
+        spa_pod_builder_control(&b, offsets[i], SPA_CONTROL_Midi);
+        spa_pod_builder_bytes(&b, events[i], lens[i]);
+    }
+    spa_pod_builder_pop(&b, &f);
+    return b.offset;
+}
+#endif
+
+static void test_pipewire_offsets(void **state) {
+    (void)state;
+    midisynthd_config_t cfg;
+    config_init_defaults(&cfg);
+    synth_t *s = synth_init(&cfg, NULL);
+    assert_non_null(s);
+    midi_pipewire_t *m = midi_pipewire_init(&cfg, s);
+#if HAVE_PIPEWIRE
+    assert_non_null(m);
+    stub_scheduled_count = 0;
+    stub_frame_time = 1000;
+
+    /* Two events at different offsets in one 256-frame cycle, the second
+     * using running status */
+    uint8_t pod[1024];
+    const uint32_t offsets[] = { 0, 100 };
+    const uint8_t events[][3] = { { 0x90, 60, 100 }, { 64, 90, 0 } };
+    const uint32_t lens[] = { 3, 2 };
+    uint32_t size = build_sequence(pod, sizeof(pod), offsets, events, lens, 2);
+    pw_stub_cycle(5000, 256, pod, size);
+
+    /* One quantum ahead of the render clock, offsets kept */
+    assert_int_equal(stub_scheduled_count, 2);
+    assert_int_equal(stub_scheduled_frame, 1000 + 256 + 100);
+    assert_memory_equal(stub_scheduled_msg, "\x90\x40\x5A", 3);
+
+    /* Next cycle: same graph-to-render mapping */
+    stub_frame_time = 1256;
+    const uint32_t offsets2[] = { 10 };
+    const uint8_t events2[][3] = { { 0xB0, 7, 100 } };
+    const uint32_t lens2[] = { 3 };
+    size = build_sequence(pod, sizeof(pod), offsets2, events2, lens2, 1);
+    pw_stub_cycle(5256, 256, pod, size);
+    assert_int_equal(stub_scheduled_count, 3);
+    assert_int_equal(stub_scheduled_frame, 1256 + 256 + 10);
+
+    /* Graph position jumps: the mapping is taken again */
+    stub_frame_time = 1512;
+    pw_stub_cycle(900000, 256, pod, size);
+    assert_int_equal(stub_scheduled_frame, 1512 + 256 + 10);
+
+    midi_parser_stats_t stats;
+    assert_int_equal(midi_pipewire_get_stats(m, &stats), 0);
+    assert_int_equal(stats.note_on, 2);
+    assert_int_equal(stats.control_change, 2);
+    assert_int_equal(stats.running_status, 1);
+
+    assert_int_equal(midi_pipewire_disconnect_all(m), 0);
+    midi_pipewire_cleanup(m);
+#else
+    assert_null(m);
+#endif
+    synth_cleanup(s);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_pipewire_offsets),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
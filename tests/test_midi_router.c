@@ -0,0 +1,181 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <string.h>
+
+#include "midi_router.h"
+
+static midi_router_t *router_with(const char *const *rules, int count) {
+    midisynthd_config_t config;
+    memset(&config, 0, sizeof(config));
+    for (int i = 0; i < count; i++) {
+        strncpy(config.routes[i], rules[i], CONFIG_MAX_STRING_LEN - 1);
+    }
+    config.route_count = count;
+    return midi_router_create(&config);
+}
+
+static void test_no_rules_passes_everything(void **state) {
+    (void)state;
+    midi_router_t *r = router_with(NULL, 0);
+    assert_non_null(r);
+    assert_false(midi_router_is_active(r));
+
+    uint8_t msg[3] = { 0x95, 60, 100 };
+    assert_true(midi_router_apply(r, msg, 3));
+    assert_int_equal(msg[0], 0x95);
+    assert_int_equal(msg[1], 60);
+    assert_int_equal(msg[2], 100);
+    assert_true(midi_router_apply(NULL, msg, 3));
+    midi_router_destroy(r);
+}
+
+static void test_channel_map_and_transpose(void **state) {
+    (void)state;
+    const char *rules[] = { "channel 1-2 10", "transpose 1 -12", "transpose 2 +7" };
+    midi_router_t *r = router_with(rules, 3);
+    assert_true(midi_router_is_active(r));
+
+    uint8_t a[3] = { 0x90, 60, 100 };
+    assert_true(midi_router_apply(r, a, 3));
+    assert_int_equal(a[0], 0x99);
+    assert_int_equal(a[1], 48);
+
+    uint8_t b[3] = { 0x81, 60, 0 };
+    assert_true(midi_router_apply(r, b, 3));
+    assert_int_equal(b[0], 0x89);
+    assert_int_equal(b[1], 67);
+
+    /* Shifted out of range */
+    uint8_t c[3] = { 0x90, 5, 100 };
+    assert_false(midi_router_apply(r, c, 3));
+
+    /* Other channels untouched */
+    uint8_t d[3] = { 0x93, 60, 100 };
+    assert_true(midi_router_apply(r, d, 3));
+    assert_int_equal(d[0], 0x93);
+    assert_int_equal(d[1], 60);
+    midi_router_destroy(r);
+}
+
+static void test_keyrange(void **state) {
+    (void)state;
+    const char *rules[] = { "keyrange all 36 84" };
+    midi_router_t *r = router_with(rules, 1);
+
+    uint8_t in[3] = { 0x90, 36, 90 };
+    uint8_t low[3] = { 0x90, 35, 90 };
+    uint8_t high[3] = { 0xA0, 85, 10 };
+    assert_true(midi_router_apply(r, in, 3));
+    assert_false(midi_router_apply(r, low, 3));
+    assert_false(midi_router_apply(r, high, 3));
+    midi_router_destroy(r);
+}
+
+static void test_velocity(void **state) {
+    (void)state;
+    const char *rules[] = { "velocity 1 fixed 100", "velocity 2 scale 40 80",
+                            "velocity 3 curve 0.5" };
+    midi_router_t *r = router_with(rules, 3);
+
+    uint8_t a[3] = { 0x90, 60, 12 };
+    midi_router_apply(r, a, 3);
+    assert_int_equal(a[2], 100);
+
+    uint8_t b[3] = { 0x91, 60, 1 };
+    midi_router_apply(r, b, 3);
+    assert_int_equal(b[2], 40);
+    b[2] = 127;
+    b[0] = 0x91;
+    midi_router_apply(r, b, 3);
+    assert_int_equal(b[2], 80);
+
+    /* Curve never turns a note on into a note off */
+    uint8_t c[3] = { 0x92, 60, 1 };
+    midi_router_apply(r, c, 3);
+    assert_true(c[2] >= 1);
+    c[2] = 32;
+    c[0] = 0x92;
+    midi_router_apply(r, c, 3);
+    assert_int_equal(c[2], 64);
+
+    /* Velocity 0 note on stays a note off; note off velocity is kept */
+    uint8_t d[3] = { 0x90, 60, 0 };
+    midi_router_apply(r, d, 3);
+    assert_int_equal(d[2], 0);
+    uint8_t e[3] = { 0x80, 60, 12 };
+    midi_router_apply(r, e, 3);
+    assert_int_equal(e[2], 12);
+    midi_router_destroy(r);
+}
+
+static void test_cc_masks(void **state) {
+    (void)state;
+    const char *rules[] = { "cc 1 allow 1,7,10-11", "cc 2 block 64" };
+    midi_router_t *r = router_with(rules, 2);
+
+    uint8_t a[3] = { 0xB0, 7, 100 };
+    uint8_t b[3] = { 0xB0, 64, 127 };
+    uint8_t c[3] = { 0xB1, 64, 127 };
+    uint8_t d[3] = { 0xB1, 7, 127 };
+    uint8_t e[3] = { 0xB0, 11, 127 };
+    assert_true(midi_router_apply(r, a, 3));
+    assert_false(midi_router_apply(r, b, 3));
+    assert_false(midi_router_apply(r, c, 3));
+    assert_true(midi_router_apply(r, d, 3));
+    assert_true(midi_router_apply(r, e, 3));
+    midi_router_destroy(r);
+}
+
+static void test_drop_types(void **state) {
+    (void)state;
+    const char *rules[] = { "drop 10 program pitchbend", "drop all sysex" };
+    midi_router_t *r = router_with(rules, 2);
+
+    uint8_t prog[2] = { 0xC9, 5 };
+    uint8_t prog_other[2] = { 0xC0, 5 };
+    uint8_t bend[3] = { 0xE9, 0, 64 };
+    uint8_t sysex[6] = { 0xF0, 0x7E, 0x7F, 0x09, 0x01, 0xF7 };
+    uint8_t clock[1] = { 0xF8 };
+    assert_false(midi_router_apply(r, prog, 2));
+    assert_true(midi_router_apply(r, prog_other, 2));
+    assert_false(midi_router_apply(r, bend, 3));
+    assert_false(midi_router_apply(r, sysex, sizeof(sysex)));
+    assert_true(midi_router_apply(r, clock, 1));
+    midi_router_destroy(r);
+}
+
+static void test_invalid_rules(void **state) {
+    (void)state;
+    assert_int_equal(midi_router_check_rule("channel 1 10"), 0);
+    assert_int_equal(midi_router_check_rule("channel 0 10"), -1);
+    assert_int_equal(midi_router_check_rule("channel 1 17"), -1);
+    assert_int_equal(midi_router_check_rule("transpose 1-x 3"), -1);
+    assert_int_equal(midi_router_check_rule("velocity 1 fixed 0"), -1);
+    assert_int_equal(midi_router_check_rule("cc 1 maybe 7"), -1);
+    assert_int_equal(midi_router_check_rule("drop 1 noise"), -1);
+    assert_int_equal(midi_router_check_rule("frobnicate all 1"), -1);
+
+    /* Invalid rules are skipped, valid ones still apply */
+    const char *rules[] = { "bogus", "channel 1 2" };
+    midi_router_t *r = router_with(rules, 2);
+    assert_true(midi_router_is_active(r));
+    uint8_t msg[3] = { 0x90, 60, 100 };
+    midi_router_apply(r, msg, 3);
+    assert_int_equal(msg[0], 0x91);
+    midi_router_destroy(r);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_no_rules_passes_everything),
+        cmocka_unit_test(test_channel_map_and_transpose),
+        cmocka_unit_test(test_keyrange),
+        cmocka_unit_test(test_velocity),
+        cmocka_unit_test(test_cc_masks),
+        cmocka_unit_test(test_drop_types),
+        cmocka_unit_test(test_invalid_rules),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,306 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "config.h"
+#include "synth.h"
+#include "event_loop.h"
+#include "osc.h"
+
+extern uint64_t stub_frame_time;
+extern int stub_scheduled_count;
+extern uint64_t stub_scheduled_frame;
+extern uint8_t stub_scheduled_msg[3];
+extern float stub_gain;
+extern bool stub_reverb_enabled;
+extern float stub_reverb_level;
+
+/* Minimal OSC packet writer */
+typedef struct {
+    uint8_t data[512];
+    size_t len;
+} packet_t;
+
+static void put_be32(packet_t *p, uint32_t v) {
+    p->data[p->len++] = v >> 24;
+    p->data[p->len++] = v >> 16;
+    p->data[p->len++] = v >> 8;
+    p->data[p->len++] = v;
+}
+
+static void put_string(packet_t *p, const char *s) {
+    size_t n = strlen(s) + 1;
+    memcpy(p->data + p->len, s, n);
+    p->len += n;
+    while (p->len % 4) p->data[p->len++] = 0;
+}
+
+static void put_float(packet_t *p, float f) {
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    put_be32(p, bits);
+}
+
+/* Message with integer arguments only */
+static void put_message(packet_t *p, const char *path, int nargs, const int *args) {
+    char tags[16] = ",";
+    for (int i = 0; i < nargs; i++) strcat(tags, "i");
+    put_string(p, path);
+    put_string(p, tags);
+    for (int i = 0; i < nargs; i++) put_be32(p, (uint32_t)args[i]);
+}
+
+static uint64_t timetag_in(double seconds) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    double t = (double)ts.tv_sec + 2208988800.0 + ts.tv_nsec / 1e9 + seconds;
+    uint64_t secs = (uint64_t)t;
+    return (secs << 32) | (uint64_t)((t - (double)secs) * 4294967296.0);
+}
+
+static void put_bundle_header(packet_t *p, uint64_t timetag) {
+    put_string(p, "#bundle");
+    put_be32(p, (uint32_t)(timetag >> 32));
+    put_be32(p, (uint32_t)timetag);
+}
+
+/* Append @p msg to bundle @p p as a size-prefixed element */
+static void put_element(packet_t *p, const packet_t *msg) {
+    put_be32(p, (uint32_t)msg->len);
+    memcpy(p->data + p->len, msg->data, msg->len);
+    p->len += msg->len;
+}
+
+static int free_udp_port(void) {
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    assert_int_equal(bind(fd, (struct sockaddr *)&addr, sizeof(addr)), 0);
+    assert_int_equal(getsockname(fd, (struct sockaddr *)&addr, &len), 0);
+    close(fd);
+    return ntohs(addr.sin_port);
+}
+
+typedef struct {
+    midisynthd_config_t cfg;
+    event_loop_t *loop;
+    synth_t *synth;
+    osc_t *osc;
+} fixture_t;
+
+static void open_fixture(fixture_t *f) {
+    memset(f, 0, sizeof(*f));
+    config_init_defaults(&f->cfg);
+    f->cfg.osc_port = free_udp_port();
+    f->loop = event_loop_create();
+    f->synth = synth_init(&f->cfg, NULL);
+    f->osc = osc_init(&f->cfg, f->synth, f->loop);
+    assert_non_null(f->osc);
+    stub_scheduled_count = 0;
+}
+
+static void close_fixture(fixture_t *f) {
+    osc_cleanup(f->osc);
+    synth_cleanup(f->synth);
+    event_loop_destroy(f->loop);
+}
+
+static void test_messages(void **state) {
+    (void)state;
+    fixture_t fix, *f = &fix;
+    open_fixture(f);
+    osc_stats_t stats;
+
+    packet_t p = { .len = 0 };
+    put_message(&p, "/note", 3, (const int[]){ 1, 60, 100 });
+    assert_int_equal(osc_handle_packet(f->osc, p.data, p.len), 0);
+
+    p.len = 0;
+    put_string(&p, "/gain");
+    put_string(&p, ",f");
+    put_float(&p, 0.75f);
+    assert_int_equal(osc_handle_packet(f->osc, p.data, p.len), 0);
+    assert_true(stub_gain > 0.74f && stub_gain < 0.76f);
+
+    p.len = 0;
+    put_string(&p, "/reverb");
+    put_string(&p, ",f");
+    put_float(&p, 0.0f);
+    assert_int_equal(osc_handle_packet(f->osc, p.data, p.len), 0);
+    assert_false(stub_reverb_enabled);
+
+    p.len = 0;
+    put_message(&p, "/panic", 0, NULL);
+    assert_int_equal(osc_handle_packet(f->osc, p.data, p.len), 0);
+
+    /* Unmapped addresses are counted, not errors */
+    p.len = 0;
+    put_message(&p, "/unknown", 1, (const int[]){ 1 });
+    assert_int_equal(osc_handle_packet(f->osc, p.data, p.len), 0);
+
+    osc_get_stats(f->osc, &stats);
+    assert_int_equal(stats.messages, 5);
+    assert_int_equal(stats.unknown, 1);
+    assert_int_equal(stats.errors, 0);
+    assert_int_equal(stats.scheduled, 0);
+
+    close_fixture(f);
+}
+
+static void test_invalid(void **state) {
+    (void)state;
+    fixture_t fix, *f = &fix;
+    open_fixture(f);
+    osc_stats_t stats;
+    packet_t p = { .len = 0 };
+
+    /* Channel out of range */
+    put_message(&p, "/note", 3, (const int[]){ 17, 60, 100 });
+    assert_int_equal(osc_handle_packet(f->osc, p.data, p.len), -1);
+
+    /* Too few arguments */
+    p.len = 0;
+    put_message(&p, "/cc", 2, (const int[]){ 1, 7 });
+    assert_int_equal(osc_handle_packet(f->osc, p.data, p.len), -1);
+
+    /* Argument truncated */
+    p.len = 0;
+    put_message(&p, "/program", 2, (const int[]){ 1, 5 });
+    assert_int_equal(osc_handle_packet(f->osc, p.data, p.len - 4), -1);
+
+    /* Unpadded and non-OSC data */
+    assert_int_equal(osc_handle_packet(f->osc, (const uint8_t *)"/ab", 3), -1);
+    assert_int_equal(osc_handle_packet(f->osc, (const uint8_t *)"hello!!!", 8), -1);
+
+    /* Bundle element larger than the packet */
+    p.len = 0;
+    put_bundle_header(&p, 1);
+    put_be32(&p, 64);
+    assert_int_equal(osc_handle_packet(f->osc, p.data, p.len), -1);
+
+    osc_get_stats(f->osc, &stats);
+    assert_int_equal(stats.errors, 6);
+
+    close_fixture(f);
+}
+
+static void test_bundle_scheduling(void **state) {
+    (void)state;
+    fixture_t fix, *f = &fix;
+    open_fixture(f);
+    osc_stats_t stats;
+    packet_t msg = { .len = 0 };
+    put_message(&msg, "/pitchbend", 2, (const int[]){ 2, 8191 });
+
+    /* Half a second ahead: queued about sample_rate / 2 frames from now */
+    packet_t p = { .len = 0 };
+    put_bundle_header(&p, timetag_in(0.5));
+    put_element(&p, &msg);
+    assert_int_equal(osc_handle_packet(f->osc, p.data, p.len), 0);
+    assert_int_equal(stub_scheduled_count, 1);
+    uint64_t expected = stub_frame_time + (uint64_t)f->cfg.sample_rate / 2;
+    assert_in_range(stub_scheduled_frame, expected - f->cfg.sample_rate / 20, expected + 1);
+    assert_int_equal(stub_scheduled_msg[0], 0xE1);
+    assert_int_equal(stub_scheduled_msg[1], 0x7F);
+    assert_int_equal(stub_scheduled_msg[2], 0x7F);
+
+    /* Past and immediate bundles apply at once; nesting is followed */
+    packet_t inner = { .len = 0 };
+    put_bundle_header(&inner, 1);
+    put_element(&inner, &msg);
+    p.len = 0;
+    put_bundle_header(&p, timetag_in(-1.0));
+    put_element(&p, &msg);
+    put_element(&p, &inner);
+    assert_int_equal(osc_handle_packet(f->osc, p.data, p.len), 0);
+    assert_int_equal(stub_scheduled_count, 1);
+
+    osc_get_stats(f->osc, &stats);
+    assert_int_equal(stats.bundles, 3);
+    assert_int_equal(stats.late, 1);
+    assert_int_equal(stats.scheduled, 1);
+    assert_int_equal(stats.messages, 3);
+
+    close_fixture(f);
+}
+
+static void test_udp_batch(void **state) {
+    (void)state;
+    fixture_t fix, *f = &fix;
+    open_fixture(f);
+    osc_stats_t stats;
+
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)f->cfg.osc_port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    /* More datagrams than one recvmmsg() batch */
+    const uint64_t count = OSC_BATCH + 8;
+    for (uint64_t i = 0; i < count; i++) {
+        packet_t p = { .len = 0 };
+        put_message(&p, "/cc", 3, (const int[]){ 1, 7, (int)(i % 128) });
+        assert_int_equal(sendto(fd, p.data, p.len, 0, (struct sockaddr *)&addr, sizeof(addr)),
+                         (ssize_t)p.len);
+    }
+    close(fd);
+
+    for (int i = 0; i < 50; i++) {
+        event_loop_run_once(f->loop, 20);
+        osc_get_stats(f->osc, &stats);
+        if (stats.messages >= count) break;
+    }
+    assert_int_equal(stats.packets, count);
+    assert_int_equal(stats.messages, count);
+    assert_true(stats.batches >= 2);
+    assert_int_equal(stats.errors, 0);
+
+    close_fixture(f);
+}
+
+static void test_init_errors(void **state) {
+    (void)state;
+    midisynthd_config_t cfg;
+    config_init_defaults(&cfg);
+    event_loop_t *loop = event_loop_create();
+    synth_t *s = synth_init(&cfg, NULL);
+
+    assert_null(osc_init(&cfg, s, loop));
+    cfg.osc_port = free_udp_port();
+    assert_null(osc_init(&cfg, s, NULL));
+    osc_t *osc = osc_init(&cfg, s, loop);
+    assert_non_null(osc);
+    /* Port already taken */
+    assert_null(osc_init(&cfg, s, loop));
+    osc_cleanup(osc);
+    osc_cleanup(NULL);
+
+    synth_cleanup(s);
+    event_loop_destroy(loop);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_messages),
+        cmocka_unit_test(test_invalid),
+        cmocka_unit_test(test_bundle_scheduling),
+        cmocka_unit_test(test_udp_batch),
+        cmocka_unit_test(test_init_errors),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,222 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <math.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "perc_cache.h"
+
+#define RATE    8000
+#define PERIOD  64
+#define HIT     200
+
+static float left[PERIOD], right[PERIOD];
+static float *out[2] = { left, right };
+
+static int renders;
+static int last_velocity;
+
+/* Constant 0.5/-0.5 hit; note 42 and 46 share exclusive class 1, note 60 loops */
+static int fake_render(void *data, int note, int velocity, float *l, float *r, int max_frames, int *exclusive) {
+    (void)data;
+    __atomic_fetch_add(&renders, 1, __ATOMIC_RELAXED);
+    last_velocity = velocity;
+    if (note == 60) return -1;
+    *exclusive = (note == 42 || note == 46) ? 1 : 0;
+    int frames = HIT < max_frames ? HIT : max_frames;
+    for (int i = 0; i < frames; i++) {
+        l[i] = 0.5f;
+        r[i] = -0.5f;
+    }
+    return frames;
+}
+
+static void clear(void) {
+    memset(left, 0, sizeof(left));
+    memset(right, 0, sizeof(right));
+}
+
+/* Play until the worker has rendered the entry, mixing a period each try */
+static bool play_when_ready(perc_cache_t *cache, int note, int velocity) {
+    for (int i = 0; i < 200; i++) {
+        if (perc_cache_play(cache, note, velocity, 0)) return true;
+        clear();
+        perc_cache_mix(cache, out, 2, PERIOD);
+        usleep(5000);
+    }
+    return false;
+}
+
+static void test_miss_then_hit(void **state) {
+    (void)state;
+    perc_cache_t *cache = perc_cache_create(1 << 20, RATE, fake_render, NULL);
+    assert_non_null(cache);
+
+    assert_false(perc_cache_play(cache, 36, 100, 0));
+    assert_true(play_when_ready(cache, 36, 100));
+    assert_int_equal(last_velocity, 100 / 16 * 16 + 8);
+
+    /* Mixed at (100/104)^2 of the rendered level */
+    clear();
+    perc_cache_mix(cache, out, 2, PERIOD);
+    float gain = (100.0f / 104.0f) * (100.0f / 104.0f);
+    assert_true(fabsf(left[0] - 0.5f * gain) < 1e-5f);
+    assert_true(fabsf(right[PERIOD - 1] - -0.5f * gain) < 1e-5f);
+
+    /* Runs out after HIT frames */
+    for (int i = 0; i < 3; i++) {
+        clear();
+        perc_cache_mix(cache, out, 2, PERIOD);
+    }
+    assert_true(left[HIT - 3 * PERIOD - 1] > 0.0f);
+    assert_true(left[HIT - 3 * PERIOD] == 0.0f);
+
+    perc_cache_stats_t stats;
+    assert_int_equal(perc_cache_get_stats(cache, &stats), 0);
+    assert_int_equal(stats.renders, 1);
+    assert_int_equal(stats.entries, 1);
+    assert_true(stats.hits >= 1);
+    assert_true(stats.misses >= 1);
+    assert_true(stats.bytes >= 2 * sizeof(float) * HIT);
+    perc_cache_destroy(cache);
+}
+
+static void test_offset_starts_inside_period(void **state) {
+    (void)state;
+    perc_cache_t *cache = perc_cache_create(1 << 20, RATE, fake_render, NULL);
+    assert_true(play_when_ready(cache, 38, 64));
+    /* The first hit above started at 0; let it run out */
+    for (int i = 0; i < 4; i++) {
+        clear();
+        perc_cache_mix(cache, out, 2, PERIOD);
+    }
+
+    assert_true(perc_cache_play(cache, 38, 64, 10));
+    clear();
+    perc_cache_mix(cache, out, 2, PERIOD);
+    assert_true(left[9] == 0.0f);
+    assert_true(left[10] > 0.0f);
+    perc_cache_destroy(cache);
+}
+
+static void test_invalidate_rerenders(void **state) {
+    (void)state;
+    perc_cache_t *cache = perc_cache_create(1 << 20, RATE, fake_render, NULL);
+    assert_true(play_when_ready(cache, 36, 100));
+    int before = __atomic_load_n(&renders, __ATOMIC_RELAXED);
+
+    perc_cache_invalidate(cache);
+    assert_false(perc_cache_play(cache, 36, 100, 0));
+    assert_true(play_when_ready(cache, 36, 100));
+    assert_int_equal(__atomic_load_n(&renders, __ATOMIC_RELAXED), before + 1);
+
+    perc_cache_stats_t stats;
+    perc_cache_get_stats(cache, &stats);
+    assert_int_equal(stats.invalidations, 1);
+    assert_int_equal(stats.entries, 1);
+    perc_cache_destroy(cache);
+}
+
+static void test_uncacheable_stays_live(void **state) {
+    (void)state;
+    perc_cache_t *cache = perc_cache_create(1 << 20, RATE, fake_render, NULL);
+    assert_false(play_when_ready(cache, 60, 100));
+
+    perc_cache_stats_t stats;
+    perc_cache_get_stats(cache, &stats);
+    assert_int_equal(stats.uncacheable, 1);
+    assert_int_equal(stats.hits, 0);
+    perc_cache_destroy(cache);
+}
+
+static void test_exclusive_class_chokes(void **state) {
+    (void)state;
+    perc_cache_t *cache = perc_cache_create(1 << 20, RATE, fake_render, NULL);
+    assert_true(play_when_ready(cache, 46, 100));
+    assert_true(play_when_ready(cache, 42, 100));
+    for (int i = 0; i < 4; i++) {
+        clear();
+        perc_cache_mix(cache, out, 2, PERIOD);
+    }
+
+    /* Open hi-hat, then closed: the open one fades over PERC_CACHE_FADE frames */
+    assert_true(perc_cache_play(cache, 46, 100, 0));
+    clear();
+    perc_cache_mix(cache, out, 2, PERIOD);
+    float level = left[0];
+    assert_true(perc_cache_play(cache, 42, 100, 0));
+    clear();
+    perc_cache_mix(cache, out, 2, PERIOD);
+    clear();
+    perc_cache_mix(cache, out, 2, PERIOD);
+    assert_true(fabsf(left[0] - level) < 1e-5f);
+    perc_cache_destroy(cache);
+}
+
+static void test_silence_fades_hits(void **state) {
+    (void)state;
+    perc_cache_t *cache = perc_cache_create(1 << 20, RATE, fake_render, NULL);
+    assert_true(play_when_ready(cache, 36, 127));
+    perc_cache_silence(cache);
+    clear();
+    perc_cache_mix(cache, out, 2, PERIOD);
+    assert_true(left[0] > left[PERIOD / 2]);
+    clear();
+    perc_cache_mix(cache, out, 2, PERIOD);
+    assert_true(left[0] == 0.0f);
+    perc_cache_destroy(cache);
+}
+
+static void test_budget_evicts_least_recent(void **state) {
+    (void)state;
+    /* Room for two entries */
+    size_t budget = 2 * (sizeof(float) * 2 * HIT + 128);
+    perc_cache_t *cache = perc_cache_create(budget, RATE, fake_render, NULL);
+    assert_true(play_when_ready(cache, 35, 100));
+    assert_true(play_when_ready(cache, 36, 100));
+    assert_true(play_when_ready(cache, 35, 100));
+    assert_true(play_when_ready(cache, 37, 100));
+
+    perc_cache_stats_t stats;
+    perc_cache_get_stats(cache, &stats);
+    assert_int_equal(stats.entries, 2);
+    assert_true(stats.evictions >= 1);
+    assert_true(stats.bytes <= budget);
+    /* 36 was played least recently */
+    assert_true(perc_cache_play(cache, 35, 100, 0));
+    assert_false(perc_cache_play(cache, 36, 100, 0));
+    perc_cache_destroy(cache);
+}
+
+static void test_invalid_arguments(void **state) {
+    (void)state;
+    assert_null(perc_cache_create(0, RATE, fake_render, NULL));
+    assert_null(perc_cache_create(1024, RATE, NULL, NULL));
+    assert_false(perc_cache_play(NULL, 36, 100, 0));
+    perc_cache_mix(NULL, out, 2, PERIOD);
+    perc_cache_invalidate(NULL);
+    perc_cache_silence(NULL);
+    perc_cache_log(NULL);
+    perc_cache_destroy(NULL);
+
+    perc_cache_t *cache = perc_cache_create(1024, RATE, fake_render, NULL);
+    assert_false(perc_cache_play(cache, 128, 100, 0));
+    assert_false(perc_cache_play(cache, 36, 0, 0));
+    perc_cache_destroy(cache);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_miss_then_hit),
+        cmocka_unit_test(test_offset_starts_inside_period),
+        cmocka_unit_test(test_invalidate_rerenders),
+        cmocka_unit_test(test_uncacheable_stays_live),
+        cmocka_unit_test(test_exclusive_class_chokes),
+        cmocka_unit_test(test_silence_fades_hits),
+        cmocka_unit_test(test_budget_evicts_least_recent),
+        cmocka_unit_test(test_invalid_arguments),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,362 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include "config.h"
+#include "synth.h"
+#include "monotonic.h"
+#include "test_soundfont.h"
+#include "rt_sentinel.h"
+
+/*
+ * Performance regression gates.
+ *
+ * Fixed workloads run through the real engine with the offline driver:
+ *   - dispatch: ns per raw MIDI event through synth_process_midi_data
+ *   - render:   realtime factor (render time / audio time) for a dense
+ *               multi-channel passage
+ *   - memory:   peak RSS of the process
+ *   - RT safety: allocations and blocking calls made inside the render
+ *               callback (only with -DENABLE_RT_SENTINEL=ON)
+ *
+ * Timings are normalized by a CPU calibration loop and compared with the
+ * baseline in perf_baseline.conf, which stores the calibration time of the
+ * machine it was recorded on. A metric fails when it exceeds its baseline
+ * by more than the configured tolerance. A missing baseline fails the
+ * timing and memory gates; the absolute ceilings are always checked.
+ *
+ * Every run appends its results to a CSV file for trend tracking
+ * (MIDISYNTHD_PERF_CSV, default perf_results.csv in the build tree).
+ * MIDISYNTHD_PERF_UPDATE=1 writes a baseline from the current run into the
+ * build tree; copy it over tests/perf_baseline.conf to adopt it.
+ */
+
+#ifndef PERF_BASELINE_FILE
+#define PERF_BASELINE_FILE "perf_baseline.conf"
+#endif
+
+#ifndef PERF_BASELINE_OUTPUT
+#define PERF_BASELINE_OUTPUT "perf_baseline.new.conf"
+#endif
+
+#ifndef PERF_RESULTS_FILE
+#define PERF_RESULTS_FILE "perf_results.csv"
+#endif
+
+#define PERF_SAMPLE_RATE        48000
+#define PERF_BLOCK              64
+#define PERF_DISPATCH_EVENTS    200000
+#define PERF_RENDER_SECONDS     10
+#define PERF_REPEATS            3
+
+/* Ceilings that hold on any machine able to run the daemon at all */
+#define PERF_MAX_NS_PER_EVENT   20000.0
+#define PERF_MAX_RENDER_RTF     1.0
+#define PERF_MAX_RSS_KB         (512 * 1024)
+
+typedef struct {
+    double calibration_ns;
+    double ns_per_event;
+    double render_rtf;
+    long peak_rss_kb;
+    double time_tolerance;
+    double rss_tolerance;
+} perf_metrics_t;
+
+static char sf_path[256];
+static perf_metrics_t current;
+
+/**
+ * Fixed floating-point workload used to normalize timings across machines
+ */
+static double calibrate(void) {
+    double best = 0.0;
+    for (int r = 0; r < PERF_REPEATS; r++) {
+        volatile float acc = 0.0f;
+        float x = 0.5f, y = 0.25f;
+        uint64_t start = monotonic_ns();
+        for (int i = 0; i < 20000000; i++) {
+            x = x * 0.999f + y;
+            y = y * 0.998f + 0.001f;
+            acc += x * y;
+        }
+        double t = (double)(monotonic_ns() - start);
+        if (best == 0.0 || t < best) best = t;
+    }
+    return best;
+}
+
+static synth_t *open_engine(midisynthd_config_t *cfg) {
+    config_init_defaults(cfg);
+    cfg->audio_driver = AUDIO_DRIVER_OFFLINE;
+    cfg->sample_rate = PERF_SAMPLE_RATE;
+    cfg->buffer_size = PERF_BLOCK;
+    cfg->realtime_priority = false;
+    cfg->reverb_enabled = true;
+    cfg->chorus_enabled = true;
+    strncpy(cfg->soundfonts[0].path, sf_path, CONFIG_MAX_PATH_LEN - 1);
+    cfg->soundfonts[0].enabled = true;
+    cfg->soundfont_count = 1;
+    return synth_init(cfg, NULL);
+}
+
+/**
+ * Dispatch cost: note on/off pairs and controller traffic on all channels
+ */
+static double measure_dispatch(void) {
+    midisynthd_config_t cfg;
+    synth_t *synth = open_engine(&cfg);
+    if (!synth) return -1.0;
+
+    float left[PERF_BLOCK], right[PERF_BLOCK];
+    double best = 0.0;
+
+    for (int r = 0; r < PERF_REPEATS; r++) {
+        uint64_t spent = 0;
+        for (int i = 0; i < PERF_DISPATCH_EVENTS; i += 256) {
+            uint64_t start = monotonic_ns();
+            for (int j = 0; j < 256; j += 4) {
+                uint8_t ch = (uint8_t)((i + j) / 4 % 16);
+                uint8_t key = (uint8_t)(36 + (i + j) % 48);
+                uint8_t on[3] = { (uint8_t)(0x90 | ch), key, 100 };
+                uint8_t cc[3] = { (uint8_t)(0xB0 | ch), 1, (uint8_t)(j & 0x7F) };
+                uint8_t bend[3] = { (uint8_t)(0xE0 | ch), 0, (uint8_t)(0x40 + (j & 7)) };
+                uint8_t off[3] = { (uint8_t)(0x80 | ch), key, 0 };
+                synth_process_midi_data(synth, on, 3);
+                synth_process_midi_data(synth, cc, 3);
+                synth_process_midi_data(synth, bend, 3);
+                synth_process_midi_data(synth, off, 3);
+            }
+            spent += monotonic_ns() - start;
+            /* Keep voice state bounded like a real stream would */
+            synth_render(synth, PERF_BLOCK, left, right);
+        }
+        double ns = (double)spent / PERF_DISPATCH_EVENTS;
+        if (best == 0.0 || ns < best) best = ns;
+    }
+
+    synth_cleanup(synth);
+    return best;
+}
+
+/**
+ * Render cost: 16 channels of sustained chords with reverb and chorus
+ * mixed into the output
+ */
+static double measure_render(void) {
+    midisynthd_config_t cfg;
+    synth_t *synth = open_engine(&cfg);
+    if (!synth) return -1.0;
+
+    float left[PERF_BLOCK], right[PERF_BLOCK];
+    const int blocks = PERF_RENDER_SECONDS * PERF_SAMPLE_RATE / PERF_BLOCK;
+    const int restrike = PERF_SAMPLE_RATE / 4 / PERF_BLOCK;
+    double best = 0.0;
+
+    for (int r = 0; r < PERF_REPEATS; r++) {
+        uint64_t start = monotonic_ns();
+        for (int b = 0; b < blocks; b++) {
+            if (b % restrike == 0) {
+                for (int ch = 0; ch < 16; ch++) {
+                    for (int n = 0; n < 4; n++) {
+                        int key = 40 + (b / restrike + ch + n * 5) % 40;
+                        synth_note_off(synth, ch, key - 5, 0);
+                        synth_note_on(synth, ch, key, 90);
+                    }
+                }
+            }
+            synth_render(synth, PERF_BLOCK, left, right);
+        }
+        double rtf = (double)(monotonic_ns() - start) / 1e9 / PERF_RENDER_SECONDS;
+        synth_all_notes_off(synth);
+        if (best == 0.0 || rtf < best) best = rtf;
+    }
+
+    synth_cleanup(synth);
+    return best;
+}
+
+static long peak_rss_kb(void) {
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) != 0) return -1;
+    return ru.ru_maxrss;
+}
+
+/* --- Baseline and results ------------------------------------------------ */
+
+static int load_baseline(perf_metrics_t *base) {
+    FILE *f = fopen(PERF_BASELINE_FILE, "r");
+    if (!f) return -1;
+
+    memset(base, 0, sizeof(*base));
+    base->time_tolerance = 0.25;
+    base->rss_tolerance = 0.20;
+
+    char line[256];
+    while (fgets(line, sizeof(line), f)) {
+        char key[64];
+        double value;
+        if (line[0] == '#' || sscanf(line, " %63[^= ] = %lf", key, &value) != 2) continue;
+        if (strcmp(key, "calibration_ns") == 0) base->calibration_ns = value;
+        else if (strcmp(key, "ns_per_event") == 0) base->ns_per_event = value;
+        else if (strcmp(key, "render_rtf") == 0) base->render_rtf = value;
+        else if (strcmp(key, "peak_rss_kb") == 0) base->peak_rss_kb = (long)value;
+        else if (strcmp(key, "time_tolerance") == 0) base->time_tolerance = value;
+        else if (strcmp(key, "rss_tolerance") == 0) base->rss_tolerance = value;
+    }
+    fclose(f);
+    return base->calibration_ns > 0.0 ? 0 : -1;
+}
+
+static int save_baseline(const perf_metrics_t *m) {
+    FILE *f = fopen(PERF_BASELINE_OUTPUT, "w");
+    if (!f) return -1;
+    fprintf(f, "# Performance baseline for test_perf\n");
+    fprintf(f, "# Regenerate with MIDISYNTHD_PERF_UPDATE=1 on an idle machine\n");
+    fprintf(f, "calibration_ns = %.0f\n", m->calibration_ns);
+    fprintf(f, "ns_per_event = %.1f\n", m->ns_per_event);
+    fprintf(f, "render_rtf = %.4f\n", m->render_rtf);
+    fprintf(f, "peak_rss_kb = %ld\n", m->peak_rss_kb);
+    fprintf(f, "time_tolerance = %.2f\n", m->time_tolerance > 0 ? m->time_tolerance : 0.25);
+    fprintf(f, "rss_tolerance = %.2f\n", m->rss_tolerance > 0 ? m->rss_tolerance : 0.20);
+    return fclose(f);
+}
+
+static void append_results(const perf_metrics_t *m) {
+    const char *path = getenv("MIDISYNTHD_PERF_CSV");
+    if (!path) path = PERF_RESULTS_FILE;
+
+    FILE *f = fopen(path, "a");
+    if (!f) return;
+    if (ftell(f) == 0) {
+        fprintf(f, "timestamp,calibration_ns,ns_per_event,render_rtf,peak_rss_kb\n");
+    }
+    fprintf(f, "%ld,%.0f,%.1f,%.4f,%ld\n", (long)time(NULL),
+            m->calibration_ns, m->ns_per_event, m->render_rtf, m->peak_rss_kb);
+    fclose(f);
+}
+
+/* --- Tests --------------------------------------------------------------- */
+
+static int setup(void **state) {
+    (void)state;
+    snprintf(sf_path, sizeof(sf_path), "/tmp/midisynthd_perf_%d.sf2", (int)getpid());
+    if (test_soundfont_write(sf_path) < 0) return -1;
+
+    memset(&current, 0, sizeof(current));
+    current.calibration_ns = calibrate();
+    current.ns_per_event = measure_dispatch();
+    current.render_rtf = measure_render();
+    current.peak_rss_kb = peak_rss_kb();
+    RT_SENTINEL_REPORT();
+
+    printf("calibration %.0f ns, dispatch %.1f ns/event, render RTF %.4f, peak RSS %ld KiB\n",
+           current.calibration_ns, current.ns_per_event, current.render_rtf, current.peak_rss_kb);
+    append_results(&current);
+
+    const char *update = getenv("MIDISYNTHD_PERF_UPDATE");
+    if (update && strcmp(update, "1") == 0) {
+        if (save_baseline(&current) != 0) return -1;
+        printf("Baseline written to %s; copy it to %s to adopt it\n",
+               PERF_BASELINE_OUTPUT, PERF_BASELINE_FILE);
+    }
+    return 0;
+}
+
+static int teardown(void **state) {
+    (void)state;
+    unlink(sf_path);
+    return 0;
+}
+
+/**
+ * Report a gate that has nothing to compare against
+ */
+static void missing_baseline(const char *name) {
+    printf("%s: no baseline in %s, run with MIDISYNTHD_PERF_UPDATE=1\n", name, PERF_BASELINE_FILE);
+    fail();
+}
+
+/**
+ * Check a timing against its baseline after normalizing machine speed
+ */
+static void check_timing(const char *name, double measured, double baseline_value,
+                         const perf_metrics_t *base) {
+    double scaled = measured * base->calibration_ns / current.calibration_ns;
+    double limit = baseline_value * (1.0 + base->time_tolerance);
+    printf("%s: %.4f normalized (baseline %.4f, limit %.4f)\n", name, scaled, baseline_value, limit);
+    assert_true(scaled <= limit);
+}
+
+static void test_dispatch_cost(void **state) {
+    (void)state;
+    assert_true(current.ns_per_event > 0.0);
+    assert_true(current.ns_per_event < PERF_MAX_NS_PER_EVENT);
+
+    perf_metrics_t base;
+    if (load_baseline(&base) < 0 || base.ns_per_event <= 0.0) {
+        missing_baseline("ns/event");
+        return;
+    }
+    check_timing("ns/event", current.ns_per_event, base.ns_per_event, &base);
+}
+
+static void test_render_realtime_factor(void **state) {
+    (void)state;
+    assert_true(current.render_rtf > 0.0);
+    assert_true(current.render_rtf < PERF_MAX_RENDER_RTF);
+
+    perf_metrics_t base;
+    if (load_baseline(&base) < 0 || base.render_rtf <= 0.0) {
+        missing_baseline("render RTF");
+        return;
+    }
+    check_timing("render RTF", current.render_rtf, base.render_rtf, &base);
+}
+
+static void test_peak_rss(void **state) {
+    (void)state;
+    assert_true(current.peak_rss_kb > 0);
+    assert_true(current.peak_rss_kb < PERF_MAX_RSS_KB);
+
+    perf_metrics_t base;
+    if (load_baseline(&base) < 0 || base.peak_rss_kb <= 0) {
+        missing_baseline("peak RSS");
+        return;
+    }
+    long limit = (long)(base.peak_rss_kb * (1.0 + base.rss_tolerance));
+    printf("peak RSS: %ld KiB (baseline %ld, limit %ld)\n", current.peak_rss_kb, base.peak_rss_kb, limit);
+    assert_true(current.peak_rss_kb <= limit);
+}
+
+static void test_rt_safety(void **state) {
+    (void)state;
+#if HAVE_RT_SENTINEL
+    /* Both workloads above ran every render period through the marked callback */
+    rt_sentinel_stats_t stats;
+    rt_sentinel_get_stats(&stats);
+    printf("RT sentinel: %llu trapped calls at %d sites\n",
+           (unsigned long long)stats.total, stats.sites);
+    assert_int_equal(stats.total, 0);
+#else
+    skip();
+#endif
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_dispatch_cost),
+        cmocka_unit_test(test_render_realtime_factor),
+        cmocka_unit_test(test_peak_rss),
+        cmocka_unit_test(test_rt_safety),
+    };
+    return cmocka_run_group_tests(tests, setup, teardown);
+}
@@ -0,0 +1,132 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <string.h>
+
+#include "playback_ring.h"
+
+#define BLOCK   256
+#define PERIOD  64
+
+static float left[BLOCK], right[BLOCK];
+static float *out[2] = { left, right };
+
+/* Render one block holding its own frame numbers, left positive and right negative */
+static void render_block(playback_ring_t *ring) {
+    float *block[2];
+    assert_true(playback_ring_claim(ring, block));
+    for (int i = 0; i < ring->block; i++) {
+        block[0][i] = (float)(ring->write + (uint64_t)i);
+        block[1][i] = -block[0][i];
+    }
+    playback_ring_commit(ring);
+}
+
+static void test_claim_until_full(void **state) {
+    (void)state;
+    playback_ring_t ring;
+    assert_int_equal(playback_ring_init(&ring, BLOCK, 2), 0);
+    assert_int_equal(ring.frames, 2 * BLOCK);
+
+    render_block(&ring);
+    render_block(&ring);
+    float *block[2];
+    assert_false(playback_ring_claim(&ring, block));
+
+    /* Less than a block mixed leaves no room, a whole block does */
+    memset(left, 0, sizeof(left));
+    assert_false(playback_ring_mix(&ring, PERIOD, 2, out));
+    assert_false(playback_ring_claim(&ring, block));
+    for (int i = 0; i < BLOCK / PERIOD - 2; i++) {
+        assert_false(playback_ring_mix(&ring, PERIOD, 2, out));
+    }
+    assert_true(playback_ring_mix(&ring, PERIOD, 2, out));
+    assert_true(playback_ring_claim(&ring, block));
+    playback_ring_free(&ring);
+}
+
+static void test_mix_adds_in_order_across_wrap(void **state) {
+    (void)state;
+    playback_ring_t ring;
+    assert_int_equal(playback_ring_init(&ring, BLOCK, 2), 0);
+    render_block(&ring);
+    render_block(&ring);
+
+    /* Consume 1.5 blocks, refill, then read across the end of the buffer */
+    for (int i = 0; i < 6; i++) {
+        memset(left, 0, sizeof(left));
+        playback_ring_mix(&ring, PERIOD, 2, out);
+    }
+    render_block(&ring);
+
+    memset(left, 0, sizeof(left));
+    memset(right, 0, sizeof(right));
+    for (int i = 0; i < BLOCK; i++) left[i] = 0.5f;
+    playback_ring_mix(&ring, BLOCK, 2, out);
+    for (int i = 0; i < BLOCK; i++) {
+        float frame = (float)(6 * PERIOD + i);
+        assert_true(left[i] == frame + 0.5f);
+        assert_true(right[i] == -frame);
+    }
+    assert_int_equal(ring.underruns, 0);
+    assert_int_equal(ring.play_offset, 0);
+    playback_ring_free(&ring);
+}
+
+static void test_underrun_holds_clock_back(void **state) {
+    (void)state;
+    playback_ring_t ring;
+    assert_int_equal(playback_ring_init(&ring, BLOCK, 2), 0);
+    assert_int_equal(playback_ring_clock(&ring, 1000), 1000);
+
+    /* Empty ring: the period stays as it was and the clock slips by it */
+    for (int i = 0; i < PERIOD; i++) left[i] = 0.25f;
+    assert_true(playback_ring_mix(&ring, PERIOD, 2, out));
+    assert_true(left[0] == 0.25f && left[PERIOD - 1] == 0.25f);
+    assert_int_equal(ring.underruns, 1);
+    assert_int_equal(ring.play_offset, PERIOD);
+    assert_int_equal(playback_ring_clock(&ring, 1000), 1000 - PERIOD);
+
+    /* Partial cover counts the missing frames only */
+    render_block(&ring);
+    for (int i = 0; i < BLOCK / PERIOD - 1; i++) {
+        playback_ring_mix(&ring, PERIOD, 2, out);
+    }
+    memset(left, 0, sizeof(left));
+    playback_ring_mix(&ring, 2 * PERIOD, 2, out);
+    assert_true(left[PERIOD - 1] == (float)(BLOCK - 1));
+    assert_true(left[PERIOD] == 0.0f);
+    assert_int_equal(ring.underruns, 2);
+    assert_int_equal(ring.play_offset, 2 * PERIOD);
+
+    /* The clock never runs below zero */
+    assert_int_equal(playback_ring_clock(&ring, PERIOD), 0);
+    playback_ring_free(&ring);
+}
+
+static void test_mix_skips_missing_outputs(void **state) {
+    (void)state;
+    playback_ring_t ring;
+    assert_int_equal(playback_ring_init(&ring, BLOCK, 2), 0);
+    render_block(&ring);
+    render_block(&ring);
+
+    float *mono[2] = { left, NULL };
+    memset(left, 0, sizeof(left));
+    playback_ring_mix(&ring, PERIOD, 2, mono);
+    assert_true(left[PERIOD - 1] == (float)(PERIOD - 1));
+    playback_ring_mix(&ring, PERIOD, 1, out);
+    assert_int_equal(ring.read, 2 * PERIOD);
+    playback_ring_free(&ring);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_claim_until_full),
+        cmocka_unit_test(test_mix_adds_in_order_across_wrap),
+        cmocka_unit_test(test_underrun_holds_clock_back),
+        cmocka_unit_test(test_mix_skips_missing_outputs),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,110 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "rt_sentinel.h"
+
+/* Keep the compiler from pairing or eliding the allocations */
+static void *volatile sink;
+
+static void allocate_once(void) {
+    sink = malloc(32);
+    free(sink);
+}
+
+static void test_unmarked_calls_pass(void **state) {
+    (void)state;
+    rt_sentinel_reset();
+    allocate_once();
+    syslog(LOG_DEBUG, "unmarked");
+
+    rt_sentinel_stats_t stats;
+    rt_sentinel_get_stats(&stats);
+    assert_int_equal(stats.total, 0);
+    assert_int_equal(stats.sites, 0);
+}
+
+static void test_marked_calls_trapped(void **state) {
+    (void)state;
+    rt_sentinel_reset();
+    RT_SENTINEL_ENTER();
+    allocate_once();
+    usleep(0);
+    RT_SENTINEL_LEAVE();
+
+    rt_sentinel_stats_t stats;
+    rt_sentinel_get_stats(&stats);
+    assert_int_equal(stats.calls[RT_CALL_MALLOC], 1);
+    assert_int_equal(stats.calls[RT_CALL_FREE], 1);
+    assert_int_equal(stats.calls[RT_CALL_SLEEP], 1);
+    assert_true(stats.sites >= 3);
+}
+
+static void test_sites_deduplicated(void **state) {
+    (void)state;
+    rt_sentinel_reset();
+    RT_SENTINEL_ENTER();
+    for (int i = 0; i < 100; i++) {
+        allocate_once();
+    }
+    RT_SENTINEL_LEAVE();
+
+    rt_sentinel_stats_t stats;
+    rt_sentinel_get_stats(&stats);
+    assert_int_equal(stats.calls[RT_CALL_MALLOC], 100);
+    assert_int_equal(stats.sites, 2);
+}
+
+static void test_sections_nest(void **state) {
+    (void)state;
+    rt_sentinel_reset();
+    RT_SENTINEL_ENTER();
+    RT_SENTINEL_ENTER();
+    RT_SENTINEL_LEAVE();
+    syslog(LOG_DEBUG, "still marked");
+    RT_SENTINEL_LEAVE();
+    syslog(LOG_DEBUG, "unmarked");
+
+    rt_sentinel_stats_t stats;
+    rt_sentinel_get_stats(&stats);
+    assert_int_equal(stats.calls[RT_CALL_SYSLOG], 1);
+}
+
+static void *marked_thread(void *arg) {
+    (void)arg;
+    RT_SENTINEL_ENTER();
+    allocate_once();
+    RT_SENTINEL_LEAVE();
+    return NULL;
+}
+
+static void test_mark_is_per_thread(void **state) {
+    (void)state;
+    rt_sentinel_reset();
+    pthread_t thread;
+    assert_int_equal(pthread_create(&thread, NULL, marked_thread, NULL), 0);
+    pthread_join(thread, NULL);
+    allocate_once();
+
+    rt_sentinel_stats_t stats;
+    rt_sentinel_get_stats(&stats);
+    assert_int_equal(stats.calls[RT_CALL_MALLOC], 1);
+    rt_sentinel_report();
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_unmarked_calls_pass),
+        cmocka_unit_test(test_marked_calls_trapped),
+        cmocka_unit_test(test_sites_deduplicated),
+        cmocka_unit_test(test_sections_nest),
+        cmocka_unit_test(test_mark_is_per_thread),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,360 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "config.h"
+#include "synth.h"
+#include "event_loop.h"
+#include "rtp_midi.h"
+
+extern int stub_scheduled_count;
+extern uint8_t stub_scheduled_msg[3];
+extern int stub_midi_count;
+extern uint8_t stub_last_midi[3];
+
+#define PEER_SSRC   0x12345678
+#define PEER_TOKEN  0xCAFEF00D
+
+/* Local peer: control and data sockets talking to the endpoint on loopback */
+typedef struct {
+    midisynthd_config_t cfg;
+    event_loop_t *loop;
+    synth_t *synth;
+    rtp_midi_t *rtp;
+    int ctl;
+    int data;
+    struct sockaddr_in ctl_addr;
+    struct sockaddr_in data_addr;
+} peer_t;
+
+static void put_be32(uint8_t *p, uint32_t v) {
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static uint32_t get_be32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static struct sockaddr_in loopback(int port) {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    return addr;
+}
+
+/* Find a port whose successor is free as well */
+static int free_port_pair(void) {
+    for (int attempt = 0; attempt < 50; attempt++) {
+        int a = socket(AF_INET, SOCK_DGRAM, 0);
+        struct sockaddr_in addr = loopback(0);
+        socklen_t len = sizeof(addr);
+        assert_int_equal(bind(a, (struct sockaddr *)&addr, sizeof(addr)), 0);
+        assert_int_equal(getsockname(a, (struct sockaddr *)&addr, &len), 0);
+        int port = ntohs(addr.sin_port);
+        int b = socket(AF_INET, SOCK_DGRAM, 0);
+        struct sockaddr_in next = loopback(port + 1);
+        int ok = port < 65534 && bind(b, (struct sockaddr *)&next, sizeof(next)) == 0;
+        close(a);
+        close(b);
+        if (ok) return port;
+    }
+    return -1;
+}
+
+static void pump(peer_t *p) {
+    for (int i = 0; i < 3; i++) event_loop_run_once(p->loop, 10);
+}
+
+/* Receive a reply on @p fd, driving the endpoint's loop meanwhile */
+static ssize_t receive(peer_t *p, int fd, uint8_t *buf, size_t len) {
+    for (int i = 0; i < 50; i++) {
+        event_loop_run_once(p->loop, 10);
+        ssize_t n = recv(fd, buf, len, MSG_DONTWAIT);
+        if (n >= 0) return n;
+    }
+    return -1;
+}
+
+static void send_to(int fd, const struct sockaddr_in *to, const uint8_t *buf, size_t len) {
+    assert_int_equal(sendto(fd, buf, len, 0, (const struct sockaddr *)to, sizeof(*to)), (ssize_t)len);
+}
+
+static size_t session_packet(uint8_t *buf, const char *cmd) {
+    buf[0] = 0xFF;
+    buf[1] = 0xFF;
+    buf[2] = (uint8_t)cmd[0];
+    buf[3] = (uint8_t)cmd[1];
+    put_be32(buf + 4, 2);
+    put_be32(buf + 8, PEER_TOKEN);
+    put_be32(buf + 12, PEER_SSRC);
+    memcpy(buf + 16, "peer", 5);
+    return 21;
+}
+
+static void open_peer(peer_t *p) {
+    memset(p, 0, sizeof(*p));
+    config_init_defaults(&p->cfg);
+    p->cfg.rtpmidi_port = free_port_pair();
+    assert_true(p->cfg.rtpmidi_port > 0);
+    p->loop = event_loop_create();
+    p->synth = synth_init(&p->cfg, NULL);
+    p->rtp = rtp_midi_init(&p->cfg, p->synth, p->loop);
+    assert_non_null(p->rtp);
+
+    p->ctl = socket(AF_INET, SOCK_DGRAM, 0);
+    p->data = socket(AF_INET, SOCK_DGRAM, 0);
+    p->ctl_addr = loopback(p->cfg.rtpmidi_port);
+    p->data_addr = loopback(p->cfg.rtpmidi_port + 1);
+    stub_scheduled_count = 0;
+    stub_midi_count = 0;
+}
+
+static void close_peer(peer_t *p) {
+    rtp_midi_cleanup(p->rtp);
+    close(p->ctl);
+    close(p->data);
+    synth_cleanup(p->synth);
+    event_loop_destroy(p->loop);
+}
+
+/* Invite on both ports and check the replies */
+static void join(peer_t *p) {
+    uint8_t buf[128];
+    size_t len = session_packet(buf, "IN");
+    send_to(p->ctl, &p->ctl_addr, buf, len);
+    ssize_t n = receive(p, p->ctl, buf, sizeof(buf));
+    assert_true(n >= 16);
+    assert_memory_equal(buf, "\xFF\xFFOK", 4);
+    assert_int_equal(get_be32(buf + 8), PEER_TOKEN);
+
+    len = session_packet(buf, "IN");
+    send_to(p->data, &p->data_addr, buf, len);
+    n = receive(p, p->data, buf, sizeof(buf));
+    assert_true(n >= 16);
+    assert_memory_equal(buf, "\xFF\xFFOK", 4);
+}
+
+/* RTP packet with a MIDI command section of @p list_len bytes, then @p journal */
+static void send_rtp(peer_t *p, uint16_t seq, uint32_t ts, uint8_t flags,
+                     const uint8_t *list, size_t list_len,
+                     const uint8_t *journal, size_t journal_len) {
+    uint8_t buf[256];
+    buf[0] = 0x80;
+    buf[1] = 0x61;
+    buf[2] = seq >> 8;
+    buf[3] = seq & 0xFF;
+    put_be32(buf + 4, ts);
+    put_be32(buf + 8, PEER_SSRC);
+    buf[12] = flags | (uint8_t)list_len;
+    memcpy(buf + 13, list, list_len);
+    if (journal_len) memcpy(buf + 13 + list_len, journal, journal_len);
+    send_to(p->data, &p->data_addr, buf, 13 + list_len + journal_len);
+    pump(p);
+}
+
+static void test_session(void **state) {
+    (void)state;
+    peer_t peer;
+    open_peer(&peer);
+    join(&peer);
+
+    rtp_midi_stats_t stats;
+    rtp_midi_get_stats(peer.rtp, &stats);
+    assert_int_equal(stats.sessions, 1);
+    assert_int_equal(stats.active_peers, 1);
+
+    /* Clock sync: endpoint answers count 0 with its own time, takes count 2 */
+    uint8_t ck[36] = { 0xFF, 0xFF, 'C', 'K' };
+    put_be32(ck + 4, PEER_SSRC);
+    ck[8] = 0;
+    put_be32(ck + 16, 5000);
+    send_to(peer.data, &peer.data_addr, ck, sizeof(ck));
+    uint8_t reply[64];
+    assert_int_equal(receive(&peer, peer.data, reply, sizeof(reply)), 36);
+    assert_memory_equal(reply, "\xFF\xFF" "CK", 4);
+    assert_int_equal(reply[8], 1);
+    assert_int_equal(get_be32(reply + 16), 5000);
+
+    memcpy(ck, reply, sizeof(ck));
+    put_be32(ck + 4, PEER_SSRC);
+    ck[8] = 2;
+    put_be32(ck + 32, 5010);
+    send_to(peer.data, &peer.data_addr, ck, sizeof(ck));
+    pump(&peer);
+    rtp_midi_get_stats(peer.rtp, &stats);
+    assert_int_equal(stats.syncs, 1);
+
+    /* Data invitation from an unknown session is declined */
+    uint8_t buf[64];
+    size_t len = session_packet(buf, "IN");
+    put_be32(buf + 12, 0x99);
+    send_to(peer.data, &peer.data_addr, buf, len);
+    assert_true(receive(&peer, peer.data, reply, sizeof(reply)) >= 4);
+    assert_memory_equal(reply, "\xFF\xFFNO", 4);
+
+    len = session_packet(buf, "BY");
+    send_to(peer.ctl, &peer.ctl_addr, buf, len);
+    pump(&peer);
+    rtp_midi_get_stats(peer.rtp, &stats);
+    assert_int_equal(stats.active_peers, 0);
+    assert_int_equal(stats.errors, 0);
+
+    close_peer(&peer);
+}
+
+static void test_commands(void **state) {
+    (void)state;
+    peer_t peer;
+    open_peer(&peer);
+    join(&peer);
+
+    /* Note on, then a delta time and a running-status note on */
+    const uint8_t list[] = { 0x90, 60, 100, 0x0A, 64, 90 };
+    send_rtp(&peer, 1, 100000, 0, list, sizeof(list), NULL, 0);
+
+    rtp_midi_stats_t stats;
+    rtp_midi_get_stats(peer.rtp, &stats);
+    assert_int_equal(stats.packets, 1);
+    assert_int_equal(stats.commands, 2);
+    assert_int_equal(stats.scheduled, 2);
+    assert_int_equal(stub_scheduled_count, 2);
+    assert_memory_equal(stub_scheduled_msg, "\x90\x40\x5A", 3);
+
+    /* Phantom status carries running status from the previous packet */
+    const uint8_t phantom[] = { 65, 80 };
+    send_rtp(&peer, 2, 105000, 0x10, phantom, sizeof(phantom), NULL, 0);
+    rtp_midi_get_stats(peer.rtp, &stats);
+    assert_int_equal(stats.commands, 3);
+    assert_memory_equal(stub_scheduled_msg, "\x90\x41\x50", 3);
+
+    /* Well in the past relative to the first packet: played at once */
+    const uint8_t old[] = { 0xB0, 7, 100 };
+    send_rtp(&peer, 3, 100000 - 1000, 0, old, sizeof(old), NULL, 0);
+    rtp_midi_get_stats(peer.rtp, &stats);
+    assert_int_equal(stats.late, 1);
+    assert_memory_equal(stub_last_midi, "\xB0\x07\x64", 3);
+
+    /* Duplicates are ignored */
+    send_rtp(&peer, 3, 100000, 0, old, sizeof(old), NULL, 0);
+    rtp_midi_get_stats(peer.rtp, &stats);
+    assert_int_equal(stats.packets, 3);
+    assert_int_equal(stats.lost, 0);
+    assert_int_equal(stats.errors, 0);
+
+    close_peer(&peer);
+}
+
+static void test_journal_recovery(void **state) {
+    (void)state;
+    peer_t peer;
+    open_peer(&peer);
+    join(&peer);
+
+    const uint8_t on[] = { 0x90, 60, 100 };
+    send_rtp(&peer, 10, 5000, 0, on, sizeof(on), NULL, 0);
+
+    /*
+     * Packet 11 is lost. Packet 12 carries a journal for channel 1 saying
+     * volume is 100, note 64 was played and note 60 has been released.
+     */
+    const uint8_t journal[] = {
+        0x20, 0x00, 0x0B,           /* A, one channel journal, checkpoint 11 */
+        0x00, 0x0B, 0x48,           /* Channel 0, length 11, chapters C and N */
+        0x00, 0x07, 0x64,           /* C: one entry, CC 7 = 100 */
+        0x01, 0x77,                 /* N: one log, offbits octet 7 only */
+        0x40, 0xDA,                 /* Note 64, Y, velocity 90 */
+        0x08,                       /* Note 60 off */
+    };
+    const uint8_t cc[] = { 0xB0, 10, 64 };
+    send_rtp(&peer, 12, 10000, 0x40, cc, sizeof(cc), journal, sizeof(journal));
+
+    rtp_midi_stats_t stats;
+    rtp_midi_get_stats(peer.rtp, &stats);
+    assert_int_equal(stats.lost, 1);
+    assert_int_equal(stats.recoveries, 1);
+    assert_int_equal(stats.recovered, 3);
+    assert_int_equal(stats.errors, 0);
+    /* Recovery plays immediately; the release of note 60 is last */
+    assert_int_equal(stub_midi_count, 3);
+    assert_memory_equal(stub_last_midi, "\x80\x3C\x00", 3);
+
+    close_peer(&peer);
+}
+
+static void test_malformed(void **state) {
+    (void)state;
+    peer_t peer;
+    open_peer(&peer);
+
+    /* Data before any session */
+    const uint8_t on[] = { 0x90, 60, 100 };
+    send_rtp(&peer, 1, 0, 0, on, sizeof(on), NULL, 0);
+    rtp_midi_stats_t stats;
+    rtp_midi_get_stats(peer.rtp, &stats);
+    assert_int_equal(stats.errors, 1);
+
+    join(&peer);
+    /* Truncated command, data byte without status, over-long delta time */
+    const uint8_t trunc[] = { 0x90, 60 };
+    send_rtp(&peer, 2, 0, 0, trunc, sizeof(trunc), NULL, 0);
+    const uint8_t nostatus[] = { 60, 100 };
+    send_rtp(&peer, 3, 0, 0, nostatus, sizeof(nostatus), NULL, 0);
+    const uint8_t delta[] = { 0x90, 60, 100, 0xFF, 0xFF, 0xFF, 0xFF, 0x7F };
+    send_rtp(&peer, 4, 0, 0, delta, sizeof(delta), NULL, 0);
+
+    uint8_t junk[8] = { 0x12, 0x34 };
+    send_to(peer.data, &peer.data_addr, junk, sizeof(junk));
+    pump(&peer);
+
+    rtp_midi_get_stats(peer.rtp, &stats);
+    assert_int_equal(stats.errors, 5);
+    assert_int_equal(stats.commands, 1);
+
+    close_peer(&peer);
+}
+
+static void test_init_errors(void **state) {
+    (void)state;
+    midisynthd_config_t cfg;
+    config_init_defaults(&cfg);
+    event_loop_t *loop = event_loop_create();
+    synth_t *s = synth_init(&cfg, NULL);
+
+    assert_null(rtp_midi_init(&cfg, s, loop));
+    cfg.rtpmidi_port = 65535;
+    assert_null(rtp_midi_init(&cfg, s, loop));
+    cfg.rtpmidi_port = free_port_pair();
+    rtp_midi_t *rtp = rtp_midi_init(&cfg, s, loop);
+    assert_non_null(rtp);
+    assert_null(rtp_midi_init(&cfg, s, loop));
+    rtp_midi_cleanup(rtp);
+    rtp_midi_cleanup(NULL);
+
+    synth_cleanup(s);
+    event_loop_destroy(loop);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_session),
+        cmocka_unit_test(test_commands),
+        cmocka_unit_test(test_journal_recovery),
+        cmocka_unit_test(test_malformed),
+        cmocka_unit_test(test_init_errors),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,161 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <string.h>
+
+#include "config.h"
+#include "synth.h"
+#include "event_loop.h"
+#include "sample_cache.h"
+
+extern int stub_channel_count;
+extern synth_preset_t stub_presets[];
+extern uint64_t stub_program_change_ns;
+
+static event_loop_t *loop;
+static synth_t *synth;
+static midisynthd_config_t cfg;
+
+static int setup(void **state) {
+    (void)state;
+    loop = event_loop_create();
+    synth = synth_init(&cfg, NULL);
+    return loop && synth ? 0 : -1;
+}
+
+static int teardown(void **state) {
+    (void)state;
+    synth_cleanup(synth);
+    event_loop_destroy(loop);
+    return 0;
+}
+
+static void reset_channels(void) {
+    memset(&cfg, 0, sizeof(cfg));
+    memset(stub_presets, 0, sizeof(synth_preset_t) * 64);
+    stub_channel_count = 32;
+    stub_program_change_ns = 0;
+}
+
+static void select_program(int channel, int program) {
+    stub_presets[channel] = (synth_preset_t){ 1, 0, program };
+}
+
+/* Hidden channel holding a program, -1 if none does */
+static int held_on(int program) {
+    for (int ch = 16; ch < stub_channel_count; ch++) {
+        if (stub_presets[ch].sfont_id == 1 && stub_presets[ch].program == program) return ch;
+    }
+    return -1;
+}
+
+static sample_cache_t *create_cache(int size, int floor) {
+    cfg.sample_cache = size;
+    cfg.sample_cache_floor = floor;
+    sample_cache_t *cache = sample_cache_create(&cfg, synth, loop);
+    assert_non_null(cache);
+    return cache;
+}
+
+static void test_requires_hidden_channels(void **state) {
+    (void)state;
+    reset_channels();
+    stub_channel_count = 16;
+    cfg.sample_cache = 4;
+    assert_null(sample_cache_create(&cfg, synth, loop));
+    cfg.sample_cache = 0;
+    stub_channel_count = 32;
+    assert_null(sample_cache_create(&cfg, synth, loop));
+}
+
+static void test_holds_and_evicts_least_recent(void **state) {
+    (void)state;
+    reset_channels();
+    select_program(0, 10);
+    sample_cache_t *cache = create_cache(2, 0);
+    assert_true(held_on(10) >= 16);
+
+    select_program(0, 20);
+    sample_cache_tick(cache);
+    select_program(0, 30);
+    sample_cache_tick(cache);
+
+    sample_cache_stats_t stats;
+    assert_int_equal(sample_cache_get_stats(cache, &stats), 0);
+    assert_int_equal(stats.held, 2);
+    assert_int_equal(stats.evictions, 1);
+    assert_int_equal(held_on(10), -1);
+    assert_true(held_on(20) >= 16);
+    assert_true(held_on(30) >= 16);
+
+    /* Selecting the released preset again is a reload */
+    stub_program_change_ns = 4000000;
+    select_program(1, 10);
+    sample_cache_tick(cache);
+    assert_int_equal(sample_cache_get_stats(cache, &stats), 0);
+    assert_int_equal(stats.reloads, 1);
+    assert_int_equal(stats.reload_ns_max, 4000000);
+    assert_true(held_on(10) >= 16);
+    assert_int_equal(held_on(20), -1);
+
+    sample_cache_cleanup(cache);
+    assert_int_equal(held_on(10), -1);
+    assert_int_equal(held_on(30), -1);
+}
+
+static void test_pressure_keeps_floor_and_selected(void **state) {
+    (void)state;
+    reset_channels();
+    sample_cache_t *cache = create_cache(8, 2);
+    for (int p = 1; p <= 6; p++) {
+        select_program(0, p);
+        sample_cache_tick(cache);
+    }
+
+    assert_int_equal(sample_cache_pressure(cache), 3);
+    assert_int_equal(held_on(1), -1);
+    assert_int_equal(held_on(3), -1);
+    assert_true(held_on(4) >= 16);
+    assert_int_equal(sample_cache_pressure(cache), 1);
+    assert_int_equal(sample_cache_pressure(cache), 0);
+    assert_true(held_on(6) >= 16);
+
+    sample_cache_stats_t stats;
+    assert_int_equal(sample_cache_get_stats(cache, &stats), 0);
+    assert_int_equal(stats.held, 2);
+    assert_int_equal(stats.pressure_events, 3);
+    assert_int_equal(stats.pressure_evictions, 4);
+    assert_int_equal(stats.evictions, 0);
+    sample_cache_cleanup(cache);
+}
+
+static void test_restores_after_reset(void **state) {
+    (void)state;
+    reset_channels();
+    select_program(0, 40);
+    sample_cache_t *cache = create_cache(4, 1);
+    int ch = held_on(40);
+    assert_true(ch >= 16);
+
+    /* A GM reset puts the default preset on every channel */
+    for (int c = 0; c < stub_channel_count; c++) select_program(c, 0);
+    sample_cache_tick(cache);
+    assert_int_equal(stub_presets[ch].program, 40);
+    assert_true(held_on(0) >= 16);
+
+    sample_cache_stats_t stats;
+    assert_int_equal(sample_cache_get_stats(cache, &stats), 0);
+    assert_int_equal(stats.held, 2);
+    sample_cache_cleanup(cache);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_requires_hidden_channels),
+        cmocka_unit_test(test_holds_and_evicts_least_recent),
+        cmocka_unit_test(test_pressure_keeps_floor_and_selected),
+        cmocka_unit_test(test_restores_after_reset),
+    };
+    return cmocka_run_group_tests(tests, setup, teardown);
+}
@@ -0,0 +1,111 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <string.h>
+
+#include "shed.h"
+
+#define PERIOD  256
+#define RATE    48000
+/* 256 frames at 48 kHz */
+#define BUDGET_NS 5333333ULL
+
+/* Learn a machine where a frame costs 1000 ns plus 100 ns per voice */
+static void learn_machine(shed_cost_t *cost) {
+    memset(cost, 0, sizeof(*cost));
+    for (int i = 0; i < 4; i++) {
+        shed_cost_learn(cost, 0, PERIOD, 1000ULL * PERIOD);
+    }
+    for (int i = 0; i < SHED_COST_WARMUP; i++) {
+        int voices = 10 + i;
+        shed_cost_learn(cost, voices, PERIOD, (1000ULL + 100ULL * (uint64_t)voices) * PERIOD);
+    }
+}
+
+static void test_cost_split_into_base_and_voices(void **state) {
+    (void)state;
+    shed_cost_t cost;
+    learn_machine(&cost);
+    assert_in_range(cost.base_ns, 999.0, 1001.0);
+    assert_in_range(cost.voice_ns, 99.0, 101.0);
+    assert_int_equal(cost.voice_samples, SHED_COST_WARMUP);
+
+    /* A period faster than the fixed cost alone teaches nothing per voice */
+    shed_cost_learn(&cost, 5, PERIOD, 500ULL * PERIOD);
+    assert_int_equal(cost.voice_samples, SHED_COST_WARMUP);
+}
+
+static void test_excess_against_budget(void **state) {
+    (void)state;
+    shed_cost_t cost;
+    learn_machine(&cost);
+
+    /* 90% of 20833 ns per frame leaves room for 177 voices */
+    assert_int_equal(shed_cost_excess(&cost, 150, PERIOD, RATE, 90), 0);
+    int excess = shed_cost_excess(&cost, 200, PERIOD, RATE, 90);
+    assert_in_range(excess, 22, 24);
+    assert_int_equal(shed_cost_excess(&cost, 200, PERIOD, RATE, 0), 0);
+
+    /* Effects alone over budget: dropping voices cannot save the period */
+    cost.base_ns = 30000.0;
+    assert_int_equal(shed_cost_excess(&cost, 200, PERIOD, RATE, 90), 0);
+}
+
+static void test_untrusted_estimate_sheds_nothing(void **state) {
+    (void)state;
+    shed_cost_t cost;
+    memset(&cost, 0, sizeof(cost));
+    shed_cost_learn(&cost, 10, PERIOD, BUDGET_NS * 10);
+    assert_int_equal(shed_cost_excess(&cost, 500, PERIOD, RATE, 90), 0);
+}
+
+static void test_pick_pedal_then_softest(void **state) {
+    (void)state;
+    shed_channel_t channels[SHED_CHANNELS];
+    for (int ch = 0; ch < SHED_CHANNELS; ch++) {
+        channels[ch].pedal = false;
+        channels[ch].level = 100 * 127;
+        channels[ch].notes = 1;
+    }
+    channels[3].level = 40 * 127;
+    channels[7].level = 20 * 127;
+    assert_int_equal(shed_pick_channel(channels, 0), 7);
+
+    channels[12].pedal = true;
+    channels[5].pedal = true;
+    channels[5].level = 127 * 127;
+    assert_int_equal(shed_pick_channel(channels, 0), 12);
+    assert_int_equal(shed_pick_channel(channels, 1u << 12), 5);
+    assert_int_equal(shed_pick_channel(channels, 1u << 12 | 1u << 5), 7);
+    assert_int_equal(shed_pick_channel(channels, 0xFFFFu), -1);
+}
+
+static void test_pick_skips_idle_and_busiest(void **state) {
+    (void)state;
+    shed_channel_t channels[SHED_CHANNELS];
+    memset(channels, 0, sizeof(channels));
+    for (int ch = 0; ch < SHED_CHANNELS; ch++) {
+        channels[ch].level = 100 * 127;
+    }
+    assert_int_equal(shed_pick_channel(channels, 0), -1);
+
+    /* A quieter idle channel frees nothing */
+    channels[4].level = 10 * 127;
+    channels[0].notes = 40;
+    channels[2].notes = 3;
+    assert_int_equal(shed_pick_channel(channels, 0), 2);
+    assert_int_equal(shed_pick_channel(channels, 1u << 2), 0);
+    assert_int_equal(shed_pick_channel(channels, 1u << 2 | 1u << 0), -1);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_cost_split_into_base_and_voices),
+        cmocka_unit_test(test_excess_against_budget),
+        cmocka_unit_test(test_untrusted_estimate_sheds_nothing),
+        cmocka_unit_test(test_pick_pedal_then_softest),
+        cmocka_unit_test(test_pick_skips_idle_and_busiest),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
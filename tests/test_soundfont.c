@@ -0,0 +1,167 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "test_soundfont.h"
+
+/* One looped sine: 100 cycles of 440 Hz at 44 kHz */
+#define SF_SAMPLE_RATE       44000
+#define SF_SAMPLE_FRAMES     10000
+#define SF_SAMPLE_PAD        46
+
+static void put16(FILE *f, uint16_t v) {
+    fputc(v & 0xFF, f);
+    fputc(v >> 8, f);
+}
+
+static void put32(FILE *f, uint32_t v) {
+    put16(f, (uint16_t)(v & 0xFFFF));
+    put16(f, (uint16_t)(v >> 16));
+}
+
+static void put_chunk_header(FILE *f, const char *id, uint32_t size) {
+    fwrite(id, 1, 4, f);
+    put32(f, size);
+}
+
+static void put_name(FILE *f, const char *name) {
+    char buf[20] = { 0 };
+    strncpy(buf, name, sizeof(buf) - 1);
+    fwrite(buf, 1, sizeof(buf), f);
+}
+
+static void put_phdr(FILE *f, const char *name, uint16_t preset, uint16_t bank, uint16_t bag) {
+    put_name(f, name);
+    put16(f, preset);
+    put16(f, bank);
+    put16(f, bag);
+    put32(f, 0);
+    put32(f, 0);
+    put32(f, 0);
+}
+
+/**
+ * Write a minimal SoundFont 2 file: one sine instrument shared by a
+ * melodic preset (bank 0) and a percussion preset (bank 128), with a
+ * 24-bit extension (version 2.04) when @p sm24 is set and a loop when
+ * @p loop is set
+ */
+static int write_soundfont(const char *path, bool sm24, bool loop) {
+    FILE *f = fopen(path, "wb");
+    if (!f) return -1;
+
+    const uint32_t smpl_size = (SF_SAMPLE_FRAMES + SF_SAMPLE_PAD) * 2;
+    const uint32_t sm24_size = sm24 ? SF_SAMPLE_FRAMES + SF_SAMPLE_PAD : 0;
+    const uint32_t info_size = 4 + (8 + 4) + (8 + 8) + (8 + 8);
+    const uint32_t sdta_size = 4 + 8 + smpl_size + (sm24 ? 8 + sm24_size : 0);
+    const uint32_t pdta_size = 4 +
+        (8 + 3 * 38) +      /* phdr: 2 presets + EOP */
+        (8 + 3 * 4) +       /* pbag */
+        (8 + 10) +          /* pmod */
+        (8 + 3 * 4) +       /* pgen */
+        (8 + 2 * 22) +      /* inst */
+        (8 + 2 * 4) +       /* ibag */
+        (8 + 10) +          /* imod */
+        (8 + 4 * 4) +       /* igen */
+        (8 + 2 * 46);       /* shdr */
+
+    put_chunk_header(f, "RIFF", 4 + (8 + info_size) + (8 + sdta_size) + (8 + pdta_size));
+    fwrite("sfbk", 1, 4, f);
+
+    put_chunk_header(f, "LIST", info_size);
+    fwrite("INFO", 1, 4, f);
+    put_chunk_header(f, "ifil", 4);
+    put16(f, 2);
+    put16(f, sm24 ? 4 : 1);
+    put_chunk_header(f, "isng", 8);
+    fwrite("EMU8000\0", 1, 8, f);
+    put_chunk_header(f, "INAM", 8);
+    fwrite("golden\0\0", 1, 8, f);
+
+    put_chunk_header(f, "LIST", sdta_size);
+    fwrite("sdta", 1, 4, f);
+    put_chunk_header(f, "smpl", smpl_size);
+    for (int i = 0; i < SF_SAMPLE_FRAMES + SF_SAMPLE_PAD; i++) {
+        int16_t s = 0;
+        if (i < SF_SAMPLE_FRAMES) {
+            s = (int16_t)lrint(16000.0 * sin(2.0 * M_PI * 440.0 * i / SF_SAMPLE_RATE));
+        }
+        put16(f, (uint16_t)s);
+    }
+    if (sm24) {
+        /* Low bytes of the 24-bit samples */
+        put_chunk_header(f, "sm24", sm24_size);
+        for (uint32_t i = 0; i < sm24_size; i++) fputc(0x80, f);
+    }
+
+    put_chunk_header(f, "LIST", pdta_size);
+    fwrite("pdta", 1, 4, f);
+
+    put_chunk_header(f, "phdr", 3 * 38);
+    put_phdr(f, "Sine", 0, 0, 0);
+    put_phdr(f, "Sine Kit", 0, 128, 1);
+    put_phdr(f, "EOP", 0, 0, 2);
+
+    put_chunk_header(f, "pbag", 3 * 4);
+    put16(f, 0); put16(f, 0);
+    put16(f, 1); put16(f, 0);
+    put16(f, 2); put16(f, 0);
+
+    put_chunk_header(f, "pmod", 10);
+    for (int i = 0; i < 10; i++) fputc(0, f);
+
+    put_chunk_header(f, "pgen", 3 * 4);
+    put16(f, 41); put16(f, 0);      /* instrument 0 */
+    put16(f, 41); put16(f, 0);
+    put16(f, 0); put16(f, 0);
+
+    put_chunk_header(f, "inst", 2 * 22);
+    put_name(f, "Sine");
+    put16(f, 0);
+    put_name(f, "EOI");
+    put16(f, 1);
+
+    put_chunk_header(f, "ibag", 2 * 4);
+    put16(f, 0); put16(f, 0);
+    put16(f, 3); put16(f, 0);
+
+    put_chunk_header(f, "imod", 10);
+    for (int i = 0; i < 10; i++) fputc(0, f);
+
+    put_chunk_header(f, "igen", 4 * 4);
+    put16(f, 38); put16(f, (uint16_t)-2786);   /* releaseVolEnv: 0.2 s */
+    put16(f, 54); put16(f, loop ? 1 : 0);       /* sampleModes: loop or one-shot */
+    put16(f, 53); put16(f, 0);                  /* sampleID 0 */
+    put16(f, 0); put16(f, 0);
+
+    put_chunk_header(f, "shdr", 2 * 46);
+    put_name(f, "sine440");
+    put32(f, 0);
+    put32(f, SF_SAMPLE_FRAMES);
+    put32(f, 0);
+    put32(f, SF_SAMPLE_FRAMES);
+    put32(f, SF_SAMPLE_RATE);
+    fputc(69, f);
+    fputc(0, f);
+    put16(f, 0);
+    put16(f, 1);                                /* mono */
+    put_name(f, "EOS");
+    for (int i = 0; i < 26; i++) fputc(0, f);
+
+    int ok = ferror(f) == 0;
+    return (fclose(f) == 0 && ok) ? 0 : -1;
+}
+
+int test_soundfont_write(const char *path) {
+    return write_soundfont(path, false, true);
+}
+
+int test_soundfont_write_sm24(const char *path) {
+    return write_soundfont(path, true, true);
+}
+
+int test_soundfont_write_oneshot(const char *path) {
+    return write_soundfont(path, false, false);
+}
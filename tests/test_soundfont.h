@@ -0,0 +1,36 @@
+#ifndef MIDISYNTHD_TEST_SOUNDFONT_H
+#define MIDISYNTHD_TEST_SOUNDFONT_H
+
+/**
+ * Write a minimal SoundFont 2 file for tests
+ *
+ * The font holds one looped 440 Hz sine instrument with a 0.2 s release,
+ * shared by a melodic preset (bank 0, program 0) and a percussion preset
+ * (bank 128, program 0), so it renders on every channel without any
+ * installed soundfont.
+ *
+ * @param path Output path
+ * @return 0 on success, -1 on error
+ */
+int test_soundfont_write(const char *path);
+
+/**
+ * Write the same SoundFont as version 2.04 with an sm24 chunk
+ *
+ * @param path Output path
+ * @return 0 on success, -1 on error
+ */
+int test_soundfont_write_sm24(const char *path);
+
+/**
+ * Write the same SoundFont with an unlooped sample
+ *
+ * Notes end on their own after 0.23 s at the root key, so percussion
+ * renders of it can be cached.
+ *
+ * @param path Output path
+ * @return 0 on success, -1 on error
+ */
+int test_soundfont_write_oneshot(const char *path);
+
+#endif /* MIDISYNTHD_TEST_SOUNDFONT_H */
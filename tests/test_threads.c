@@ -0,0 +1,105 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "threads.h"
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+static int phase;
+static pid_t worker_tid;
+
+static void wait_phase(int p) {
+    pthread_mutex_lock(&lock);
+    while (phase < p) pthread_cond_wait(&cond, &lock);
+    pthread_mutex_unlock(&lock);
+}
+
+static void set_phase(int p) {
+    pthread_mutex_lock(&lock);
+    phase = p;
+    pthread_cond_broadcast(&cond);
+    pthread_mutex_unlock(&lock);
+}
+
+static void *worker(void *arg) {
+    (void)arg;
+    threads_register("msd-test", true);
+    threads_register("ignored", true);
+    worker_tid = (pid_t)syscall(SYS_gettid);
+
+    /* Burn some CPU so there is time to account */
+    volatile unsigned x = 0;
+    for (unsigned i = 0; i < 20000000; i++) x += i;
+
+    set_phase(1);
+    wait_phase(2);
+    threads_unregister();
+    return NULL;
+}
+
+static int find_role(const char *role, thread_info_t *info) {
+    for (int i = 0; i < THREADS_MAX; i++) {
+        if (threads_get(i, info) == 0 && strcmp(info->role, role) == 0) return i;
+    }
+    return -1;
+}
+
+static void read_comm(pid_t tid, char *buf, size_t size) {
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/self/task/%d/comm", (int)tid);
+    FILE *f = fopen(path, "r");
+    assert_non_null(f);
+    assert_non_null(fgets(buf, (int)size, f));
+    fclose(f);
+    buf[strcspn(buf, "\n")] = '\0';
+}
+
+static void test_threads_registry(void **state) {
+    (void)state;
+    char comm_before[32], comm[32];
+    pid_t main_tid = (pid_t)syscall(SYS_gettid);
+    read_comm(main_tid, comm_before, sizeof(comm_before));
+
+    assert_int_equal(threads_register("main", false), 0);
+    pthread_t t;
+    assert_int_equal(pthread_create(&t, NULL, worker, NULL), 0);
+    wait_phase(1);
+
+    thread_info_t info;
+    assert_true(find_role("main", &info) >= 0);
+    assert_int_equal(info.tid, main_tid);
+    read_comm(main_tid, comm, sizeof(comm));
+    assert_string_equal(comm, comm_before);
+
+    /* Second registration on the same thread is a no-op */
+    assert_true(find_role("msd-test", &info) >= 0);
+    assert_int_equal(find_role("ignored", &info), -1);
+    assert_true(find_role("msd-test", &info) >= 0);
+    assert_int_equal(info.tid, worker_tid);
+    assert_true(info.alive);
+    assert_int_equal(info.policy, SCHED_OTHER);
+    assert_string_equal(threads_policy_name(info.policy), "SCHED_OTHER");
+    assert_true(info.affinity[0] != '\0');
+    assert_true(info.cpu_ns > 0);
+    read_comm(worker_tid, comm, sizeof(comm));
+    assert_string_equal(comm, "msd-test");
+
+    set_phase(2);
+    pthread_join(t, NULL);
+    assert_int_equal(find_role("msd-test", &info), -1);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_threads_registry),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,152 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "trace.h"
+
+#define OUT_PATH "/tmp/midisynthd_test_trace.json"
+
+static char *read_file(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) return NULL;
+    static char buf[1 << 23];
+    size_t n = fread(buf, 1, sizeof(buf) - 1, f);
+    buf[n] = '\0';
+    fclose(f);
+    return buf;
+}
+
+static int count(const char *text, const char *needle) {
+    int n = 0;
+    for (const char *p = strstr(text, needle); p; p = strstr(p + 1, needle)) n++;
+    return n;
+}
+
+static void test_disabled_records_nothing(void **state) {
+    (void)state;
+    assert_false(trace_enabled());
+    uint64_t start = trace_begin();
+    assert_int_equal(start, 0);
+    trace_end(start, "idle", -1);
+    assert_int_equal(trace_write(OUT_PATH), -1);
+
+    trace_stats_t stats;
+    trace_get_stats(&stats);
+    assert_int_equal(stats.spans, 0);
+    trace_stop();
+}
+
+static void test_spans_are_written(void **state) {
+    (void)state;
+    assert_int_equal(trace_start(), 0);
+    assert_true(trace_enabled());
+
+    uint64_t outer = trace_begin();
+    assert_true(outer != 0);
+    uint64_t inner = trace_begin();
+    trace_end(inner, "render", 64);
+    trace_end(outer, "period", -1);
+
+    assert_int_equal(trace_write(OUT_PATH), 2);
+    char *json = read_file(OUT_PATH);
+    assert_non_null(json);
+    assert_non_null(strstr(json, "\"traceEvents\""));
+    assert_non_null(strstr(json, "\"name\":\"render\""));
+    assert_non_null(strstr(json, "\"name\":\"period\""));
+    assert_non_null(strstr(json, "\"n\":64"));
+    assert_non_null(strstr(json, "\"thread_name\""));
+
+    trace_stop();
+    assert_false(trace_enabled());
+    unlink(OUT_PATH);
+}
+
+static void test_ring_keeps_latest(void **state) {
+    (void)state;
+    assert_int_equal(trace_start(), 0);
+    for (int i = 0; i < TRACE_EVENTS + 10; i++) {
+        trace_end(trace_begin(), i < 10 ? "old" : "new", i);
+    }
+
+    trace_stats_t stats;
+    trace_get_stats(&stats);
+    assert_int_equal(stats.spans, TRACE_EVENTS + 10);
+    assert_int_equal(stats.overwritten, 10);
+    assert_int_equal(stats.threads, 1);
+
+    /* The oldest kept span is skipped as the slot written next */
+    assert_int_equal(trace_write(OUT_PATH), TRACE_EVENTS - 1);
+    char *json = read_file(OUT_PATH);
+    assert_non_null(json);
+    assert_null(strstr(json, "\"name\":\"old\""));
+    assert_int_equal(count(json, "\"name\":\"new\""), TRACE_EVENTS - 1);
+
+    trace_stop();
+    unlink(OUT_PATH);
+}
+
+static void *record_spans(void *arg) {
+    (void)arg;
+    for (int i = 0; i < 100; i++) {
+        trace_end(trace_begin(), "worker", i);
+    }
+    return NULL;
+}
+
+static void test_threads_get_own_buffers(void **state) {
+    (void)state;
+    assert_int_equal(trace_start(), 0);
+    pthread_t threads[4];
+    for (int i = 0; i < 4; i++) {
+        assert_int_equal(pthread_create(&threads[i], NULL, record_spans, NULL), 0);
+    }
+    for (int i = 0; i < 4; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    trace_stats_t stats;
+    trace_get_stats(&stats);
+    assert_int_equal(stats.threads, 4);
+    assert_int_equal(stats.spans, 400);
+    assert_int_equal(stats.overwritten, 0);
+    assert_int_equal(trace_write(OUT_PATH), 400);
+
+    trace_stop();
+    unlink(OUT_PATH);
+}
+
+static void test_restart_starts_empty(void **state) {
+    (void)state;
+    assert_int_equal(trace_start(), 0);
+    trace_end(trace_begin(), "first", -1);
+    trace_stop();
+
+    /* The thread's buffer from the previous run must not be reused */
+    assert_int_equal(trace_start(), 0);
+    trace_end(trace_begin(), "second", -1);
+    assert_int_equal(trace_write(OUT_PATH), 1);
+    char *json = read_file(OUT_PATH);
+    assert_non_null(json);
+    assert_null(strstr(json, "\"name\":\"first\""));
+    assert_non_null(strstr(json, "\"name\":\"second\""));
+
+    trace_stop();
+    unlink(OUT_PATH);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_disabled_records_nothing),
+        cmocka_unit_test(test_spans_are_written),
+        cmocka_unit_test(test_ring_keeps_latest),
+        cmocka_unit_test(test_threads_get_own_buffers),
+        cmocka_unit_test(test_restart_starts_empty),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
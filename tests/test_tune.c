@@ -0,0 +1,59 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <string.h>
+
+#include "tune.h"
+
+static void set_result(tune_result_t *r, int buffer_size, int periods, bool stable) {
+    memset(r, 0, sizeof(*r));
+    r->buffer_size = buffer_size;
+    r->audio_periods = periods;
+    r->latency_ms = 1000.0 * buffer_size * periods / 48000.0;
+    r->stable = stable;
+}
+
+static void test_select_lowest_stable_with_margin(void **state) {
+    (void)state;
+    tune_result_t results[4];
+    set_result(&results[0], 512, 4, true);
+    set_result(&results[1], 256, 4, true);
+    set_result(&results[2], 256, 3, true);
+    set_result(&results[3], 256, 2, false);
+
+    int buffer_size = 0, periods = 0;
+    assert_int_equal(tune_select(results, 4, &buffer_size, &periods), 2);
+    assert_int_equal(buffer_size, 256);
+    assert_int_equal(periods, 4);
+}
+
+static void test_select_margin_at_period_cap(void **state) {
+    (void)state;
+    tune_result_t results[1];
+    set_result(&results[0], 128, 8, true);
+
+    int buffer_size = 0, periods = 0;
+    assert_int_equal(tune_select(results, 1, &buffer_size, &periods), 0);
+    assert_int_equal(buffer_size, 256);
+    assert_int_equal(periods, 8);
+}
+
+static void test_select_none_stable(void **state) {
+    (void)state;
+    tune_result_t results[2];
+    set_result(&results[0], 1024, 4, false);
+    set_result(&results[1], 1024, 3, false);
+
+    int buffer_size = 0, periods = 0;
+    assert_int_equal(tune_select(results, 2, &buffer_size, &periods), -1);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_select_lowest_stable_with_margin),
+        cmocka_unit_test(test_select_margin_at_period_cap),
+        cmocka_unit_test(test_select_none_stable),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}